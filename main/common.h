@@ -16,6 +16,7 @@
 #define _DEVICE_ENABLE_MQTT         (true && _DEVICE_ENABLE_WIFI)
 #define _DEVICE_ENABLE_HA           (true && _DEVICE_ENABLE_MQTT)
 #define _DEVICE_ENABLE_NET_LOGGING  (true && _DEVICE_ENABLE_WIFI)
+#define _DEVICE_ENABLE_SNTP         (true && _DEVICE_ENABLE_WIFI)
 
 #define _DEVICE_ENABLE_MQTT_REFRESH         (true && _DEVICE_ENABLE_MQTT)
 
@@ -29,6 +30,7 @@
 #define _DEVICE_ENABLE_STATUS_SYSINFO_HEAP_TRACE    ((false && _DEVICE_ENABLE_STATUS) || _DEVICE_ENGINEERING_BUILD)
 #define _DEVICE_ENABLE_STATUS_SYSINFO_GPIO          ((false && _DEVICE_ENABLE_STATUS) || _DEVICE_ENGINEERING_BUILD)
 #define _DEVICE_ENABLE_STATUS_MEMGUARD              ((true && _DEVICE_ENABLE_STATUS) || _DEVICE_ENGINEERING_BUILD)
+#define _DEVICE_ENABLE_STATUS_LATENCY               ((true && _DEVICE_ENABLE_STATUS) || _DEVICE_ENGINEERING_BUILD)
 
 
 static const char *TAG = "RelayBoard";
@@ -0,0 +1,59 @@
+#include "debounce.h"
+
+/**
+ * @brief: Initialize pin debounce state
+ *
+ * @param pin Pointer to the pin debounce state
+ * @param level Current (stable) level of the pin
+ * @param window_us Debounce window in microseconds
+ */
+void debounce_pin_init(debounce_pin_t *pin, int level, uint32_t window_us) {
+    pin->first_edge_us = 0;
+    pin->last_edge_us = 0;
+    pin->edge_level = (uint8_t)(level ? 1 : 0);
+    pin->pending = false;
+    pin->stable_level = pin->edge_level;
+    pin->window_us = window_us;
+}
+
+/**
+ * @brief: Poll the pin and settle it if the debounce window after the last edge has expired
+ *
+ * @param pin Pointer to the pin debounce state
+ * @param level Level currently on the pin
+ * @param now_us Current time in microseconds
+ * @return debounce_result_t poll result. On DEBOUNCE_CHANGED stable_level holds the new level.
+ */
+debounce_result_t debounce_pin_poll(debounce_pin_t *pin, int level, int64_t now_us) {
+    if (!pin->pending) {
+        return DEBOUNCE_IDLE;
+    }
+
+    if (now_us < pin->last_edge_us + (int64_t)pin->window_us) {
+        return DEBOUNCE_PENDING;
+    }
+
+    // Window expired with no new edges: the level on the pin is the settled one
+    pin->pending = false;
+
+    uint8_t settled = (uint8_t)(level ? 1 : 0);
+    if (settled == pin->stable_level) {
+        return DEBOUNCE_BOUNCED;
+    }
+
+    pin->stable_level = settled;
+    return DEBOUNCE_CHANGED;
+}
+
+/**
+ * @brief: Get the time when the pin has to be polled next
+ *
+ * @param pin Pointer to the pin debounce state
+ * @return deadline in microseconds or DEBOUNCE_NO_DEADLINE if the pin is idle
+ */
+int64_t debounce_pin_deadline(const debounce_pin_t *pin) {
+    if (!pin->pending) {
+        return DEBOUNCE_NO_DEADLINE;
+    }
+    return pin->last_edge_us + (int64_t)pin->window_us;
+}
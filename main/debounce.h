@@ -0,0 +1,80 @@
+/**
+ * @file debounce.h
+ * @brief Per-pin non-blocking debounce state machine
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * The core is plain C with no ESP-IDF dependencies: time is passed in by the caller, so
+ * every pin settles independently and the worst-case settle latency is one debounce
+ * window after the last edge regardless of how many pins are bouncing at the same time.
+ */
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** TYPES **/
+
+/**
+ * @brief: Debounce state of a single input pin
+ */
+typedef struct {
+    volatile int64_t first_edge_us; // Timestamp of the first edge of the current edge train
+    volatile int64_t last_edge_us;  // Timestamp of the most recent edge
+    volatile uint8_t edge_level;    // Level captured at the most recent edge
+    volatile bool pending;          // Edge seen, waiting for the window to expire
+    uint8_t stable_level;           // Last accepted (debounced) level
+    uint32_t window_us;             // Debounce window
+} debounce_pin_t;
+
+/**
+ * @brief: Result of polling a pin
+ */
+typedef enum {
+    DEBOUNCE_IDLE,                  // No edges to process
+    DEBOUNCE_PENDING,               // Window not expired yet
+    DEBOUNCE_BOUNCED,               // Settled at the previous stable level: edge train was a bounce
+    DEBOUNCE_CHANGED                // Settled at a new level
+} debounce_result_t;
+
+#define DEBOUNCE_NO_DEADLINE    INT64_MAX
+
+/** ROUTINES **/
+void debounce_pin_init(debounce_pin_t *pin, int level, uint32_t window_us);
+debounce_result_t debounce_pin_poll(debounce_pin_t *pin, int level, int64_t now_us);
+int64_t debounce_pin_deadline(const debounce_pin_t *pin);
+
+/**
+ * @brief: Record an edge on the pin. Safe to call from ISR.
+ *
+ * Defined inline so it ends up in IRAM together with the ISR that calls it.
+ *
+ * @param pin Pointer to the pin debounce state
+ * @param level Level read at the edge
+ * @param now_us Current time in microseconds
+ * @return true if the pin was idle before this edge, i.e. the caller has to schedule a poll
+ */
+static inline bool debounce_pin_edge(debounce_pin_t *pin, int level, int64_t now_us) {
+    bool was_idle = !pin->pending;
+    if (was_idle) {
+        pin->first_edge_us = now_us;
+    }
+    pin->last_edge_us = now_us;
+    pin->edge_level = (uint8_t)(level ? 1 : 0);
+    pin->pending = true;
+    return was_idle;
+}
+
+/**
+ * @brief: Forget the current edge train of the pin. Safe to call from ISR.
+ *
+ * Used when the poll of the pin could not be scheduled: the pin goes back to idle at its stable level,
+ * so the next edge is reported as the first one again.
+ *
+ * @param pin Pointer to the pin debounce state
+ */
+static inline void debounce_pin_drop(debounce_pin_t *pin) {
+    pin->pending = false;
+}
+
+#endif // DEBOUNCE_H
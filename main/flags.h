@@ -21,6 +21,7 @@ extern EventGroupHandle_t g_sys_events;
 #define BIT_OTA_IN_PROGRESS         (1 << 6)
 #define BIT_DEVICE_READY            (1 << 7)
 #define BIT_UNITS_IN_MEMORY         (1 << 8)
+#define BIT_TIME_SYNCED             (1 << 9)
 
 
 /* Function Prototypes */
@@ -385,6 +385,10 @@ esp_err_t ha_entity_discovery_init(ha_entity_discovery_t *discovery) {
 
     // Initialize discovery fields
     discovery->enabled_by_default = true;
+    discovery->command_topic = NULL;
+    discovery->state_class = NULL;
+    discovery->unit_of_measurement = NULL;
+    discovery->entity_category = NULL;
 
     return ESP_OK;
 }
@@ -422,16 +426,25 @@ esp_err_t ha_entity_discovery_fullfill(ha_entity_discovery_t *discovery, const c
         return err;
     }
 
+    // Pulse counters expose several metrics of one unit (count, rate), actuators expose their wear counters next to
+    // the state: each metric is a separate entity
+    char entity_key[64];
+    if (relay_type == RELAY_TYPE_PULSE_COUNTER || strcmp(metric, HA_DEVICE_METRIC_STATE) != 0) {
+        snprintf(entity_key, sizeof(entity_key), "%s_%s", relay_key, metric);
+    } else {
+        snprintf(entity_key, sizeof(entity_key), "%s", relay_key);
+    }
+
     // Allocate memory for object_id and format it
     if (device_id != NULL || relay_key != NULL) {  // Double-check for NULL before strlen
-        discovery->object_id = (char *)malloc(strlen(device_id) + strlen(relay_key) + 2);  // +2 for '_' and null terminator
+        discovery->object_id = (char *)malloc(strlen(device_id) + strlen(entity_key) + 2);  // +2 for '_' and null terminator
         if (discovery->object_id == NULL) {
             ESP_LOGE(TAG, "Failed to allocate memory for object_id");
             free(device_id);
             free(device_serial);
             return ESP_ERR_NO_MEM;
         }
-        sprintf(discovery->object_id, "%s_%s", device_id, relay_key);
+        sprintf(discovery->object_id, "%s_%s", device_id, entity_key);
     } else {
         ESP_LOGE(TAG, "Invalid device_id or metric");
         free(device_id);
@@ -462,6 +475,7 @@ esp_err_t ha_entity_discovery_fullfill(ha_entity_discovery_t *discovery, const c
     }
     snprintf(discovery->json_attributes_topic, topic_len, "%s/%s/%s/%s", mqtt_prefix, device_id, relay_key, (relay_type == RELAY_TYPE_ACTUATOR)?HA_DEVICE_STATE_PATH_RELAY:HA_DEVICE_STATE_PATH_SENSOR);
 
+    // entities read the unit's JSON topic, which is published with every MQTT publish profile
     discovery->state_topic = (char *)malloc(topic_len);
     if (discovery->state_topic == NULL) {
         ESP_LOGE(TAG, "Failed to allocate memory for state topic");
@@ -474,7 +488,7 @@ esp_err_t ha_entity_discovery_fullfill(ha_entity_discovery_t *discovery, const c
     snprintf(discovery->state_topic, topic_len, "%s/%s/%s/%s", mqtt_prefix, device_id, relay_key, (relay_type == RELAY_TYPE_ACTUATOR)?HA_DEVICE_STATE_PATH_RELAY:HA_DEVICE_STATE_PATH_SENSOR);
 
     // Allocate memory for unique_id and format it
-    discovery->unique_id = (char *)malloc(strlen(device_id) + strlen(device_serial) + strlen(relay_key) + 3);  // +3 for two '_' and null terminator
+    discovery->unique_id = (char *)malloc(strlen(device_id) + strlen(device_serial) + strlen(entity_key) + 3);  // +3 for two '_' and null terminator
     if (discovery->unique_id == NULL) {
         ESP_LOGE(TAG, "Failed to allocate memory for unique_id");
         free(discovery->json_attributes_topic);
@@ -484,7 +498,7 @@ esp_err_t ha_entity_discovery_fullfill(ha_entity_discovery_t *discovery, const c
         free(device_serial);
         return ESP_ERR_NO_MEM;
     }
-    sprintf(discovery->unique_id, "%s_%s_%s", device_id, device_serial, relay_key);
+    sprintf(discovery->unique_id, "%s_%s_%s", device_id, device_serial, entity_key);
 
     // Set device class
     discovery->device_class = device_class;
@@ -514,28 +528,34 @@ esp_err_t ha_entity_discovery_fullfill(ha_entity_discovery_t *discovery, const c
         // r/w device
         discovery->optimistic = false;
         name_suffix = "Relay ";
+    } else if (relay_type == RELAY_TYPE_PULSE_COUNTER) {
+        // r/o device, no commands
+        discovery->optimistic = false;
+        name_suffix = "Pulse counter ";
     } else {
         // r/o device
         discovery->optimistic = false;
         name_suffix = "Contact sensor ";
     }
 
-    // set command enabled
-    topic_len = strlen(discovery->state_topic) + strlen("/set") + 1;  // for slashes and null terminator
-    discovery->command_topic = (char *)malloc(topic_len);
-    if (discovery->json_attributes_topic == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for command topic");
-            free(discovery->json_attributes_topic);
-            free(discovery->state_topic);
-            free(discovery->unique_id);
-            free(discovery->object_id);
-            free(discovery->value_template);
-            free(mqtt_prefix);
-            free(device_id);
-            free(device_serial);
-        return ESP_ERR_NO_MEM;
+    // set command enabled, pulse counters and diagnostic metrics have nothing to command
+    if (relay_type != RELAY_TYPE_PULSE_COUNTER && strcmp(metric, HA_DEVICE_METRIC_STATE) == 0) {
+        topic_len = strlen(discovery->state_topic) + strlen("/set") + 1;  // for slashes and null terminator
+        discovery->command_topic = (char *)malloc(topic_len);
+        if (discovery->command_topic == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for command topic");
+                free(discovery->json_attributes_topic);
+                free(discovery->state_topic);
+                free(discovery->unique_id);
+                free(discovery->object_id);
+                free(discovery->value_template);
+                free(mqtt_prefix);
+                free(device_id);
+                free(device_serial);
+            return ESP_ERR_NO_MEM;
+        }
+        snprintf(discovery->command_topic, topic_len, "%s/set", discovery->state_topic);
     }
-    snprintf(discovery->command_topic, topic_len, "%s/set", discovery->state_topic);
 
     // payload data
     discovery->payload_on = HA_DEVICE_PAYLOAD_ON;
@@ -544,7 +564,7 @@ esp_err_t ha_entity_discovery_fullfill(ha_entity_discovery_t *discovery, const c
     // <relay_key> switch on <device_id>
     // <relay_key> contact sensor on <device_id>
     // set command enabled
-    topic_len = strlen(relay_key) + strlen(name_suffix) + 1;  // for slashes and null terminator
+    topic_len = strlen(entity_key) + strlen(name_suffix) + 1;  // for slashes and null terminator
     discovery->name = (char *)malloc(topic_len);
     if (discovery->name == NULL) {
         ESP_LOGE(TAG, "Failed to allocate memory for name topic");
@@ -559,7 +579,7 @@ esp_err_t ha_entity_discovery_fullfill(ha_entity_discovery_t *discovery, const c
             free(device_serial);
         return ESP_ERR_NO_MEM;
     }
-    snprintf(discovery->name, topic_len, "%s%s", name_suffix, relay_key);
+    snprintf(discovery->name, topic_len, "%s%s", name_suffix, entity_key);
 
     // Clean up temporary variables
     free(device_id);
@@ -613,7 +633,9 @@ cJSON *ha_entity_discovery_to_JSON(ha_entity_discovery_t *discovery) {
     cJSON_AddItemToArray(availability_array, ha_availability_to_JSON(&discovery->availability[0]));
     cJSON_AddItemToObject(root, "availability", availability_array);
 
-    cJSON_AddStringToObject(root, "device_class", discovery->device_class);
+    if (discovery->device_class != NULL && discovery->device_class[0] != '\0') {
+        cJSON_AddStringToObject(root, "device_class", discovery->device_class);
+    }
     cJSON_AddBoolToObject(root, "enabled_by_default", discovery->enabled_by_default);
     cJSON_AddStringToObject(root, "json_attributes_topic", discovery->json_attributes_topic);
     cJSON_AddStringToObject(root, "object_id", discovery->object_id);
@@ -623,10 +645,19 @@ cJSON *ha_entity_discovery_to_JSON(ha_entity_discovery_t *discovery) {
 
     if (discovery->command_topic != NULL) {
         cJSON_AddStringToObject(root, "command_topic", discovery->command_topic);
+        cJSON_AddBoolToObject(root, "payload_on", discovery->payload_on);
+        cJSON_AddBoolToObject(root, "payload_off", discovery->payload_off);
+        cJSON_AddBoolToObject(root, "optimistic", discovery->optimistic);
+    }
+    if (discovery->state_class != NULL) {
+        cJSON_AddStringToObject(root, "state_class", discovery->state_class);
+    }
+    if (discovery->unit_of_measurement != NULL) {
+        cJSON_AddStringToObject(root, "unit_of_measurement", discovery->unit_of_measurement);
+    }
+    if (discovery->entity_category != NULL) {
+        cJSON_AddStringToObject(root, "entity_category", discovery->entity_category);
     }
-    cJSON_AddBoolToObject(root, "payload_on", discovery->payload_on);
-    cJSON_AddBoolToObject(root, "payload_off", discovery->payload_off);
-    cJSON_AddBoolToObject(root, "optimistic", discovery->optimistic);
     cJSON_AddStringToObject(root, "name", discovery->name);
 
     return root;
@@ -27,6 +27,24 @@
 #define HA_DEVICE_FAMILY              "switch"
 #define HA_DEVICE_METRIC_STATE        "state"
 
+// Pulse counters are exposed as two read-only sensors
+#define HA_DEVICE_FAMILY_SENSOR         "sensor"
+#define HA_DEVICE_METRIC_COUNT          "count"
+#define HA_DEVICE_METRIC_RATE           "rate"
+#define HA_STATE_CLASS_TOTAL_INCREASING "total_increasing"
+#define HA_STATE_CLASS_MEASUREMENT      "measurement"
+#define HA_UNIT_PULSE_RATE              "1/s"
+
+// Actuators get three diagnostic sensors with their wear counters
+#define HA_DEVICE_METRIC_CYCLES         "cycles"
+#define HA_DEVICE_METRIC_ON_TIME        "on_time"
+#define HA_DEVICE_METRIC_LAST_CHANGE    "last_change"
+#define HA_DEVICE_CLASS_DURATION        "duration"
+#define HA_DEVICE_CLASS_TIMESTAMP       "timestamp"
+#define HA_UNIT_SECONDS                 "s"
+#define HA_ENTITY_CATEGORY_DIAGNOSTIC   "diagnostic"
+#define HA_LAST_CHANGE_VAL_TPL          "{{ as_datetime(value_json.last_change) if value_json.last_change else None }}"
+
 #define HA_DEVICE_PAYLOAD_ON          true
 #define HA_DEVICE_PAYLOAD_OFF         false
 
@@ -70,6 +88,9 @@ typedef struct {
     bool payload_off;
     bool payload_on;
     char *command_topic;
+    const char *state_class;            // optional, NULL if not applicable
+    const char *unit_of_measurement;    // optional, NULL if not applicable
+    const char *entity_category;        // optional, NULL for a primary entity
 } ha_entity_discovery_t;
 
 
@@ -0,0 +1,99 @@
+#include "interlock.h"
+
+/**
+ * @brief: Initialize the interlock group: never released, nothing parked
+ *
+ * @param group Pointer to the interlock group
+ */
+void interlock_group_init(interlock_group_t *group) {
+    group->released_us = 0;
+    group->pending.channel = -1;
+}
+
+/**
+ * @brief: Account a member switched OFF: the dead time of the group runs from the time its contacts open
+ *
+ * Members switched at a zero crossing open later than they are switched, and when several members are switched
+ * OFF together the last one to open counts.
+ *
+ * @param group Pointer to the interlock group
+ * @param open_us Time the contacts of the member open, may be in the future
+ */
+void interlock_released(interlock_group_t *group, int64_t open_us) {
+    if (open_us > group->released_us) {
+        group->released_us = open_us;
+    }
+}
+
+/**
+ * @brief: Check if the members conflicting with an ON request may be switched OFF to make way for it
+ *
+ * @param conflicts Bits of the other members that are ON or going to be
+ * @param preempt Conflicting members may be switched OFF. False while outputs are restored on boot.
+ * @return true if there is nothing in the way, or it may be switched OFF
+ */
+bool interlock_may_release(uint32_t conflicts, bool preempt) {
+    return conflicts == 0 || preempt;
+}
+
+/**
+ * @brief: Decide on an ON request of a member once no other member is ON anymore
+ *
+ * @param group Pointer to the interlock group
+ * @param on The member is ON already
+ * @param booting Outputs are being restored on boot, one by one: there is nothing to wait for
+ * @param now_us Current time
+ * @param dead_us Dead time of the group
+ * @return INTERLOCK_ON or INTERLOCK_WAIT
+ */
+interlock_decision_t interlock_decide_on(const interlock_group_t *group, bool on, bool booting, int64_t now_us, uint32_t dead_us) {
+    if (on || booting || group->released_us == 0) {
+        return INTERLOCK_ON;
+    }
+    // contacts opening in the future (zero crossing) keep the group dead until they did, even without dead time
+    return (now_us - group->released_us >= (int64_t)dead_us) ? INTERLOCK_ON : INTERLOCK_WAIT;
+}
+
+/**
+ * @brief: Park the ON request until the dead time has passed. Replaces any request parked before.
+ *
+ * @param group Pointer to the interlock group
+ * @param request The request
+ * @param now_us Current time
+ * @param dead_us Dead time of the group
+ * @return time left until the dead time has passed, at least 1 microsecond
+ */
+int64_t interlock_park(interlock_group_t *group, const interlock_request_t *request, int64_t now_us, uint32_t dead_us) {
+    group->pending = *request;
+
+    int64_t wait_us = (int64_t)dead_us - (now_us - group->released_us);
+    return (wait_us < 1) ? 1 : wait_us;
+}
+
+/**
+ * @brief: Drop the parked request of the member: it was switched OFF, switched ON by a newer request or removed
+ *
+ * @param group Pointer to the interlock group
+ * @param channel Member, -1 for whichever is parked
+ * @return true if a request was dropped
+ */
+bool interlock_cancel(interlock_group_t *group, int channel) {
+    if (group->pending.channel < 0 || (channel >= 0 && group->pending.channel != channel)) {
+        return false;
+    }
+    group->pending.channel = -1;
+    return true;
+}
+
+/**
+ * @brief: Take the parked request to re-issue it, after the dead time has passed
+ *
+ * @param group Pointer to the interlock group
+ * @param[out] request The request
+ * @return true if a request was parked
+ */
+bool interlock_take(interlock_group_t *group, interlock_request_t *request) {
+    *request = group->pending;
+    group->pending.channel = -1;
+    return request->channel >= 0;
+}
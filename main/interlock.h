@@ -0,0 +1,56 @@
+/**
+ * @file interlock.h
+ * @brief Interlock group: dead time between members and the ON request parked until it has passed
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * The core is plain C with no ESP-IDF dependencies, and the caller serializes access (relay.c holds
+ * s_interlock_mux). The caller drives the outputs: it switches conflicting members OFF and reports the time
+ * their contacts open, the core decides whether a member may be switched ON now. Once a member went OFF the
+ * group stays dead for the dead time, an ON request within it is parked (the newest one wins) and taken
+ * back by the caller when the dead time has passed.
+ */
+#ifndef INTERLOCK_H
+#define INTERLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** TYPES **/
+
+/**
+ * @brief: ON request of a member
+ */
+typedef struct {
+    int8_t channel;                 // Member, -1 if none
+    uint16_t pulse_ms;              // Pulse width, 0 for a latching ON
+    uint8_t latency_path;           // Latency tracing of the original request
+    int64_t origin_us;
+} interlock_request_t;
+
+/**
+ * @brief: State of an interlock group
+ */
+typedef struct {
+    int64_t released_us;            // Latest time contacts of a member opened, 0 if never
+    interlock_request_t pending;    // Request waiting for the dead time to pass
+} interlock_group_t;
+
+/**
+ * @brief: Outcome of an ON request
+ */
+typedef enum {
+    INTERLOCK_ON,                   // Switch the member ON now
+    INTERLOCK_WAIT,                 // Dead time has not passed yet: park the request
+    INTERLOCK_CONFLICT              // Another member is ON and may not be switched OFF
+} interlock_decision_t;
+
+/** ROUTINES **/
+void interlock_group_init(interlock_group_t *group);
+void interlock_released(interlock_group_t *group, int64_t open_us);
+bool interlock_may_release(uint32_t conflicts, bool preempt);
+interlock_decision_t interlock_decide_on(const interlock_group_t *group, bool on, bool booting, int64_t now_us, uint32_t dead_us);
+int64_t interlock_park(interlock_group_t *group, const interlock_request_t *request, int64_t now_us, uint32_t dead_us);
+bool interlock_cancel(interlock_group_t *group, int channel);
+bool interlock_take(interlock_group_t *group, interlock_request_t *request);
+
+#endif // INTERLOCK_H
@@ -0,0 +1,156 @@
+#include "freertos/FreeRTOS.h"   // must be first
+
+#include <string.h>
+
+#include "esp_timer.h"
+#include "cJSON.h"
+
+#include "common.h"
+#include "latency.h"
+
+/* Histograms */
+// Counters are updated under a spinlock from tasks only, never from ISRs: ISR timestamps are
+// stored with the event and the deltas are recorded later by the task that processes it.
+static uint32_t s_buckets[LATENCY_PATH_COUNT][LATENCY_STAGE_COUNT][LATENCY_BUCKETS];
+static uint32_t s_count[LATENCY_PATH_COUNT][LATENCY_STAGE_COUNT];
+static uint32_t s_max_us[LATENCY_PATH_COUNT][LATENCY_STAGE_COUNT];
+static portMUX_TYPE s_latency_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *LATENCY_PATH_NAMES[LATENCY_PATH_COUNT] = {"sensor", "command", "rule"};
+static const char *LATENCY_STAGE_NAMES[LATENCY_STAGE_COUNT] = {"debounce", "lookup", "nvs", "enqueue", "publish", "gpio_write", "total"};
+
+/**
+ * @brief: Record a stage delta
+ *
+ * @param path Event path. LATENCY_PATH_NONE is ignored.
+ * @param stage Path stage
+ * @param delta_us Stage duration in microseconds
+ */
+void latency_record(latency_path_t path, latency_stage_t stage, int64_t delta_us) {
+#if _DEVICE_ENABLE_STATUS_LATENCY
+    if (path >= LATENCY_PATH_COUNT || stage >= LATENCY_STAGE_COUNT) {
+        return;
+    }
+
+    if (delta_us < 0) {
+        delta_us = 0;
+    }
+    uint32_t value = (delta_us > UINT32_MAX) ? UINT32_MAX : (uint32_t)delta_us;
+
+    // power-of-two bucket: index of the highest set bit + 1
+    int bucket = (value == 0) ? 0 : 32 - __builtin_clz(value);
+    if (bucket >= LATENCY_BUCKETS) {
+        bucket = LATENCY_BUCKETS - 1;
+    }
+
+    portENTER_CRITICAL(&s_latency_mux);
+    s_buckets[path][stage][bucket]++;
+    s_count[path][stage]++;
+    if (value > s_max_us[path][stage]) {
+        s_max_us[path][stage] = value;
+    }
+    portEXIT_CRITICAL(&s_latency_mux);
+#endif
+}
+
+/**
+ * @brief: Record a stage that started at the given time and ends now
+ *
+ * @param path Event path. LATENCY_PATH_NONE is ignored.
+ * @param stage Path stage
+ * @param since_us Stage start, esp_timer_get_time() based. 0 means unknown and is ignored.
+ */
+void latency_record_since(latency_path_t path, latency_stage_t stage, int64_t since_us) {
+    if (since_us <= 0) {
+        return;
+    }
+    latency_record(path, stage, esp_timer_get_time() - since_us);
+}
+
+/**
+ * @brief: Get percentile from the bucket counters
+ *
+ * @return Upper bound of the bucket holding the percentile, limited by the maximum seen
+ */
+static uint32_t latency_percentile(const uint32_t *buckets, uint32_t count, uint32_t max_us, uint32_t percent) {
+    if (count == 0) {
+        return 0;
+    }
+
+    // rank of the percentile sample, 1-based
+    uint32_t rank = (uint32_t)(((uint64_t)count * percent + 99) / 100);
+    uint32_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint32_t upper = (uint32_t)((1ULL << i) - 1);
+            return (i == LATENCY_BUCKETS - 1 || upper > max_us) ? max_us : upper;
+        }
+    }
+    return max_us;
+}
+
+/**
+ * @brief: Get the latency summary of a stage
+ *
+ * @param path Event path
+ * @param stage Path stage
+ * @param[out] summary Stage summary
+ */
+void latency_get_summary(latency_path_t path, latency_stage_t stage, latency_summary_t *summary) {
+    uint32_t buckets[LATENCY_BUCKETS];
+
+    *summary = (latency_summary_t){0};
+    if (path >= LATENCY_PATH_COUNT || stage >= LATENCY_STAGE_COUNT) {
+        return;
+    }
+
+    portENTER_CRITICAL(&s_latency_mux);
+    memcpy(buckets, s_buckets[path][stage], sizeof(buckets));
+    summary->count = s_count[path][stage];
+    summary->max_us = s_max_us[path][stage];
+    portEXIT_CRITICAL(&s_latency_mux);
+
+    summary->p50_us = latency_percentile(buckets, summary->count, summary->max_us, 50);
+    summary->p95_us = latency_percentile(buckets, summary->count, summary->max_us, 95);
+    summary->p99_us = latency_percentile(buckets, summary->count, summary->max_us, 99);
+}
+
+/**
+ * @brief: Compile JSON object with latency summaries of all recorded stages
+ *
+ * Format: { "<path>": { "<stage>": { "count", "p50_us", "p95_us", "p99_us", "max_us" }, ... }, ... }
+ */
+cJSON *latency_to_JSON() {
+    cJSON *root = cJSON_CreateObject();
+    if (root == NULL) {
+        return NULL;
+    }
+
+    for (int path = 0; path < LATENCY_PATH_COUNT; path++) {
+        cJSON *j_path = cJSON_AddObjectToObject(root, LATENCY_PATH_NAMES[path]);
+        if (j_path == NULL) {
+            continue;
+        }
+
+        for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+            latency_summary_t summary;
+            latency_get_summary((latency_path_t)path, (latency_stage_t)stage, &summary);
+            if (summary.count == 0) {
+                continue;
+            }
+
+            cJSON *j_stage = cJSON_AddObjectToObject(j_path, LATENCY_STAGE_NAMES[stage]);
+            if (j_stage == NULL) {
+                continue;
+            }
+            cJSON_AddNumberToObject(j_stage, "count", summary.count);
+            cJSON_AddNumberToObject(j_stage, "p50_us", summary.p50_us);
+            cJSON_AddNumberToObject(j_stage, "p95_us", summary.p95_us);
+            cJSON_AddNumberToObject(j_stage, "p99_us", summary.p99_us);
+            cJSON_AddNumberToObject(j_stage, "max_us", summary.max_us);
+        }
+    }
+
+    return root;
+}
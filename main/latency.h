@@ -0,0 +1,67 @@
+/**
+ * @file latency.h
+ * @brief Fixed-bucket latency histograms of event processing stages
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * Three paths are traced: a contact sensor edge from the GPIO ISR to the MQTT publish,
+ * an MQTT command from MQTT_EVENT_DATA to the GPIO write, and a contact sensor edge to the
+ * GPIO write made by an on-device rule. Every stage delta is counted in
+ * a power-of-two bucket, so recording is O(1) with no allocations and percentiles are
+ * reported as the upper bound of the bucket (at most 2x of the real value).
+ */
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include "cJSON.h"
+
+/** TYPES **/
+
+/**
+ * @brief: Traced event path
+ */
+typedef enum {
+    LATENCY_PATH_SENSOR,        // Contact sensor edge (GPIO ISR) => MQTT publish
+    LATENCY_PATH_COMMAND,       // MQTT command (MQTT_EVENT_DATA) => GPIO write => MQTT publish
+    LATENCY_PATH_RULE,          // Contact sensor edge (GPIO ISR) => rule action GPIO write => MQTT publish
+    LATENCY_PATH_COUNT
+} latency_path_t;
+
+#define LATENCY_PATH_NONE   LATENCY_PATH_COUNT      // Event is not traced
+
+/**
+ * @brief: Stage of the event path
+ */
+typedef enum {
+    LATENCY_STAGE_DEBOUNCE,     // First edge => level settled
+    LATENCY_STAGE_LOOKUP,       // Unit resolution
+    LATENCY_STAGE_NVS,          // Persisting the new state (write-behind request)
+    LATENCY_STAGE_ENQUEUE,      // Handing the event over to the next task queue
+    LATENCY_STAGE_PUBLISH,      // MQTT publish queued => handed to the MQTT client
+    LATENCY_STAGE_GPIO_WRITE,   // Command received => GPIO level set
+    LATENCY_STAGE_TOTAL,        // Path origin => MQTT publish handed to the MQTT client
+    LATENCY_STAGE_COUNT
+} latency_stage_t;
+
+/**
+ * @brief: Latency summary of a stage
+ */
+typedef struct {
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p95_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} latency_summary_t;
+
+/** SETTINGS AND CONSTANTS **/
+
+#define LATENCY_BUCKETS     24      // bucket i counts deltas in [2^(i-1), 2^i) us, the last one everything above 2^22 us
+
+/** ROUTINES **/
+void latency_record(latency_path_t path, latency_stage_t stage, int64_t delta_us);
+void latency_record_since(latency_path_t path, latency_stage_t stage, int64_t since_us);
+void latency_get_summary(latency_path_t path, latency_stage_t stage, latency_summary_t *summary);
+cJSON *latency_to_JSON();
+
+#endif // LATENCY_H
@@ -27,6 +27,10 @@
 #include "status.h"
 #include "relay.h"
 #include "mqtt.h"
+#include "rules.h"
+#include "schedule.h"
+#include "time_sync.h"
+#include "relay_rtc.h"
 
 EventGroupHandle_t g_sys_events;
 
@@ -35,6 +39,9 @@ EventGroupHandle_t g_sys_events;
  */
 void app_main(void) {
 
+    // Drive actuator outputs back from RTC memory first: on a warm reset they don't wait for NVS and settings
+    relay_rtc_restore_outputs();
+
 #if _DEVICE_ENABLE_STATUS_SYSINFO_HEAP_TRACE
     // Start heap trace
     esp_err_t trace_result = heap_trace_start(HEAP_TRACE_LEAKS);
@@ -73,15 +80,33 @@ void app_main(void) {
     // Init settings
     ESP_ERROR_CHECK(settings_init());
 
+    // Cold boot: settings_init() has just driven the outputs from NVS
+    relay_rtc_outputs_restored(RELAY_RTC_SOURCE_NVS);
+
+    // Load MQTT settings used on every publish into RAM, before any unit can publish
+    ESP_ERROR_CHECK(mqtt_config_reload());
+
+    // Apply the time zone: schedules and logs use local time
+    ESP_ERROR_CHECK(time_zone_init());
+
     // Initialize relay units from NVS: in-memory storage
     ESP_ERROR_CHECK(init_relay_units_in_memory());
 
     // relays in memory dump
     ESP_ERROR_CHECK(dump_relay_units_in_memory());
 
+    // Load on-device rules: they refer to the relay units in memory
+    ESP_ERROR_CHECK(rules_init());
+
+    // Load schedules and start the schedule task. It waits for the clock to be synchronized.
+    ESP_ERROR_CHECK(schedule_init());
+
     // Register ISRs for the GPIO pins
     ESP_ERROR_CHECK(relay_all_sensors_register_isr());
 
+    // Attach pulse counters to PCNT units and start sampling them
+    ESP_ERROR_CHECK(relay_all_pulse_counters_attach());
+
     // Start monitoring the GPIO events queue for sensor units
     // Create the GPIO event task to process the ISR queue
     xTaskCreate(gpio_event_task, "gpio_event_task", 4096, NULL, 10, NULL);
@@ -175,6 +200,12 @@ void app_main(void) {
         free(device_serial);
 #endif
 
+#if _DEVICE_ENABLE_SNTP
+        // synchronize the clock for schedules
+        ESP_LOGI(TAG, "SNTP ENABLED!");
+        ESP_ERROR_CHECK(time_sync_init());
+#endif
+
 #if _DEVICE_ENABLE_WEB || _DEVICE_ENABLE_HTTP_API
         // start web server
         ESP_LOGI(TAG, "WEB and/or HTTP API ENABLED!");
@@ -183,9 +214,8 @@ void app_main(void) {
 #endif
 
 #if _DEVICE_ENABLE_MQTT
-        // get MQTT connection mode from NVS
-        uint16_t mqtt_connection_mode;
-        ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mqtt_connection_mode));
+        // get MQTT connection mode from the RAM snapshot
+        uint16_t mqtt_connection_mode = mqtt_config_connection_mode();
 
         // start MQTT client
         if (mqtt_connection_mode) {
@@ -12,6 +12,7 @@
 #include "ca_cert_manager.h"
 #include "mqtt_client.h"
 #include "esp_check.h"
+#include "esp_timer.h"
 
 #include "cJSON.h"
 
@@ -22,21 +23,105 @@
 #include "relay.h"  // To access relay data
 #include "hass.h"
 #include "status.h"
+#include "pending.h"
 
 /* Queue global variables */
-static QueueHandle_t mqtt_event_queue = NULL; 
 static QueueHandle_t mqtt_command_queue = NULL;
 
+/**
+ * @brief: Units waiting to be published, a bit per topic table slot
+ *
+ * Producers set the bit of a unit and notify the MQTT event task, which takes the whole bitmap at once and
+ * publishes the current state of every unit in it. Marking a unit that is already pending costs nothing more,
+ * so bursts of changes are coalesced and producers never wait for the publisher.
+ */
+_Static_assert(MQTT_TOPIC_SLOTS <= 32, "MQTT publish bitmap holds 32 topic table slots");
+
+static pending_set_t s_mqtt_pending = {0};                              // Guarded by s_mqtt_pending_mux
+static mqtt_publish_trace_t s_mqtt_pending_trace[MQTT_TOPIC_SLOTS] = {     // Guarded by s_mqtt_pending_mux
+    [0 ... MQTT_TOPIC_SLOTS - 1] = { .latency_path = LATENCY_PATH_NONE },
+};
+static portMUX_TYPE s_mqtt_pending_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_mqtt_event_task = NULL;
+
 /* MQTT client global variables */
 esp_mqtt_client_handle_t mqtt_client = NULL;
 
 /**
- * @brief Starts the MQTT event queue task.
+ * @brief: RAM snapshot of the settings used on every publish, subscription and command
+ *
+ * Loaded from NVS once and rebuilt by mqtt_config_reload() only when one of the settings is changed,
+ * so the hot path doesn't open an NVS handle per value. Readers take a copy with mqtt_config_get().
+ */
+struct mqtt_config {
+    uint16_t connection_mode;               // mqtt_connection_mode_t
+    char mqtt_prefix[MQTT_PREFIX_LENGTH];
+    char device_id[DEVICE_ID_LENGTH + 1];
+    char ha_prefix[HA_PREFIX_LENGTH];
+    uint16_t publish_profile;               // mqtt_publish_profile_t
+    uint32_t heartbeat_interval;            // ms between publishes of unchanged units
+    uint32_t generation;                    // Incremented on every reload, 0 if not loaded yet
+};
+
+/**
+ * @brief: Counters of the MQTT hot path, reported in the device status
+ */
+typedef struct {
+    uint32_t config_reloads;                // Snapshots built
+    uint32_t config_nvs_reads;              // NVS reads made to build them
+    uint32_t publishes;                     // Calls of mqtt_publish_relay_data() that reached the client
+    uint64_t publish_us_total;              // Time spent in them
+    uint32_t publish_us_max;
+    uint32_t units_sent;                    // Unit refreshes published
+    uint32_t units_suppressed;              // Unit refreshes skipped, nothing changed since the last one published
+    uint32_t messages_sent;                 // Messages handed to the client by the relay and system publishes
+    uint64_t message_bytes;                 // Their topic and payload bytes
+    uint32_t messages_suppressed;           // Messages not sent, the broker already had their payload
+    uint32_t heartbeats;                    // Heartbeats: everything published again, changed or not
+} mqtt_stats_t;
+
+static mqtt_config_t s_mqtt_config = {0};
+static mqtt_stats_t s_mqtt_stats = {0};
+static portMUX_TYPE s_mqtt_config_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief: Topic table with its reference count
+ *
+ * The current table is built from the snapshot on first use after the units or the settings changed and is
+ * never modified. A rebuild replaces it, the previous one is freed once the last publish using it is done.
+ */
+struct mqtt_topics {
+    topic_table_t table;                    // Must be the first member
+    uint32_t refs;                          // One for being current, one per user
+    uint32_t config_generation;             // Settings snapshot the topics were built from
+};
+
+static mqtt_topics_t *s_mqtt_topics = NULL;                     // Guarded by s_mqtt_config_mux
+static mqtt_topics_t s_mqtt_topics_none = {0};                  // Empty table handed out if the table can't be built
+static SemaphoreHandle_t s_mqtt_topics_build_lock = NULL;       // Serializes builds
+
+/**
+ * @brief: Digest of the payload last published, per unit and per system information field
+ *
+ * Refreshes whose payload didn't change are not published. An entry only counts for the epoch it was stored
+ * in. The epoch is advanced on every connect, settings reload, change of units and heartbeat, so everything
+ * is published again after them.
+ */
+struct mqtt_published {
+    uint32_t digest;                        // FNV-1a of the payload
+    uint32_t epoch;
+};
+
+static mqtt_published_t s_mqtt_published[MQTT_TOPIC_SLOTS] = {0};                   // Units by topic table slot, used by the MQTT event task only
+static mqtt_published_t s_mqtt_system_published[MQTT_SYSTEM_FIELD_MAX] = {0};       // Used by the status task only
+static uint32_t s_mqtt_published_epoch = 1;                                         // Guarded by s_mqtt_config_mux
+
+/**
+ * @brief Starts the MQTT publishing and command tasks.
  * 
- * This function creates the MQTT event queue and starts the task responsible for 
- * handling MQTT publishing requests. The task monitors the queue for events and 
- * processes them by loading the necessary relay data from NVS and publishing the 
- * state to MQTT.
+ * This function starts the task responsible for publishing units to MQTT, which
+ * publishes the units marked by trigger_mqtt_publish() and friends, and creates the
+ * MQTT command queue and the task subscribed to relay commands.
  * 
  * @return 
  *      - ESP_OK on success
@@ -65,14 +150,11 @@ esp_err_t start_mqtt_queue_task(void) {
     }
     */
 
-    // Create the event queue
-    mqtt_event_queue = xQueueCreate(MQTT_QUEUE_LENGTH, sizeof(relay_event_t));
-    if (mqtt_event_queue == NULL) {
-        ESP_LOGE(TAG, "Failed to create event queue for MQTT");
+    // Start the MQTT event task, units marked before it started are published right away
+    if (xTaskCreate(mqtt_event_task, "mqtt_event_task", 8192, NULL, 5, &s_mqtt_event_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start MQTT event task");
         return ESP_FAIL;
     }
-    // Start the MQTT event task
-    xTaskCreate(mqtt_event_task, "mqtt_event_task", 8192, NULL, 5, NULL);
 
 
     // mqtt_subscribe_relays_task
@@ -90,88 +172,175 @@ esp_err_t start_mqtt_queue_task(void) {
 /**
  * @brief FreeRTOS task to handle MQTT relay publish events.
  * 
- * This task monitors an event queue for relay publish requests. When an event is 
- * received, it loads the relay data from NVS based on the event type (actuator or 
- * contact sensor), and then publishes the state to MQTT using the 
- * mqtt_publish_relay_data() function.
+ * This task sleeps until a unit is marked for publishing. Then it takes all units
+ * marked so far at once, resolves every in-memory relay unit (actuator, contact sensor
+ * or pulse counter) from its topic table slot and publishes its current state to MQTT
+ * using the mqtt_publish_relay_data() function. Units marked again while the pass
+ * runs are published by the next one.
  * 
  * @param[in] arg Unused task argument.
  */
 void mqtt_event_task(void *arg) {
-    relay_event_t event;
-    relay_unit_t *relay = NULL;
+    mqtt_publish_trace_t trace[MQTT_TOPIC_SLOTS];
+    relay_unit_t snapshot;
+    unit_handle_t unit;
     esp_err_t err;
 
     while (1) {
-        // Wait for events to arrive in the queue
-        if (xQueueReceive(mqtt_event_queue, &event, portMAX_DELAY)) {
-            
-            ESP_LOGI(TAG, "mqtt_event_task: Recevied MQTT publish message. Key (%s), type (%d)", event.relay_key, event.relay_type);
-
-            // Load relay based on event type
-            if (event.relay_type == RELAY_TYPE_ACTUATOR) {
-                err = get_relay_actuator_from_memory_by_key(event.relay_key, &relay);
-            } else {
-                err = get_relay_sensor_from_memory_by_key(event.relay_key, &relay);
+        // Take all pending units, with the traces of those that have one
+        taskENTER_CRITICAL(&s_mqtt_pending_mux);
+        uint32_t pending = pending_set_take(&s_mqtt_pending);
+        for (uint32_t mask = pending; mask != 0; mask &= mask - 1) {
+            int slot = __builtin_ctz(mask);
+            trace[slot] = s_mqtt_pending_trace[slot];
+            s_mqtt_pending_trace[slot].latency_path = LATENCY_PATH_NONE;
+        }
+        taskEXIT_CRITICAL(&s_mqtt_pending_mux);
+
+        if (pending == 0) {
+            // Wait for units to be marked
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        ESP_LOGD(TAG, "mqtt_event_task: Publishing pending units. Slots (0x%08lx)", (unsigned long)pending);
+
+        for (uint32_t mask = pending; mask != 0; mask &= mask - 1) {
+            int slot = __builtin_ctz(mask);
+
+            // Resolve the relay unit from its slot: a copy, the unit may move in memory while it's published
+            err = mqtt_topic_slot_unit(slot, &unit);
+            if (err == ESP_OK) {
+                err = relay_unit_snapshot_by_handle(unit, &snapshot);
             }
 
             if (err == ESP_OK) {
                 // Publish the relay state to MQTT
-                mqtt_publish_relay_data(relay);
-
-                // Free relay memory if dynamically allocated
-                if (relay->type == RELAY_TYPE_ACTUATOR) {
-                    if (INIT_RELAY_ON_LOAD) {
-                        ESP_ERROR_CHECK(relay_gpio_deinit(relay));
-                    }
-                } else {
-                    if (INIT_SENSORS_ON_LOAD) {
-                        ESP_ERROR_CHECK(relay_gpio_deinit(relay));
+                mqtt_publish_relay_data(&snapshot);
+                latency_record_since((latency_path_t)trace[slot].latency_path, LATENCY_STAGE_PUBLISH, trace[slot].enqueued_us);
+                latency_record_since((latency_path_t)trace[slot].latency_path, LATENCY_STAGE_TOTAL, trace[slot].origin_us);
+
+                // Free relay memory if dynamically allocated. Resolved again by the handle, under the writer lock.
+                if ((unit.type == RELAY_TYPE_ACTUATOR && INIT_RELAY_ON_LOAD) || (unit.type == RELAY_TYPE_SENSOR && INIT_SENSORS_ON_LOAD)) {
+                    err = relay_gpio_deinit_by_handle(unit);
+                    if (err != ESP_OK && err != ESP_ERR_NOT_FOUND) {
+                        ESP_LOGE(TAG, "Failed to de-init GPIO pin of the published unit. Slot (%d): %s", slot, esp_err_to_name(err));
                     }
                 }
             } else {
-                ESP_LOGE(TAG, "Failed to load relay from NVS for key %s", event.relay_key);
+                ESP_LOGE(TAG, "Failed to find relay unit in memory. Slot (%d)", slot);
             }
-
-            // Free the dynamically allocated relay_key
-            free((void *)event.relay_key);
         }
     }
 }
 
 /**
- * @brief Sends a relay publish event to the MQTT queue.
+ * @brief: Mark a unit for publishing and wake up the MQTT event task
+ * 
+ * Never blocks: only sets the bit of the unit. A unit that is pending already is published once, with its
+ * state at the time of the publish. Its trace is kept from the oldest traced change, so the latency covers
+ * the whole wait.
+ * 
+ * @param[in] unit Handle of the relay unit.
+ * @param[in] path Latency path of the change, LATENCY_PATH_NONE if not traced.
+ * @param[in] origin_us Time the change originated, esp_timer_get_time() based.
+ * 
+ * @return bool    true if the unit was marked, false if it has no topic table slot.
+ */
+static bool mqtt_mark_pending(unit_handle_t unit, latency_path_t path, int64_t origin_us) {
+    int slot = mqtt_topic_slot(unit);
+    if (slot < 0) {
+        return false;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&s_mqtt_pending_mux);
+    pending_set_mark(&s_mqtt_pending, slot);
+    if (path != LATENCY_PATH_NONE && s_mqtt_pending_trace[slot].latency_path == LATENCY_PATH_NONE) {
+        s_mqtt_pending_trace[slot].latency_path = (uint8_t)path;
+        s_mqtt_pending_trace[slot].origin_us = origin_us;
+        s_mqtt_pending_trace[slot].enqueued_us = now_us;
+    }
+    TaskHandle_t task = s_mqtt_event_task;
+    taskEXIT_CRITICAL(&s_mqtt_pending_mux);
+
+    // before the task is started the units just stay pending
+    if (task != NULL) {
+        xTaskNotifyGive(task);
+    }
+    return true;
+}
+
+/**
+ * @brief Marks a relay unit for publishing to MQTT.
  * 
- * This function triggers an MQTT publish by sending a relay event to the 
- * mqtt_event_queue. The event includes the relay key and type (actuator or contact sensor).
- * The event will be processed by the MQTT event task, which will load the relay data 
- * from NVS and publish its state to MQTT.
+ * The unit is published by the MQTT event task, which resolves the relay unit from
+ * its handle and publishes its state to MQTT. Never blocks and allocates no memory.
  * 
- * @param[in] relay_key The key identifying the relay in NVS.
- * @param[in] relay_type The type of relay (e.g., actuator or sensor).
+ * @param[in] unit Handle of the relay unit.
  * 
  * @return 
  *      - ESP_OK on success
- *      - ESP_FAIL if the event cannot be sent to the queue
+ *      - ESP_ERR_INVALID_ARG if the handle is not a valid unit
  */
-esp_err_t  trigger_mqtt_publish(const char *relay_key, relay_type_t relay_type) {
-    relay_event_t event;
-
-    event.relay_key = strdup(relay_key);  // Duplicate the key to ensure it remains valid
-    event.relay_type = relay_type;
+esp_err_t  trigger_mqtt_publish(unit_handle_t unit) {
+    return trigger_mqtt_publish_traced(unit, LATENCY_PATH_NONE, 0);
+}
 
-    ESP_LOGI(TAG, "trigger_mqtt_publish: +-> Pushing MQTT publish event to the queue. Key (%s), type(%d)", event.relay_key, (int)event.relay_type);
+/**
+ * @brief Marks a relay unit for publishing to MQTT with latency tracing.
+ * 
+ * Same as trigger_mqtt_publish(), but the unit carries the origin timestamp of the change, so the
+ * MQTT event task records the publish handoff and the end-to-end latency of the path.
+ * 
+ * @param[in] unit Handle of the relay unit.
+ * @param[in] path Latency path of the event, LATENCY_PATH_NONE to disable tracing.
+ * @param[in] origin_us Time the event originated, esp_timer_get_time() based.
+ * 
+ * @return 
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG if the handle is not a valid unit
+ */
+esp_err_t trigger_mqtt_publish_traced(unit_handle_t unit, latency_path_t path, int64_t origin_us) {
+    ESP_LOGD(TAG, "trigger_mqtt_publish: +-> Marking unit for MQTT publishing. Channel (%d), type(%d)", unit.index, (int)unit.type);
 
-    // Send the event to the MQTT event task
-    if (xQueueSend(mqtt_event_queue, &event, portMAX_DELAY) != pdTRUE) {
-        ESP_LOGE(TAG, "Failed to send event to MQTT queue");
-        free(event.relay_key);
-        return ESP_FAIL;
+    if (!mqtt_mark_pending(unit, path, origin_us)) {
+        ESP_LOGE(TAG, "No MQTT topic table slot for unit. Channel (%d), type(%d)", unit.index, (int)unit.type);
+        return ESP_ERR_INVALID_ARG;
     }
 
     return ESP_OK;
 }
 
+/**
+ * @brief Marks a batch of relay units for publishing to MQTT.
+ * 
+ * Used when several units change together: they are published by the MQTT event task
+ * in one pass.
+ * 
+ * @param[in] units Handles of the units to be published
+ * @param[in] count Number of handles
+ * 
+ * @return 
+ *      - ESP_OK on success
+ *      - ESP_FAIL if any of the units has no topic table slot
+ */
+esp_err_t trigger_mqtt_publish_units(const unit_handle_t *units, size_t count) {
+    esp_err_t err = ESP_OK;
+
+    ESP_LOGD(TAG, "trigger_mqtt_publish_units: +-> Marking %d unit(s) for MQTT publishing", (int)count);
+
+    for (size_t i = 0; i < count; i++) {
+        if (!mqtt_mark_pending(units[i], LATENCY_PATH_NONE, 0)) {
+            ESP_LOGE(TAG, "Unable to mark unit for MQTT publishing. Channel (%d), type(%d)", units[i].index, (int)units[i].type);
+            err = ESP_FAIL;
+        }
+    }
+
+    return err;
+}
+
 /**
  * @brief: Log an error message if the error code is non-zero.
  * 
@@ -209,6 +378,8 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
         xEventGroupSetBits(g_sys_events, BIT_MQTT_CONNECTED);
         xEventGroupSetBits(g_sys_events, BIT_MQTT_READY);
+        // the broker may have lost the retained topics: publish everything once again
+        mqtt_published_invalidate();
         // update all relays to MQTT
         esp_err_t err = relay_publish_all_to_mqtt(true);
         if (err != ESP_OK) {
@@ -231,6 +402,7 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         ESP_LOGD(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
         break;
     case MQTT_EVENT_DATA: {
+        int64_t received_us = esp_timer_get_time();  // origin of the command path for latency tracing
         ESP_LOGI(TAG, "MQTT_EVENT_DATA");
         // TODO: check the code for heap memory leaks
 
@@ -238,46 +410,31 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         ESP_LOGI(TAG, "TOPIC=%.*s, len: %i", event->topic_len, event->topic, event->topic_len);
         ESP_LOGI(TAG, "DATA=%.*s, len: %i", event->data_len, event->data, event->data_len);
 
-        // Dynamically allocate memory for topic and data buffers
-        char *topic_buf = (char *)malloc(event->topic_len + 1);  // +1 for the null terminator
-        char *data_buf = (char *)malloc(event->data_len + 1);  // +1 for the null terminator
-
-        if (topic_buf == NULL || data_buf == NULL) {
-            ESP_LOGE(TAG, "Failed to allocate memory for MQTT topic or data buffers");
-            free(topic_buf);  // Ensure any allocated memory is freed
-            free(data_buf);
-            break;
-        }
-
-        // Copy the topic and data, ensuring they are null-terminated
-        strncpy(topic_buf, event->topic, event->topic_len);
-        topic_buf[event->topic_len] = '\0';  // Null-terminate the string
-
-        strncpy(data_buf, event->data, event->data_len);
-        data_buf[event->data_len] = '\0';  // Null-terminate the string
-
-        // Log to ensure correct handling of topic and data
-        ESP_LOGI(TAG, "MQTT_EVENT_DATA: Got MQTT topic to extract relay key from: %s", topic_buf);
-
-        // Create the command event and resolve the relay key
+        // Resolve the relay unit handle right from the topic: no memory is allocated on the command path
         mqtt_command_event_t command_event;
-        command_event.relay_key = resolve_key_from_topic(topic_buf);  // Use the topic buffer
-        if (command_event.relay_key == NULL) {
-            ESP_LOGE(TAG, "Failed to resolve relay key from topic %s (NULL)", topic_buf);
-            free(topic_buf);  // Ensure any allocated memory is freed
-            free(data_buf);
+        command_event.received_us = received_us;
+        if (resolve_unit_handle_from_topic(event->topic, event->topic_len, &command_event.unit) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to resolve relay unit from topic %.*s", event->topic_len, event->topic);
             break;  // Handle the error
         }
 
-        // Handle state based on data buffer
-        command_event.state = (strcmp(data_buf, "True") == 0 || strcmp(data_buf, "true") == 0) ? RELAY_STATE_ON : RELAY_STATE_OFF;
+        // Handle state based on data buffer: plain "true"/"false" or JSON {"state":true,"pulse_ms":500}
+        command_event.pulse_ms = MQTT_COMMAND_PULSE_DEFAULT;
+        if (event->data_len > 0 && event->data[0] == '{') {
+            if (mqtt_parse_command_json(event->data, event->data_len, &command_event) != ESP_OK) {
+                ESP_LOGE(TAG, "Invalid JSON command on topic %.*s", event->topic_len, event->topic);
+                break;
+            }
+        } else {
+            bool is_true = (event->data_len == 4) && (strncmp(event->data, "True", 4) == 0 || strncmp(event->data, "true", 4) == 0);
+            command_event.state = is_true ? RELAY_STATE_ON : RELAY_STATE_OFF;
+        }
 
         // Send the event to the queue
         if (xQueueSend(mqtt_command_queue, &command_event, portMAX_DELAY) != pdPASS) {
             ESP_LOGE(TAG, "Failed to send MQTT command event to the queue");
         }
-        free(topic_buf);  // Free allocated memory
-        free(data_buf);
+        latency_record_since(LATENCY_PATH_COMMAND, LATENCY_STAGE_ENQUEUE, received_us);
         break;
     }
     case MQTT_EVENT_ERROR:
@@ -309,8 +466,7 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
  */
 esp_err_t mqtt_init(void) {
     
-    uint16_t mqtt_connection_mode;
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mqtt_connection_mode));
+    uint16_t mqtt_connection_mode = mqtt_config_connection_mode();
     if (mqtt_connection_mode < (uint16_t)MQTT_CONN_MODE_NO_RECONNECT) {
         ESP_LOGW(TAG, "MQTT disabled in device settings. Publishing skipped.");
         return ESP_OK; // not an issue
@@ -336,8 +492,6 @@ esp_err_t mqtt_init(void) {
     char *mqtt_protocol = NULL;
     char *mqtt_user = NULL;
     char *mqtt_password = NULL;
-    char *mqtt_prefix = NULL;
-    char *device_id = NULL;
 
     uint16_t mqtt_port;
 
@@ -346,8 +500,6 @@ esp_err_t mqtt_init(void) {
     ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PROTOCOL, &mqtt_protocol));
     ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_USER, &mqtt_user));
     ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PASSWORD, &mqtt_password));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, &mqtt_prefix));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id));
 
     char broker_url[256];
     snprintf(broker_url, sizeof(broker_url), "%s://%s:%d", mqtt_protocol, mqtt_server, mqtt_port);
@@ -389,8 +541,6 @@ esp_err_t mqtt_init(void) {
     free(mqtt_protocol);
     free(mqtt_user);
     free(mqtt_password);
-    free(mqtt_prefix);
-    free(device_id);
 
     // 🟢 Wait up to 10 seconds for MQTT to become fully ready
     ESP_LOGI(TAG, "Waiting for MQTT client to connect...");
@@ -448,8 +598,10 @@ void cleanup_mqtt() {
  * 
  * This function publishes the relay data to MQTT. The function reads the relay state,
  * channel, inverted, and GPIO pin from the relay structure and publishes the data to
- * the appropriate MQTT topics. The function also reads the MQTT prefix and device ID
- * from NVS to construct the MQTT topics.
+ * the appropriate MQTT topics. Which topics are published is decided by the publish
+ * profile setting (mqtt_publish_profile_t). All topics are built from one consistent copy
+ * of the unit. Nothing is published if the unit didn't change since it was last published
+ * (see mqtt_publish_heartbeat()).
  * 
  * @param[in] relay The relay data to publish.
  * 
@@ -464,17 +616,22 @@ esp_err_t mqtt_publish_relay_data(const relay_unit_t *relay) {
         return ESP_ERR_INVALID_ARG;
     }
 
+    // Every topic is built from one consistent copy of the unit: the in-memory one may change meanwhile
+    relay_unit_t snapshot;
+    if (relay_unit_snapshot(relay, &snapshot) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    relay = &snapshot;
+
     ESP_LOGI(TAG, "Publish relay/sensor information to MQTT. Channel (%i), type (%i)", relay->channel, relay->type);
 
-    uint16_t mqtt_connection_mode;
-    esp_err_t err;
+    int64_t started_us = esp_timer_get_time();
 
-    // Read MQTT connection mode
-    err = nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mqtt_connection_mode);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read MQTT connection mode from NVS");
-        return ESP_FAIL;
-    }
+    // MQTT settings come from the RAM snapshot and topics from the topic table, no NVS access here
+    mqtt_config_t config;
+    mqtt_config_get(&config);
+    uint16_t mqtt_connection_mode = config.connection_mode;
+    mqtt_publish_profile_t profile = (mqtt_publish_profile_t)config.publish_profile;
 
     // Check if MQTT is disabled in the device settings
     if (mqtt_connection_mode < (uint16_t)MQTT_CONN_MODE_NO_RECONNECT) {
@@ -498,122 +655,98 @@ esp_err_t mqtt_publish_relay_data(const relay_unit_t *relay) {
         }
     }
 
-    /* Declare NULL pointer for string variables */
-    char *mqtt_prefix = NULL;
-    char *device_id = NULL;
-    char *relay_key = NULL;
-
-    // Read MQTT prefix and device ID from NVS
-    err = nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, &mqtt_prefix);
-    if (err != ESP_OK || mqtt_prefix == NULL) {
-        ESP_LOGE(TAG, "Failed to read MQTT prefix from NVS or NULL prefix");
-        return ESP_ERR_NVS_BASE;
-    }
-
-    err = nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id);
-    if (err != ESP_OK || device_id == NULL) {
-        ESP_LOGE(TAG, "Failed to read device ID from NVS or NULL device ID");
-        free(mqtt_prefix);  // Ensure mqtt_prefix is freed before returning
-        return ESP_ERR_NVS_BASE;
-    }
-
-    // Get relay_key
-    relay_key = get_unit_nvs_key(relay);
-    if (relay_key == NULL) {
-        ESP_LOGE(TAG, "Failed to get relay key for channel %d", relay->channel);
-        free(mqtt_prefix);
-        free(device_id);
-        return ESP_ERR_INVALID_ARG;
+    // Look up the MQTT topics of the unit, the table is locked until all of them are published
+    int slot = mqtt_topic_slot(get_unit_handle(relay));
+    const topic_table_t *topics = mqtt_topics_acquire(slot);
+    if (topic_table_get(topics, slot, TOPIC_KIND_JSON) == NULL) {
+        ESP_LOGE(TAG, "No MQTT topics for relay unit. Channel (%d), type (%d)", relay->channel, relay->type);
+        mqtt_topics_release(topics);
+        return ESP_ERR_NOT_FOUND;
     }
-
-    // Create MQTT topics
-    char topic[256]; 
-
-    // Publish each sensor data field separately
-    int msg_id;
+    const char *topic;
     bool is_error = false;
     char value[32];
 
-    // Publish state
-    snprintf(topic, sizeof(topic), "%s/%s/%s/%s/state", mqtt_prefix, device_id, relay_key, (relay->type == RELAY_TYPE_ACTUATOR)?HA_DEVICE_STATE_PATH_RELAY:HA_DEVICE_STATE_PATH_SENSOR);
-    snprintf(value, sizeof(value), "%i", (int)relay->state);
-    ESP_LOGI(TAG, "mqtt_publish_relay_data: Publish value (%s) to topic (%s)", value, topic);
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic, value, 0, MQTT_QOS_PUBLISH, 1);
-    if (msg_id < 0) {
-        ESP_LOGW(TAG, "Topic %s not published", topic);
-        is_error = true;
+    // The JSON has every field of the unit: its digest tells whether anything changed since the last publish
+    char *relay_json = serialize_relay_unit(relay);
+    if (relay_json == NULL) {
+        ESP_LOGW(TAG, "Get NULL when tried serialize_relay_unit(). Relay's data will not be publised to MQTT.");
+        mqtt_topics_release(topics);
+        return ESP_FAIL;
     }
 
-    // Publish channel
-    snprintf(topic, sizeof(topic), "%s/%s/%s/%s/channel", mqtt_prefix, device_id, relay_key, (relay->type == RELAY_TYPE_ACTUATOR)?HA_DEVICE_STATE_PATH_RELAY:HA_DEVICE_STATE_PATH_SENSOR);
-    snprintf(value, sizeof(value), "%i", (int)relay->channel);
-    ESP_LOGI(TAG, "mqtt_publish_relay_data: Publish value (%s) to topic (%s)", value, topic);
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic, value, 0, MQTT_QOS_PUBLISH, 0);
-    if (msg_id < 0) {
-        ESP_LOGW(TAG, "Topic %s not published", topic);
-        is_error = true;
-    }
+    mqtt_published_t published;
+    if (!mqtt_published_changed(&s_mqtt_published[slot], relay_json, &published)) {
+        ESP_LOGI(TAG, "Relay unit unchanged since last published, skipped. Channel (%d), type (%d)", relay->channel, relay->type);
+        free(relay_json);
+        mqtt_topics_release(topics);
 
-    // Publish inverted
-    snprintf(topic, sizeof(topic), "%s/%s/%s/%s/inverted", mqtt_prefix, device_id, relay_key, (relay->type == RELAY_TYPE_ACTUATOR)?HA_DEVICE_STATE_PATH_RELAY:HA_DEVICE_STATE_PATH_SENSOR);
-    snprintf(value, sizeof(value), "%i", (int)relay->inverted);
-    ESP_LOGI(TAG, "mqtt_publish_relay_data: Publish value (%s) to topic (%s)", value, topic);
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic, value, 0, MQTT_QOS_PUBLISH, 0);
-    if (msg_id < 0) {
-        ESP_LOGW(TAG, "Topic %s not published", topic);
-        is_error = true;
-    }
+        taskENTER_CRITICAL(&s_mqtt_config_mux);
+        s_mqtt_stats.units_suppressed++;
+        s_mqtt_stats.messages_suppressed += mqtt_profile_unit_messages(profile, relay->type);
+        taskEXIT_CRITICAL(&s_mqtt_config_mux);
 
-    // Publish gpio_pin
-    snprintf(topic, sizeof(topic), "%s/%s/%s/%s/gpio_pin", mqtt_prefix, device_id, relay_key, (relay->type == RELAY_TYPE_ACTUATOR)?HA_DEVICE_STATE_PATH_RELAY:HA_DEVICE_STATE_PATH_SENSOR);
-    snprintf(value, sizeof(value), "%i", (int)relay->gpio_pin);
-    ESP_LOGI(TAG, "mqtt_publish_relay_data: Publish value (%s) to topic (%s)", value, topic);
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic, value, 0, MQTT_QOS_PUBLISH, 0);
-    if (msg_id < 0) {
-        ESP_LOGW(TAG, "Topic %s not published", topic);
-        is_error = true;
+        mqtt_stats_record_publish(started_us);
+        return ESP_OK;
     }
 
-    // Publish enabled
-    snprintf(topic, sizeof(topic), "%s/%s/%s/%s/enabled", mqtt_prefix, device_id, relay_key, (relay->type == RELAY_TYPE_ACTUATOR)?HA_DEVICE_STATE_PATH_RELAY:HA_DEVICE_STATE_PATH_SENSOR);
-    snprintf(value, sizeof(value), "%i", (int)relay->enabled);
-    ESP_LOGI(TAG, "mqtt_publish_relay_data: Publish value (%s) to topic (%s)", value, topic);
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic, value, 0, MQTT_QOS_PUBLISH, 0);
-    if (msg_id < 0) {
-        ESP_LOGW(TAG, "Topic %s not published", topic);
-        is_error = true;
+    // Publish state
+    if (profile == MQTT_PUBLISH_PROFILE_LEGACY || profile == MQTT_PUBLISH_PROFILE_STATE) {
+        topic = topic_table_get(topics, slot, TOPIC_KIND_STATE);
+        snprintf(value, sizeof(value), "%i", (int)relay->state);
+        is_error |= !mqtt_publish_value(topic, value, 1);
+    }
+
+    // Publish each data field separately, for subscribers of the legacy topics
+    if (profile == MQTT_PUBLISH_PROFILE_LEGACY) {
+        topic = topic_table_get(topics, slot, TOPIC_KIND_CHANNEL);
+        snprintf(value, sizeof(value), "%i", (int)relay->channel);
+        is_error |= !mqtt_publish_value(topic, value, 0);
+
+        topic = topic_table_get(topics, slot, TOPIC_KIND_INVERTED);
+        snprintf(value, sizeof(value), "%i", (int)relay->inverted);
+        is_error |= !mqtt_publish_value(topic, value, 0);
+
+        topic = topic_table_get(topics, slot, TOPIC_KIND_GPIO_PIN);
+        snprintf(value, sizeof(value), "%i", (int)relay->gpio_pin);
+        is_error |= !mqtt_publish_value(topic, value, 0);
+
+        topic = topic_table_get(topics, slot, TOPIC_KIND_ENABLED);
+        snprintf(value, sizeof(value), "%i", (int)relay->enabled);
+        is_error |= !mqtt_publish_value(topic, value, 0);
+
+        topic = topic_table_get(topics, slot, TOPIC_KIND_TYPE);
+        snprintf(value, sizeof(value), "%i", (int)relay->type);
+        is_error |= !mqtt_publish_value(topic, value, 0);
+
+        // Publish aggregated count and rate of pulse counters
+        if (relay->type == RELAY_TYPE_PULSE_COUNTER) {
+            topic = topic_table_get(topics, slot, TOPIC_KIND_COUNT);
+            snprintf(value, sizeof(value), "%llu", (unsigned long long)relay->pulse_count);
+            is_error |= !mqtt_publish_value(topic, value, 1);
+
+            topic = topic_table_get(topics, slot, TOPIC_KIND_RATE);
+            snprintf(value, sizeof(value), "%.3f", relay->pulse_rate);
+            is_error |= !mqtt_publish_value(topic, value, 1);
+        }
     }
 
-    // Publish type
-    snprintf(topic, sizeof(topic), "%s/%s/%s/%s/type", mqtt_prefix, device_id, relay_key, (relay->type == RELAY_TYPE_ACTUATOR)?HA_DEVICE_STATE_PATH_RELAY:HA_DEVICE_STATE_PATH_SENSOR);
-    snprintf(value, sizeof(value), "%i", (int)relay->type);
-    ESP_LOGI(TAG, "mqtt_publish_relay_data: Publish value (%s) to topic (%s)", value, topic);
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic, value, 0, MQTT_QOS_PUBLISH, 0);
-    if (msg_id < 0) {
-        ESP_LOGW(TAG, "Topic %s not published", topic);
-        is_error = true;
-    }
+    // process JSON status, every profile has it
+    topic = topic_table_get(topics, slot, TOPIC_KIND_JSON);
+    is_error |= !mqtt_publish_value(topic, relay_json, 1);
+    free(relay_json);
 
-    // process JSON status
-    snprintf(topic, sizeof(topic), "%s/%s/%s/%s", mqtt_prefix, device_id, relay_key, (relay->type == RELAY_TYPE_ACTUATOR)?HA_DEVICE_STATE_PATH_RELAY:HA_DEVICE_STATE_PATH_SENSOR);
-    char *relay_json = serialize_relay_unit(relay);
-    if (relay_json != NULL) {
-        ESP_LOGI(TAG, "mqtt_publish_relay_data: Publish value (%s) to topic (%s)", relay_json, topic);
-        msg_id = esp_mqtt_client_publish(mqtt_client, topic, relay_json, 0, MQTT_QOS_PUBLISH, 1);
-        if (msg_id < 0) {
-            ESP_LOGW(TAG, "Topic %s not published", topic);
-            is_error = true;
-        }
-        free(relay_json);
-    } else {
-        ESP_LOGW(TAG, "Get NULL when tried serialize_relay_unit(). Relay's JSON data will not be publised to MQTT.");
-        is_error = true;
+    mqtt_topics_release(topics);
+
+    // only a complete publish counts, a failed one is retried on next refresh
+    if (!is_error) {
+        s_mqtt_published[slot] = published;
+        taskENTER_CRITICAL(&s_mqtt_config_mux);
+        s_mqtt_stats.units_sent++;
+        taskEXIT_CRITICAL(&s_mqtt_config_mux);
     }
 
-    // Free allocated resources for MQTT prefix and device ID
-    free(mqtt_prefix);
-    free(device_id);
-    free(relay_key);
+    mqtt_stats_record_publish(started_us);
 
     if (is_error) {
         ESP_LOGE(TAG, "There were errors when publishing relay data to MQTT");
@@ -653,15 +786,9 @@ esp_err_t mqtt_publish_system_info(device_status_t *status) {
 
     
     /* Process MQTT connection mode: check if MQTT is enabled and client is connected */
-    uint16_t mqtt_connection_mode;
-    esp_err_t err;
-
-    // Read MQTT connection mode from NVS
-    err = nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mqtt_connection_mode);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read MQTT connection mode from NVS");
-        return ESP_FAIL;
-    }
+    mqtt_config_t config;
+    mqtt_config_get(&config);
+    uint16_t mqtt_connection_mode = config.connection_mode;
 
     // Check if MQTT is disabled in the device settings
     if (mqtt_connection_mode < (uint16_t)MQTT_CONN_MODE_NO_RECONNECT) {
@@ -685,11 +812,8 @@ esp_err_t mqtt_publish_system_info(device_status_t *status) {
         }
     }
 
-    // Read MQTT prefix and device ID from NVS
-    char *mqtt_prefix = NULL;
-    char *device_id = NULL;
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, &mqtt_prefix));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id));
+    const char *mqtt_prefix = config.mqtt_prefix;
+    const char *device_id = config.device_id;
 
     // Publish system information to MQTT
     char topic[256];
@@ -697,76 +821,50 @@ esp_err_t mqtt_publish_system_info(device_status_t *status) {
     bool is_error = false;
     char value[32];
 
-    // Publish entire status as JSON
+    // Publish entire status as JSON, on every call: it carries the uptime and is the sign of life of the device
     snprintf(topic, sizeof(topic), "%s/%s/system", mqtt_prefix, device_id);
     char *payload = serialize_device_status(status);
     ESP_LOGI(TAG, "Publishing system information to MQTT topic: %s", topic);
     msg_id = esp_mqtt_client_publish(mqtt_client, topic, payload, 0, 1, 0);
     if (msg_id < 0) {
         ESP_LOGE(TAG, "Failed to publish system information to MQTT topic: %s", topic);
-        free(mqtt_prefix);
-        free(device_id);
         free(payload);
         return ESP_FAIL;
     } else {
         ESP_LOGI(TAG, "System information published to MQTT topic: %s, msg_id: %d", topic, msg_id);
+        mqtt_stats_record_message(topic, payload);
     }
     
-    // Publish individual fields for compatibility
-    // Uptime
-    snprintf(topic, sizeof(topic), "%s/%s/system/uptime", mqtt_prefix, device_id);
-    snprintf(value, sizeof(value), "%llu", (unsigned long long)status->time_since_boot);
-    ESP_LOGI(TAG, "mqtt_publish_system_info: Publish value (%s) to topic (%s)", value, topic);
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic, value, 0, MQTT_QOS_PUBLISH, 0);
-    if (msg_id < 0) {
-        ESP_LOGW(TAG, "Topic %s not published", topic);
-        is_error = true;
-    }
-
-    // Free heap
-    snprintf(topic, sizeof(topic), "%s/%s/system/free_heap", mqtt_prefix, device_id);
-    snprintf(value, sizeof(value), "%u", status->free_heap);
-    ESP_LOGI(TAG, "mqtt_publish_system_info: Publish value (%s) to topic (%s)", value, topic);
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic, value, 0, MQTT_QOS_PUBLISH, 0);
-    if (msg_id < 0) {
-        ESP_LOGW(TAG, "Topic %s not published", topic);
-        is_error = true;
-    }
-
-    // Min free heap
-    snprintf(topic, sizeof(topic), "%s/%s/system/min_free_heap", mqtt_prefix, device_id);
-    snprintf(value, sizeof(value), "%u", status->min_free_heap);
-    ESP_LOGI(TAG, "mqtt_publish_system_info: Publish value (%s) to topic (%s)", value, topic);
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic, value, 0, MQTT_QOS_PUBLISH, 0);
-    if (msg_id < 0) {
-        ESP_LOGW(TAG, "Topic %s not published", topic);
-        is_error = true;
-    }
+    // Publish individual fields for compatibility, only those that changed
+    if (config.publish_profile == MQTT_PUBLISH_PROFILE_LEGACY) {
+        // Uptime
+        snprintf(topic, sizeof(topic), "%s/%s/system/uptime", mqtt_prefix, device_id);
+        snprintf(value, sizeof(value), "%llu", (unsigned long long)status->time_since_boot);
+        is_error |= !mqtt_publish_system_field(MQTT_SYSTEM_FIELD_UPTIME, topic, value);
+
+        // Free heap
+        snprintf(topic, sizeof(topic), "%s/%s/system/free_heap", mqtt_prefix, device_id);
+        snprintf(value, sizeof(value), "%u", status->free_heap);
+        is_error |= !mqtt_publish_system_field(MQTT_SYSTEM_FIELD_FREE_HEAP, topic, value);
+
+        // Min free heap
+        snprintf(topic, sizeof(topic), "%s/%s/system/min_free_heap", mqtt_prefix, device_id);
+        snprintf(value, sizeof(value), "%u", status->min_free_heap);
+        is_error |= !mqtt_publish_system_field(MQTT_SYSTEM_FIELD_MIN_FREE_HEAP, topic, value);
 #if _DEVICE_ENABLE_STATUS_MEMGUARD
-    // memguard threshold
-    snprintf(topic, sizeof(topic), "%s/%s/system/memguard_threshold", mqtt_prefix, device_id);
-    snprintf(value, sizeof(value), "%u", status->memguard_threshold);
-    ESP_LOGI(TAG, "mqtt_publish_system_info: Publish value (%s) to topic (%s)", value, topic);
-    msg_id = esp_mqtt_client_publish(mqtt_client,   topic, value, 0, MQTT_QOS_PUBLISH, 0);
-    if (msg_id < 0) {
-        ESP_LOGW(TAG, "Topic %s not published", topic);
-        is_error = true;
-    }
-
-    // memguard mode
-    snprintf(topic, sizeof(topic), "%s/%s/system/memguard_mode", mqtt_prefix, device_id);
-    snprintf(value, sizeof(value), "%u", status->memguard_mode);
-    ESP_LOGI(TAG, "mqtt_publish_system_info: Publish value (%s) to topic (%s)", value, topic);
-    msg_id = esp_mqtt_client_publish(mqtt_client, topic, value, 0, MQTT_QOS_PUBLISH, 0);
-    if (msg_id < 0) {
-        ESP_LOGW(TAG, "Topic %s not published", topic);
-        is_error = true;
-    }
+        // memguard threshold
+        snprintf(topic, sizeof(topic), "%s/%s/system/memguard_threshold", mqtt_prefix, device_id);
+        snprintf(value, sizeof(value), "%u", status->memguard_threshold);
+        is_error |= !mqtt_publish_system_field(MQTT_SYSTEM_FIELD_MEMGUARD_THRESHOLD, topic, value);
+
+        // memguard mode
+        snprintf(topic, sizeof(topic), "%s/%s/system/memguard_mode", mqtt_prefix, device_id);
+        snprintf(value, sizeof(value), "%u", status->memguard_mode);
+        is_error |= !mqtt_publish_system_field(MQTT_SYSTEM_FIELD_MEMGUARD_MODE, topic, value);
 #endif
+    }
 
     // Free allocated resources
-    free(mqtt_prefix);
-    free(device_id);
     free(payload);
 
     if (is_error) {
@@ -778,149 +876,305 @@ esp_err_t mqtt_publish_system_info(device_status_t *status) {
     return ESP_OK;
 }
 
+/* Home Assistant sensors of a unit */
+// Pulse counters are read-only count and rate sensors, actuators get diagnostic sensors with their wear counters
+// next to the switch. All of them take their values from the unit's JSON topic, same as switches and contact sensors.
+static const mqtt_ha_metric_t MQTT_HA_PULSE_COUNTER_METRICS[] = {
+    { HA_DEVICE_METRIC_COUNT, "", HA_STATE_CLASS_TOTAL_INCREASING, NULL, NULL, NULL },
+    { HA_DEVICE_METRIC_RATE, "", HA_STATE_CLASS_MEASUREMENT, HA_UNIT_PULSE_RATE, NULL, NULL },
+};
+
+static const mqtt_ha_metric_t MQTT_HA_ACTUATOR_WEAR_METRICS[] = {
+    { HA_DEVICE_METRIC_CYCLES, "", HA_STATE_CLASS_TOTAL_INCREASING, NULL, HA_ENTITY_CATEGORY_DIAGNOSTIC, NULL },
+    { HA_DEVICE_METRIC_ON_TIME, HA_DEVICE_CLASS_DURATION, HA_STATE_CLASS_TOTAL_INCREASING, HA_UNIT_SECONDS, HA_ENTITY_CATEGORY_DIAGNOSTIC, NULL },
+    { HA_DEVICE_METRIC_LAST_CHANGE, HA_DEVICE_CLASS_TIMESTAMP, NULL, NULL, HA_ENTITY_CATEGORY_DIAGNOSTIC, HA_LAST_CHANGE_VAL_TPL },
+};
+
+#define MQTT_HA_METRICS_COUNT(metrics)  (sizeof(metrics) / sizeof(metrics[0]))
+
 /**
- * @brief: Task for regular device auto-discovery updates for Home Assistant
- * 
- * This function creates a task that periodically updates the Home Assistant device
- * configuration in MQTT. The task reads the device ID, MQTT prefix, and Home Assistant
- * prefix from NVS and uses them to publish the device configuration to MQTT. The task
- * waits for the MQTT connection to become ready before publishing the configuration.
+ * @brief: Publish Home Assistant discovery of read-only sensors of a unit, one entity per metric
  * 
- * @param[in] param Unused task parameter.
+ * @param[in] device_id Device ID
+ * @param[in] relay_key NVS key of the unit
+ * @param[in] relay_type Type of the unit
+ * @param[in] homeassistant_prefix Home Assistant discovery prefix
+ * @param[in] metrics Sensors to publish
+ * @param[in] metrics_count Number of sensors
  * 
- * @return esp_err_t    ESP_OK on success, ESP_FAIL if HA data connot be published.
+ * @return esp_err_t    ESP_OK on success, ESP_FAIL if any of the entities was not published.
  */
-esp_err_t mqtt_publish_home_assistant_config(const char *device_id, const char *mqtt_prefix, const char *homeassistant_prefix) {
-    
-    // get random session id
-    uint32_t session_id = esp_random();
-    ESP_LOGI(TAG, "MQTT HASS Publish Session ID: %u", session_id);
-
-#if _DEVICE_ENGINEERING_BUILD
-    // dump relays from memory for debug
-    ESP_LOGI(TAG, "Dumping relay units in memory BEFORE publishing HASS Config to MQTT (%u):", session_id);
-    ESP_ERROR_CHECK(dump_relay_units_in_memory());
-#endif
-
-    uint16_t mqtt_connection_mode;
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mqtt_connection_mode));
-    if (mqtt_connection_mode < (uint16_t)MQTT_CONN_MODE_NO_RECONNECT) {
-        ESP_LOGW(TAG, "MQTT disabled in device settings. Publishing skipped.");
-        return ESP_OK;
-    }
-
-    ESP_LOGI(TAG, "mqtt-hass: Waiting for MQTT connection to become ready...");
-
-    // Wait up to 10 seconds total
-    EventBits_t bits = xEventGroupWaitBits(
-        g_sys_events,             // event group handle
-        BIT_MQTT_CONNECTED | BIT_MQTT_READY,       // bit(s) to wait for
-        pdFALSE,                  // don't clear the bit on exit
-        pdTRUE,                   // wait for all bits (only one here)
-        pdMS_TO_TICKS(10000)      // timeout 10 seconds
-    );
-
-    if ((bits & BIT_MQTT_CONNECTED) && (bits & BIT_MQTT_READY)) {
-        ESP_LOGI(TAG, "mqtt-hass: MQTT connection is ready!");
-        // Continue normal operation
-    } else {
-        ESP_LOGE(TAG, "mqtt-hass: MQTT never became ready after 10 seconds");
-        return ESP_FAIL;
-    }
-    
+static esp_err_t mqtt_publish_ha_metrics_config(const char *device_id, const char *relay_key, relay_type_t relay_type, const char *homeassistant_prefix,
+                                                const mqtt_ha_metric_t *metrics, size_t metrics_count) {
     char topic[512];
-    char discovery_path[256];
-    int msg_id;
     bool is_error = false;
-    const char *metric = HA_DEVICE_METRIC_STATE;
-    const char *device_class = HA_DEVICE_DEVICE_CLASS;
-    char *relay_key = NULL;
 
-    relay_unit_t *relay_list = NULL;
-    uint16_t total_count = 0;
-
-
-    // Load all relay units
-    esp_err_t err = get_all_relay_units(&relay_list, &total_count);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to load relay units from NVS.");
-        return err;
-    }
-    if (!total_count) {
-        ESP_LOGW(TAG, "No relays found to update HA auto-discovery records for.");
-        return ESP_OK;
-    }
-
-    ha_entity_discovery_t *entity_discovery = NULL;
-    char *discovery_json;
-
-    // Iterate through each relay and publish to MQTT
-    for (uint16_t i = 0; i < total_count; i++) {
-        // Get the NVS key for the relay
-        relay_key = get_unit_nvs_key(&relay_list[i]);
-        if (relay_key == NULL) {
-            ESP_LOGE(TAG, "Failed to get NVS key for relay channel %d.", relay_list[i].channel);
-            continue;  // Move to the next relay if key generation fails
-        }
-        // Initialize entity discovery structure
-        entity_discovery = (ha_entity_discovery_t *)malloc(sizeof(ha_entity_discovery_t));
-        if (entity_discovery == NULL) {
-            ESP_LOGE(TAG, "Failed to allocate memory for entity discovery object. Relay key: %s", relay_key);
-            is_error = true;
-            continue;  // Move to the next relay if allocation fails
-        }
-
-        // Fill in HomeAssistant entity discovery structure for the relay
-        if (ha_entity_discovery_fullfill(entity_discovery, device_class, relay_key, metric,relay_list[i].type) != ESP_OK) {
-            ESP_LOGE(TAG, "Unable to initiate entity discovery for %s", metric);
-            free(entity_discovery);
+    for (int m = 0; m < metrics_count; m++) {
+        ha_entity_discovery_t entity_discovery;
+        if (ha_entity_discovery_fullfill(&entity_discovery, metrics[m].device_class, relay_key, metrics[m].metric, relay_type) != ESP_OK) {
+            ESP_LOGE(TAG, "Unable to initiate entity discovery for %s of %s", metrics[m].metric, relay_key);
             return ESP_FAIL;
         }
+        entity_discovery.state_class = metrics[m].state_class;
+        entity_discovery.unit_of_measurement = metrics[m].unit_of_measurement;
+        entity_discovery.entity_category = metrics[m].entity_category;
+        if (metrics[m].value_template != NULL) {
+            char *value_template = strdup(metrics[m].value_template);
+            if (value_template != NULL) {
+                free(entity_discovery.value_template);
+                entity_discovery.value_template = value_template;
+            }
+        }
 
-        // Serialize HomeAssistant discovery structure to JSON
-        discovery_json = ha_entity_discovery_print_JSON(entity_discovery);
+        char *discovery_json = ha_entity_discovery_print_JSON(&entity_discovery);
         ESP_LOGI(TAG, "Device discovery serialized:\n%s", discovery_json);
 
-        // Construct discovery topic and publish to MQTT
-        memset(discovery_path, 0, sizeof(discovery_path));
-        sprintf(discovery_path, "%s/%s", homeassistant_prefix, HA_DEVICE_FAMILY);
-        sprintf(topic, "%s/%s_%s/%s/%s", discovery_path, device_id, relay_key, HA_DEVICE_FAMILY, HA_DEVICE_CONFIG_PATH);
-        msg_id = esp_mqtt_client_publish(mqtt_client, topic, discovery_json, 0, MQTT_QOS_PUBLISH, 1);
-        if (msg_id < 0) {
+        snprintf(topic, sizeof(topic), "%s/%s/%s_%s/%s/%s", homeassistant_prefix, HA_DEVICE_FAMILY_SENSOR, device_id, relay_key, metrics[m].metric, HA_DEVICE_CONFIG_PATH);
+        if (esp_mqtt_client_publish(mqtt_client, topic, discovery_json, 0, MQTT_QOS_PUBLISH, 1) < 0) {
             ESP_LOGW(TAG, "Discovery topic %s not published", topic);
             is_error = true;
         }
 
-        // Publish availability as "online"
-        char *ha_availability_entry_json = ha_availability_entry_print_JSON("online");
-        msg_id = esp_mqtt_client_publish(
-            mqtt_client,
-            entity_discovery->availability->topic,
-            ha_availability_entry_json,
-            0, MQTT_QOS_PUBLISH, 1);
-
-        if (msg_id < 0) {
-            ESP_LOGW(TAG, "Availability topic %s not published",
-                    entity_discovery->availability->topic);
-            is_error = true;
-        }
-
-        // Free allocated resources
-        free(ha_availability_entry_json);
         free(discovery_json);
-        free(relay_key);
-        relay_key = NULL;
-        ha_entity_discovery_free(entity_discovery);
-        free(entity_discovery);
-        entity_discovery = NULL;
-        // memset(entity_discovery, 0, sizeof(ha_entity_discovery_t)); // reset for next use
-
+        ha_entity_discovery_free(&entity_discovery);
     }
 
-    // free relays list only if not in-memory cache was used
-    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) ESP_ERROR_CHECK(free_relays_array(relay_list, total_count));
+    return is_error ? ESP_FAIL : ESP_OK;
+}
 
-    if (is_error) {
+/**
+ * @brief: Remove Home Assistant sensors of a unit: empty retained payload on their discovery config topics
+ * 
+ * @param[in] device_id Device ID
+ * @param[in] relay_key NVS key of the unit
+ * @param[in] homeassistant_prefix Home Assistant discovery prefix
+ * @param[in] metrics Sensors to remove
+ * @param[in] metrics_count Number of sensors
+ * 
+ * @return esp_err_t    ESP_OK on success, ESP_FAIL if any of the topics was not published.
+ */
+static esp_err_t mqtt_remove_ha_metrics_config(const char *device_id, const char *relay_key, const char *homeassistant_prefix,
+                                                const mqtt_ha_metric_t *metrics, size_t metrics_count) {
+    char topic[512];
+    bool is_error = false;
+
+    for (int m = 0; m < metrics_count; m++) {
+        snprintf(topic, sizeof(topic), "%s/%s/%s_%s/%s/%s", homeassistant_prefix, HA_DEVICE_FAMILY_SENSOR, device_id, relay_key, metrics[m].metric, HA_DEVICE_CONFIG_PATH);
+        if (esp_mqtt_client_publish(mqtt_client, topic, "", 0, MQTT_QOS_PUBLISH, 1) < 0) {
+            ESP_LOGW(TAG, "Discovery topic %s not cleared", topic);
+            is_error = true;
+        }
+    }
+
+    return is_error ? ESP_FAIL : ESP_OK;
+}
+
+/**
+ * @brief: Publish Home Assistant discovery config of a single relay unit
+ * 
+ * @param[in] device_id Device ID
+ * @param[in] relay The relay unit
+ * @param[in] homeassistant_prefix Home Assistant discovery prefix
+ * 
+ * @return esp_err_t    ESP_OK on success, ESP_FAIL if the config (or availability) was not published.
+ */
+static esp_err_t mqtt_publish_ha_unit_config(const char *device_id, const relay_unit_t *relay, const char *homeassistant_prefix) {
+    char topic[512];
+    char discovery_path[256];
+    int msg_id;
+    bool is_error = false;
+
+    // Get the NVS key for the relay
+    char *relay_key = get_unit_nvs_key(relay);
+    if (relay_key == NULL) {
+        ESP_LOGE(TAG, "Failed to get NVS key for relay channel %d.", relay->channel);
+        return ESP_FAIL;
+    }
+
+    // Pulse counters are read-only sensors with several metrics
+    if (relay->type == RELAY_TYPE_PULSE_COUNTER) {
+        esp_err_t err = mqtt_publish_ha_metrics_config(device_id, relay_key, relay->type, homeassistant_prefix,
+                                                        MQTT_HA_PULSE_COUNTER_METRICS, MQTT_HA_METRICS_COUNT(MQTT_HA_PULSE_COUNTER_METRICS));
+        free(relay_key);
+        return err;
+    }
+
+    // Actuators: wear counters as diagnostic sensors
+    if (relay->type == RELAY_TYPE_ACTUATOR
+        && mqtt_publish_ha_metrics_config(device_id, relay_key, relay->type, homeassistant_prefix,
+                                          MQTT_HA_ACTUATOR_WEAR_METRICS, MQTT_HA_METRICS_COUNT(MQTT_HA_ACTUATOR_WEAR_METRICS)) != ESP_OK) {
+        is_error = true;
+    }
+
+    // Initialize entity discovery structure
+    ha_entity_discovery_t *entity_discovery = (ha_entity_discovery_t *)malloc(sizeof(ha_entity_discovery_t));
+    if (entity_discovery == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for entity discovery object. Relay key: %s", relay_key);
+        free(relay_key);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Fill in HomeAssistant entity discovery structure for the relay
+    if (ha_entity_discovery_fullfill(entity_discovery, HA_DEVICE_DEVICE_CLASS, relay_key, HA_DEVICE_METRIC_STATE, relay->type) != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to initiate entity discovery for %s", HA_DEVICE_METRIC_STATE);
+        free(entity_discovery);
+        free(relay_key);
+        return ESP_FAIL;
+    }
+
+    // Serialize HomeAssistant discovery structure to JSON
+    char *discovery_json = ha_entity_discovery_print_JSON(entity_discovery);
+    ESP_LOGI(TAG, "Device discovery serialized:\n%s", discovery_json);
+
+    // Construct discovery topic and publish to MQTT
+    snprintf(discovery_path, sizeof(discovery_path), "%s/%s", homeassistant_prefix, HA_DEVICE_FAMILY);
+    snprintf(topic, sizeof(topic), "%s/%s_%s/%s/%s", discovery_path, device_id, relay_key, HA_DEVICE_FAMILY, HA_DEVICE_CONFIG_PATH);
+    msg_id = esp_mqtt_client_publish(mqtt_client, topic, discovery_json, 0, MQTT_QOS_PUBLISH, 1);
+    if (msg_id < 0) {
+        ESP_LOGW(TAG, "Discovery topic %s not published", topic);
+        is_error = true;
+    }
+
+    // Publish availability as "online"
+    char *ha_availability_entry_json = ha_availability_entry_print_JSON("online");
+    msg_id = esp_mqtt_client_publish(
+        mqtt_client,
+        entity_discovery->availability->topic,
+        ha_availability_entry_json,
+        0, MQTT_QOS_PUBLISH, 1);
+
+    if (msg_id < 0) {
+        ESP_LOGW(TAG, "Availability topic %s not published",
+                entity_discovery->availability->topic);
+        is_error = true;
+    }
+
+    // Free allocated resources
+    free(ha_availability_entry_json);
+    free(discovery_json);
+    free(relay_key);
+    ha_entity_discovery_free(entity_discovery);
+    free(entity_discovery);
+
+    return is_error ? ESP_FAIL : ESP_OK;
+}
+
+/**
+ * @brief: Remove Home Assistant entities of a relay unit: empty retained payload on its discovery config topic(s)
+ * 
+ * @param[in] device_id Device ID
+ * @param[in] relay The relay unit. Only type and channel are used, the unit doesn't have to be in memory.
+ * @param[in] homeassistant_prefix Home Assistant discovery prefix
+ * 
+ * @return esp_err_t    ESP_OK on success, ESP_FAIL if any of the topics was not published.
+ */
+static esp_err_t mqtt_remove_ha_unit_config(const char *device_id, const relay_unit_t *relay, const char *homeassistant_prefix) {
+    char topic[512];
+    bool is_error = false;
+
+    char *relay_key = get_unit_nvs_key(relay);
+    if (relay_key == NULL) {
+        ESP_LOGE(TAG, "Failed to get NVS key for relay channel %d.", relay->channel);
+        return ESP_FAIL;
+    }
+
+    if (relay->type == RELAY_TYPE_PULSE_COUNTER) {
+        is_error = mqtt_remove_ha_metrics_config(device_id, relay_key, homeassistant_prefix,
+                                                 MQTT_HA_PULSE_COUNTER_METRICS, MQTT_HA_METRICS_COUNT(MQTT_HA_PULSE_COUNTER_METRICS)) != ESP_OK;
+    } else {
+        snprintf(topic, sizeof(topic), "%s/%s/%s_%s/%s/%s", homeassistant_prefix, HA_DEVICE_FAMILY, device_id, relay_key, HA_DEVICE_FAMILY, HA_DEVICE_CONFIG_PATH);
+        if (esp_mqtt_client_publish(mqtt_client, topic, "", 0, MQTT_QOS_PUBLISH, 1) < 0) {
+            ESP_LOGW(TAG, "Discovery topic %s not cleared", topic);
+            is_error = true;
+        }
+        if (relay->type == RELAY_TYPE_ACTUATOR
+            && mqtt_remove_ha_metrics_config(device_id, relay_key, homeassistant_prefix,
+                                             MQTT_HA_ACTUATOR_WEAR_METRICS, MQTT_HA_METRICS_COUNT(MQTT_HA_ACTUATOR_WEAR_METRICS)) != ESP_OK) {
+            is_error = true;
+        }
+    }
+
+    ESP_LOGI(TAG, "Home Assistant entities of %s removed", relay_key);
+    free(relay_key);
+    return is_error ? ESP_FAIL : ESP_OK;
+}
+
+/**
+ * @brief: Task for regular device auto-discovery updates for Home Assistant
+ * 
+ * This function creates a task that periodically updates the Home Assistant device
+ * configuration in MQTT. The task reads the device ID, MQTT prefix, and Home Assistant
+ * prefix from NVS and uses them to publish the device configuration to MQTT. The task
+ * waits for the MQTT connection to become ready before publishing the configuration.
+ * 
+ * @param[in] param Unused task parameter.
+ * 
+ * @return esp_err_t    ESP_OK on success, ESP_FAIL if HA data connot be published.
+ */
+esp_err_t mqtt_publish_home_assistant_config(const char *device_id, const char *mqtt_prefix, const char *homeassistant_prefix) {
+    
+    // get random session id
+    uint32_t session_id = esp_random();
+    ESP_LOGI(TAG, "MQTT HASS Publish Session ID: %u", session_id);
+
+#if _DEVICE_ENGINEERING_BUILD
+    // dump relays from memory for debug
+    ESP_LOGI(TAG, "Dumping relay units in memory BEFORE publishing HASS Config to MQTT (%u):", session_id);
+    ESP_ERROR_CHECK(dump_relay_units_in_memory());
+#endif
+
+    uint16_t mqtt_connection_mode = mqtt_config_connection_mode();
+    if (mqtt_connection_mode < (uint16_t)MQTT_CONN_MODE_NO_RECONNECT) {
+        ESP_LOGW(TAG, "MQTT disabled in device settings. Publishing skipped.");
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "mqtt-hass: Waiting for MQTT connection to become ready...");
+
+    // Wait up to 10 seconds total
+    EventBits_t bits = xEventGroupWaitBits(
+        g_sys_events,             // event group handle
+        BIT_MQTT_CONNECTED | BIT_MQTT_READY,       // bit(s) to wait for
+        pdFALSE,                  // don't clear the bit on exit
+        pdTRUE,                   // wait for all bits (only one here)
+        pdMS_TO_TICKS(10000)      // timeout 10 seconds
+    );
+
+    if ((bits & BIT_MQTT_CONNECTED) && (bits & BIT_MQTT_READY)) {
+        ESP_LOGI(TAG, "mqtt-hass: MQTT connection is ready!");
+        // Continue normal operation
+    } else {
+        ESP_LOGE(TAG, "mqtt-hass: MQTT never became ready after 10 seconds");
+        return ESP_FAIL;
+    }
+    
+    bool is_error = false;
+
+    relay_unit_t *relay_list = NULL;
+    uint16_t total_count = 0;
+
+
+    // Load all relay units
+    esp_err_t err = get_all_relay_units(&relay_list, &total_count);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to load relay units from NVS.");
+        return err;
+    }
+    if (!total_count) {
+        ESP_LOGW(TAG, "No relays found to update HA auto-discovery records for.");
+        return ESP_OK;
+    }
+
+    // Iterate through each relay and publish to MQTT
+    for (uint16_t i = 0; i < total_count; i++) {
+        if (mqtt_publish_ha_unit_config(device_id, &relay_list[i], homeassistant_prefix) != ESP_OK) {
+            is_error = true;
+        }
+    }
+
+    free(relay_list);
+
+    if (is_error) {
         ESP_LOGE(TAG, "There were errors when publishing Home Assistant device configuration to MQTT.");
         return ESP_FAIL;
     } else {
@@ -948,27 +1202,24 @@ esp_err_t mqtt_publish_home_assistant_config(const char *device_id, const char *
  * @return void   This function does not return a value.
  */
 void mqtt_device_config_task(void *param) {
-    char *device_id = NULL;
-    char *mqtt_prefix = NULL;
-    char *ha_prefix = NULL;
+    mqtt_config_t config;
     uint32_t ha_upd_intervl;
     uint32_t ha_retry_interval = 5000;
     bool ha_update_successful = false;
 
     const char* LOG_TAG = "HA MQTT DEVICE";
       
-    // Load MQTT prefix from NVS
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, &mqtt_prefix));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id));
     ESP_ERROR_CHECK(nvs_read_uint32(S_NAMESPACE, S_KEY_HA_UPDATE_INTERVAL, &ha_upd_intervl));
-    ESP_ERROR_CHECK(nvs_read_string(S_NAMESPACE, S_KEY_HA_PREFIX, &ha_prefix));
 
     ESP_LOGI(LOG_TAG, "Starting HA MQTT device update task. Update interval: %lu minutes.", (uint32_t) ha_upd_intervl / 1000 / 60);
 
     while (true) {
+        // Prefixes and device ID are taken from the RAM snapshot on every pass, so changed settings apply on the next update
+        mqtt_config_get(&config);
+
         // Update Home Assistant device configuration
         ESP_LOGI(LOG_TAG, "Updating HA device configurations...");
-        if (mqtt_publish_home_assistant_config(device_id, mqtt_prefix, ha_prefix) != ESP_OK) {
+        if (mqtt_publish_home_assistant_config(config.device_id, config.mqtt_prefix, config.ha_prefix) != ESP_OK) {
             ha_update_successful = false;
             ESP_LOGI(LOG_TAG, "HA device configurations end up with errors. Will retry in %li seconds.", (uint32_t)ha_retry_interval/1000);
         } else {
@@ -979,10 +1230,6 @@ void mqtt_device_config_task(void *param) {
         // Wait for the defined interval before the next update
         vTaskDelay(ha_update_successful?ha_upd_intervl:ha_retry_interval);
     }
-
-    free(device_id);
-    free(mqtt_prefix);
-    free(ha_prefix);
 }
 
 /**
@@ -1034,20 +1281,121 @@ relay_unit_t *resolve_relay_from_topic(const char *topic) {
     return relay;
 }
 
+/**
+ * @brief: Locate the relay key in a topic of this device
+ * 
+ * The topic has to start with "<mqtt_prefix>/<device_id>/", both taken from the RAM snapshot, so
+ * a prefix with slashes in it is matched as a whole. The key is the following path element.
+ * 
+ * @param[in] topic The MQTT topic (not null-terminated).
+ * @param[in] topic_len Length of the topic.
+ * @param[out] key_len Length of the relay key.
+ * 
+ * @return const char*    Start of the relay key within the topic, NULL if the topic is not one of this device.
+ */
+static const char *mqtt_topic_unit_key(const char *topic, size_t topic_len, size_t *key_len) {
+    mqtt_config_t config;
+    mqtt_config_get(&config);
+
+    size_t prefix_len = strlen(config.mqtt_prefix);
+    size_t device_id_len = strlen(config.device_id);
+    if (topic_len < prefix_len + device_id_len + 2
+        || memcmp(topic, config.mqtt_prefix, prefix_len) != 0 || topic[prefix_len] != '/'
+        || memcmp(topic + prefix_len + 1, config.device_id, device_id_len) != 0 || topic[prefix_len + 1 + device_id_len] != '/') {
+        return NULL;
+    }
+
+    const char *key = topic + prefix_len + device_id_len + 2;
+    const char *end = topic + topic_len;
+    const char *key_end = memchr(key, '/', end - key);
+    *key_len = (key_end != NULL ? key_end : end) - key;
+    return key;
+}
+
 /**
  * @brief: Get relay key from MQTT topic
  * 
- * This function extracts the relay key from the MQTT topic. The function splits the topic
- * using '/' as a delimiter and retrieves the element at index 2. The function returns a
- * dynamically allocated string containing the relay key if successful, or NULL if the key
- * cannot be resolved. The caller is responsible for freeing the returned string.
+ * This function extracts the relay key from the MQTT topic: the path element following the MQTT prefix
+ * and device ID. The function returns a dynamically allocated string containing the relay key if successful,
+ * or NULL if the key cannot be resolved. The caller is responsible for freeing the returned string.
  * 
  * @param[in] topic The MQTT topic to extract the relay key from.
  * 
  * @return char*    A dynamically allocated string containing the relay key, or NULL if the key cannot be resolved.
  */
 char *resolve_key_from_topic(const char *topic) {
-    return get_element_from_path(topic, 2);
+    if (topic == NULL) {
+        return NULL;
+    }
+
+    size_t key_len = 0;
+    const char *key = mqtt_topic_unit_key(topic, strlen(topic), &key_len);
+    if (key == NULL || key_len == 0) {
+        return NULL;
+    }
+    return strndup(key, key_len);
+}
+
+/**
+ * @brief Parses JSON command payload, e.g. {"state":true,"pulse_ms":500}.
+ * 
+ * @param[in] data Payload (not null-terminated).
+ * @param[in] data_len Length of the payload.
+ * @param[out] command Command event to fill in: state and pulse_ms (left untouched if not given).
+ * 
+ * @return esp_err_t    ESP_OK on success, ESP_ERR_INVALID_ARG if the payload is not a valid command.
+ */
+static esp_err_t mqtt_parse_command_json(const char *data, int data_len, mqtt_command_event_t *command) {
+    cJSON *json = cJSON_ParseWithLength(data, data_len);
+    if (json == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = ESP_OK;
+    cJSON *state = cJSON_GetObjectItem(json, "state");
+    cJSON *pulse_ms = cJSON_GetObjectItem(json, "pulse_ms");
+    if (!cJSON_IsBool(state)) {
+        err = ESP_ERR_INVALID_ARG;
+    } else if (pulse_ms != NULL && (!cJSON_IsNumber(pulse_ms) || pulse_ms->valueint < 0 || pulse_ms->valueint > RELAY_PULSE_MS_MAX)) {
+        err = ESP_ERR_INVALID_ARG;
+    } else {
+        command->state = cJSON_IsTrue(state) ? RELAY_STATE_ON : RELAY_STATE_OFF;
+        if (pulse_ms != NULL) {
+            command->pulse_ms = pulse_ms->valueint;
+        }
+    }
+
+    cJSON_Delete(json);
+    return err;
+}
+
+/**
+ * @brief Resolves the relay unit handle from the MQTT command topic.
+ * 
+ * The relay key follows the MQTT prefix and device ID, e.g. "relay_board/DCDA0C7E08A4/relay_ch_1/switch/set".
+ * Unlike resolve_key_from_topic(), the topic does not have to be null-terminated and no memory is allocated.
+ * 
+ * @param[in] topic The MQTT topic (not null-terminated).
+ * @param[in] topic_len Length of the topic.
+ * @param[out] unit Handle of the relay unit.
+ * 
+ * @return esp_err_t    ESP_OK on success, error code if the unit cannot be resolved.
+ */
+static esp_err_t resolve_unit_handle_from_topic(const char *topic, int topic_len, unit_handle_t *unit) {
+    size_t key_len = 0;
+    const char *segment = mqtt_topic_unit_key(topic, (size_t)topic_len, &key_len);
+    if (segment == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char relay_key[NVS_KEY_NAME_MAX_SIZE];
+    if (key_len == 0 || key_len >= sizeof(relay_key)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(relay_key, segment, key_len);
+    relay_key[key_len] = '\0';
+
+    return get_unit_handle_from_key(relay_key, unit);
 }
 
 /**
@@ -1197,21 +1545,23 @@ void mqtt_subscribe_relays_task(void *arg) {
     while (1) {
         if (xQueueReceive(mqtt_command_queue, &event, portMAX_DELAY)) {
 
-            ESP_LOGI(TAG, "Recevied subscription event: key (%s), state (%i)", event.relay_key, (int)event.state);
+            ESP_LOGI(TAG, "Recevied subscription event: channel (%d), type (%d), state (%i)", event.unit.index, event.unit.type, (int)event.state);
 
-            relay_type_t relay_type = get_relay_type_from_key(event.relay_key);
-            if (relay_type != RELAY_TYPE_ACTUATOR) {
-                ESP_LOGW(TAG, "Wrong relay type got request for state update (key: %s, type: %i). Ignoring.", event.relay_key, relay_type);
-                free((void *)event.relay_key);
+            if (event.unit.type != RELAY_TYPE_ACTUATOR) {
+                ESP_LOGW(TAG, "Wrong relay type got request for state update (channel: %d, type: %i). Ignoring.", event.unit.index, event.unit.type);
                 continue;
             }
-            relay_unit_t *relay = NULL;
-            if (get_relay_actuator_from_memory_by_key(event.relay_key, &relay) == ESP_OK) {
-                ESP_ERROR_CHECK(relay_set_state(relay, event.state, true));  // Update the relay state
+            // Resolved and switched by the handle in one writer section: the unit may have moved since the command was queued.
+            // ON with a pulse width (given in the command or the unit's own) is timed on the device.
+            uint32_t pulse_ms = (event.pulse_ms != MQTT_COMMAND_PULSE_DEFAULT) ? (uint32_t)event.pulse_ms : RELAY_PULSE_MS_UNIT;
+            relay_command_t command = (event.state == RELAY_STATE_ON) ? RELAY_COMMAND_ON : RELAY_COMMAND_OFF;
+            esp_err_t err = relay_actuator_command(event.unit, command, pulse_ms, LATENCY_PATH_COMMAND, event.received_us, NULL);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to apply command to channel %d: %s", event.unit.index, esp_err_to_name(err));
+                continue;
             }
-            free((void *)event.relay_key);  // Free the allocated key
             if (INIT_RELAY_ON_LOAD) {
-                relay_gpio_deinit(relay);
+                relay_gpio_deinit_by_handle(event.unit);
             }
         }
     }
@@ -1239,15 +1589,7 @@ esp_err_t mqtt_relay_subscribe(relay_unit_t *relay) {
 
     ESP_LOGI(TAG, "Subscribe relay/sensor information to receive information from MQTT. Channel (%i), type (%i)", relay->channel, relay->type);
 
-    uint16_t mqtt_connection_mode;
-    esp_err_t err;
-
-    // Read MQTT connection mode
-    err = nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mqtt_connection_mode);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read MQTT connection mode from NVS");
-        return ESP_FAIL;
-    }
+    uint16_t mqtt_connection_mode = mqtt_config_connection_mode();
 
     // Check if MQTT is disabled in the device settings
     if (mqtt_connection_mode < (uint16_t)MQTT_CONN_MODE_NO_RECONNECT) {
@@ -1275,58 +1617,153 @@ esp_err_t mqtt_relay_subscribe(relay_unit_t *relay) {
         }
     }
 
-    // Allocate and read the MQTT prefix
-    char *mqtt_prefix = NULL;
-    err = nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, &mqtt_prefix);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read MQTT prefix from NVS");
-        return err;
-    }
-
-    // Allocate and read the device ID
-    char *device_id = NULL;
-    err = nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read device ID from NVS");
-        free(mqtt_prefix);  // Clean up previous allocation
-        return err;
-    }
-
-    // Allocate memory for the command topic
-    char *relay_key = get_unit_nvs_key(relay);
-    size_t topic_len = strlen(mqtt_prefix) + strlen(device_id) + strlen(relay_key) + strlen(HA_DEVICE_FAMILY) + strlen("/set") + 4; // extra for slashes and null terminator
-    char *command_topic = (char *)malloc(topic_len);
+    // Command topic comes from the topic table
+    int slot = mqtt_topic_slot(get_unit_handle(relay));
+    const topic_table_t *topics = mqtt_topics_acquire(slot);
+    const char *command_topic = topic_table_get(topics, slot, TOPIC_KIND_SET);
     if (command_topic == NULL) {
-        free(mqtt_prefix);
-        free(device_id);
-        ESP_LOGE(TAG, "Failed to allocate memory for command topic");
-        return ESP_ERR_NO_MEM;
+        ESP_LOGE(TAG, "No MQTT command topic for relay unit. Channel (%d), type (%d)", relay->channel, relay->type);
+        mqtt_topics_release(topics);
+        return ESP_ERR_NOT_FOUND;
     }
 
-    // Format the command topic
-    snprintf(command_topic, topic_len, "%s/%s/%s/%s/set", mqtt_prefix, device_id, relay_key, HA_DEVICE_FAMILY);
-
     // Subscribe to the command topic
     int msg_id = esp_mqtt_client_subscribe_single(mqtt_client, command_topic, MQTT_QOS_SUBSCRIBE);
     if (msg_id < 0) {
         ESP_LOGE(TAG, "Failed to subscribe to topic: %s", command_topic);
-        free(mqtt_prefix);
-        free(device_id);
-        free(command_topic);
+        mqtt_topics_release(topics);
         return ESP_FAIL;
     }
 
     ESP_LOGI(TAG, "Subscribed to topic: %s", command_topic);
 
-    // Free allocated memory for command topic
-    free(relay_key);
-    free(mqtt_prefix);
-    free(device_id);
-    free(command_topic);
+    mqtt_topics_release(topics);
 
     return ESP_OK;
 }
 
+/**
+ * @brief: Unsubscribe relay from its MQTT command topic
+ * 
+ * Counterpart of mqtt_relay_subscribe(), used when the unit is removed at runtime.
+ * 
+ * @param[in] relay The relay unit. Only type and channel are used, the unit doesn't have to be in memory.
+ * 
+ * @return esp_err_t    ESP_OK on success, ESP_FAIL if the relay cannot be unsubscribed.
+ */
+esp_err_t mqtt_relay_unsubscribe(const relay_unit_t *relay) {
+
+    if (relay == NULL) {
+        ESP_LOGE(TAG, "Got NULL as relay in mqtt_relay_unsubscribe.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (mqtt_client == NULL || !IS_MQTT_READY()) {
+        ESP_LOGW(TAG, "MQTT client is not connected. Nothing to unsubscribe from.");
+        return ESP_FAIL;
+    }
+
+    mqtt_config_t config;
+    mqtt_config_get(&config);
+
+    char *relay_key = get_unit_nvs_key(relay);
+    if (relay_key == NULL) {
+        return ESP_FAIL;
+    }
+
+    char command_topic[256];
+    snprintf(command_topic, sizeof(command_topic), "%s/%s/%s/%s/set", config.mqtt_prefix, config.device_id, relay_key, HA_DEVICE_FAMILY);
+
+    esp_err_t err = ESP_OK;
+    if (esp_mqtt_client_unsubscribe(mqtt_client, command_topic) < 0) {
+        ESP_LOGE(TAG, "Failed to unsubscribe from topic: %s", command_topic);
+        err = ESP_FAIL;
+    } else {
+        ESP_LOGI(TAG, "Unsubscribed from topic: %s", command_topic);
+    }
+
+    free(relay_key);
+
+    return err;
+}
+
+/**
+ * @brief: Update MQTT for the units added and removed by relay_units_reconfigure()
+ * 
+ * Only the delta is handled: removed units are unsubscribed and their Home Assistant entities are deleted, added units
+ * are subscribed, announced to Home Assistant and their state is published. If MQTT is not connected now, there's
+ * nothing to do: all units in memory are subscribed and published on (re)connect anyway.
+ * 
+ * @param[in] added Handles of the added units
+ * @param[in] added_count Number of added units
+ * @param[in] removed Handles of the removed units
+ * @param[in] removed_count Number of removed units
+ * 
+ * @return esp_err_t    ESP_OK on success, ESP_FAIL if any of the units was not updated.
+ */
+esp_err_t mqtt_units_reconfigured(const unit_handle_t *added, size_t added_count, const unit_handle_t *removed, size_t removed_count) {
+
+    mqtt_config_t config;
+    mqtt_config_get(&config);
+    if (config.connection_mode < (uint16_t)MQTT_CONN_MODE_NO_RECONNECT) {
+        return ESP_OK;
+    }
+    if (mqtt_client == NULL || !IS_MQTT_READY()) {
+        ESP_LOGW(TAG, "MQTT is not connected, reconfigured units will be synchronized on reconnect");
+        return ESP_OK;
+    }
+
+    bool is_error = false;
+
+#if _DEVICE_ENABLE_HA
+    const char *device_id = config.device_id;
+    const char *ha_prefix = config.ha_prefix;
+    bool ha_ready = (device_id[0] != '\0' && ha_prefix[0] != '\0');
+#endif
+
+    for (size_t i = 0; i < removed_count; i++) {
+        relay_unit_t relay = {0};
+        relay.type = (relay_type_t)removed[i].type;
+        relay.channel = removed[i].index;
+
+        if (mqtt_relay_unsubscribe(&relay) != ESP_OK) {
+            is_error = true;
+        }
+#if _DEVICE_ENABLE_HA
+        if (ha_ready && mqtt_remove_ha_unit_config(device_id, &relay, ha_prefix) != ESP_OK) {
+            is_error = true;
+        }
+#endif
+    }
+
+    // removed units are unsubscribed with their old topics, now the table follows the new set of units
+    mqtt_topics_invalidate();
+    mqtt_published_invalidate();
+
+    for (size_t i = 0; i < added_count; i++) {
+        relay_unit_t snapshot;
+        if (relay_unit_snapshot_by_handle(added[i], &snapshot) != ESP_OK) {
+            is_error = true;
+            continue;
+        }
+
+        if (mqtt_relay_subscribe(&snapshot) != ESP_OK) {
+            is_error = true;
+        }
+#if _DEVICE_ENABLE_HA
+        if (ha_ready && mqtt_publish_ha_unit_config(device_id, &snapshot, ha_prefix) != ESP_OK) {
+            is_error = true;
+        }
+#endif
+        if (trigger_mqtt_publish(added[i]) != ESP_OK) {
+            is_error = true;
+        }
+    }
+
+    ESP_LOGI(TAG, "MQTT updated for reconfigured units: %d subscribed, %d unsubscribed%s", (int)added_count, (int)removed_count, is_error ? " (with errors)" : "");
+    return is_error ? ESP_FAIL : ESP_OK;
+}
+
 /**
  * @brief: Validate MQTT connection mode value
  * 
@@ -1340,4 +1777,530 @@ esp_err_t mqtt_relay_subscribe(relay_unit_t *relay) {
 bool mqtt_conn_mode_is_valid(int v)
 {
     return (v >= MQTT_CONN_MODE_DISABLE) && (v <= MQTT_CONN_MODE_AUTOCONNECT);
-}
\ No newline at end of file
+}
+/**
+ * @brief: Validate MQTT publish profile value
+ * 
+ * @param[in] v The MQTT publish profile value to validate.
+ * 
+ * @return bool   true if the value is a mqtt_publish_profile_t, false otherwise.
+ */
+bool mqtt_publish_profile_is_valid(int v)
+{
+    return (v >= MQTT_PUBLISH_PROFILE_LEGACY) && (v <= MQTT_PUBLISH_PROFILE_STATE);
+}
+
+/**
+ * @brief: Rebuild the RAM snapshot of the MQTT settings from NVS
+ * 
+ * Called on first use and by apply_setting() when the connection mode, the publish profile, the heartbeat
+ * interval, the MQTT or Home Assistant prefix is changed. The values are read outside of the lock, then swapped in at once, so a reader
+ * never sees a prefix of one snapshot and a device ID of another.
+ * 
+ * @return esp_err_t    ESP_OK on success, error code of the failed NVS read otherwise (the previous snapshot is kept).
+ */
+esp_err_t mqtt_config_reload(void) {
+    if (s_mqtt_topics_build_lock == NULL) {
+        // first load on boot, before any task uses MQTT
+        s_mqtt_topics_build_lock = xSemaphoreCreateMutex();
+    }
+
+    mqtt_config_t config = {0};
+    char *mqtt_prefix = NULL;
+    char *device_id = NULL;
+    char *ha_prefix = NULL;
+    uint32_t nvs_reads = 0;
+    esp_err_t err;
+
+    err = nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &config.connection_mode);
+    nvs_reads++;
+    if (err == ESP_OK) {
+        err = nvs_read_string(S_NAMESPACE, S_KEY_MQTT_PREFIX, &mqtt_prefix);
+        nvs_reads++;
+    }
+    if (err == ESP_OK) {
+        err = nvs_read_string(S_NAMESPACE, S_KEY_DEVICE_ID, &device_id);
+        nvs_reads++;
+    }
+    if (err == ESP_OK) {
+        err = nvs_read_string(S_NAMESPACE, S_KEY_HA_PREFIX, &ha_prefix);
+        nvs_reads++;
+    }
+    if (err == ESP_OK) {
+        err = nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_PUBLISH_PROFILE, &config.publish_profile);
+        nvs_reads++;
+    }
+    if (err == ESP_OK) {
+        err = nvs_read_uint32(S_NAMESPACE, S_KEY_MQTT_HEARTBEAT_INTERVAL, &config.heartbeat_interval);
+        nvs_reads++;
+    }
+
+    if (err == ESP_OK) {
+        strlcpy(config.mqtt_prefix, mqtt_prefix, sizeof(config.mqtt_prefix));
+        strlcpy(config.device_id, device_id, sizeof(config.device_id));
+        strlcpy(config.ha_prefix, ha_prefix, sizeof(config.ha_prefix));
+    }
+    free(mqtt_prefix);
+    free(device_id);
+    free(ha_prefix);
+
+    taskENTER_CRITICAL(&s_mqtt_config_mux);
+    s_mqtt_stats.config_nvs_reads += nvs_reads;
+    if (err == ESP_OK) {
+        config.generation = s_mqtt_config.generation + 1;
+        s_mqtt_config = config;
+        s_mqtt_stats.config_reloads++;
+    }
+    taskEXIT_CRITICAL(&s_mqtt_config_mux);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to load MQTT settings from NVS: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // topics are built from the prefix and device ID, the publish profile decides what was published
+    mqtt_topics_invalidate();
+    mqtt_published_invalidate();
+
+    ESP_LOGI(TAG, "MQTT settings loaded: mode (%u), prefix (%s), device ID (%s), Home Assistant prefix (%s), publish profile (%u), heartbeat (%lu ms)",
+             config.connection_mode, config.mqtt_prefix, config.device_id, config.ha_prefix, config.publish_profile, (unsigned long)config.heartbeat_interval);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Copy the RAM snapshot of the MQTT settings, loading it first if it wasn't yet
+ * 
+ * @param[out] config Snapshot copy. Zeroed (MQTT disabled, empty strings) if the settings can't be loaded.
+ */
+static void mqtt_config_get(mqtt_config_t *config) {
+    taskENTER_CRITICAL(&s_mqtt_config_mux);
+    bool loaded = (s_mqtt_config.generation != 0);
+    taskEXIT_CRITICAL(&s_mqtt_config_mux);
+
+    if (!loaded) {
+        mqtt_config_reload();
+    }
+
+    taskENTER_CRITICAL(&s_mqtt_config_mux);
+    *config = s_mqtt_config;
+    taskEXIT_CRITICAL(&s_mqtt_config_mux);
+}
+
+/**
+ * @brief: MQTT connection mode from the RAM snapshot
+ * 
+ * @return uint16_t    mqtt_connection_mode_t value, MQTT_CONN_MODE_DISABLE if the settings can't be loaded.
+ */
+uint16_t mqtt_config_connection_mode(void) {
+    taskENTER_CRITICAL(&s_mqtt_config_mux);
+    bool loaded = (s_mqtt_config.generation != 0);
+    uint16_t mode = s_mqtt_config.connection_mode;
+    taskEXIT_CRITICAL(&s_mqtt_config_mux);
+
+    if (!loaded) {
+        mqtt_config_reload();
+        taskENTER_CRITICAL(&s_mqtt_config_mux);
+        mode = s_mqtt_config.connection_mode;
+        taskEXIT_CRITICAL(&s_mqtt_config_mux);
+    }
+    return mode;
+}
+
+/**
+ * @brief: MQTT heartbeat interval from the RAM snapshot
+ * 
+ * @return uint32_t    Milliseconds between publishes of unchanged units, 0 if the settings can't be loaded.
+ */
+uint32_t mqtt_config_heartbeat_interval(void) {
+    mqtt_config_t config;
+    mqtt_config_get(&config);
+    return config.heartbeat_interval;
+}
+
+/**
+ * @brief: Count a relay publish and the time it took
+ * 
+ * @param[in] started_us Time the publish started, esp_timer_get_time() based.
+ */
+static void mqtt_stats_record_publish(int64_t started_us) {
+    int64_t elapsed_us = esp_timer_get_time() - started_us;
+    uint32_t elapsed = (elapsed_us > UINT32_MAX) ? UINT32_MAX : (uint32_t)elapsed_us;
+
+    taskENTER_CRITICAL(&s_mqtt_config_mux);
+    s_mqtt_stats.publishes++;
+    s_mqtt_stats.publish_us_total += elapsed;
+    if (elapsed > s_mqtt_stats.publish_us_max) {
+        s_mqtt_stats.publish_us_max = elapsed;
+    }
+    taskEXIT_CRITICAL(&s_mqtt_config_mux);
+}
+
+/**
+ * @brief: Publish a value with the default QoS and count it
+ * 
+ * @param[in] topic Topic to publish to
+ * @param[in] payload NUL-terminated payload
+ * @param[in] retain Retain flag of the message
+ * 
+ * @return bool    true if the client accepted the message, false otherwise.
+ */
+static bool mqtt_publish_value(const char *topic, const char *payload, int retain) {
+    ESP_LOGI(TAG, "Publish value (%s) to topic (%s)", payload, topic);
+    int msg_id = esp_mqtt_client_publish(mqtt_client, topic, payload, 0, MQTT_QOS_PUBLISH, retain);
+    if (msg_id < 0) {
+        ESP_LOGW(TAG, "Topic %s not published", topic);
+        return false;
+    }
+
+    mqtt_stats_record_message(topic, payload);
+    return true;
+}
+
+/**
+ * @brief: Count a message handed to the MQTT client
+ * 
+ * @param[in] topic Topic of the message
+ * @param[in] payload NUL-terminated payload
+ */
+static void mqtt_stats_record_message(const char *topic, const char *payload) {
+    size_t bytes = strlen(topic) + strlen(payload);
+    taskENTER_CRITICAL(&s_mqtt_config_mux);
+    s_mqtt_stats.messages_sent++;
+    s_mqtt_stats.message_bytes += bytes;
+    taskEXIT_CRITICAL(&s_mqtt_config_mux);
+}
+
+/**
+ * @brief: Forget all payloads published, everything is published again on next refresh
+ */
+static void mqtt_published_invalidate(void) {
+    taskENTER_CRITICAL(&s_mqtt_config_mux);
+    s_mqtt_published_epoch++;
+    taskEXIT_CRITICAL(&s_mqtt_config_mux);
+}
+
+/**
+ * @brief: Publish all units and system fields on their next refresh, changed or not
+ * 
+ * Called every heartbeat interval by the refresh task, so consumers that missed the retained
+ * messages (or the non-retained legacy ones) still converge.
+ */
+void mqtt_publish_heartbeat(void) {
+    taskENTER_CRITICAL(&s_mqtt_config_mux);
+    s_mqtt_stats.heartbeats++;
+    taskEXIT_CRITICAL(&s_mqtt_config_mux);
+
+    mqtt_published_invalidate();
+}
+
+/**
+ * @brief: Check whether a payload differs from the one last published on its topic
+ * 
+ * @param[in] last Digest and epoch stored when the topic was last published
+ * @param[in] payload NUL-terminated payload to publish
+ * @param[out] current Digest and epoch of the payload, to be stored in place of last once it is published
+ * 
+ * @return bool    true if the payload has to be published, false if the broker already has it.
+ */
+static bool mqtt_published_changed(const mqtt_published_t *last, const char *payload, mqtt_published_t *current) {
+    // FNV-1a
+    uint32_t digest = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)payload; *p != '\0'; p++) {
+        digest = (digest ^ *p) * 16777619u;
+    }
+
+    taskENTER_CRITICAL(&s_mqtt_config_mux);
+    current->digest = digest;
+    current->epoch = s_mqtt_published_epoch;
+    taskEXIT_CRITICAL(&s_mqtt_config_mux);
+
+    return (last->epoch != current->epoch) || (last->digest != current->digest);
+}
+
+/**
+ * @brief: Publish a system information field, unless the broker already has its value
+ * 
+ * @param[in] field The field
+ * @param[in] topic Topic of the field
+ * @param[in] value NUL-terminated value
+ * 
+ * @return bool    true if published or unchanged, false if the client didn't accept the message.
+ */
+static bool mqtt_publish_system_field(mqtt_system_field_t field, const char *topic, const char *value) {
+    mqtt_published_t published;
+    if (!mqtt_published_changed(&s_mqtt_system_published[field], value, &published)) {
+        taskENTER_CRITICAL(&s_mqtt_config_mux);
+        s_mqtt_stats.messages_suppressed++;
+        taskEXIT_CRITICAL(&s_mqtt_config_mux);
+        return true;
+    }
+
+    if (!mqtt_publish_value(topic, value, 0)) {
+        return false;
+    }
+    s_mqtt_system_published[field] = published;
+    return true;
+}
+
+/**
+ * @brief: Number of messages a unit refresh takes with a publish profile
+ * 
+ * @param[in] profile Publish profile
+ * @param[in] type Type of the unit
+ * 
+ * @return int    Messages published for the unit when it changed.
+ */
+static int mqtt_profile_unit_messages(mqtt_publish_profile_t profile, relay_type_t type) {
+    switch (profile) {
+    case MQTT_PUBLISH_PROFILE_JSON:
+        return 1;   // JSON
+    case MQTT_PUBLISH_PROFILE_STATE:
+        return 2;   // state, JSON
+    default:
+        // JSON, state, channel, inverted, gpio_pin, enabled, type, and count, rate of pulse counters
+        return (type == RELAY_TYPE_PULSE_COUNTER) ? 9 : 7;
+    }
+}
+
+/**
+ * @brief: MQTT hot path counters as JSON
+ * 
+ * @return cJSON*    JSON object, NULL on allocation failure. The caller owns it.
+ */
+cJSON *mqtt_stats_to_JSON(void) {
+    mqtt_stats_t stats;
+    uint32_t generation;
+    size_t topics_size = 0;
+    uint16_t topics_units = 0;
+
+    pending_set_t pending;
+    taskENTER_CRITICAL(&s_mqtt_pending_mux);
+    pending = s_mqtt_pending;
+    taskEXIT_CRITICAL(&s_mqtt_pending_mux);
+
+    taskENTER_CRITICAL(&s_mqtt_config_mux);
+    stats = s_mqtt_stats;
+    generation = s_mqtt_config.generation;
+    if (s_mqtt_topics != NULL) {
+        topics_size = s_mqtt_topics->table.size;
+        topics_units = s_mqtt_topics->table.units;
+    }
+    taskEXIT_CRITICAL(&s_mqtt_config_mux);
+
+    cJSON *root = cJSON_CreateObject();
+    if (root == NULL) {
+        return NULL;
+    }
+    cJSON_AddNumberToObject(root, "config_generation", generation);
+    cJSON_AddNumberToObject(root, "config_reloads", stats.config_reloads);
+    cJSON_AddNumberToObject(root, "config_nvs_reads", stats.config_nvs_reads);
+    cJSON_AddNumberToObject(root, "publishes", stats.publishes);
+    cJSON_AddNumberToObject(root, "publish_us_avg", stats.publishes ? (double)(stats.publish_us_total / stats.publishes) : 0);
+    cJSON_AddNumberToObject(root, "publish_us_max", stats.publish_us_max);
+    cJSON_AddNumberToObject(root, "units_sent", stats.units_sent);
+    cJSON_AddNumberToObject(root, "units_suppressed", stats.units_suppressed);
+    cJSON_AddNumberToObject(root, "messages_sent", stats.messages_sent);
+    cJSON_AddNumberToObject(root, "message_bytes", (double)stats.message_bytes);
+    cJSON_AddNumberToObject(root, "messages_suppressed", stats.messages_suppressed);
+    cJSON_AddNumberToObject(root, "heartbeats", stats.heartbeats);
+    cJSON_AddNumberToObject(root, "pending_marks", pending.marks);
+    cJSON_AddNumberToObject(root, "pending_coalesced", pending.coalesced);
+    cJSON_AddNumberToObject(root, "publish_passes", pending.passes);
+    cJSON_AddNumberToObject(root, "publish_pass_units_max", pending.pass_units_max);
+    cJSON_AddNumberToObject(root, "topic_table_units", topics_units);
+    cJSON_AddNumberToObject(root, "topic_table_bytes", topics_size);
+    return root;
+}
+
+/**
+ * @brief: Topic table slot of a unit: actuators, then contact sensors, then pulse counters, by channel
+ * 
+ * @param[in] unit Handle of the unit
+ * 
+ * @return int    Slot, -1 if the handle is out of range.
+ */
+static int mqtt_topic_slot(unit_handle_t unit) {
+    switch ((relay_type_t)unit.type) {
+        case RELAY_TYPE_ACTUATOR:
+            return (unit.index <= CHANNEL_COUNT_MAX) ? unit.index : -1;
+        case RELAY_TYPE_SENSOR:
+            return (unit.index <= CONTACT_SENSORS_COUNT_MAX) ? MQTT_TOPIC_SLOTS_ACTUATORS + unit.index : -1;
+        case RELAY_TYPE_PULSE_COUNTER:
+            return (unit.index <= PULSE_COUNTERS_COUNT_MAX) ? MQTT_TOPIC_SLOTS_ACTUATORS + MQTT_TOPIC_SLOTS_SENSORS + unit.index : -1;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * @brief: Unit of a topic table slot, the inverse of mqtt_topic_slot()
+ * 
+ * @param[in] slot Topic table slot
+ * @param[out] unit Handle of the unit
+ * 
+ * @return esp_err_t    ESP_OK on success, ESP_ERR_INVALID_ARG if the slot is out of range.
+ */
+static esp_err_t mqtt_topic_slot_unit(int slot, unit_handle_t *unit) {
+    if (slot < 0 || slot >= MQTT_TOPIC_SLOTS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (slot < MQTT_TOPIC_SLOTS_ACTUATORS) {
+        unit->type = RELAY_TYPE_ACTUATOR;
+        unit->index = (uint8_t)slot;
+    } else if (slot < MQTT_TOPIC_SLOTS_ACTUATORS + MQTT_TOPIC_SLOTS_SENSORS) {
+        unit->type = RELAY_TYPE_SENSOR;
+        unit->index = (uint8_t)(slot - MQTT_TOPIC_SLOTS_ACTUATORS);
+    } else {
+        unit->type = RELAY_TYPE_PULSE_COUNTER;
+        unit->index = (uint8_t)(slot - MQTT_TOPIC_SLOTS_ACTUATORS - MQTT_TOPIC_SLOTS_SENSORS);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief: Build the topic table from the units in memory and the settings snapshot, and make it current
+ * 
+ * Builds are serialized by the caller. Publishes still using the previous table keep it until they release it.
+ * 
+ * @return esp_err_t    ESP_OK on success, ESP_ERR_INVALID_STATE if the units are not loaded yet, ESP_ERR_NO_MEM otherwise.
+ */
+static esp_err_t mqtt_topics_rebuild(void) {
+    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    mqtt_config_t config;
+    mqtt_config_get(&config);
+
+    topic_unit_spec_t specs[MQTT_TOPIC_SLOTS];
+    char keys[MQTT_TOPIC_SLOTS][NVS_KEY_NAME_MAX_SIZE];
+    size_t count = 0;
+    relay_unit_t *relay = NULL;
+
+    for (int i = 0; count < MQTT_TOPIC_SLOTS && get_relay_unit_from_memory_by_index(i, &relay) == ESP_OK; i++) {
+        int slot = mqtt_topic_slot(get_unit_handle(relay));
+        char *key = get_unit_nvs_key(relay);
+        if (slot < 0 || key == NULL) {
+            free(key);
+            continue;
+        }
+        strlcpy(keys[count], key, sizeof(keys[count]));
+        free(key);
+
+        specs[count].slot = (uint16_t)slot;
+        specs[count].kinds = (relay->type == RELAY_TYPE_PULSE_COUNTER) ? TOPIC_KINDS_ALL : TOPIC_KINDS_BASIC;
+        specs[count].key = keys[count];
+        specs[count].state_path = (relay->type == RELAY_TYPE_ACTUATOR) ? HA_DEVICE_STATE_PATH_RELAY : HA_DEVICE_STATE_PATH_SENSOR;
+        specs[count].command_path = HA_DEVICE_FAMILY;
+        count++;
+    }
+
+    mqtt_topics_t *topics = calloc(1, sizeof(mqtt_topics_t));
+    if (topics == NULL
+        || !topic_table_build(&topics->table, config.mqtt_prefix, config.device_id, HA_DEVICE_STATUS_PATH, specs, count, MQTT_TOPIC_SLOTS)) {
+        ESP_LOGE(TAG, "Unable to build MQTT topic table for %d units", (int)count);
+        free(topics);
+        return ESP_ERR_NO_MEM;
+    }
+    topics->refs = 1;
+    topics->config_generation = config.generation;
+
+    taskENTER_CRITICAL(&s_mqtt_config_mux);
+    mqtt_topics_t *previous = s_mqtt_topics;
+    s_mqtt_topics = topics;
+    taskEXIT_CRITICAL(&s_mqtt_config_mux);
+
+    if (previous != NULL) {
+        mqtt_topics_release(&previous->table);
+    }
+
+    ESP_LOGI(TAG, "MQTT topic table built: %d units, %d bytes", (int)count, (int)topics->table.size);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Take a reference to the current topic table if it has the topics of the unit
+ * 
+ * @param[in] slot Slot of the unit, -1 to take any table
+ * 
+ * @return mqtt_topics_t*    The table, NULL if there's none or the unit has no topics in it.
+ */
+static mqtt_topics_t *mqtt_topics_ref(int slot) {
+    mqtt_topics_t *topics = NULL;
+
+    taskENTER_CRITICAL(&s_mqtt_config_mux);
+    // a table built from older settings, e.g. by a rebuild racing with a settings change, is never handed out
+    if (s_mqtt_topics != NULL && s_mqtt_topics->config_generation == s_mqtt_config.generation
+        && (slot < 0 || topic_table_get(&s_mqtt_topics->table, (uint16_t)slot, TOPIC_KIND_JSON) != NULL)) {
+        topics = s_mqtt_topics;
+        topics->refs++;
+    }
+    taskEXIT_CRITICAL(&s_mqtt_config_mux);
+
+    return topics;
+}
+
+/**
+ * @brief: Get the topic table for lookups, building it first if needed
+ * 
+ * The table is (re)built if there's none or the unit in the given slot has no topics yet, e.g. it was added
+ * and the table not yet invalidated. No lock is held while the topics are in use, so a publish never blocks
+ * a rebuild or the MQTT client. Every call must be followed by mqtt_topics_release().
+ * 
+ * @param[in] slot Slot of the unit that will be looked up, -1 if none
+ * 
+ * @return const topic_table_t*    The table, never NULL. Lookups return NULL if it couldn't be built.
+ */
+static const topic_table_t *mqtt_topics_acquire(int slot) {
+    mqtt_topics_t *topics = mqtt_topics_ref(slot);
+
+    if (topics == NULL) {
+        xSemaphoreTake(s_mqtt_topics_build_lock, portMAX_DELAY);
+        // another task may have built it meanwhile
+        topics = mqtt_topics_ref(slot);
+        if (topics == NULL) {
+            mqtt_topics_rebuild();
+            topics = mqtt_topics_ref(-1);
+        }
+        xSemaphoreGive(s_mqtt_topics_build_lock);
+    }
+
+    return (topics != NULL) ? &topics->table : &s_mqtt_topics_none.table;
+}
+
+/**
+ * @brief: Release the topic table taken by mqtt_topics_acquire(), it is freed with the last reference
+ * 
+ * @param[in] table The table
+ */
+static void mqtt_topics_release(const topic_table_t *table) {
+    mqtt_topics_t *topics = (mqtt_topics_t *)table;     // table is the first member
+    if (topics == &s_mqtt_topics_none) {
+        return;
+    }
+
+    taskENTER_CRITICAL(&s_mqtt_config_mux);
+    bool last = (--topics->refs == 0);
+    taskEXIT_CRITICAL(&s_mqtt_config_mux);
+
+    if (last) {
+        topic_table_free(&topics->table);
+        free(topics);
+    }
+}
+
+/**
+ * @brief: Drop the current topic table, it is built again on next use
+ * 
+ * Called when the units or the MQTT settings change.
+ */
+static void mqtt_topics_invalidate(void) {
+    taskENTER_CRITICAL(&s_mqtt_config_mux);
+    mqtt_topics_t *previous = s_mqtt_topics;
+    s_mqtt_topics = NULL;
+    taskEXIT_CRITICAL(&s_mqtt_config_mux);
+
+    if (previous != NULL) {
+        mqtt_topics_release(&previous->table);
+    }
+}
@@ -9,6 +9,8 @@
 #include "mqtt_client.h"
 #include "relay.h"
 #include "status.h"
+#include "latency.h"
+#include "topic_table.h"
 
 #define MQTT_QOS_DEFAULT    0
 #define MQTT_QOS_SUBSCRIBE  1
@@ -32,30 +34,91 @@ typedef enum {
 } mqtt_connection_mode_t;
 
 /**
- * @brief: Event data used to communicate between MQTT publishing event queue and other tasks
+ * @brief: What is published when a unit or the system information changed
+ */
+typedef enum {
+    MQTT_PUBLISH_PROFILE_LEGACY = 0,      // JSON topic plus a topic per field (state, channel, inverted, ...)
+    MQTT_PUBLISH_PROFILE_JSON,            // JSON topic only
+    MQTT_PUBLISH_PROFILE_STATE,           // state topic and JSON topic
+} mqtt_publish_profile_t;
+
+/**
+ * @brief: System information fields published one per topic by the legacy profile
+ */
+typedef enum {
+    MQTT_SYSTEM_FIELD_UPTIME = 0,
+    MQTT_SYSTEM_FIELD_FREE_HEAP,
+    MQTT_SYSTEM_FIELD_MIN_FREE_HEAP,
+    MQTT_SYSTEM_FIELD_MEMGUARD_THRESHOLD,
+    MQTT_SYSTEM_FIELD_MEMGUARD_MODE,
+    MQTT_SYSTEM_FIELD_MAX
+} mqtt_system_field_t;
+
+/**
+ * @brief: Latency trace of a pending publish of a unit
  */
 typedef struct {
-    char *relay_key;            // Relay key (dynamically allocated or stored)
-    relay_type_t relay_type;    // Type of relay (e.g., actuator or sensor)
-} relay_event_t;
+    uint8_t latency_path;       // latency_path_t of the oldest traced change not published yet, LATENCY_PATH_NONE if none
+    int64_t origin_us;          // Time the change originated (GPIO ISR or MQTT command receipt)
+    int64_t enqueued_us;        // Time the unit was marked for publishing
+} mqtt_publish_trace_t;
 
 /**
  * @brief: Event data used to communicate between MQTT subscription event queue and other tasks
  */
 typedef struct {
-    char *relay_key;
+    unit_handle_t unit;
     relay_state_t state;
+    int32_t pulse_ms;           // Pulse width given in the command, MQTT_COMMAND_PULSE_DEFAULT if not given
+    int64_t received_us;        // Time the command was received (MQTT_EVENT_DATA)
 } mqtt_command_event_t;
 
+#define MQTT_COMMAND_PULSE_DEFAULT  (-1)    // Command has no pulse_ms: unit's own pulse_ms applies
+
+/**
+ * @brief: Read-only Home Assistant sensor taking its value from the unit's JSON topic
+ */
+typedef struct {
+    const char *metric;             // JSON field of the unit, also the entity key suffix
+    const char *device_class;       // "" if none
+    const char *state_class;        // NULL if not applicable
+    const char *unit_of_measurement;    // NULL if not applicable
+    const char *entity_category;    // NULL for a primary entity
+    const char *value_template;     // NULL for the plain JSON field
+} mqtt_ha_metric_t;
+
+/**
+ * @brief: RAM snapshot of the MQTT settings, defined in mqtt.c
+ */
+typedef struct mqtt_config mqtt_config_t;
+
+/**
+ * @brief: Reference counted MQTT topic table, defined in mqtt.c
+ */
+typedef struct mqtt_topics mqtt_topics_t;
+
+/**
+ * @brief: Digest of the payload last published on a topic, defined in mqtt.c
+ */
+typedef struct mqtt_published mqtt_published_t;
+
 #define MQTT_QUEUE_LENGTH 10  // Number of items the queue can hold
 
+/* Topic table slots: every possible unit has a fixed slot, by type and channel */
+#define MQTT_TOPIC_SLOTS_ACTUATORS      (CHANNEL_COUNT_MAX + 1)
+#define MQTT_TOPIC_SLOTS_SENSORS        (CONTACT_SENSORS_COUNT_MAX + 1)
+#define MQTT_TOPIC_SLOTS_PULSE_COUNTERS (PULSE_COUNTERS_COUNT_MAX + 1)
+#define MQTT_TOPIC_SLOTS                (MQTT_TOPIC_SLOTS_ACTUATORS + MQTT_TOPIC_SLOTS_SENSORS + MQTT_TOPIC_SLOTS_PULSE_COUNTERS)
+
 static void log_error_if_nonzero(const char *message, int error_code);
 
 esp_err_t start_mqtt_queue_task(void);
 
 void mqtt_event_task(void *arg);
 
-esp_err_t trigger_mqtt_publish(const char *relay_key, relay_type_t relay_type);
+esp_err_t trigger_mqtt_publish(unit_handle_t unit);
+esp_err_t trigger_mqtt_publish_traced(unit_handle_t unit, latency_path_t path, int64_t origin_us);
+esp_err_t trigger_mqtt_publish_units(const unit_handle_t *units, size_t count);
 
 // init MQTT connection
 esp_err_t mqtt_init(void);
@@ -73,16 +136,50 @@ esp_err_t mqtt_publish_relay_data(const relay_unit_t *relay);
 esp_err_t mqtt_publish_system_info(device_status_t *status);
 
 esp_err_t mqtt_publish_home_assistant_config(const char *device_id, const char *mqtt_prefix, const char *homeassistant_prefix);
+static esp_err_t mqtt_publish_ha_metrics_config(const char *device_id, const char *relay_key, relay_type_t relay_type, const char *homeassistant_prefix,
+                                                const mqtt_ha_metric_t *metrics, size_t metrics_count);
+static esp_err_t mqtt_remove_ha_metrics_config(const char *device_id, const char *relay_key, const char *homeassistant_prefix,
+                                                const mqtt_ha_metric_t *metrics, size_t metrics_count);
+static esp_err_t mqtt_publish_ha_unit_config(const char *device_id, const relay_unit_t *relay, const char *homeassistant_prefix);
+static esp_err_t mqtt_remove_ha_unit_config(const char *device_id, const relay_unit_t *relay, const char *homeassistant_prefix);
 void mqtt_device_config_task(void *param);
 
 void mqtt_subscribe_relays_task(void *arg);
 relay_unit_t *resolve_relay_from_topic(const char *topic);
 char *resolve_key_from_topic(const char *topic);
+static const char *mqtt_topic_unit_key(const char *topic, size_t topic_len, size_t *key_len);
+static esp_err_t resolve_unit_handle_from_topic(const char *topic, int topic_len, unit_handle_t *unit);
+static esp_err_t mqtt_parse_command_json(const char *data, int data_len, mqtt_command_event_t *command);
 char *get_element_from_path(const char *path, int index);
 char** str_split(char* a_str, const char a_delim, size_t *element_count);
 
 esp_err_t mqtt_relay_subscribe(relay_unit_t *relay);
+esp_err_t mqtt_relay_unsubscribe(const relay_unit_t *relay);
+esp_err_t mqtt_units_reconfigured(const unit_handle_t *added, size_t added_count, const unit_handle_t *removed, size_t removed_count);
 
 bool mqtt_conn_mode_is_valid(int v);
+bool mqtt_publish_profile_is_valid(int v);
+
+esp_err_t mqtt_config_reload(void);
+uint16_t mqtt_config_connection_mode(void);
+uint32_t mqtt_config_heartbeat_interval(void);
+static void mqtt_config_get(mqtt_config_t *config);
+static void mqtt_stats_record_publish(int64_t started_us);
+static void mqtt_stats_record_message(const char *topic, const char *payload);
+static bool mqtt_publish_value(const char *topic, const char *payload, int retain);
+static void mqtt_published_invalidate(void);
+static bool mqtt_published_changed(const mqtt_published_t *last, const char *payload, mqtt_published_t *current);
+static bool mqtt_publish_system_field(mqtt_system_field_t field, const char *topic, const char *value);
+static int mqtt_profile_unit_messages(mqtt_publish_profile_t profile, relay_type_t type);
+void mqtt_publish_heartbeat(void);
+static int mqtt_topic_slot(unit_handle_t unit);
+static esp_err_t mqtt_topic_slot_unit(int slot, unit_handle_t *unit);
+static bool mqtt_mark_pending(unit_handle_t unit, latency_path_t path, int64_t origin_us);
+static esp_err_t mqtt_topics_rebuild(void);
+static mqtt_topics_t *mqtt_topics_ref(int slot);
+static const topic_table_t *mqtt_topics_acquire(int slot);
+static void mqtt_topics_release(const topic_table_t *table);
+static void mqtt_topics_invalidate(void);
+cJSON *mqtt_stats_to_JSON(void);
 
 #endif // MQTT_H
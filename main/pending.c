@@ -0,0 +1,40 @@
+#include "pending.h"
+
+/**
+ * @brief: Mark the unit for publishing
+ *
+ * @param ps Pointer to the pending set
+ * @param unit Bit of the unit (0 - 31)
+ * @return true if the unit was not pending yet, false if the mark was coalesced with an earlier one
+ */
+bool pending_set_mark(pending_set_t *ps, int unit) {
+    uint32_t bit = 1u << unit;
+    bool was_idle = !(ps->mask & bit);
+
+    ps->mask |= bit;
+    ps->marks++;
+    if (!was_idle) {
+        ps->coalesced++;
+    }
+    return was_idle;
+}
+
+/**
+ * @brief: Take all pending units for a publish pass. The units have to be read after this call.
+ *
+ * @param ps Pointer to the pending set
+ * @return bit per unit to publish, 0 if none are pending
+ */
+uint32_t pending_set_take(pending_set_t *ps) {
+    uint32_t pending = ps->mask;
+    ps->mask = 0;
+
+    if (pending != 0) {
+        uint32_t units = (uint32_t)__builtin_popcount(pending);
+        ps->passes++;
+        if (units > ps->pass_units_max) {
+            ps->pass_units_max = units;
+        }
+    }
+    return pending;
+}
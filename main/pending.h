@@ -0,0 +1,34 @@
+/**
+ * @file pending.h
+ * @brief Pending set: units waiting to be published, coalesced into one pass
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * The core is plain C with no ESP-IDF dependencies, and the caller serializes access (mqtt.c holds
+ * s_mqtt_pending_mux). Producers mark a unit in O(1) and never wait; the publisher takes the whole
+ * set at once and publishes the current state of every unit in it. A unit marked again before the
+ * publisher took it is published once, so bursts of changes cost one publish per unit and pass.
+ */
+#ifndef PENDING_H
+#define PENDING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** TYPES **/
+
+/**
+ * @brief: Pending set of up to 32 units
+ */
+typedef struct {
+    uint32_t mask;                  // Bit per unit waiting to be published
+    uint32_t marks;                 // Units marked for publishing
+    uint32_t coalesced;             // Marks of units that were pending already
+    uint32_t passes;                // Sets taken by the publisher
+    uint32_t pass_units_max;        // Most units taken at once
+} pending_set_t;
+
+/** ROUTINES **/
+bool pending_set_mark(pending_set_t *ps, int unit);
+uint32_t pending_set_take(pending_set_t *ps);
+
+#endif // PENDING_H
@@ -0,0 +1,98 @@
+#include "pin_mask.h"
+
+#define PIN_MASK_BIT(pin)   (((pin) >= 0 && (pin) < 64) ? (1ULL << (pin)) : 0)
+
+/**
+ * @brief: Initialize the pin masks: safe pins from the list, none used
+ *
+ * @param pm Pointer to the pin masks
+ * @param safe_pins Safe GPIO pins
+ * @param count Number of safe pins
+ */
+void pin_mask_init(pin_mask_t *pm, const int *safe_pins, int count) {
+    pm->safe = 0;
+    pm->used = 0;
+    for (int i = 0; i < count; i++) {
+        pm->safe |= PIN_MASK_BIT(safe_pins[i]);
+    }
+}
+
+/**
+ * @brief: Check if the pin is in the safe list
+ *
+ * @param pm Pointer to the pin masks
+ * @param pin GPIO pin, out of range pins are never safe
+ */
+bool pin_mask_is_safe(const pin_mask_t *pm, int pin) {
+    return (pm->safe & PIN_MASK_BIT(pin)) != 0;
+}
+
+/**
+ * @brief: Check if the pin is taken by a unit
+ *
+ * @param pm Pointer to the pin masks
+ * @param pin GPIO pin, out of range pins are never used
+ */
+bool pin_mask_is_used(const pin_mask_t *pm, int pin) {
+    return (pm->used & PIN_MASK_BIT(pin)) != 0;
+}
+
+/**
+ * @brief: Mark the pin taken by a unit. Out of range pins (unassigned units) are ignored.
+ *
+ * @param pm Pointer to the pin masks
+ * @param pin GPIO pin
+ */
+void pin_mask_take(pin_mask_t *pm, int pin) {
+    pm->used |= PIN_MASK_BIT(pin);
+}
+
+/**
+ * @brief: Give the pin back: its unit was removed or moved to another pin
+ *
+ * @param pm Pointer to the pin masks
+ * @param pin GPIO pin
+ */
+void pin_mask_release(pin_mask_t *pm, int pin) {
+    pm->used &= ~PIN_MASK_BIT(pin);
+}
+
+/**
+ * @brief: Find the lowest safe pin neither used nor reserved
+ *
+ * @param pm Pointer to the pin masks
+ * @param reserved Bit per pin taken by something other than a unit
+ * @return GPIO pin, -1 if all safe pins are taken
+ */
+int pin_mask_next_free(const pin_mask_t *pm, uint64_t reserved) {
+    uint64_t free_mask = pm->safe & ~pm->used & ~reserved;
+    return (free_mask != 0) ? __builtin_ctzll(free_mask) : -1;
+}
+
+/**
+ * @brief: Count the safe pins neither used nor reserved
+ *
+ * @param pm Pointer to the pin masks
+ * @param reserved Bit per pin taken by something other than a unit
+ * @return number of pins units can still be given
+ */
+int pin_mask_free_count(const pin_mask_t *pm, uint64_t reserved) {
+    return __builtin_popcountll(pm->safe & ~pm->used & ~reserved);
+}
+
+/**
+ * @brief: Take a pin for a unit: the one it had if that is still safe and free, the lowest free one otherwise
+ *
+ * @param pm Pointer to the pin masks
+ * @param preferred Pin of the unit, -1 if it has none yet
+ * @param reserved Bit per pin taken by something other than a unit
+ * @return GPIO pin taken for the unit, -1 if all safe pins are taken
+ */
+int pin_mask_claim(pin_mask_t *pm, int preferred, uint64_t reserved) {
+    int pin = preferred;
+    if (!pin_mask_is_safe(pm, pin) || pin_mask_is_used(pm, pin) || (reserved & PIN_MASK_BIT(pin))) {
+        pin = pin_mask_next_free(pm, reserved);
+    }
+    pin_mask_take(pm, pin);
+    return pin;
+}
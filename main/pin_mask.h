@@ -0,0 +1,37 @@
+/**
+ * @file pin_mask.h
+ * @brief GPIO occupancy: safe and used pins as bit masks, pin allocation for relay units
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * The core is plain C with no ESP-IDF dependencies, and the caller serializes access (relay.c updates
+ * the used pins within the writer section of the units). Pins are numbered 0 - 63, one bit each, so
+ * conflict checks and allocation are a few bit operations. Pins taken by something other than a unit,
+ * like the zero-cross detector input, are passed in as a reserved mask when a pin is allocated.
+ */
+#ifndef PIN_MASK_H
+#define PIN_MASK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** TYPES **/
+
+/**
+ * @brief: GPIO pins units may use, and the ones they do
+ */
+typedef struct {
+    uint64_t safe;                  // Bit per pin in the safe list
+    uint64_t used;                  // Bit per pin taken by a unit
+} pin_mask_t;
+
+/** ROUTINES **/
+void pin_mask_init(pin_mask_t *pm, const int *safe_pins, int count);
+bool pin_mask_is_safe(const pin_mask_t *pm, int pin);
+bool pin_mask_is_used(const pin_mask_t *pm, int pin);
+void pin_mask_take(pin_mask_t *pm, int pin);
+void pin_mask_release(pin_mask_t *pm, int pin);
+int pin_mask_next_free(const pin_mask_t *pm, uint64_t reserved);
+int pin_mask_free_count(const pin_mask_t *pm, uint64_t reserved);
+int pin_mask_claim(pin_mask_t *pm, int preferred, uint64_t reserved);
+
+#endif // PIN_MASK_H
@@ -0,0 +1,54 @@
+#include "pulse.h"
+
+/**
+ * @brief: Initialize pulse counter state
+ *
+ * @param pc Pointer to the pulse counter state
+ * @param hw_count Current hardware count
+ * @param now_us Current time in microseconds
+ */
+void pulse_counter_init(pulse_counter_t *pc, int32_t hw_count, int64_t now_us) {
+    pc->total = 0;
+    pc->rate = 0.0f;
+    pc->last_hw_count = hw_count;
+    pc->last_us = now_us;
+}
+
+/**
+ * @brief: Rebase the counter on a new hardware count (e.g. the hardware counter was cleared or re-created),
+ *         keeping the total
+ *
+ * @param pc Pointer to the pulse counter state
+ * @param hw_count Current hardware count
+ * @param now_us Current time in microseconds
+ */
+void pulse_counter_rebase(pulse_counter_t *pc, int32_t hw_count, int64_t now_us) {
+    pc->rate = 0.0f;
+    pc->last_hw_count = hw_count;
+    pc->last_us = now_us;
+}
+
+/**
+ * @brief: Take a sample of the hardware count: add new pulses to the total and recalculate the rate
+ *
+ * @param pc Pointer to the pulse counter state
+ * @param hw_count Current hardware count. Only counts up, may wrap around.
+ * @param now_us Current time in microseconds
+ * @return number of pulses since the previous sample
+ */
+uint32_t pulse_counter_update(pulse_counter_t *pc, int32_t hw_count, int64_t now_us) {
+    // unsigned difference is correct across the wrap-around of the hardware count
+    uint32_t delta = (uint32_t)hw_count - (uint32_t)pc->last_hw_count;
+    int64_t elapsed_us = now_us - pc->last_us;
+
+    pc->total += delta;
+    pc->last_hw_count = hw_count;
+
+    // keep the previous rate if the clock did not move, e.g. two samples in a row
+    if (elapsed_us > 0) {
+        pc->rate = (float)((double)delta * 1000000.0 / (double)elapsed_us);
+        pc->last_us = now_us;
+    }
+
+    return delta;
+}
@@ -0,0 +1,33 @@
+/**
+ * @file pulse.h
+ * @brief Pulse counter aggregation: total count and rate over the sampling interval
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * The core is plain C with no ESP-IDF dependencies: the hardware count and the time are passed
+ * in by the caller, so it can be driven by the PCNT peripheral on the device or by a simulated
+ * counter on the host. The hardware count is treated as a free-running 32-bit counter, so its
+ * wrap-around does not lose pulses.
+ */
+#ifndef PULSE_H
+#define PULSE_H
+
+#include <stdint.h>
+
+/** TYPES **/
+
+/**
+ * @brief: Aggregated state of a single pulse counter
+ */
+typedef struct {
+    uint64_t total;                 // Pulses counted since init
+    float rate;                     // Pulses per second over the last sampling interval
+    int32_t last_hw_count;          // Hardware count at the last sample
+    int64_t last_us;                // Time of the last sample
+} pulse_counter_t;
+
+/** ROUTINES **/
+void pulse_counter_init(pulse_counter_t *pc, int32_t hw_count, int64_t now_us);
+void pulse_counter_rebase(pulse_counter_t *pc, int32_t hw_count, int64_t now_us);
+uint32_t pulse_counter_update(pulse_counter_t *pc, int32_t hw_count, int64_t now_us);
+
+#endif // PULSE_H
@@ -5,9 +5,18 @@
 
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "soc/soc.h"
+#include "soc/soc_caps.h"
+#include "soc/gpio_reg.h"
+#if SOC_PCNT_SUPPORTED
+#include "driver/pulse_cnt.h"
+#endif
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 
 #include "cJSON.h"
 
@@ -19,36 +28,248 @@
 #include "relay.h"
 #include "mqtt.h"
 #include "status.h"
+#include "debounce.h"
+#include "relay_rtc.h"
+#include "relay_table.h"
+#include "relay_wear.h"
+#include "relay_zc.h"
+#include "latency.h"
+#include "pulse.h"
+#include "scan.h"
+#include "rules.h"
+#include "writebehind.h"
+#include "unit_key.h"
+#include "seqlock.h"
+#include "interlock.h"
+#include "pin_mask.h"
 
 /* Global arrays for relay units in-memory storage */
 // This implements a heap_1.c like behavior: load once on boot, keep in RAM, use everwhere, free on shutdown
-// The order of array is: first all actuators, then all sensors, as it formed by get_all_relay_units() function.
+// The order of array is: first all actuators, then all sensors, then all pulse counters, as it formed by get_all_relay_units() function.
+// The array is allocated for RELAY_INDEX_UNITS_MAX units: relay_units_reconfigure() moves units within it when the unit counts
+// change, so it is never re-allocated and pointers taken by other tasks never point to freed memory.
 static relay_unit_t *s_units;
 
 // Keep counts in memory as well
 static size_t s_units_count;
 static size_t s_relays_count;
 static size_t s_sensors_count;
+static size_t s_pulse_counters_count;
+
+/* In-memory units consistency */
+// Writers (web handlers, MQTT commands, GPIO event task) serialize on the recursive mutex and bump the sequence
+// counter before and after the change, so it is odd while a unit is being modified. Readers copy the units without
+// taking any lock and retry if the counter was odd or moved during the copy (seqlock.h).
+#define RELAY_SNAPSHOT_RETRIES  16      // lock-free attempts before the reader falls back to the writer mutex
+
+static seqlock_t s_units_seq;
+static SemaphoreHandle_t s_units_write_lock = NULL;
+static uint32_t s_units_write_depth = 0;
+static SemaphoreHandle_t s_units_reconfig_lock = NULL;     // serializes relay_units_reconfigure() calls
 
 /* Other global variables */
 // Safe GPIO pins to be used by relays and contact sensors
 const int SAFE_GPIO_PINS[SAFE_GPIO_COUNT] = {4, 5, 6, 7, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 39};
 
 static QueueHandle_t gpio_evt_queue = NULL;
+// One slot per contact sensor pin (the ISR posts only the first edge of a train), plus the debounce timer,
+// the input scan timer and the delay timer of every rule
+#define GPIO_EVT_QUEUE_LENGTH   ((CONTACT_SENSORS_COUNT_MAX + 1) + 1 + 1 + RULES_MAX)
+
+/* In-memory units index */
+// Built by init_relay_units_in_memory() and rebuilt by relay_units_index_rebuild() every time s_units changes.
+// Channels and GPIO pins are small bounded integers, so the tables below are directly addressed and every lookup
+// (by key, by type and channel, by GPIO pin) is a single array access instead of a walk over s_units.
+#define RELAY_INDEX_NONE    (-1)
+#define RELAY_INDEX_UNITS_MAX   ((CHANNEL_COUNT_MAX + 1) + (CONTACT_SENSORS_COUNT_MAX + 1) + (PULSE_COUNTERS_COUNT_MAX + 1))
+#define RELAY_TYPES_COUNT       3   // relay_type_t values
+#define RELAY_LIST_ALL          (-1) // relay_units_list_copy(): all units regardless of type
+
+static char s_unit_keys[RELAY_INDEX_UNITS_MAX][NVS_KEY_NAME_MAX_SIZE];     // precomputed NVS key per s_units element
+static int8_t s_actuator_idx_by_channel[CHANNEL_COUNT_MAX + 1];             // actuator channel => s_units index
+static int8_t s_sensor_idx_by_channel[CONTACT_SENSORS_COUNT_MAX + 1];       // sensor channel => s_units index
+static int8_t s_pulse_idx_by_channel[PULSE_COUNTERS_COUNT_MAX + 1];         // pulse counter channel => s_units index
+static int8_t s_unit_idx_by_gpio[RELAY_GPIO_PIN_MAX + 1];                   // GPIO pin => s_units index
+
+/* GPIO occupancy */
+// Bit per GPIO pin, see pin_mask.h. Safe pins are set once from SAFE_GPIO_PINS, used pins are maintained by
+// relay_units_index_rebuild() together with the index.
+static pin_mask_t s_pins;
+
+/* GPIO edge dispatch */
+// GPIO pin => in-memory contact sensor with ISR registered on that pin. Maintained by relay_sensor_register_isr()
+// and relay_sensor_unregister_isr(), so gpio_event_task() resolves the edge owner with a single array access.
+static relay_unit_t *s_gpio_dispatch[GPIO_NUM_MAX];
+
+/* Debounce engine */
+// Per-pin debounce state. ISR only records the edge, gpio_event_task() settles the pins once their windows expire.
+// The single timer is armed for the earliest pending deadline, so independent pins settle in parallel.
+static debounce_pin_t s_debounce[GPIO_NUM_MAX];
+static portMUX_TYPE s_debounce_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_debounce_timer = NULL;
+
+/* Input scan engine */
+// Alternative to edge interrupts (S_KEY_SENSORS_ACQ_MODE, applied on boot). relay_scan_timer_cb() reads the GPIO input
+// register(s) once per tick and runs all scanned pins through one bit-parallel N-of-M filter. Flipped pins are collected
+// in s_scan_changed and gpio_event_task() is woken up once per batch, so the queue traffic does not depend on pin count.
+static uint16_t s_sensors_acq_mode = SENSORS_ACQ_MODE_ISR;
+static uint16_t s_scan_tick_ms = S_DEFAULT_SENSORS_SCAN_TICK;
+static scan_filter_t s_scan_filter;
+static uint64_t s_scan_changed = 0;         // Pins flipped since gpio_event_task() took the last batch
+static int64_t s_scan_changed_us = 0;       // Tick of the first flip of the batch, origin for latency tracing
+static bool s_scan_notified = false;        // Batch event is in the queue
+static portMUX_TYPE s_scan_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_scan_timer = NULL;
+
+/* Write-behind persistence */
+// Bit per s_units element. State changes are kept in RAM and all dirty units are flushed to NVS
+// with one handle and one commit once changes stop coming for RELAY_PERSIST_QUIET_MS,
+// but not later than RELAY_PERSIST_MAX_DELAY_MS after the first unflushed change.
+// The same task writes the wear counters (see relay_wear.h) once per RELAY_WEAR_FLUSH_INTERVAL_S.
+#define RELAY_PERSIST_NOTIFY_UNITS  (1UL << 0)  // relay_persist_task() notification bits
+#define RELAY_PERSIST_NOTIFY_WEAR   (1UL << 1)
+
+static writebehind_t s_persist = {
+    .quiet_us = RELAY_PERSIST_QUIET_MS * 1000,
+    .max_delay_us = RELAY_PERSIST_MAX_DELAY_MS * 1000
+};
+static portMUX_TYPE s_persist_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t s_persist_timer = NULL;
+static esp_timer_handle_t s_wear_timer = NULL;
+static TaskHandle_t s_persist_task = NULL;
+static SemaphoreHandle_t s_persist_lock = NULL;
+
+/* Pulse counters */
+// Slot per pulse counter channel. Edges are counted by the PCNT peripheral without any CPU involvement, so no
+// per-pulse interrupts or queue events. pulse_counter_task() samples the hardware counts once per S_KEY_PULSE_INTERVAL
+// and publishes aggregated count and rate.
+typedef struct {
+#if SOC_PCNT_SUPPORTED
+    pcnt_unit_handle_t pcnt_unit;
+    pcnt_channel_handle_t pcnt_channel;
+#endif
+    pulse_counter_t counter;
+    bool attached;
+} relay_pulse_slot_t;
+
+static relay_pulse_slot_t s_pulse_slots[PULSE_COUNTERS_COUNT_MAX + 1];
+static TaskHandle_t s_pulse_counter_task = NULL;
+
+/* Actuator pulse mode */
+// One-shot timer per actuator channel. The ON level is written by the commanding task and the OFF level directly by the
+// timer callback, so the pulse width depends neither on HTTP/MQTT load nor on the unit writer lock. The final state is
+// then applied, saved and published by relay_actuator_pulse_task(), which the callback notifies with a bit per channel.
+typedef struct {
+    esp_timer_handle_t timer;
+    int gpio_pin;               // Pin and OFF level captured when the pulse started
+    uint32_t off_level;
+    uint32_t width_ms;          // Requested width
+    int64_t on_us;              // Time the ON level was written
+    int64_t off_us;             // Time the OFF level was written
+} relay_actuator_pulse_t;
+
+static relay_actuator_pulse_t s_actuator_pulses[CHANNEL_COUNT_MAX + 1];
+static TaskHandle_t s_actuator_pulse_task = NULL;
+
+/* Interlock groups */
+// Actuators sharing a non-zero interlock_group are never ON together. Every output write of a member goes through
+// s_interlock_mux: conflicting members are switched OFF and the target is switched ON within one critical section, and
+// whether a member is ON is read back from the GPIO output register, so pulse timers and batches can't be missed.
+// Once a member went OFF its group stays dead for s_interlock_dead_us: an ON request within that time is parked in the
+// group and re-issued by relay_actuator_pulse_task() when the group timer expires. The caller never waits.
+typedef struct {
+    int gpio_pin;               // Pin and ON level of the member, refreshed on every write
+    uint8_t on_level;
+    uint8_t group;              // Interlock group, 0 if none
+    bool registered;            // Written at least once: output changes of the pin are accounted to this channel
+    bool zero_cross;            // Edges are written at the switching point after a zero crossing, see relay_zc.h
+    uint16_t zc_offset_us;
+    uint16_t zc_latency_us;
+} relay_interlock_member_t;
+
+typedef struct {
+    esp_timer_handle_t timer;   // Dead time timer
+    interlock_group_t state;    // Dead time and the parked request, see interlock.h
+} relay_interlock_group_t;
+
+// relay_actuator_pulse_task() notification bits: channels of completed pulses, then groups whose dead time expired
+#define RELAY_NOTIFY_INTERLOCK_SHIFT    16
+
+static relay_interlock_member_t s_interlock_members[CHANNEL_COUNT_MAX + 1];
+static relay_interlock_group_t s_interlock_groups[RELAY_INTERLOCK_GROUPS_MAX + 1];
+static portMUX_TYPE s_interlock_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_interlock_dead_us = 0;
+static bool s_interlock_ready = false;
+
+static void relay_interlock_resume(int group);
+static esp_err_t relay_interlock_output_write(int channel, uint32_t level, int64_t *delay_us);
 
 /* Routines */
 
+/**
+ * @brief: Set up the safe pins on first use
+ */
+static void relay_pins_init() {
+    if (s_pins.safe == 0) {
+        pin_mask_t pins;
+        pin_mask_init(&pins, SAFE_GPIO_PINS, SAFE_GPIO_COUNT);
+        s_pins.safe = pins.safe;
+    }
+}
+
+/**
+ * @brief: Get the safe and used GPIO pins
+ * 
+ * Used pins are maintained by the index when units are in memory, built with one pass over the units otherwise.
+ * 
+ * @param[out] pins Pin masks
+ */
+static void relay_pins_get(pin_mask_t *pins) {
+    relay_pins_init();
+    *pins = s_pins;
+
+    if (xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY) {
+        return;
+    }
+
+    relay_unit_t *relay_list = NULL;
+    uint16_t total_count = 0;
+    esp_err_t err = get_all_relay_units(&relay_list, &total_count);
+
+    pins->used = 0;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to get relay units.");
+        return;  // Assume pins are not in use in case of failure
+    }
+
+    for (int i = 0; i < total_count; i++) {
+        if (relay_list[i].gpio_pin >= RELAY_GPIO_PIN_MIN && relay_list[i].gpio_pin <= RELAY_GPIO_PIN_MAX) {
+            pin_mask_take(pins, relay_list[i].gpio_pin);
+        }
+    }
+
+    // Free the relay list memory
+    free(relay_list);
+}
+
+/**
+ * @brief: Get the mask of GPIO pins taken by something other than a relay unit: the zero-cross detector input
+ */
+static uint64_t relay_reserved_pin_mask() {
+    int zc_pin = relay_zc_gpio_pin();
+    return (zc_pin >= 0 && zc_pin < 64) ? (1ULL << zc_pin) : 0;
+}
+
 /**
  * @brief: checks if a GPIO is in the safe list
  * @param gpio_pin GPIO pin number
  */
 bool is_gpio_safe(int gpio_pin) {
-    for (int i = 0; i < SAFE_GPIO_COUNT; i++) {
-        if (SAFE_GPIO_PINS[i] == gpio_pin) {
-            return true;
-        }
+    if (gpio_pin < RELAY_GPIO_PIN_MIN || gpio_pin > RELAY_GPIO_PIN_MAX) {
+        return false;
     }
-    return false;
+    relay_pins_init();
+    return pin_mask_is_safe(&s_pins, gpio_pin);
 }
 
 /**
@@ -60,33 +281,22 @@ bool is_gpio_safe(int gpio_pin) {
  *     - false: The pin is not in use.
  */
 bool is_gpio_pin_in_use(int pin) {
-    relay_unit_t *relay_list = NULL;
-    uint16_t total_count = 0;
-    esp_err_t err = get_all_relay_units(&relay_list, &total_count);
-
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to get relay units.");
-        return false;  // Assume pin is not in use in case of failure
-    }
 
-    if (total_count < 1) {
-        ESP_LOGW(TAG, "No initialized relay units are found. Pin is not in use.");
+    if (pin < RELAY_GPIO_PIN_MIN || pin > RELAY_GPIO_PIN_MAX) {
         return false;
     }
 
-    for (int i = 0; i < total_count; i++) {
-        if (relay_list[i].gpio_pin == pin) {
-            const char *type_str = (relay_list[i].type == RELAY_TYPE_ACTUATOR) ? "actuator" : "sensor";
-            ESP_LOGI(TAG, "GPIO pin %d is already in use by relay channel %d (%s)", 
-                     pin, relay_list[i].channel, type_str);
-            // ESP_ERROR_CHECK(free_relays_array(relay_list, total_count));  // Free the relay list memory
-            free(relay_list);
-            return true;
-        }
+    pin_mask_t pins;
+    relay_pins_get(&pins);
+    if (pin_mask_is_used(&pins, pin)) {
+        ESP_LOGI(TAG, "GPIO pin %d is already in use", pin);
+        return true;
     }
 
-    // Free the relay list memory
-    free(relay_list);
+    if (pin == relay_zc_gpio_pin()) {
+        ESP_LOGI(TAG, "GPIO pin %d is used by the zero-cross detector", pin);
+        return true;
+    }
 
     ESP_LOGI(TAG, "GPIO pin %d is not in use", pin);
     return false;
@@ -100,15 +310,17 @@ bool is_gpio_pin_in_use(int pin) {
  *     - -1: All safe GPIO pins are in use.
  */
 int get_next_available_safe_gpio_pin() {
-    for (int i = 0; i < SAFE_GPIO_COUNT; i++) {
-        if (!is_gpio_pin_in_use(SAFE_GPIO_PINS[i])) {
-            ESP_LOGI(TAG, "Found available safe GPIO pin: %d", SAFE_GPIO_PINS[i]);
-            return SAFE_GPIO_PINS[i];  // Return the first available safe pin
-        }
+    pin_mask_t pins;
+    relay_pins_get(&pins);
+
+    int pin = pin_mask_next_free(&pins, relay_reserved_pin_mask());  // lowest free safe pin
+    if (pin < 0) {
+        ESP_LOGW(TAG, "No available safe GPIO pins found.");
+        return -1;  // All safe pins are in use
     }
 
-    ESP_LOGW(TAG, "No available safe GPIO pins found.");
-    return -1;  // All safe pins are in use
+    ESP_LOGI(TAG, "Found available safe GPIO pin: %d", pin);
+    return pin;
 }
 
 
@@ -129,6 +341,12 @@ relay_unit_t get_actuator_relay(int channel, int pin) {
     relay.enabled = true;          // Enable by default
     relay.gpio_initialized = false;
     relay.type = RELAY_TYPE_ACTUATOR;
+    relay.debounce_ms = 0;         // Not applicable to actuators
+    relay.pulse_ms = 0;            // Latching by default
+    relay.interlock_group = 0;     // No interlock by default
+    relay.zero_cross = false;      // Switch right away by default
+    relay.zc_offset_us = 0;
+    relay.zc_latency_us = 0;
 
     if(INIT_RELAY_ON_GET) {
         if(relay_gpio_init(&relay) != ESP_OK) {
@@ -159,6 +377,12 @@ relay_unit_t get_sensor_relay(int channel, int pin) {
     relay.enabled = true;          // Enable by default
     relay.gpio_initialized = false;
     relay.type = RELAY_TYPE_SENSOR;
+    relay.debounce_ms = DEBOUNCE_TIME_MS;
+    relay.pulse_ms = 0;            // Not applicable to sensors
+    relay.interlock_group = 0;
+    relay.zero_cross = false;
+    relay.zc_offset_us = 0;
+    relay.zc_latency_us = 0;
 
     if(INIT_SENSORS_ON_GET) {
         if(relay_gpio_init(&relay) != ESP_OK) {
@@ -172,6 +396,29 @@ relay_unit_t get_sensor_relay(int channel, int pin) {
     return relay;
 }
 
+/**
+ * @brief Initialize a pulse counter
+ *
+ * @param channel Pulse counter channel number
+ * @param pin GPIO pin number of the pulse input
+ * @return Initialized relay_unit_t structure
+ */
+relay_unit_t get_pulse_counter_relay(int channel, int pin) {
+    relay_unit_t relay = {0};
+    relay.channel = channel;
+    relay.state = RELAY_STATE_OFF; // Not applicable to pulse counters
+    relay.inverted = false;        // Count rising edges. Inverted counts falling edges.
+    relay.gpio_pin = pin;
+    relay.enabled = true;
+    relay.gpio_initialized = false;
+    relay.type = RELAY_TYPE_PULSE_COUNTER;
+    relay.debounce_ms = 0;         // Filtered by PCNT glitch filter instead
+    relay.io_conf = (gpio_config_t){0};
+
+    ESP_LOGI(TAG, "Pulse counter initialized on channel %d, GPIO pin %d", channel, pin);
+    return relay;
+}
+
 /**
  * @brief: Load all relay units from NVS and initialize in-memory storage
  * @return esp_err_t result of the operation
@@ -180,1133 +427,4097 @@ esp_err_t init_relay_units_in_memory() {
     esp_err_t err;
     uint16_t total_count = 0;
 
+    // Load relay units table from NVS (single read, migrates legacy records if needed)
+    int64_t t_start = esp_timer_get_time();
+
+    // Writer lock for in-memory units
+    if (s_units_write_lock == NULL) {
+        s_units_write_lock = xSemaphoreCreateRecursiveMutex();
+        if (s_units_write_lock == NULL) {
+            ESP_LOGE(TAG, "Failed to create relay units writer lock");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (s_units_reconfig_lock == NULL) {
+        s_units_reconfig_lock = xSemaphoreCreateMutex();
+        if (s_units_reconfig_lock == NULL) {
+            ESP_LOGE(TAG, "Failed to create relay units reconfiguration lock");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    err = relay_table_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to load relay units table from NVS");
+        return err;
+    }
+
     // Load all relay units from NVS
-    err = get_all_relay_units(&s_units, &total_count);
+    relay_unit_t *units = NULL;
+    err = get_all_relay_units(&units, &total_count);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to load relay units from NVS");
         return err;
     }
+    if (total_count > RELAY_INDEX_UNITS_MAX) {
+        ESP_LOGE(TAG, "Too many relay units: %d (max %d)", total_count, RELAY_INDEX_UNITS_MAX);
+        free(units);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Allocated once for the max number of units: hot reconfiguration never re-allocates it
+    s_units = calloc(RELAY_INDEX_UNITS_MAX, sizeof(relay_unit_t));
+    if (s_units == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for in-memory relay units");
+        free(units);
+        return ESP_ERR_NO_MEM;
+    }
+    if (total_count > 0) {
+        memcpy(s_units, units, sizeof(relay_unit_t) * total_count);
+    }
+    free(units);
 
     s_units_count = total_count;
     s_relays_count = 0;
     s_sensors_count = 0;
+    s_pulse_counters_count = 0;
 
-    // Count relays and sensors
+    // Count relays, sensors and pulse counters
     for (int i = 0; i < s_units_count; i++) {
         if (s_units[i].type == RELAY_TYPE_ACTUATOR) {
             s_relays_count++;
         } else if (s_units[i].type == RELAY_TYPE_SENSOR) {
             s_sensors_count++;
+        } else if (s_units[i].type == RELAY_TYPE_PULSE_COUNTER) {
+            s_pulse_counters_count++;
         }
     }
 
+    // Build lookup index
+    err = relay_units_index_rebuild();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to build in-memory relay units index");
+        return err;
+    }
+
+    // Load wear counters: outputs are synced with them by relay_interlock_init()
+    err = relay_wear_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start wear accounting");
+        return err;
+    }
+
+    // Start write-behind persistence
+    err = relay_persist_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start write-behind persistence");
+        return err;
+    }
+
+    // Start actuator pulse timers
+    err = relay_actuator_pulse_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start actuator pulse timers");
+        return err;
+    }
+
+    // Start interlock groups: needs the pulse task to re-issue parked requests
+    err = relay_interlock_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start interlock groups");
+        return err;
+    }
+
     // Set system event bit for units in memory
     xEventGroupSetBits(g_sys_events, BIT_UNITS_IN_MEMORY);
 
-    ESP_LOGI(TAG, "Initialized %d relay units (%d actuators, %d sensors) from NVS into memory", 
-             s_units_count, s_relays_count, s_sensors_count);
+    ESP_LOGI(TAG, "Initialized %d relay units (%d actuators, %d sensors, %d pulse counters) from NVS into memory in %lld us", 
+             s_units_count, s_relays_count, s_sensors_count, s_pulse_counters_count, (long long)(esp_timer_get_time() - t_start));
 
     return ESP_OK;  
 
 }
 
 /**
- * @brief: Dump all relay units currently stored in memory
+ * @brief: (Re)build the lookup index over in-memory relay units.
+ * 
+ * Precomputes the NVS key of every unit and fills the channel and GPIO tables and the used GPIO pins mask. The tables are fixed-size
+ * arrays (RELAY_INDEX_UNITS_MAX units), filled in place. Has to be called every time units are added, removed or moved within s_units,
+ * or any unit changes its channel or GPIO pin.
+ * 
  * @return esp_err_t result of the operation
  */
-esp_err_t dump_relay_units_in_memory() {
-    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
-        ESP_LOGW(TAG, "Relay units are not loaded in memory.");
-        return ESP_ERR_INVALID_STATE;
+esp_err_t relay_units_index_rebuild() {
+
+    if (s_units_count > RELAY_INDEX_UNITS_MAX) {
+        ESP_LOGE(TAG, "Too many relay units to index: %d (max %d)", s_units_count, RELAY_INDEX_UNITS_MAX);
+        return ESP_ERR_INVALID_SIZE;
     }
 
-    ESP_LOGI(TAG, "Dumping %d relay units in memory:", s_units_count);
+    memset(s_unit_keys, 0, sizeof(s_unit_keys));
+    memset(s_actuator_idx_by_channel, RELAY_INDEX_NONE, sizeof(s_actuator_idx_by_channel));
+    memset(s_sensor_idx_by_channel, RELAY_INDEX_NONE, sizeof(s_sensor_idx_by_channel));
+    memset(s_pulse_idx_by_channel, RELAY_INDEX_NONE, sizeof(s_pulse_idx_by_channel));
+    memset(s_unit_idx_by_gpio, RELAY_INDEX_NONE, sizeof(s_unit_idx_by_gpio));
+    pin_mask_t pins = { .safe = s_pins.safe, .used = 0 };
+    uint64_t actuator_pin_mask = 0;
+
     for (int i = 0; i < s_units_count; i++) {
         relay_unit_t *relay = &s_units[i];
-        const char *type_str = (relay->type == RELAY_TYPE_ACTUATOR) ? "Actuator" : "Sensor";
-        ESP_LOGI(TAG, "Channel: %d, Type: %s, GPIO Pin: %d, State: %d, Inverted: %d, Enabled: %d, GPIO Initialized: %d",
-                 relay->channel, type_str, relay->gpio_pin, relay->state,
-                 relay->inverted, relay->enabled, relay->gpio_initialized);
+
+        switch (relay->type) {
+            case RELAY_TYPE_ACTUATOR:
+                if (relay->channel < CHANNEL_COUNT_MIN || relay->channel > CHANNEL_COUNT_MAX) {
+                    ESP_LOGW(TAG, "Actuator channel %d is out of range, skipping from index", relay->channel);
+                    continue;
+                }
+                snprintf(s_unit_keys[i], sizeof(s_unit_keys[i]), "%s%d", S_KEY_CH_PREFIX, relay->channel);
+                s_actuator_idx_by_channel[relay->channel] = i;
+                break;
+            case RELAY_TYPE_SENSOR:
+                if (relay->channel < CONTACT_SENSORS_COUNT_MIN || relay->channel > CONTACT_SENSORS_COUNT_MAX) {
+                    ESP_LOGW(TAG, "Sensor channel %d is out of range, skipping from index", relay->channel);
+                    continue;
+                }
+                snprintf(s_unit_keys[i], sizeof(s_unit_keys[i]), "%s%d", S_KEY_SN_PREFIX, relay->channel);
+                s_sensor_idx_by_channel[relay->channel] = i;
+                break;
+            case RELAY_TYPE_PULSE_COUNTER:
+                if (relay->channel < PULSE_COUNTERS_COUNT_MIN || relay->channel > PULSE_COUNTERS_COUNT_MAX) {
+                    ESP_LOGW(TAG, "Pulse counter channel %d is out of range, skipping from index", relay->channel);
+                    continue;
+                }
+                snprintf(s_unit_keys[i], sizeof(s_unit_keys[i]), "%s%d", S_KEY_PC_PREFIX, relay->channel);
+                s_pulse_idx_by_channel[relay->channel] = i;
+                break;
+            default:
+                ESP_LOGW(TAG, "Invalid relay type %d at index %d, skipping from index", relay->type, i);
+                continue;
+        }
+
+        if (relay->gpio_pin >= RELAY_GPIO_PIN_MIN && relay->gpio_pin <= RELAY_GPIO_PIN_MAX) {
+            pin_mask_take(&pins, relay->gpio_pin);
+            if (relay->type == RELAY_TYPE_ACTUATOR) {
+                actuator_pin_mask |= 1ULL << relay->gpio_pin;
+            }
+            if (s_unit_idx_by_gpio[relay->gpio_pin] != RELAY_INDEX_NONE) {
+                ESP_LOGW(TAG, "GPIO pin %d is shared by several units, index keeps the first one", relay->gpio_pin);
+            } else {
+                s_unit_idx_by_gpio[relay->gpio_pin] = i;
+            }
+        }
     }
 
+    s_pins.used = pins.used;
+
+    // outputs mirrored into RTC memory follow the actuator pins
+    relay_rtc_set_pins(actuator_pin_mask);
+
+    ESP_LOGI(TAG, "Relay units index built for %d unit(s)", s_units_count);
     return ESP_OK;
-}   
+}
 
 /**
- * @brief: Init relay unit's (either actuator or sensor) GPIO. It defines GPIO pin parameters according to the relay type (actuator or contact sensor), and calls gpio_config().
+ * @brief: Resolve s_units index from NVS key using the in-memory index
  * 
- * @param[in,out] relay Pointer to the relay unit for which GPIO pin shall be initialized
- * @return esp_err_t result of the operation
+ * @param key NVS key, e.g. "relay_ch_0", "relay_sn_1" or "relay_pc_0"
+ * @param type Expected relay type
+ * @return index in s_units array or RELAY_INDEX_NONE if not found
  */
-esp_err_t relay_gpio_init(relay_unit_t *relay) {
-    if (relay == NULL) {
-        ESP_LOGE(TAG, "NULL value for relay unit");
-        return ESP_ERR_INVALID_ARG;
+static int relay_index_from_key(const char *key, relay_type_t type) {
+    const char *prefix;
+    const int8_t *table;
+    int table_size;
+
+    if (key == NULL) {
+        return RELAY_INDEX_NONE;
     }
 
-    // check gpio init flag
-    if (relay->gpio_initialized) {
-        ESP_LOGW(TAG, "GPIO pin %d seems to be already inialized. Flag set to TRUE. Potential risk of memory leak.", relay->gpio_pin);
+    if (type == RELAY_TYPE_ACTUATOR) {
+        prefix = S_KEY_CH_PREFIX;
+        table = s_actuator_idx_by_channel;
+        table_size = CHANNEL_COUNT_MAX + 1;
+    } else if (type == RELAY_TYPE_SENSOR) {
+        prefix = S_KEY_SN_PREFIX;
+        table = s_sensor_idx_by_channel;
+        table_size = CONTACT_SENSORS_COUNT_MAX + 1;
+    } else if (type == RELAY_TYPE_PULSE_COUNTER) {
+        prefix = S_KEY_PC_PREFIX;
+        table = s_pulse_idx_by_channel;
+        table_size = PULSE_COUNTERS_COUNT_MAX + 1;
+    } else {
+        return RELAY_INDEX_NONE;
     }
 
-    gpio_config_t io_conf = {0};
-    io_conf.pin_bit_mask = (1ULL << relay->gpio_pin);
-    
-    // Configure GPIO based on relay type (actuator or sensor)
-    switch (relay->type) {
-        case RELAY_TYPE_SENSOR:
-            io_conf.mode = GPIO_MODE_INPUT;
-            io_conf.pull_up_en = GPIO_PULLUP_ENABLE;     // Enable pull-up
-            io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;  // Disable pull-down
-            io_conf.intr_type = GPIO_INTR_ANYEDGE;  // Interrupt on any edge
-            break;
+    // non-canonical forms like "relay_ch_01" are rejected by the parser
+    int channel = unit_key_channel(key, prefix, table_size - 1);
+    if (channel == UNIT_KEY_NONE) {
+        return RELAY_INDEX_NONE;
+    }
 
-        case RELAY_TYPE_ACTUATOR:
-            io_conf.mode = GPIO_MODE_OUTPUT;
-            io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
-            io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
-            io_conf.intr_type = GPIO_INTR_DISABLE;
-            break;
+    return table[channel];
+}
 
+/**
+ * @brief: Get s_units index of the unit by its type and channel
+ * 
+ * @param type Relay type
+ * @param channel Channel of the unit
+ * @return index in s_units array or RELAY_INDEX_NONE if not found
+ */
+static int relay_index_by_channel(relay_type_t type, int channel) {
+    switch (type) {
+        case RELAY_TYPE_ACTUATOR:
+            return (channel >= 0 && channel <= CHANNEL_COUNT_MAX) ? s_actuator_idx_by_channel[channel] : RELAY_INDEX_NONE;
+        case RELAY_TYPE_SENSOR:
+            return (channel >= 0 && channel <= CONTACT_SENSORS_COUNT_MAX) ? s_sensor_idx_by_channel[channel] : RELAY_INDEX_NONE;
+        case RELAY_TYPE_PULSE_COUNTER:
+            return (channel >= 0 && channel <= PULSE_COUNTERS_COUNT_MAX) ? s_pulse_idx_by_channel[channel] : RELAY_INDEX_NONE;
         default:
-            ESP_LOGE(TAG, "Invalid relay type: %d", relay->type);
-            return ESP_ERR_INVALID_ARG;
+            return RELAY_INDEX_NONE;
     }
+}
 
-    // Apply GPIO configuration
-    esp_err_t err = gpio_config(&io_conf);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "GPIO configuration failed for pin %d, error: %s", relay->gpio_pin, esp_err_to_name(err));
-        return err;
+/**
+ * @brief: Resolve the in-memory relay unit by its handle. Caller holds the writer lock and must not keep the pointer
+ *         after releasing it.
+ * 
+ * @param unit Unit handle
+ * @return Pointer into s_units or NULL if the unit is not in memory
+ */
+static relay_unit_t *relay_unit_by_handle(unit_handle_t unit) {
+    if (s_units == NULL || !(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
+        return NULL;
     }
 
-    // Assign io_conf to relay struct
-    relay->io_conf = io_conf;
-
-    // set flag to true
-    relay->gpio_initialized = true;
-
-    return ESP_OK;
+    int idx = relay_index_by_channel((relay_type_t)unit.type, unit.index);
+    return (idx != RELAY_INDEX_NONE) ? &s_units[idx] : NULL;
 }
 
 /**
- * @brief: Register ISR interrupt handler to the pin of the sensor
+ * @brief: Checks if the pointer refers to an element of in-memory storage
  * 
- * @param[in,out] relay Pointer to the relay unit for which GPIO pin shall ISR be registered
- * @return esp_err_t result of the operation
+ * @param relay Pointer to the relay unit
+ * @return true if relay is an element of s_units array
  */
-esp_err_t relay_sensor_register_isr(relay_unit_t *relay) {
+static bool relay_is_in_memory(const relay_unit_t *relay) {
+    if (relay == NULL || s_units == NULL || !(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
+        return false;
+    }
+    return (relay >= s_units && relay < s_units + s_units_count);
+}
 
-    if (relay == NULL) {
-        ESP_LOGE(TAG, "NULL value for relay unit");
-        return ESP_ERR_INVALID_ARG;
+/**
+ * @brief: Enter the writer section of in-memory relay units
+ *
+ * Has to wrap every modification of s_units elements. Sections may nest, the sequence counter
+ * is bumped by the outermost one only. Keep the section short and never block on queues inside of it:
+ * readers spin while the section is open.
+ */
+void relay_units_write_lock() {
+    if (s_units_write_lock == NULL) {
+        return;
     }
 
-    // Check if GPIO is initialized
-    if (!relay->gpio_initialized) {
-        ESP_LOGE(TAG, "io_conf not initialized. Cannot continue.");
-        return ESP_ERR_INVALID_ARG;
+    xSemaphoreTakeRecursive(s_units_write_lock, portMAX_DELAY);
+    if (s_units_write_depth++ == 0) {
+        seqlock_write_begin(&s_units_seq);
     }
+}
 
-    // Register ISR handler for sensor-type relays
-    if (relay->type == RELAY_TYPE_SENSOR) {
-        // Add ISR handler for the specific GPIO pin
-        gpio_isr_handler_add(relay->gpio_pin, gpio_isr_handler, (void *)(relay->gpio_pin));
-        ESP_LOGI(TAG, "ISR handler added for GPIO pin %d", relay->gpio_pin);
-    } else {
-        ESP_LOGE(TAG, "Relay unit is not sensor.");
-        return ESP_ERR_INVALID_ARG;
+/**
+ * @brief: Leave the writer section of in-memory relay units
+ */
+void relay_units_write_unlock() {
+    if (s_units_write_lock == NULL) {
+        return;
     }
 
-    return ESP_OK;
+    if (--s_units_write_depth == 0) {
+        seqlock_write_end(&s_units_seq);
+    }
+    xSemaphoreGiveRecursive(s_units_write_lock);
 }
 
-
 /**
- * @brief GPIO interrupt service routine (ISR) handler.
- * 
- * This ISR is triggered when a GPIO interrupt occurs. It reads the GPIO pin state
- * and sends an event to the queue for further processing by a FreeRTOS task.
+ * @brief: Keep in-memory relay units in place
  *
- * @param[in] arg A pointer to the GPIO pin number that triggered the interrupt.
+ * relay_units_reconfigure() waits until relay_units_release() is called, so pointers into in-memory storage stay valid
+ * in between. For configuration paths that resolve a unit once and then block on NVS or drivers: tasks applying
+ * commands resolve units by their handles within a writer section instead. Never call relay_units_reconfigure() while
+ * holding the units.
  */
-void IRAM_ATTR gpio_isr_handler(void *arg) {
-    int gpio_num = (int)arg;
-    gpio_event_t evt;
-    evt.gpio_num = gpio_num;
-    evt.level = gpio_get_level(gpio_num);
-
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    if (gpio_evt_queue != NULL) {
-        if (xQueueSendFromISR(gpio_evt_queue, &evt, &xHigherPriorityTaskWoken) != pdPASS) {
-            // Logging removed: Don't log inside ISR
-        }
+void relay_units_hold() {
+    if (s_units_reconfig_lock != NULL) {
+        xSemaphoreTake(s_units_reconfig_lock, portMAX_DELAY);
     }
+}
 
-    // Perform a context switch if necessary
-    if (xHigherPriorityTaskWoken == pdTRUE) {
-        portYIELD_FROM_ISR();
+/**
+ * @brief: Let relay_units_reconfigure() move in-memory relay units again
+ */
+void relay_units_release() {
+    if (s_units_reconfig_lock != NULL) {
+        xSemaphoreGive(s_units_reconfig_lock);
     }
 }
 
 /**
- * @brief FreeRTOS task to handle GPIO events.
- * 
- * This task processes GPIO events that are posted to the event queue by the ISR.
- * It includes optional debounce logic to filter out bouncing signals and updates 
- * the contact sensor state in NVS if necessary.
+ * @brief: Copy a range of in-memory relay units consistently
  *
- * @param[in] arg Unused task argument.
+ * Lock-free in the common case: the copy is retried if a writer was active. After RELAY_SNAPSHOT_RETRIES
+ * attempts the reader takes the writer mutex, so a low priority writer can not be starved by a spinning reader.
+ *
+ * @param first Index of the first unit in s_units
+ * @param count Number of units to copy
+ * @param[out] dst Destination array, at least count elements
  */
-void gpio_event_task(void *arg) {
-    gpio_event_t evt;
-    while (1) {
-        if (xQueueReceive(gpio_evt_queue, &evt, portMAX_DELAY)) {
-            ESP_LOGI(TAG, "GPIO[%d] intr, val: %d", evt.gpio_num, evt.level);
-
-            // Debouncing logic
-            vTaskDelay(pdMS_TO_TICKS(DEBOUNCE_TIME_MS));
-            int current_level = gpio_get_level(evt.gpio_num);
-            if (current_level != evt.level) {
-                ESP_LOGW(TAG, "Debounce detected, ignoring event");
-                continue;
-            }
-
-            // Get the list of contact sensors from NVS
-            relay_unit_t *sensors = NULL;
-            uint16_t sensor_count = 0;
-            esp_err_t err = get_contact_sensor_list(&sensors, &sensor_count);
-            if (err != ESP_OK || sensors == NULL) {
-                ESP_LOGE(TAG, "Failed to get contact sensor list from NVS");
-                continue;
-            }
+static void relay_units_copy(size_t first, size_t count, relay_unit_t *dst) {
+    if (seqlock_read_copy(&s_units_seq, dst, s_units + first, sizeof(relay_unit_t) * count, RELAY_SNAPSHOT_RETRIES)) {
+        return;
+    }
 
-            // Find the sensor associated with the GPIO pin
-            relay_unit_t *relay = NULL;
-            for (int i = 0; i < sensor_count; i++) {
-                if (sensors[i].gpio_pin == evt.gpio_num) {
-                    relay = &sensors[i];
-                    break;
-                }
-            }
+    ESP_LOGD(TAG, "Relay units are busy, taking writer lock to make the snapshot");
+    if (s_units_write_lock != NULL) {
+        xSemaphoreTakeRecursive(s_units_write_lock, portMAX_DELAY);
+    }
+    memcpy(dst, s_units + first, sizeof(relay_unit_t) * count);
+    if (s_units_write_lock != NULL) {
+        xSemaphoreGiveRecursive(s_units_write_lock);
+    }
+}
 
-            // Update relay state (if necessary)
-            if (relay->inverted) {
-                relay->state = (current_level == 1) ? RELAY_STATE_OFF : RELAY_STATE_ON;
-            } else {
-                relay->state = (current_level == 1) ? RELAY_STATE_ON : RELAY_STATE_OFF;
-            }
-
-
-            // Get NVS key for the contact sensor and save state to NVS
-            char *relay_nvs_key = get_contact_sensor_nvs_key(relay->channel);
-            if (relay_nvs_key == NULL) {
-                ESP_LOGE(TAG, "Failed to get NVS key for channel %d", relay->channel);
-                free_relays_array(sensors, sensor_count);  // Free sensor list before exiting
-                continue;
-            }
-
-            ESP_LOGI(TAG, ">>> Saving new relay contact state (%d) to NVS. Key (%s), channel (%d), pin (%d)", (int)relay->state, relay_nvs_key, relay->channel, relay->gpio_pin);
-            err = save_relay_to_nvs(relay_nvs_key, relay);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to save contact sensor state to NVS");
-                continue;
-            }
-
-            // publish to MQTT
-            uint16_t mqtt_connection_mode;
-            ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mqtt_connection_mode));
-            if (_DEVICE_ENABLE_MQTT && mqtt_connection_mode && IS_MQTT_READY()) {
-                // mqtt_publish_relay_data(relay);
-                // ESP_ERROR_CHECK(trigger_mqtt_publish(get_unit_nvs_key(relay), relay->type));
-                char *key = get_unit_nvs_key(relay);
-                ESP_ERROR_CHECK(trigger_mqtt_publish(key, relay->type));
-                free(key);
-            }
+/**
+ * @brief: Get a consistent copy of a relay unit
+ *
+ * @param relay Pointer to the relay unit. May point into in-memory storage or anywhere else.
+ * @param[out] snapshot Copy of the unit
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_unit_snapshot(const relay_unit_t *relay, relay_unit_t *snapshot) {
+    if (relay == NULL || snapshot == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-            free(relay_nvs_key);  // Free the dynamically allocated NVS key
-            // cleanup if no in-memory storage was used
-            if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
-                free_relays_array(sensors, sensor_count);
-            }
-            
-        }
+    if (relay_is_in_memory(relay)) {
+        relay_units_copy(relay - s_units, 1, snapshot);
+    } else {
+        *snapshot = *relay;
     }
+    return ESP_OK;
 }
 
 /**
- * @brief: Captures the level currently on the GPIO pin and saves it to NVS
- * 
- * @param[in,out] relay Pointer to the relay unit for which GPIO pin shall be refreshed
+ * @brief: Get a consistent copy of the in-memory relay unit by its handle
+ *
+ * The unit is resolved and copied within one read section, so relay_units_reconfigure() can't move another unit
+ * into its place in between. Lock-free like relay_units_copy().
+ *
+ * @param unit Unit handle
+ * @param[out] snapshot Copy of the unit
  * @return esp_err_t result of the operation
  */
-esp_err_t relay_sensor_gpio_state_refresh(relay_unit_t *relay) {
-
-    // is relay an instance ?
-    if (relay == NULL) {
-        ESP_LOGE(TAG, "NULL value for relay unit");
+esp_err_t relay_unit_snapshot_by_handle(unit_handle_t unit, relay_unit_t *snapshot) {
+    if (snapshot == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (relay->type != RELAY_TYPE_SENSOR) {
-        ESP_LOGE(TAG, "Relay unit is not sensor.");
-        return ESP_ERR_INVALID_ARG;
+    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
+        ESP_LOGE(TAG, "Relay units are not loaded in memory.");
+        return ESP_ERR_INVALID_STATE;
     }
 
-    int current_level = gpio_get_level(relay->gpio_pin);
+    for (int attempt = 0; attempt < RELAY_SNAPSHOT_RETRIES; attempt++) {
+        uint32_t seq = seqlock_read_begin(&s_units_seq);
+        if (seq & 1) {
+            continue;
+        }
 
-    // Update relay state (if necessary)
-    if (relay->inverted) {
-        relay->state = (current_level == 1) ? RELAY_STATE_OFF : RELAY_STATE_ON;
-    } else {
-        relay->state = (current_level == 1) ? RELAY_STATE_ON : RELAY_STATE_OFF;
-    }
+        int idx = relay_index_by_channel((relay_type_t)unit.type, unit.index);
+        if (idx != RELAY_INDEX_NONE) {
+            memcpy(snapshot, s_units + idx, sizeof(relay_unit_t));
+        }
 
-    // Get NVS key for the relay and save state to NVS
-    char *relay_nvs_key = get_contact_sensor_nvs_key(relay->channel);
-    if (relay_nvs_key == NULL) {
-        ESP_LOGE(TAG, "Failed to get NVS key for channel %d", relay->channel);
+        if (!seqlock_read_retry(&s_units_seq, seq)) {
+            return (idx != RELAY_INDEX_NONE) ? ESP_OK : ESP_ERR_NOT_FOUND;
+        }
     }
 
-    ESP_LOGI(TAG, ">>> Saving new relay contact state (%d) to NVS. Key (%s), channel (%d), pin (%d)", (int)relay->state, relay_nvs_key, relay->channel, relay->gpio_pin);
-    esp_err_t err = save_relay_to_nvs(relay_nvs_key, relay);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to save contact sensor state to NVS");
+    relay_units_write_lock();
+    int idx = relay_index_by_channel((relay_type_t)unit.type, unit.index);
+    if (idx != RELAY_INDEX_NONE) {
+        *snapshot = s_units[idx];
     }
-
-    free(relay_nvs_key);  // Free the dynamically allocated NVS key
-    return ESP_OK;
+    relay_units_write_unlock();
+    return (idx != RELAY_INDEX_NONE) ? ESP_OK : ESP_ERR_NOT_FOUND;
 }
 
-
 /**
- * @brief: Reset the GPIO pin configuration and free the associated object
- * 
- * @param[out] relay Pointer to the relay unit for which GPIO pin shall be de-initialized and freed
- * @return esp_err_t result of the operation
+ * @brief: Get the range of the in-memory units of one type in s_units. Read within a read or writer section.
+ *
+ * @param type relay_type_t of the units, or RELAY_LIST_ALL for all units
+ * @param[out] first Index of the first unit
+ * @param[out] count Number of units
  */
-esp_err_t relay_gpio_deinit(relay_unit_t *relay) {
-
-    // is relay an instance ?
-    if (relay == NULL) {
-        ESP_LOGE(TAG, "NULL value for relay unit. Nothing to de-init. Channel (%d), type (%d)", relay->channel, relay->type);
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    // Protect against non-initialized GPIO
-    if (!relay->gpio_initialized) {
-        ESP_LOGW(TAG, "GPIO pin %d is not initialized. Nothing to de-init. Channel (%d), type (%d)", relay->gpio_pin, relay->channel, relay->type);
-        return ESP_OK;
+static void relay_units_range(int type, size_t *first, size_t *count) {
+    *first = 0;
+    *count = s_units_count;
+    if (type == RELAY_TYPE_ACTUATOR) {
+        *count = s_relays_count;
+    } else if (type == RELAY_TYPE_SENSOR) {
+        *first = s_relays_count;
+        *count = s_sensors_count;
+    } else if (type == RELAY_TYPE_PULSE_COUNTER) {
+        *first = s_relays_count + s_sensors_count;
+        *count = s_pulse_counters_count;
     }
-
-    // Deinitialize the GPIO pin
-    relay->io_conf = (gpio_config_t){0};
-    relay->gpio_initialized = false;
-
-    ESP_LOGI(TAG, "GPIO pin %d de-initialized. Channel (%d), type (%d)", relay->gpio_pin, relay->channel, relay->type);
-
-    return ESP_OK;
 }
 
 /**
- * @brief Save a relay unit to NVS
+ * @brief: Allocate a consistent copy of the in-memory units of one type, or of all units
  *
- * @param key NVS key
- * @param relay Pointer to the relay unit to be saved
- * @return esp_err_t result of the NVS operation
+ * Counts and units are read within one read section, like relay_units_copy() does, so the copy can't be torn by
+ * relay_units_reconfigure(). The buffer is allocated outside of any section and lock: if the count grew in between,
+ * it is allocated again.
+ *
+ * @param type relay_type_t of the units to copy, or RELAY_LIST_ALL for all units (actuators, sensors, pulse counters)
+ * @param[out] list Pointer to the allocated copy. NULL if there are no units.
+ * @param[out] count Number of units in the copy
+ * @return esp_err_t result of the operation
  */
-esp_err_t save_relay_to_nvs(const char *key, relay_unit_t *relay) {
+static esp_err_t relay_units_list_copy(int type, relay_unit_t **list, uint16_t *count) {
+    relay_unit_t *buf = NULL;
+    size_t capacity = 0;
+    size_t first, n;
+
+    *list = NULL;
+    *count = 0;
+
+    for (int attempt = 0; ; attempt++) {
+        bool copied;
+        if (attempt < RELAY_SNAPSHOT_RETRIES) {
+            uint32_t seq = seqlock_read_begin(&s_units_seq);
+            if (seq & 1) {
+                continue;
+            }
+            relay_units_range(type, &first, &n);
+            // counts read while a writer is active can be anything: keep the copy within s_units until validated
+            if (n <= capacity && n > 0 && first + n <= RELAY_INDEX_UNITS_MAX) {
+                memcpy(buf, s_units + first, sizeof(relay_unit_t) * n);
+            }
+            if (seqlock_read_retry(&s_units_seq, seq)) {
+                continue;
+            }
+            copied = (n <= capacity);
+        } else {
+            // writers kept the counter moving: copy under their lock, still allocating outside of it
+            relay_units_write_lock();
+            relay_units_range(type, &first, &n);
+            copied = (n <= capacity);
+            if (copied && n > 0) {
+                memcpy(buf, s_units + first, sizeof(relay_unit_t) * n);
+            }
+            relay_units_write_unlock();
+        }
 
-    if (relay == NULL) {
-        ESP_LOGE(TAG, "Got NULL as relay. Cannot save.");
-        return ESP_ERR_INVALID_ARG;
-    }
+        if (copied) {
+            break;
+        }
 
-    // create a working copy
-    relay_unit_t *relay_copy = (relay_unit_t *)calloc(1, sizeof(relay_unit_t));
-    if (relay_copy == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for relay copy");
-        return ESP_ERR_NO_MEM;
+        free(buf);
+        buf = calloc(n, sizeof(relay_unit_t));
+        if (buf == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate memory for the copy of %d relay unit(s)", (int)n);
+            return ESP_ERR_NO_MEM;
+        }
+        capacity = n;
     }
-    memcpy(relay_copy, relay, sizeof(relay_unit_t));
-
-    //reset the io_conf property and the flag
-    relay_copy->io_conf = (gpio_config_t){0};
-    relay_copy->gpio_initialized = false;
 
-    // save the copy to NVS
-    esp_err_t err = nvs_write_blob(S_NAMESPACE, key, relay_copy, sizeof(relay_unit_t));
-    if (err == ESP_OK) {
-        ESP_LOGI(TAG, "Relay successfully saved to NVS under key: %s", key);
-    } else {
-        ESP_LOGE(TAG, "Failed to save relay to NVS: %s", esp_err_to_name(err));
+    if (n == 0) {
+        free(buf);
+        return ESP_OK;
     }
 
-    free(relay_copy);
-    return err;
+    *list = buf;
+    *count = (uint16_t)n;
+    return ESP_OK;
 }
 
 /**
- * @brief Load a relay actuator from NVS
- *
- * @param namespace NVS namespace
- * @param key NVS key
- * @param relay Pointer to the relay unit to be loaded, has to be pre-allocated
- * @return esp_err_t result of the NVS operation
+ * @brief: Get precomputed NVS key of the in-memory relay unit
+ * 
+ * Unlike get_unit_nvs_key(), the returned string is not allocated and must not be freed by the caller.
+ * 
+ * @param relay Pointer to the relay unit. Has to point into in-memory storage.
+ * @return NVS key string or NULL if the unit is not in memory
  */
-esp_err_t load_relay_actuator_from_nvs(const char *key, relay_unit_t *relay) {
-    esp_err_t err = nvs_read_blob(S_NAMESPACE, key, relay, sizeof(relay_unit_t));
-    if (err != ESP_OK) {
-        /* ESP_LOGE(TAG, "Failed to load relay from NVS: %s", esp_err_to_name(err)); */
-        return err;
-    }
-
-    if(INIT_RELAY_ON_LOAD) {
-        if(relay_gpio_init(relay) != ESP_OK) {
-            // raise just warning
-            ESP_LOGW(TAG, "Failed to init GPIO pin (%d) for actuator relay unit (%d)", relay->gpio_pin, relay->channel);
-        }
-    } else {
-        relay->io_conf = (gpio_config_t){0};
+const char *get_unit_nvs_key_from_memory(const relay_unit_t *relay) {
+    if (!relay_is_in_memory(relay)) {
+        return NULL;
     }
 
-    ESP_LOGI(TAG, "Relay actuator loaded successfully from NVS under key: %s", key);
-    return ESP_OK;
+    const char *key = s_unit_keys[relay - s_units];
+    return (key[0] != '\0') ? key : NULL;
 }
 
 /**
- * @brief Get a relay actuator from in-memory storage
- * @param channel The relay channel number
+ * @brief: Get a relay unit (actuator or sensor) from in-memory storage by GPIO pin
+ * @param gpio_pin GPIO pin number
  * @param relay Pointer to the relay unit to be returned
  * @return esp_err_t result of the operation
  */
-esp_err_t get_relay_actuator_from_memory_by_channel(int channel, relay_unit_t **relay) {
+esp_err_t get_relay_unit_from_memory_by_gpio(int gpio_pin, relay_unit_t **relay) {
     if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
         ESP_LOGE(TAG, "Relay units are not loaded in memory.");
         return ESP_ERR_INVALID_STATE;
     }
 
-    for (int i = 0; i < s_units_count; i++) {
-        if (s_units[i].type == RELAY_TYPE_ACTUATOR && s_units[i].channel == channel) {
-            // return pointer to the found relay
-            *relay = &s_units[i];
-            return ESP_OK;
-        }
+    if (gpio_pin < RELAY_GPIO_PIN_MIN || gpio_pin > RELAY_GPIO_PIN_MAX || s_unit_idx_by_gpio[gpio_pin] == RELAY_INDEX_NONE) {
+        ESP_LOGD(TAG, "Relay unit with GPIO pin %d not found in memory.", gpio_pin);
+        return ESP_ERR_NOT_FOUND;
     }
 
-    ESP_LOGE(TAG, "Actuator relay with channel %d not found in memory.", channel);
-    return ESP_ERR_NOT_FOUND;
+    *relay = &s_units[(int)s_unit_idx_by_gpio[gpio_pin]];
+    return ESP_OK;
 }
 
 /**
- * @brief Get a relay actuator from in-memory storage by NVS key
- * @param key The NVS key
+ * @brief: Get a relay unit (actuator or sensor) from in-memory storage by its handle
+ * @param unit Unit handle
  * @param relay Pointer to the relay unit to be returned
  * @return esp_err_t result of the operation
  */
-esp_err_t get_relay_actuator_from_memory_by_key(const char *key, relay_unit_t **relay) {
-    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
-        ESP_LOGE(TAG, "Relay units are not loaded in memory.");
-        return ESP_ERR_INVALID_STATE;
-    }
-
-    for (int i = 0; i < s_units_count; i++) {
-        char *nvs_key = get_relay_nvs_key(s_units[i].channel);
-        if (s_units[i].type == RELAY_TYPE_ACTUATOR && nvs_key != NULL && strcmp(nvs_key, key) == 0) {
-            free(nvs_key);
-            // return pointer to the found relay
-            *relay = &s_units[i];
-            return ESP_OK;
-        }
-        free(nvs_key);
+esp_err_t get_relay_unit_from_memory_by_handle(unit_handle_t unit, relay_unit_t **relay) {
+    if (unit.type == RELAY_TYPE_ACTUATOR) {
+        return get_relay_actuator_from_memory_by_channel(unit.index, relay);
+    } else if (unit.type == RELAY_TYPE_SENSOR) {
+        return get_relay_sensor_from_memory_by_channel(unit.index, relay);
+    } else if (unit.type == RELAY_TYPE_PULSE_COUNTER) {
+        return get_relay_pulse_counter_from_memory_by_channel(unit.index, relay);
     }
 
-    ESP_LOGE(TAG, "Actuator relay with key %s not found in memory.", key);
-    return ESP_ERR_NOT_FOUND;
+    ESP_LOGE(TAG, "Invalid relay unit handle type %d", unit.type);
+    return ESP_ERR_INVALID_ARG;
 }
 
 /**
- * @brief Load a relay sensor from NVS
- *
- * @param key NVS key
- * @param relay Pointer to the relay unit to be loaded
- * @return esp_err_t result of the NVS operation
+ * @brief: Get the handle of a relay unit
+ * @param relay Pointer to the relay unit
+ * @return Unit handle
  */
-esp_err_t load_relay_sensor_from_nvs(const char *key, relay_unit_t *relay) {
-    esp_err_t err = nvs_read_blob(S_NAMESPACE, key, relay, sizeof(relay_unit_t));
-    if (err != ESP_OK) {
-        /* ESP_LOGE(TAG, "Failed to load relay from NVS: %s", esp_err_to_name(err)); */
-        return err;
-    }
-
-    if(INIT_SENSORS_ON_LOAD) {
-        if(relay_gpio_init(relay) != ESP_OK) {
-            // raise just warning
-            ESP_LOGW(TAG, "Failed to init GPIO pin (%d) for contact sensor relay unit (%d)", relay->gpio_pin, relay->channel);
-        }
-    } else {
-        relay->io_conf = (gpio_config_t){0};
-    }
-
-
-    ESP_LOGI(TAG, "Relay sensor loaded successfully from NVS under key: %s", key);
-    return ESP_OK;
+unit_handle_t get_unit_handle(const relay_unit_t *relay) {
+    unit_handle_t unit = {
+        .type = (uint8_t)relay->type,
+        .index = (uint8_t)relay->channel,
+    };
+    return unit;
 }
 
 /**
- * @brief Get a relay sensor from in-memory storage
- * @param channel The relay channel number
- * @param relay Pointer to the relay unit to be returned
+ * @brief: Resolve the handle of an in-memory relay unit from its NVS key
+ * 
+ * Used at MQTT/HTTP boundaries to convert the key once, no memory is allocated.
+ * 
+ * @param key NVS key of the unit, e.g. "relay_ch_0", "relay_sn_1" or "relay_pc_0"
+ * @param[out] unit Unit handle
  * @return esp_err_t result of the operation
  */
-esp_err_t get_relay_sensor_from_memory_by_channel(int channel, relay_unit_t **relay) {
-    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
-        ESP_LOGE(TAG, "Relay units are not loaded in memory.");
-        return ESP_ERR_INVALID_STATE;
+esp_err_t get_unit_handle_from_key(const char *key, unit_handle_t *unit) {
+    if (key == NULL || unit == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    for (int i = 0; i < s_units_count; i++) {
-        if (s_units[i].type == RELAY_TYPE_SENSOR && s_units[i].channel == channel) {
-            // return pointer to the found relay
-            *relay = &s_units[i];
-            return ESP_OK;
-        }
+    // index and unit are read in one section: relay_units_reconfigure() may move units meanwhile
+    relay_units_write_lock();
+    int idx = relay_index_from_key(key, RELAY_TYPE_ACTUATOR);
+    if (idx == RELAY_INDEX_NONE) {
+        idx = relay_index_from_key(key, RELAY_TYPE_SENSOR);
+    }
+    if (idx == RELAY_INDEX_NONE) {
+        idx = relay_index_from_key(key, RELAY_TYPE_PULSE_COUNTER);
     }
+    if (idx != RELAY_INDEX_NONE) {
+        *unit = get_unit_handle(&s_units[idx]);
+    }
+    relay_units_write_unlock();
 
-    ESP_LOGE(TAG, "Sensor relay with channel %d not found in memory.", channel);
-    return ESP_ERR_NOT_FOUND;
+    if (idx == RELAY_INDEX_NONE) {
+        ESP_LOGE(TAG, "Relay unit with key %s not found in memory.", key);
+        return ESP_ERR_NOT_FOUND;
+    }
+    return ESP_OK;
 }
 
 /**
- * @brief Get a relay sensor from in-memory storage by NVS key
- * @param key The NVS key
- * @param relay Pointer to the relay unit to be returned
+ * @brief: Dump all relay units currently stored in memory
  * @return esp_err_t result of the operation
  */
-esp_err_t get_relay_sensor_from_memory_by_key(const char *key, relay_unit_t **relay) {
+esp_err_t dump_relay_units_in_memory() {
     if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
-        ESP_LOGE(TAG, "Relay units are not loaded in memory.");
+        ESP_LOGW(TAG, "Relay units are not loaded in memory.");
         return ESP_ERR_INVALID_STATE;
     }
 
-    for (int i = s_units_count - s_sensors_count; i < s_units_count; i++) {
-        char *nvs_key = get_contact_sensor_nvs_key(s_units[i].channel);
-        if (s_units[i].type == RELAY_TYPE_SENSOR && nvs_key != NULL && strcmp(nvs_key, key) == 0) {
-            free(nvs_key);
-            // return pointer to the found relay
-            *relay = &s_units[i];
-            return ESP_OK;
-        }
-        free(nvs_key);
+    ESP_LOGI(TAG, "Dumping %d relay units in memory:", s_units_count);
+    for (int i = 0; i < s_units_count; i++) {
+        relay_unit_t *relay = &s_units[i];
+        const char *type_str = (relay->type == RELAY_TYPE_ACTUATOR) ? "Actuator" : (relay->type == RELAY_TYPE_SENSOR) ? "Sensor" : "Pulse counter";
+        ESP_LOGI(TAG, "Channel: %d, Type: %s, GPIO Pin: %d, State: %d, Inverted: %d, Enabled: %d, GPIO Initialized: %d",
+                 relay->channel, type_str, relay->gpio_pin, relay->state,
+                 relay->inverted, relay->enabled, relay->gpio_initialized);
     }
 
-    ESP_LOGE(TAG, "Sensor relay with key %s not found in memory.", key);
-    return ESP_ERR_NOT_FOUND;
-}
+    return ESP_OK;
+}   
 
 /**
- * @brief Get the NVS key for a relay channel
- *
- * @param channel The relay channel number
- * @return Dynamically allocated string with the NVS key, or NULL if out of range
+ * @brief: Init relay unit's (either actuator or sensor) GPIO. It defines GPIO pin parameters according to the relay type (actuator or contact sensor), and calls gpio_config().
+ * 
+ * @param[in,out] relay Pointer to the relay unit for which GPIO pin shall be initialized
+ * @return esp_err_t result of the operation
  */
-char *get_relay_nvs_key(int channel) {
-    // Check if the channel is within the valid range
-    if (channel < CHANNEL_COUNT_MIN || channel > CHANNEL_COUNT_MAX) {
-        ESP_LOGE(TAG, "Channel %d is out of valid range (%d - %d)", channel, CHANNEL_COUNT_MIN, CHANNEL_COUNT_MAX);
-        return NULL;
+esp_err_t relay_gpio_init(relay_unit_t *relay) {
+    if (relay == NULL) {
+        ESP_LOGE(TAG, "NULL value for relay unit");
+        return ESP_ERR_INVALID_ARG;
     }
 
-    // Allocate memory for the key string
-    size_t key_size = snprintf(NULL, 0, "%s%d", S_KEY_CH_PREFIX, channel) + 1;
-    char *key = malloc(key_size);
-    if (key == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for NVS key");
-        return NULL;
+    // check gpio init flag
+    if (relay->gpio_initialized) {
+        ESP_LOGW(TAG, "GPIO pin %d seems to be already inialized. Flag set to TRUE. Potential risk of memory leak.", relay->gpio_pin);
     }
 
-    // Create the key string
-    snprintf(key, key_size, "%s%d", S_KEY_CH_PREFIX, channel);
+    gpio_config_t io_conf = {0};
+    io_conf.pin_bit_mask = (1ULL << relay->gpio_pin);
+    
+    // Configure GPIO based on relay type (actuator or sensor)
+    switch (relay->type) {
+        case RELAY_TYPE_SENSOR:
+            io_conf.mode = GPIO_MODE_INPUT;
+            io_conf.pull_up_en = GPIO_PULLUP_ENABLE;     // Enable pull-up
+            io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;  // Disable pull-down
+            io_conf.intr_type = GPIO_INTR_ANYEDGE;  // Interrupt on any edge
+            break;
 
-    return key;
+        case RELAY_TYPE_ACTUATOR:
+            io_conf.mode = GPIO_MODE_OUTPUT;
+            io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
+            io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
+            io_conf.intr_type = GPIO_INTR_DISABLE;
+            break;
+
+        case RELAY_TYPE_PULSE_COUNTER:
+            io_conf.mode = GPIO_MODE_INPUT;
+            io_conf.pull_up_en = GPIO_PULLUP_ENABLE;     // Open collector outputs (S0, reed switches) pull the line down
+            io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
+            io_conf.intr_type = GPIO_INTR_DISABLE;      // Edges are counted by PCNT, no CPU interrupts
+            break;
+
+        default:
+            ESP_LOGE(TAG, "Invalid relay type: %d", relay->type);
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    // Apply GPIO configuration
+    esp_err_t err = gpio_config(&io_conf);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "GPIO configuration failed for pin %d, error: %s", relay->gpio_pin, esp_err_to_name(err));
+        return err;
+    }
+
+    // Assign io_conf to relay struct
+    relay->io_conf = io_conf;
+
+    // set flag to true
+    relay->gpio_initialized = true;
+
+    return ESP_OK;
 }
 
 /**
- * @brief Get the NVS key for a contact sensor channel
- *
- * @param channel The relay contact sensor number
- * @return Dynamically allocated string with the NVS key, or NULL if out of range
+ * @brief: Register ISR interrupt handler to the pin of the sensor
+ * 
+ * @param[in,out] relay Pointer to the relay unit for which GPIO pin shall ISR be registered
+ * @return esp_err_t result of the operation
  */
-char *get_contact_sensor_nvs_key(int channel) {
-    // Check if the channel is within the valid range
-    if (channel < CONTACT_SENSORS_COUNT_MIN || channel > CONTACT_SENSORS_COUNT_MAX) {
-        ESP_LOGE(TAG, "Channel %d is out of valid range (%d - %d)", channel, CONTACT_SENSORS_COUNT_MIN, CONTACT_SENSORS_COUNT_MAX);
-        return NULL;
+esp_err_t relay_sensor_register_isr(relay_unit_t *relay) {
+
+    if (relay == NULL) {
+        ESP_LOGE(TAG, "NULL value for relay unit");
+        return ESP_ERR_INVALID_ARG;
     }
 
-    // Allocate memory for the key string
-    size_t key_size = snprintf(NULL, 0, "%s%d", S_KEY_SN_PREFIX, channel) + 1;
-    char *key = malloc(key_size);
-    if (key == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for NVS key");
-        return NULL;
+    // Check if GPIO is initialized
+    if (!relay->gpio_initialized) {
+        ESP_LOGE(TAG, "io_conf not initialized. Cannot continue.");
+        return ESP_ERR_INVALID_ARG;
     }
 
-    // Create the key string
-    snprintf(key, key_size, "%s%d", S_KEY_SN_PREFIX, channel);
+    // Scan mode: no interrupt on the pin, just add it to the scanned ones
+    if (relay->type == RELAY_TYPE_SENSOR && s_sensors_acq_mode == SENSORS_ACQ_MODE_SCAN) {
+        if (relay->gpio_pin < 0 || relay->gpio_pin >= GPIO_NUM_MAX) {
+            ESP_LOGE(TAG, "Invalid GPIO pin %d", relay->gpio_pin);
+            return ESP_ERR_INVALID_ARG;
+        }
+        gpio_intr_disable(relay->gpio_pin);
 
-    return key;
+        s_gpio_dispatch[relay->gpio_pin] = relay_is_in_memory(relay) ? relay : NULL;
+
+        portENTER_CRITICAL(&s_scan_mux);
+        scan_filter_set_pin(&s_scan_filter, relay->gpio_pin, true, gpio_get_level(relay->gpio_pin));
+        portEXIT_CRITICAL(&s_scan_mux);
+
+        ESP_LOGI(TAG, "GPIO pin %d added to input scan", relay->gpio_pin);
+        return ESP_OK;
+    }
+
+    // Register ISR handler for sensor-type relays
+    if (relay->type == RELAY_TYPE_SENSOR) {
+        // Start debouncing from the level currently on the pin
+        relay_sensor_debounce_reset(relay);
+
+        // Add ISR handler for the specific GPIO pin
+        gpio_isr_handler_add(relay->gpio_pin, gpio_isr_handler, (void *)(relay->gpio_pin));
+        ESP_LOGI(TAG, "ISR handler added for GPIO pin %d", relay->gpio_pin);
+
+        // Dispatch edges on the pin directly to the in-memory unit
+        if (relay->gpio_pin >= 0 && relay->gpio_pin < GPIO_NUM_MAX) {
+            s_gpio_dispatch[relay->gpio_pin] = relay_is_in_memory(relay) ? relay : NULL;
+        }
+    } else {
+        ESP_LOGE(TAG, "Relay unit is not sensor.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
 }
 
+/**
+ * @brief: Get effective debounce window of the unit
+ * 
+ * @param relay Pointer to the relay unit
+ * @return debounce window in milliseconds
+ */
+static uint32_t relay_debounce_window_ms(const relay_unit_t *relay) {
+    return (relay->debounce_ms > 0) ? relay->debounce_ms : DEBOUNCE_TIME_MS;
+}
 
 /**
- * @brief: Get NVS key for the provided relay
+ * @brief: (Re)initialize debounce state of the sensor pin with the unit's debounce window and the current pin level
  * 
- * @param relay Pointer to the relay_unit_t structure
- * @return Dynamically allocated string with the NVS key, or NULL if type or other params are out of range
+ * @param relay Pointer to the relay unit (contact sensor)
+ * @return esp_err_t result of the operation
  */
-char *get_unit_nvs_key(const relay_unit_t *relay) {
+esp_err_t relay_sensor_debounce_reset(relay_unit_t *relay) {
 
-    // is relay an instance ?
-    if (relay == NULL) {
-        ESP_LOGE(TAG, "NULL value for relay unit");
-        return NULL;
+    if (relay == NULL || relay->type != RELAY_TYPE_SENSOR) {
+        ESP_LOGE(TAG, "NULL value or not a sensor relay unit");
+        return ESP_ERR_INVALID_ARG;
     }
-    // Configure GPIO based on relay type (actuator or sensor)
-    switch (relay->type) {
-        case RELAY_TYPE_SENSOR:
-            return get_contact_sensor_nvs_key(relay->channel);
-            break;
-        case RELAY_TYPE_ACTUATOR:
-            return get_relay_nvs_key(relay->channel);
-            break;
-        default:
-            ESP_LOGE(TAG, "Invalid relay type: %d", relay->type);
-            return NULL;
+
+    if (relay->gpio_pin < 0 || relay->gpio_pin >= GPIO_NUM_MAX) {
+        ESP_LOGE(TAG, "Invalid GPIO pin %d", relay->gpio_pin);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t window_ms = relay_debounce_window_ms(relay);
+
+    portENTER_CRITICAL(&s_debounce_mux);
+    debounce_pin_init(&s_debounce[relay->gpio_pin], gpio_get_level(relay->gpio_pin), window_ms * 1000);
+    portEXIT_CRITICAL(&s_debounce_mux);
+
+    ESP_LOGI(TAG, "Debounce window for GPIO pin %d set to %u ms", relay->gpio_pin, (unsigned int)window_ms);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Remove ISR interrupt handler from the GPIO pin previously used by a sensor
+ * 
+ * @param gpio_pin GPIO pin number the ISR handler was registered for
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_sensor_unregister_isr(int gpio_pin) {
+
+    if (gpio_pin < 0 || gpio_pin >= GPIO_NUM_MAX) {
+        ESP_LOGE(TAG, "Invalid GPIO pin %d", gpio_pin);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_gpio_dispatch[gpio_pin] = NULL;
+
+    if (s_sensors_acq_mode == SENSORS_ACQ_MODE_SCAN) {
+        portENTER_CRITICAL(&s_scan_mux);
+        scan_filter_set_pin(&s_scan_filter, gpio_pin, false, 0);
+        s_scan_changed &= ~(1ULL << gpio_pin);
+        portEXIT_CRITICAL(&s_scan_mux);
+        ESP_LOGI(TAG, "GPIO pin %d removed from input scan", gpio_pin);
+        return ESP_OK;
+    }
+
+    esp_err_t err = gpio_isr_handler_remove(gpio_pin);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Unable to remove ISR handler for GPIO pin %d: %s", gpio_pin, esp_err_to_name(err));
+        return err;
     }
+
+    ESP_LOGI(TAG, "ISR handler removed for GPIO pin %d", gpio_pin);
+    return ESP_OK;
 }
 
 
 /**
- * @brief Determines the relay type from the relay_key.
+ * @brief GPIO interrupt service routine (ISR) handler.
  * 
- * This function checks the prefix of the provided relay_key and determines whether
- * the relay is an actuator or a contact sensor based on the prefix.
+ * This ISR is triggered when a GPIO interrupt occurs. It reads the GPIO pin state
+ * and sends an event to the queue for further processing by a FreeRTOS task.
+ *
+ * @param[in] arg A pointer to the GPIO pin number that triggered the interrupt.
+ */
+void IRAM_ATTR gpio_isr_handler(void *arg) {
+    int gpio_num = (int)arg;
+    gpio_event_t evt;
+    evt.gpio_num = gpio_num;
+    evt.level = gpio_get_level(gpio_num);
+
+    // Just record the edge. The pin is settled by gpio_event_task() when its debounce window expires.
+    portENTER_CRITICAL_ISR(&s_debounce_mux);
+    bool first_edge = debounce_pin_edge(&s_debounce[gpio_num], evt.level, esp_timer_get_time());
+    portEXIT_CRITICAL_ISR(&s_debounce_mux);
+
+    // Only the first edge of the train wakes up the task, so the queue holds at most one event per pin
+    if (!first_edge) {
+        return;
+    }
+
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    if (gpio_evt_queue == NULL || xQueueSendFromISR(gpio_evt_queue, &evt, &xHigherPriorityTaskWoken) != pdPASS) {
+        // Nobody is going to poll the pin: drop the edge train, so the next edge starts a new one and posts again
+        portENTER_CRITICAL_ISR(&s_debounce_mux);
+        debounce_pin_drop(&s_debounce[gpio_num]);
+        portEXIT_CRITICAL_ISR(&s_debounce_mux);
+    }
+
+    // Perform a context switch if necessary
+    if (xHigherPriorityTaskWoken == pdTRUE) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/**
+ * @brief: Debounce timer callback. Wakes up gpio_event_task() to settle pending pins.
  * 
- * @param[in] relay_key The key that identifies the relay (e.g., "relay_ch_0" or "relay_sn_1").
- * @return relay_type_t The type of relay (RELAY_TYPE_ACTUATOR or RELAY_TYPE_SENSOR). 
- *         Returns -1 if the prefix doesn't match.
+ * @param arg Unused
  */
-relay_type_t get_relay_type_from_key(const char *relay_key) {
-    // Check for the actuator prefix
-    if (strncmp(relay_key, S_KEY_CH_PREFIX, strlen(S_KEY_CH_PREFIX)) == 0) {
-        return RELAY_TYPE_ACTUATOR;
+static void debounce_timer_cb(void *arg) {
+    gpio_event_t evt = { .gpio_num = GPIO_EVENT_DEBOUNCE_TIMER, .level = 0 };
+    if (gpio_evt_queue == NULL) {
+        return;
     }
-    // Check for the contact sensor prefix
-    else if (strncmp(relay_key, S_KEY_SN_PREFIX, strlen(S_KEY_SN_PREFIX)) == 0) {
-        return RELAY_TYPE_SENSOR;
+    if (xQueueSend(gpio_evt_queue, &evt, 0) != pdPASS) {
+        // queue is full: the task is awake anyway, but make sure pending pins are not forgotten
+        esp_timer_start_once(s_debounce_timer, 1000);
     }
-    // Return -1 for unknown types
-    else {
-        ESP_LOGE(TAG, "Unknown relay type for key: %s", relay_key);
-        return -1;
+}
+
+/**
+ * @brief: Post an event to gpio_event_task() from task or timer context
+ * 
+ * @param gpio_num GPIO pin number or one of GPIO_EVENT_* values
+ * @param level Level of the pin or event argument
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if the task is not running, ESP_FAIL if the queue is full
+ */
+esp_err_t gpio_event_post(int gpio_num, int level) {
+    gpio_event_t evt = { .gpio_num = gpio_num, .level = level };
+    if (gpio_evt_queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
     }
+    return (xQueueSend(gpio_evt_queue, &evt, 0) == pdPASS) ? ESP_OK : ESP_FAIL;
 }
 
 /**
- * @brief Serialize relay_unit_t structure to a JSON string
- *
- * This function takes a pointer to a relay_unit_t structure and serializes its fields 
- * into a JSON formatted string. The returned JSON string should be freed by the caller 
- * using `free()` after use.
- *
- * @param[in] relay Pointer to the relay_unit_t structure to be serialized
- * @return A dynamically allocated JSON string representing the relay_unit_t structure,
- *         or NULL if serialization fails.
+ * @brief: Read the levels of all GPIO pins at once
+ * 
+ * @return input levels, bit per GPIO number
  */
-char* serialize_relay_unit(const relay_unit_t *relay) {
-    cJSON *relay_json = cJSON_CreateObject();
-    if (relay_json == NULL) {
-        ESP_LOGE(TAG, "Failed to create JSON object for relay serialization");
-        return NULL;
+static inline uint64_t relay_scan_read_inputs() {
+    uint64_t levels = REG_READ(GPIO_IN_REG);
+#if SOC_GPIO_PIN_COUNT > 32
+    levels |= (uint64_t)REG_READ(GPIO_IN1_REG) << 32;
+#endif
+    return levels;
+}
+
+/**
+ * @brief: Input scan timer callback. Samples all pins, filters them and wakes up gpio_event_task() if any pin flipped.
+ * 
+ * @param arg Unused
+ */
+static void relay_scan_timer_cb(void *arg) {
+    uint64_t sample = relay_scan_read_inputs();
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_scan_mux);
+    uint64_t changed = scan_filter_update(&s_scan_filter, sample);
+    if (changed != 0 && s_scan_changed == 0) {
+        s_scan_changed_us = now_us;
     }
+    s_scan_changed |= changed;
+    bool notify = (s_scan_changed != 0 && !s_scan_notified);
+    portEXIT_CRITICAL(&s_scan_mux);
 
-    // Generate relay_key based on type
-    char *relay_key = (relay->type == RELAY_TYPE_ACTUATOR) ? get_relay_nvs_key(relay->channel) : get_contact_sensor_nvs_key(relay->channel);
-    cJSON_AddStringToObject(relay_json, "relay_key", relay_key);
+    if (!notify || gpio_evt_queue == NULL) {
+        return;
+    }
 
-    // Serialize the fields
-    cJSON_AddNumberToObject(relay_json, "channel", relay->channel);
-    cJSON_AddBoolToObject(relay_json, "state", relay->state == RELAY_STATE_ON);
-    cJSON_AddBoolToObject(relay_json, "inverted", relay->inverted);
-    cJSON_AddNumberToObject(relay_json, "gpio_pin", relay->gpio_pin);
-    cJSON_AddBoolToObject(relay_json, "enabled", relay->enabled);
-    cJSON_AddNumberToObject(relay_json, "type", relay->type);
+    // if the queue is full the batch stays pending and the next tick tries again
+    gpio_event_t evt = { .gpio_num = GPIO_EVENT_SCAN, .level = 0 };
+    if (xQueueSend(gpio_evt_queue, &evt, 0) == pdPASS) {
+        portENTER_CRITICAL(&s_scan_mux);
+        s_scan_notified = true;
+        portEXIT_CRITICAL(&s_scan_mux);
+    }
+}
 
-    // Convert the JSON object to a string
-    char *json_string = cJSON_PrintUnformatted(relay_json);
-    if (json_string == NULL) {
-        ESP_LOGE(TAG, "Failed to convert relay JSON object to string");
+/**
+ * @brief: Apply settled level of the contact sensor pin: update the state, save it to NVS and publish to MQTT
+ * 
+ * @param pin GPIO pin of the contact sensor
+ * @param level Settled level on the pin
+ * @param edge_us ISR timestamp of the first edge, origin of the event for latency tracing
+ */
+static void gpio_event_apply_level(int pin, int level, int64_t edge_us) {
+
+    int64_t t_start = esp_timer_get_time();
+
+    // Update relay state (if necessary). The unit is resolved under the writer lock: relay_units_reconfigure() may
+    // have moved it or taken it down since the edge was seen, and may move it again once the lock is released.
+    // Everything after the unlock works on a copy of the unit and its handle.
+    relay_units_write_lock();
+    relay_unit_t *relay = s_gpio_dispatch[pin];
+    if (relay == NULL) {
+        relay_units_write_unlock();
+        ESP_LOGD(TAG, "GPIO[%d] has no contact sensor anymore, level ignored", pin);
+        return;
+    }
+    if (relay->inverted) {
+        relay->state = (level == 1) ? RELAY_STATE_OFF : RELAY_STATE_ON;
+    } else {
+        relay->state = (level == 1) ? RELAY_STATE_ON : RELAY_STATE_OFF;
     }
+    relay_unit_t sensor = *relay;
+    unit_handle_t unit = get_unit_handle(relay);
 
-    // Free the JSON object and relay_key
-    cJSON_Delete(relay_json);
-    free(relay_key);
+    // Schedule saving state to NVS. Only marks the unit dirty, so it is done while the unit can not move.
+    int64_t t_stage = esp_timer_get_time();
+    esp_err_t err = relay_persist_mark_dirty(relay);
+    relay_units_write_unlock();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save contact sensor state to NVS. Channel (%d), pin (%d)", sensor.channel, pin);
+    } else {
+        latency_record_since(LATENCY_PATH_SENSOR, LATENCY_STAGE_NVS, t_stage);
+        ESP_LOGI(TAG, ">>> Saving new relay contact state (%d) to NVS. Channel (%d), pin (%d)", (int)sensor.state, sensor.channel, pin);
+    }
+
+    // Run on-device rules: the actuators should not wait for MQTT
+    rules_on_sensor_change(&sensor, edge_us);
+
+    // publish to MQTT
+    if (_DEVICE_ENABLE_MQTT && mqtt_config_connection_mode() && IS_MQTT_READY()) {
+        // a unit without a topic slot (e.g. while the topic table is rebuilt) is logged by the trigger and skipped
+        t_stage = esp_timer_get_time();
+        if (trigger_mqtt_publish_traced(unit, LATENCY_PATH_SENSOR, edge_us) == ESP_OK) {
+            latency_record_since(LATENCY_PATH_SENSOR, LATENCY_STAGE_ENQUEUE, t_stage);
+        }
+    }
+
+    ESP_LOGD(TAG, "GPIO[%d] edge processed in %lld us", pin, (long long)(esp_timer_get_time() - t_start));
+}
+
+/**
+ * @brief: Settle all pins whose debounce window has expired and re-arm the debounce timer for the earliest pending one
+ */
+static void gpio_event_debounce_process() {
+    int64_t next_deadline = DEBOUNCE_NO_DEADLINE;
+
+    for (int pin = 0; pin < GPIO_NUM_MAX; pin++) {
+        relay_unit_t *relay = s_gpio_dispatch[pin];
+        if (relay == NULL) {
+            continue;
+        }
+
+        portENTER_CRITICAL(&s_debounce_mux);
+        int level = gpio_get_level(pin);
+        int64_t now_us = esp_timer_get_time();
+        int64_t edge_us = s_debounce[pin].first_edge_us;    // ISR timestamp of the edge train
+        debounce_result_t result = debounce_pin_poll(&s_debounce[pin], level, now_us);
+        int64_t deadline = debounce_pin_deadline(&s_debounce[pin]);
+        portEXIT_CRITICAL(&s_debounce_mux);
+
+        switch (result) {
+            case DEBOUNCE_CHANGED:
+                latency_record(LATENCY_PATH_SENSOR, LATENCY_STAGE_DEBOUNCE, now_us - edge_us);
+                gpio_event_apply_level(pin, level, edge_us);
+                break;
+            case DEBOUNCE_BOUNCED:
+                ESP_LOGW(TAG, "Debounce detected on GPIO[%d], ignoring event", pin);
+                break;
+            default:
+                break;
+        }
+
+        if (deadline < next_deadline) {
+            next_deadline = deadline;
+        }
+    }
+
+    if (next_deadline == DEBOUNCE_NO_DEADLINE || s_debounce_timer == NULL) {
+        return;
+    }
+
+    int64_t delay_us = next_deadline - esp_timer_get_time();
+    if (delay_us < 1) {
+        delay_us = 1;
+    }
+    esp_timer_stop(s_debounce_timer);  // not running is fine
+    if (esp_timer_start_once(s_debounce_timer, (uint64_t)delay_us) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to arm debounce timer");
+    }
+}
+
+/**
+ * @brief: Apply filtered levels of all pins flipped since the last batch taken from the input scan
+ */
+static void gpio_event_scan_process() {
+    portENTER_CRITICAL(&s_scan_mux);
+    uint64_t changed = s_scan_changed;
+    uint64_t levels = s_scan_filter.state;
+    int64_t changed_us = s_scan_changed_us;
+    s_scan_changed = 0;
+    s_scan_notified = false;
+    portEXIT_CRITICAL(&s_scan_mux);
+
+    while (changed != 0) {
+        int pin = __builtin_ctzll(changed);
+        changed &= changed - 1;
+
+        if (pin >= GPIO_NUM_MAX || s_gpio_dispatch[pin] == NULL) {
+            continue;
+        }
+        gpio_event_apply_level(pin, (int)((levels >> pin) & 1ULL), changed_us);
+    }
+}
+
+/**
+ * @brief FreeRTOS task to handle GPIO events.
+ * 
+ * This task processes GPIO events that are posted to the event queue by the ISR, by the
+ * debounce timer and by the input scan timer. Every wake up settles all pins whose debounce window has expired
+ * (or applies the batch of pins flipped by the scan filter),
+ * updates the contact sensor state in NVS and publishes it to MQTT if necessary.
+ *
+ * @param[in] arg Unused task argument.
+ */
+void gpio_event_task(void *arg) {
+    gpio_event_t evt;
+
+    while (1) {
+        if (xQueueReceive(gpio_evt_queue, &evt, portMAX_DELAY)) {
+            if (evt.gpio_num == GPIO_EVENT_SCAN) {
+                gpio_event_scan_process();
+                continue;
+            }
+            if (evt.gpio_num == GPIO_EVENT_RULE) {
+                rules_run_delayed(evt.level);
+                continue;
+            }
+            if (evt.gpio_num != GPIO_EVENT_DEBOUNCE_TIMER) {
+                ESP_LOGI(TAG, "GPIO[%d] intr, val: %d", evt.gpio_num, evt.level);
+            }
+            gpio_event_debounce_process();
+        }
+    }
+}
+
+/**
+ * @brief: Captures the level currently on the GPIO pin and saves it to NVS
+ * 
+ * @param[in,out] relay Pointer to the relay unit for which GPIO pin shall be refreshed
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_sensor_gpio_state_refresh(relay_unit_t *relay) {
+
+    // is relay an instance ?
+    if (relay == NULL) {
+        ESP_LOGE(TAG, "NULL value for relay unit");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (relay->type != RELAY_TYPE_SENSOR) {
+        ESP_LOGE(TAG, "Relay unit is not sensor.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int current_level = gpio_get_level(relay->gpio_pin);
+
+    // Update relay state (if necessary)
+    relay_units_write_lock();
+    if (relay->inverted) {
+        relay->state = (current_level == 1) ? RELAY_STATE_OFF : RELAY_STATE_ON;
+    } else {
+        relay->state = (current_level == 1) ? RELAY_STATE_ON : RELAY_STATE_OFF;
+    }
+    relay_units_write_unlock();
+
+    // Save state to NVS (write-behind for in-memory units)
+    ESP_LOGI(TAG, ">>> Saving new relay contact state (%d) to NVS. Channel (%d), pin (%d)", (int)relay->state, relay->channel, relay->gpio_pin);
+    esp_err_t err = relay_persist_mark_dirty(relay);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save contact sensor state to NVS");
+    }
+
+    return ESP_OK;
+}
+
+
+/**
+ * @brief: Reset the GPIO pin configuration and free the associated object
+ * 
+ * @param[out] relay Pointer to the relay unit for which GPIO pin shall be de-initialized and freed
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_gpio_deinit(relay_unit_t *relay) {
+
+    // is relay an instance ?
+    if (relay == NULL) {
+        ESP_LOGE(TAG, "NULL value for relay unit. Nothing to de-init. Channel (%d), type (%d)", relay->channel, relay->type);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Protect against non-initialized GPIO
+    if (!relay->gpio_initialized) {
+        ESP_LOGW(TAG, "GPIO pin %d is not initialized. Nothing to de-init. Channel (%d), type (%d)", relay->gpio_pin, relay->channel, relay->type);
+        return ESP_OK;
+    }
+
+    // Deinitialize the GPIO pin
+    relay->io_conf = (gpio_config_t){0};
+    relay->gpio_initialized = false;
+
+    ESP_LOGI(TAG, "GPIO pin %d de-initialized. Channel (%d), type (%d)", relay->gpio_pin, relay->channel, relay->type);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief: De-initialize the GPIO pin of the in-memory relay unit by its handle
+ * 
+ * The unit is resolved and changed in one writer section: relay_units_reconfigure() can't move it in between.
+ * 
+ * @param unit Unit handle
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_gpio_deinit_by_handle(unit_handle_t unit) {
+    relay_units_write_lock();
+    relay_unit_t *relay = relay_unit_by_handle(unit);
+    esp_err_t err = (relay != NULL) ? relay_gpio_deinit(relay) : ESP_ERR_NOT_FOUND;
+    relay_units_write_unlock();
+    return err;
+}
+
+/**
+ * @brief Save a relay unit to NVS
+ *
+ * The unit is stored as a record of the relay units table (see relay_table.h), the whole table is written under one key.
+ *
+ * @param key NVS key of the unit (used for logging)
+ * @param relay Pointer to the relay unit to be saved
+ * @return esp_err_t result of the NVS operation
+ */
+esp_err_t save_relay_to_nvs(const char *key, relay_unit_t *relay) {
+
+    if (relay == NULL) {
+        ESP_LOGE(TAG, "Got NULL as relay. Cannot save.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = relay_table_put_unit(relay);
+    if (err == ESP_OK) {
+        err = relay_table_save();
+    }
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Relay successfully saved to NVS under key: %s", key);
+    } else {
+        ESP_LOGE(TAG, "Failed to save relay to NVS: %s", esp_err_to_name(err));
+    }
+
+    return err;
+}
+
+/**
+ * @brief: Write-behind and wear timers callback. Wakes up the persistence task.
+ * 
+ * @param arg Notification bit: RELAY_PERSIST_NOTIFY_UNITS or RELAY_PERSIST_NOTIFY_WEAR
+ */
+static void relay_persist_timer_cb(void *arg) {
+    if (s_persist_task != NULL) {
+        xTaskNotify(s_persist_task, (uint32_t)(uintptr_t)arg, eSetBits);
+    }
+}
+
+/**
+ * @brief: FreeRTOS task flushing dirty relay units and changed wear counters to NVS
+ * 
+ * @param arg Unused
+ */
+static void relay_persist_task(void *arg) {
+    uint32_t bits = 0;
+
+    while (1) {
+        if (xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        if ((bits & RELAY_PERSIST_NOTIFY_UNITS) && relay_persist_flush() != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to flush dirty relay units to NVS");
+        }
+        if ((bits & RELAY_PERSIST_NOTIFY_WEAR) && relay_wear_flush() != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to flush wear counters to NVS");
+        }
+    }
+}
+
+/**
+ * @brief: Shutdown handler: save pending relay unit changes and wear counters on any esp_restart(),
+ *         including OTA, MemGuard and Wi-Fi timeout restarts
+ */
+static void relay_persist_shutdown_handler() {
+    if (relay_persist_flush() != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to flush pending relay unit changes on restart");
+    }
+    if (relay_wear_flush() != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to flush wear counters on restart");
+    }
+}
+
+/**
+ * @brief: Initialize write-behind persistence of in-memory relay units
+ * 
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_persist_init() {
+
+    if (s_persist_timer != NULL) {
+        // already initialized
+        return ESP_OK;
+    }
+
+    s_persist_lock = xSemaphoreCreateMutex();
+    if (s_persist_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create write-behind lock");
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (xTaskCreate(relay_persist_task, "relay_persist", 4096, NULL, 2, &s_persist_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create write-behind task");
+        return ESP_FAIL;
+    }
+
+    const esp_timer_create_args_t persist_timer_args = {
+        .callback = relay_persist_timer_cb,
+        .arg = (void *)(uintptr_t)RELAY_PERSIST_NOTIFY_UNITS,
+        .name = "relay_persist"
+    };
+    esp_err_t err = esp_timer_create(&persist_timer_args, &s_persist_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create write-behind timer: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // wear counters change with every switch: they are written periodically instead, the flush skips unchanged ones
+    const esp_timer_create_args_t wear_timer_args = {
+        .callback = relay_persist_timer_cb,
+        .arg = (void *)(uintptr_t)RELAY_PERSIST_NOTIFY_WEAR,
+        .name = "relay_wear"
+    };
+    err = esp_timer_create(&wear_timer_args, &s_wear_timer);
+    if (err == ESP_OK) {
+        err = esp_timer_start_periodic(s_wear_timer, (uint64_t)RELAY_WEAR_FLUSH_INTERVAL_S * 1000000);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start wear flush timer: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = esp_register_shutdown_handler(relay_persist_shutdown_handler);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register write-behind shutdown handler: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(TAG, "Write-behind persistence started: quiet period %d ms, max delay %d ms", RELAY_PERSIST_QUIET_MS, RELAY_PERSIST_MAX_DELAY_MS);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Check if the output of the interlock member is ON as driven right now. Caller holds s_interlock_mux.
+ * 
+ * @param member Pointer to the interlock member
+ * @return true if the output register holds the ON level of the member
+ */
+static inline bool relay_interlock_output_on(const relay_interlock_member_t *member) {
+#if SOC_GPIO_PIN_COUNT > 32
+    if (member->gpio_pin >= 32) {
+        return ((REG_READ(GPIO_OUT1_REG) >> (member->gpio_pin - 32)) & 1U) == member->on_level;
+    }
+#endif
+    return ((REG_READ(GPIO_OUT_REG) >> member->gpio_pin) & 1U) == member->on_level;
+}
+
+/**
+ * @brief: Refresh the RTC memory mirror after actuator output write(s) and account the outputs that changed
+ *         in the wear counters. Caller holds s_interlock_mux.
+ */
+static void relay_outputs_written() {
+    uint64_t changed = relay_rtc_mirror_outputs();
+    if (changed == 0) {
+        return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    for (int channel = 0; channel <= CHANNEL_COUNT_MAX; channel++) {
+        const relay_interlock_member_t *member = &s_interlock_members[channel];
+        if (member->registered && member->gpio_pin >= 0 && member->gpio_pin < 64 && ((changed >> member->gpio_pin) & 1ULL)) {
+            relay_wear_record(channel, relay_interlock_output_on(member), now_us);
+        }
+    }
+}
+
+/**
+ * @brief: Actuator pulse timer callback. Ends the pulse right away and hands the rest over to relay_actuator_pulse_task().
+ * 
+ * @param arg Channel of the actuator
+ */
+static void relay_actuator_pulse_timer_cb(void *arg) {
+    int channel = (int)(intptr_t)arg;
+    relay_actuator_pulse_t *pulse = &s_actuator_pulses[channel];
+
+    // members of interlock groups start the dead time of their group
+    portENTER_CRITICAL(&s_interlock_mux);
+    relay_interlock_member_t *member = &s_interlock_members[channel];
+    bool released = member->group != 0 && member->gpio_pin == pulse->gpio_pin && relay_interlock_output_on(member);
+    int64_t delay_us = 0;
+    relay_rtc_pulse_clear(pulse->gpio_pin);
+    if (member->gpio_pin == pulse->gpio_pin) {
+        relay_interlock_output_write(channel, pulse->off_level, &delay_us);
+    } else {
+        gpio_set_level((gpio_num_t)pulse->gpio_pin, pulse->off_level);
+    }
+    relay_outputs_written();
+    pulse->off_us = esp_timer_get_time() + delay_us;
+    if (released) {
+        interlock_released(&s_interlock_groups[member->group].state, pulse->off_us);
+    }
+    portEXIT_CRITICAL(&s_interlock_mux);
+
+    xTaskNotify(s_actuator_pulse_task, 1UL << channel, eSetBits);
+}
+
+/**
+ * @brief: FreeRTOS task completing actuator pulses: sets the final (OFF) state of the unit, saves and publishes it.
+ *         Also re-issues ON requests parked in interlock groups once their dead time has passed.
+ * 
+ * @param arg Unused
+ */
+static void relay_actuator_pulse_task(void *arg) {
+    uint32_t channels = 0;
+
+    while (1) {
+        if (xTaskNotifyWait(0, UINT32_MAX, &channels, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        while (channels != 0) {
+            int channel = __builtin_ctz(channels);
+            channels &= channels - 1;
+
+            if (channel >= RELAY_NOTIFY_INTERLOCK_SHIFT) {
+                relay_interlock_resume(channel - RELAY_NOTIFY_INTERLOCK_SHIFT);
+                continue;
+            }
+
+            relay_actuator_pulse_t *pulse = &s_actuator_pulses[channel];
+            if (esp_timer_is_active(pulse->timer)) {
+                // re-triggered before we got here: the new pulse is in progress
+                continue;
+            }
+
+            ESP_LOGI(TAG, "Pulse on channel %d completed: requested %u ms, actual %lld us", channel,
+                        (unsigned int)pulse->width_ms, (long long)(pulse->off_us - pulse->on_us));
+
+            unit_handle_t unit = { .type = RELAY_TYPE_ACTUATOR, .index = (uint8_t)channel };
+            esp_err_t err = relay_actuator_command(unit, RELAY_COMMAND_OFF, 0, LATENCY_PATH_NONE, 0, NULL);
+            if (err != ESP_OK && err != ESP_ERR_NOT_FOUND) {
+                ESP_LOGE(TAG, "Failed to apply final state of the pulse on channel %d", channel);
+            }
+        }
+    }
+}
+
+/**
+ * @brief: Create actuator pulse timers and the task completing the pulses
+ * 
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_actuator_pulse_init() {
+
+    if (s_actuator_pulse_task != NULL) {
+        // already initialized
+        return ESP_OK;
+    }
+
+    for (int channel = 0; channel <= CHANNEL_COUNT_MAX; channel++) {
+        const esp_timer_create_args_t pulse_timer_args = {
+            .callback = relay_actuator_pulse_timer_cb,
+            .arg = (void *)(intptr_t)channel,
+            .name = "relay_pulse"
+        };
+        esp_err_t err = esp_timer_create(&pulse_timer_args, &s_actuator_pulses[channel].timer);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create pulse timer for channel %d: %s", channel, esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    if (xTaskCreate(relay_actuator_pulse_task, "relay_pulse", 4096, NULL, 5, &s_actuator_pulse_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create actuator pulse task");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief: Cancel the pulse in progress on the actuator, if any. The output is left as it is and mirrored to RTC memory
+ *         as driven again with the next output write.
+ * 
+ * @param relay Pointer to the relay unit (actuator)
+ */
+static void relay_actuator_pulse_cancel(const relay_unit_t *relay) {
+    if (relay->channel < 0 || relay->channel > CHANNEL_COUNT_MAX || s_actuator_pulses[relay->channel].timer == NULL) {
+        return;
+    }
+    esp_timer_stop(s_actuator_pulses[relay->channel].timer);  // not running is fine
+    relay_rtc_pulse_clear(s_actuator_pulses[relay->channel].gpio_pin);
+    relay_rtc_pulse_clear(relay->gpio_pin);
+}
+
+/**
+ * @brief: Arm the pulse timer of the actuator whose output has just been switched ON. Caller holds the writer lock.
+ * 
+ * @param relay Pointer to the in-memory relay unit (actuator)
+ * @param pulse_ms Pulse width in milliseconds
+ * @param on_us Time the ON level was written
+ * @return esp_err_t result of the operation
+ */
+static esp_err_t relay_actuator_pulse_arm(const relay_unit_t *relay, uint32_t pulse_ms, int64_t on_us) {
+    relay_actuator_pulse_t *pulse = &s_actuator_pulses[relay->channel];
+
+    pulse->gpio_pin = relay->gpio_pin;
+    pulse->off_level = relay->inverted ? 1 : 0;
+    pulse->width_ms = pulse_ms;
+    pulse->on_us = on_us;
+
+    // count the time already passed since the ON edge, so the width is measured from the edge
+    int64_t timeout_us = (int64_t)pulse_ms * 1000 - (esp_timer_get_time() - on_us);
+    if (timeout_us < 1) {
+        timeout_us = 1;
+    }
+    esp_timer_stop(pulse->timer);  // not running is fine
+    return esp_timer_start_once(pulse->timer, (uint64_t)timeout_us);
+}
+
+/**
+ * @brief: Refresh the interlock member entry of the actuator. Caller holds s_interlock_mux.
+ * 
+ * Members are registered by their first write, so pins not driven yet are never taken for energised ones.
+ * 
+ * @param relay Pointer to the relay unit (actuator)
+ */
+static void relay_interlock_member_update(const relay_unit_t *relay) {
+    relay_interlock_member_t *member = &s_interlock_members[relay->channel];
+    member->gpio_pin = relay->gpio_pin;
+    member->on_level = relay->inverted ? 0 : 1;
+    member->group = (relay->interlock_group <= RELAY_INTERLOCK_GROUPS_MAX) ? relay->interlock_group : 0;
+    member->registered = true;
+    member->zero_cross = relay->zero_cross;
+    member->zc_offset_us = relay->zc_offset_us;
+    member->zc_latency_us = relay->zc_latency_us;
+}
+
+/**
+ * @brief: Write the output level of the interlock member. Members switching AC loads get the edge written at their
+ *         switching point after the next zero crossing, others right away. Replaces any edge pending for the member.
+ *         Caller holds s_interlock_mux.
+ * 
+ * @param channel Channel of the member
+ * @param level Output level
+ * @param[out] delay_us Time until the edge is written, 0 if it was written right away
+ * @return esp_err_t result of the operation
+ */
+static esp_err_t relay_interlock_output_write(int channel, uint32_t level, int64_t *delay_us) {
+    relay_interlock_member_t *member = &s_interlock_members[channel];
+
+    *delay_us = 0;
+    if (member->zero_cross
+        && relay_zc_schedule(channel, member->gpio_pin, level, member->zc_offset_us, member->zc_latency_us, delay_us) == ESP_OK) {
+        return ESP_OK;
+    }
+    relay_zc_cancel(channel);
+    return gpio_set_level((gpio_num_t)member->gpio_pin, level);
+}
+
+/**
+ * @brief: Check if an ON edge of the interlock member waits for a zero crossing. Caller holds s_interlock_mux.
+ * 
+ * @param channel Channel of the member
+ * @return true if the output is going to be switched ON
+ */
+static inline bool relay_interlock_zc_pending_on(int channel) {
+    uint32_t level;
+    return relay_zc_pending(channel, &level) && level == s_interlock_members[channel].on_level;
+}
+
+/**
+ * @brief: Write the OFF level of the interlock member and start the dead time of its group if it was ON.
+ *         Caller holds s_interlock_mux.
+ * 
+ * @param channel Channel of the member
+ * @param now_us Current time
+ * @return true if the member was ON
+ */
+static bool relay_interlock_switch_off(int channel, int64_t now_us) {
+    relay_interlock_member_t *member = &s_interlock_members[channel];
+    bool was_on = relay_interlock_output_on(member);
+
+    // the dead time starts when the contacts open, which may be at the next zero crossing
+    int64_t delay_us = 0;
+    relay_interlock_output_write(channel, member->on_level ? 0 : 1, &delay_us);
+    if (was_on && member->group != 0) {
+        interlock_released(&s_interlock_groups[member->group].state, now_us + delay_us);
+    }
+    return was_on;
+}
+
+/**
+ * @brief: Make way for the interlock member to be switched ON. Caller holds s_interlock_mux.
+ * 
+ * @param channel Channel of the member to be switched ON
+ * @param now_us Current time
+ * @param preempt Switch conflicting members OFF. If false, any conflicting member makes the request fail.
+ * @param[out] released Bits of the channels switched OFF
+ * @return true if the member can be switched ON now, false if it conflicts or the group dead time has not passed yet
+ */
+static bool relay_interlock_acquire(int channel, int64_t now_us, bool preempt, uint32_t *released) {
+    relay_interlock_member_t *member = &s_interlock_members[channel];
+    relay_interlock_group_t *group = &s_interlock_groups[member->group];
+
+    uint32_t conflicts = 0;
+    for (int other = 0; other <= CHANNEL_COUNT_MAX; other++) {
+        if (other != channel && s_interlock_members[other].group == member->group
+            && (relay_interlock_output_on(&s_interlock_members[other]) || relay_interlock_zc_pending_on(other))) {
+            conflicts |= 1UL << other;
+        }
+    }
+    if (!interlock_may_release(conflicts, preempt)) {
+        return false;
+    }
+
+    *released |= conflicts;
+    while (conflicts != 0) {
+        relay_interlock_switch_off(__builtin_ctz(conflicts), now_us);
+        conflicts &= conflicts - 1;
+    }
+
+    return interlock_decide_on(&group->state, relay_interlock_output_on(member), !s_interlock_ready, now_us,
+                               s_interlock_dead_us) == INTERLOCK_ON;
+}
+
+/**
+ * @brief: Park ON request of the interlock member until the dead time of its group has passed. Replaces any request
+ *         parked in the group before. Caller holds s_interlock_mux and starts the group timer afterwards.
+ * 
+ * @param channel Channel of the member
+ * @param pulse_ms Pulse width to be used when the request is re-issued, 0 for latching ON
+ * @param latency_path latency_path_t of the request
+ * @param origin_us Origin of the request for latency tracing
+ * @param now_us Current time
+ * @return time left until the dead time has passed, microseconds
+ */
+static int64_t relay_interlock_park(int channel, uint16_t pulse_ms, uint8_t latency_path, int64_t origin_us, int64_t now_us) {
+    const interlock_request_t request = {
+        .channel = (int8_t)channel,
+        .pulse_ms = pulse_ms,
+        .latency_path = latency_path,
+        .origin_us = origin_us
+    };
+    return interlock_park(&s_interlock_groups[s_interlock_members[channel].group].state, &request, now_us, s_interlock_dead_us);
+}
+
+/**
+ * @brief: Drive the output of the actuator through its interlock group
+ * 
+ * OFF is written right away. ON switches the conflicting members of the group OFF and energises the actuator within
+ * one critical section. If the group dead time has not passed yet, the request is parked in the group (replacing any
+ * parked one) and the group timer is started, the output stays OFF for now.
+ * 
+ * @param relay Pointer to the relay unit (actuator)
+ * @param state State to set
+ * @param pulse_ms Pulse width of ON request, to be used if the request is parked. 0 for latching ON.
+ * @param latency_path latency_path_t of the request, to be used if the request is parked
+ * @param origin_us Origin of the request for latency tracing, to be used if the request is parked
+ * @param[out] released Bits of the channels switched OFF by the interlock
+ * @param[out] parked true if the request was parked
+ * @param[out] delay_us Time until the output of the actuator switches: 0 if right away, up to a mains half-cycle for
+ *             actuators switched at a zero crossing. Can be NULL.
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if ON conflicts with another member while booting
+ */
+static esp_err_t relay_interlock_write(const relay_unit_t *relay, relay_state_t state, uint16_t pulse_ms,
+                                        uint8_t latency_path, int64_t origin_us, uint32_t *released, bool *parked,
+                                        int64_t *delay_us) {
+    esp_err_t err = ESP_OK;
+    int64_t wait_us = 0;
+    int64_t edge_delay_us = 0;
+
+    *released = 0;
+    *parked = false;
+
+    portENTER_CRITICAL(&s_interlock_mux);
+    relay_interlock_member_update(relay);
+    relay_interlock_member_t *member = &s_interlock_members[relay->channel];
+    relay_interlock_group_t *group = &s_interlock_groups[member->group];
+    int64_t now_us = esp_timer_get_time();
+
+    if (member->group == 0) {
+        // not interlocked
+        err = relay_interlock_output_write(relay->channel, (state == RELAY_STATE_ON) ? member->on_level : !member->on_level, &edge_delay_us);
+    } else if (state == RELAY_STATE_OFF) {
+        interlock_cancel(&group->state, relay->channel);
+        relay_interlock_switch_off(relay->channel, now_us);
+        if (group->state.released_us > now_us) {
+            edge_delay_us = group->state.released_us - now_us;
+        }
+    } else if (relay_interlock_acquire(relay->channel, now_us, s_interlock_ready, released)) {
+        // the newest request wins: anything parked in the group is dropped
+        interlock_cancel(&group->state, -1);
+        err = relay_interlock_output_write(relay->channel, member->on_level, &edge_delay_us);
+    } else if (s_interlock_ready) {
+        wait_us = relay_interlock_park(relay->channel, pulse_ms, latency_path, origin_us, now_us);
+        *parked = true;
+    } else {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    relay_outputs_written();
+    portEXIT_CRITICAL(&s_interlock_mux);
+
+    if (*parked) {
+        esp_timer_stop(group->timer);  // not running is fine
+        err = esp_timer_start_once(group->timer, (uint64_t)wait_us);
+        ESP_LOGI(TAG, "Interlock group %d: channel %d waits %lld us of dead time", member->group, relay->channel, (long long)wait_us);
+    }
+    if (delay_us != NULL) {
+        *delay_us = edge_delay_us;
+    }
+    return err;
+}
+
+/**
+ * @brief: Apply OFF state to the in-memory actuators switched OFF by the interlock. Caller holds the writer lock.
+ * 
+ * @param channels Bits of the channels switched OFF
+ * @return mask of in-memory unit indexes to be saved and published with relay_interlock_commit_released()
+ */
+static uint32_t relay_interlock_mark_released(uint32_t channels) {
+    uint32_t unit_mask = 0;
+
+    while (channels != 0) {
+        int channel = __builtin_ctz(channels);
+        channels &= channels - 1;
+
+        relay_unit_t *member = NULL;
+        if (get_relay_actuator_from_memory_by_channel(channel, &member) != ESP_OK) {
+            continue;
+        }
+        relay_actuator_pulse_cancel(member);
+        member->state = RELAY_STATE_OFF;
+        unit_mask |= 1UL << (member - s_units);
+        ESP_LOGI(TAG, "Interlock group %d: channel %d switched OFF", member->interlock_group, channel);
+    }
+    return unit_mask;
+}
+
+/**
+ * @brief: Save and publish the actuators switched OFF by the interlock. Caller holds the writer lock: the mask is made of
+ *         s_units indexes.
+ * 
+ * @param unit_mask Mask of in-memory unit indexes returned by relay_interlock_mark_released()
+ */
+static void relay_interlock_commit_released(uint32_t unit_mask) {
+    unit_handle_t units[RELAY_INDEX_UNITS_MAX];
+    size_t count = 0;
+
+    for (uint32_t mask = unit_mask; mask != 0; mask &= mask - 1) {
+        relay_unit_t *member = &s_units[__builtin_ctz(mask)];
+        if (relay_persist_mark_dirty(member) != ESP_OK) {
+            ESP_LOGE(TAG, "Unable to save actuator switched OFF by the interlock");
+        }
+        units[count++] = get_unit_handle(member);
+    }
+
+    if (count > 0 && _DEVICE_ENABLE_MQTT && mqtt_config_connection_mode() && IS_MQTT_READY()) {
+        trigger_mqtt_publish_units(units, count);
+    }
+}
+
+/**
+ * @brief: Interlock group timer callback: the dead time has passed, hand the parked request over to relay_actuator_pulse_task()
+ * 
+ * @param arg Interlock group
+ */
+static void relay_interlock_timer_cb(void *arg) {
+    xTaskNotify(s_actuator_pulse_task, 1UL << (RELAY_NOTIFY_INTERLOCK_SHIFT + (int)(intptr_t)arg), eSetBits);
+}
+
+/**
+ * @brief: Re-issue the request parked in the interlock group. Called by relay_actuator_pulse_task().
+ * 
+ * @param group Interlock group
+ */
+static void relay_interlock_resume(int group) {
+    interlock_request_t request;
+
+    portENTER_CRITICAL(&s_interlock_mux);
+    bool parked = interlock_take(&s_interlock_groups[group].state, &request);
+    portEXIT_CRITICAL(&s_interlock_mux);
+
+    if (!parked) {
+        // cancelled by OFF or superseded meanwhile
+        return;
+    }
+
+    // resolved by the channel again: the unit may have moved in memory or been removed while the request was parked
+    int channel = request.channel;
+    unit_handle_t unit = { .type = RELAY_TYPE_ACTUATOR, .index = (uint8_t)channel };
+    esp_err_t err = relay_actuator_command(unit, RELAY_COMMAND_ON, request.pulse_ms, request.latency_path,
+                                           request.origin_us, NULL);
+    if (err == ESP_ERR_NOT_FOUND) {
+        return;
+    } else if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Interlock group %d: failed to switch channel %d ON after the dead time", group, channel);
+    }
+}
+
+/**
+ * @brief: Start interlock groups: read the dead time, create group timers and register in-memory actuators.
+ *         Actuators left OFF by the interlock while their outputs were restored on boot are saved as OFF.
+ * 
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_interlock_init() {
+
+    if (s_interlock_ready) {
+        // already initialized
+        return ESP_OK;
+    }
+
+    uint16_t dead_ms;
+    if (nvs_read_uint16(S_NAMESPACE, S_KEY_INTERLOCK_DEAD_TIME, &dead_ms) != ESP_OK) {
+        ESP_LOGW(TAG, "Unable to read interlock dead time from NVS. Using default %d ms.", S_DEFAULT_INTERLOCK_DEAD_TIME);
+        dead_ms = S_DEFAULT_INTERLOCK_DEAD_TIME;
+    }
+    if (dead_ms > RELAY_INTERLOCK_DEAD_MS_MAX) {
+        dead_ms = RELAY_INTERLOCK_DEAD_MS_MAX;
+    }
+
+    // zero-cross edges are written under the interlock lock too. Without a working detector actuators switch right away.
+    esp_err_t zc_err = relay_zc_init(&s_interlock_mux, relay_outputs_written);
+    if (zc_err != ESP_OK) {
+        ESP_LOGW(TAG, "Zero-cross switching not available: %s", esp_err_to_name(zc_err));
+    }
+
+    for (int group = 1; group <= RELAY_INTERLOCK_GROUPS_MAX; group++) {
+        const esp_timer_create_args_t interlock_timer_args = {
+            .callback = relay_interlock_timer_cb,
+            .arg = (void *)(intptr_t)group,
+            .name = "relay_interlock"
+        };
+        esp_err_t err = esp_timer_create(&interlock_timer_args, &s_interlock_groups[group].timer);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create timer for interlock group %d: %s", group, esp_err_to_name(err));
+            return err;
+        }
+        interlock_group_init(&s_interlock_groups[group].state);
+    }
+
+    relay_units_write_lock();
+
+    uint32_t unit_mask = 0;
+    int members = 0;
+    for (int i = 0; i < s_relays_count; i++) {
+        relay_unit_t *relay = &s_units[i];
+        if (relay->channel < 0 || relay->channel > CHANNEL_COUNT_MAX) {
+            continue;
+        }
+
+        portENTER_CRITICAL(&s_interlock_mux);
+        relay_interlock_member_update(relay);
+        bool output_on = relay_interlock_output_on(&s_interlock_members[relay->channel]);
+        portEXIT_CRITICAL(&s_interlock_mux);
+
+        // outputs restored at boot are not counted as cycles, their ON time starts now
+        relay_wear_sync(relay->channel, output_on, esp_timer_get_time());
+
+        if (relay->interlock_group == 0) {
+            continue;
+        }
+        members++;
+        if (relay->state == RELAY_STATE_ON && !output_on) {
+            ESP_LOGW(TAG, "Interlock group %d: channel %d was kept OFF on boot", relay->interlock_group, relay->channel);
+            relay->state = RELAY_STATE_OFF;
+            unit_mask |= 1UL << i;
+        }
+    }
+
+    portENTER_CRITICAL(&s_interlock_mux);
+    s_interlock_dead_us = (uint32_t)dead_ms * 1000;
+    s_interlock_ready = true;
+    portEXIT_CRITICAL(&s_interlock_mux);
+
+    relay_units_write_unlock();
+
+    for (uint32_t mask = unit_mask; mask != 0; mask &= mask - 1) {
+        relay_persist_mark_dirty(&s_units[__builtin_ctz(mask)]);
+    }
+
+    ESP_LOGI(TAG, "Interlock groups started: %d member(s), dead time %u ms", members, dead_ms);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Mark in-memory relay unit as dirty, so it is saved to NVS by the next write-behind flush
+ * 
+ * Units not in in-memory storage (or if write-behind is not initialized) are saved to NVS right away.
+ * 
+ * @param relay Pointer to the relay unit
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_persist_mark_dirty(relay_unit_t *relay) {
+
+    if (relay == NULL) {
+        ESP_LOGE(TAG, "Got NULL as relay. Cannot persist.");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!relay_is_in_memory(relay) || s_persist_timer == NULL) {
+        char *key = get_unit_nvs_key(relay);
+        if (key == NULL) {
+            return ESP_FAIL;
+        }
+        esp_err_t err = save_relay_to_nvs(key, relay);
+        free(key);
+        return err;
+    }
+
+    // quiet period, capped by the max delay since the first unflushed change
+    portENTER_CRITICAL(&s_persist_mux);
+    int64_t delay_us = writebehind_mark(&s_persist, 1UL << (relay - s_units), esp_timer_get_time());
+    portEXIT_CRITICAL(&s_persist_mux);
+
+    // restart quiet period
+    esp_timer_stop(s_persist_timer);  // not running is fine
+    esp_err_t err = esp_timer_start_once(s_persist_timer, (uint64_t)delay_us);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to arm write-behind timer: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGD(TAG, "Relay unit %s marked dirty, flush in %lld ms", get_unit_nvs_key_from_memory(relay), (long long)(delay_us / 1000));
+    return ESP_OK;
+}
+
+/**
+ * @brief: Flush all dirty in-memory relay units to NVS using one NVS handle and one commit
+ * 
+ * Called by the write-behind task and has to be called before reboot to not lose pending changes.
+ * 
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_persist_flush() {
+
+    if (s_persist_lock == NULL) {
+        return ESP_OK;
+    }
+
+    xSemaphoreTake(s_persist_lock, portMAX_DELAY);
+
+    // units are read after the set was taken: a change marked meanwhile is either saved now or stays for the next flush
+    portENTER_CRITICAL(&s_persist_mux);
+    uint32_t dirty = writebehind_take(&s_persist);
+    portEXIT_CRITICAL(&s_persist_mux);
+
+    if (dirty == 0) {
+        xSemaphoreGive(s_persist_lock);
+        return ESP_OK;
+    }
+
+    int64_t t_start = esp_timer_get_time();
+    uint32_t written = 0;
+    uint32_t failed = 0;
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < s_units_count; i++) {
+        if (!(dirty & (1UL << i))) {
+            continue;
+        }
+
+        relay_unit_t snapshot;
+        relay_units_copy(i, 1, &snapshot);
+        err = relay_table_put_unit(&snapshot);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to update relay unit %s in units table: %s", s_unit_keys[i], esp_err_to_name(err));
+            failed |= (1UL << i);
+            continue;
+        }
+        written++;
+    }
+
+    // one blob, one commit
+    err = relay_table_save();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to commit relay units to NVS: %s", esp_err_to_name(err));
+        failed = dirty;
+        written = 0;
+    }
+
+    portENTER_CRITICAL(&s_persist_mux);
+    writebehind_done(&s_persist, written, failed);
+    portEXIT_CRITICAL(&s_persist_mux);
+
+    xSemaphoreGive(s_persist_lock);
+
+    ESP_LOGI(TAG, "Write-behind flush: %u unit(s) saved to NVS in %lld us", (unsigned int)written, (long long)(esp_timer_get_time() - t_start));
+    return (failed == 0) ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * @brief: Get write-behind persistence counters
+ * 
+ * @param[out] stats Pointer to the structure to fill
+ */
+void relay_persist_get_stats(relay_persist_stats_t *stats) {
+    portENTER_CRITICAL(&s_persist_mux);
+    stats->requests = s_persist.requests;
+    stats->flushes = s_persist.flushes;
+    stats->units_written = s_persist.units_written;
+    portEXIT_CRITICAL(&s_persist_mux);
+    stats->writes_saved = (stats->requests > stats->units_written) ? (stats->requests - stats->units_written) : 0;
+}
+
+/**
+ * @brief Load a relay actuator from NVS
+ *
+ * @param namespace NVS namespace
+ * @param key NVS key
+ * @param relay Pointer to the relay unit to be loaded, has to be pre-allocated
+ * @return esp_err_t result of the NVS operation
+ */
+esp_err_t load_relay_actuator_from_nvs(const char *key, relay_unit_t *relay) {
+    int channel = (key != NULL && get_relay_type_from_key(key) == RELAY_TYPE_ACTUATOR) ? atoi(key + strlen(S_KEY_CH_PREFIX)) : -1;
+    esp_err_t err = relay_table_get_unit(RELAY_TYPE_ACTUATOR, channel, relay);
+    if (err != ESP_OK) {
+        /* ESP_LOGE(TAG, "Failed to load relay from NVS: %s", esp_err_to_name(err)); */
+        return err;
+    }
+
+    if(INIT_RELAY_ON_LOAD) {
+        if(relay_gpio_init(relay) != ESP_OK) {
+            // raise just warning
+            ESP_LOGW(TAG, "Failed to init GPIO pin (%d) for actuator relay unit (%d)", relay->gpio_pin, relay->channel);
+        }
+    } else {
+        relay->io_conf = (gpio_config_t){0};
+    }
+
+    ESP_LOGI(TAG, "Relay actuator loaded successfully from NVS under key: %s", key);
+    return ESP_OK;
+}
+
+/**
+ * @brief Get a relay actuator from in-memory storage
+ * @param channel The relay channel number
+ * @param relay Pointer to the relay unit to be returned
+ * @return esp_err_t result of the operation
+ */
+esp_err_t get_relay_actuator_from_memory_by_channel(int channel, relay_unit_t **relay) {
+    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
+        ESP_LOGE(TAG, "Relay units are not loaded in memory.");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (channel >= CHANNEL_COUNT_MIN && channel <= CHANNEL_COUNT_MAX && s_actuator_idx_by_channel[channel] != RELAY_INDEX_NONE) {
+        // return pointer to the found relay
+        *relay = &s_units[(int)s_actuator_idx_by_channel[channel]];
+        return ESP_OK;
+    }
+
+    ESP_LOGE(TAG, "Actuator relay with channel %d not found in memory.", channel);
+    return ESP_ERR_NOT_FOUND;
+}
+
+/**
+ * @brief Get a relay actuator from in-memory storage by NVS key
+ * @param key The NVS key
+ * @param relay Pointer to the relay unit to be returned
+ * @return esp_err_t result of the operation
+ */
+esp_err_t get_relay_actuator_from_memory_by_key(const char *key, relay_unit_t **relay) {
+    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
+        ESP_LOGE(TAG, "Relay units are not loaded in memory.");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int idx = relay_index_from_key(key, RELAY_TYPE_ACTUATOR);
+    if (idx != RELAY_INDEX_NONE) {
+        // return pointer to the found relay
+        *relay = &s_units[idx];
+        return ESP_OK;
+    }
+
+    ESP_LOGE(TAG, "Actuator relay with key %s not found in memory.", key);
+    return ESP_ERR_NOT_FOUND;
+}
+
+/**
+ * @brief Load a relay sensor from NVS
+ *
+ * @param key NVS key
+ * @param relay Pointer to the relay unit to be loaded
+ * @return esp_err_t result of the NVS operation
+ */
+esp_err_t load_relay_sensor_from_nvs(const char *key, relay_unit_t *relay) {
+    int channel = (key != NULL && get_relay_type_from_key(key) == RELAY_TYPE_SENSOR) ? atoi(key + strlen(S_KEY_SN_PREFIX)) : -1;
+    esp_err_t err = relay_table_get_unit(RELAY_TYPE_SENSOR, channel, relay);
+    if (err != ESP_OK) {
+        /* ESP_LOGE(TAG, "Failed to load relay from NVS: %s", esp_err_to_name(err)); */
+        return err;
+    }
+
+    if(INIT_SENSORS_ON_LOAD) {
+        if(relay_gpio_init(relay) != ESP_OK) {
+            // raise just warning
+            ESP_LOGW(TAG, "Failed to init GPIO pin (%d) for contact sensor relay unit (%d)", relay->gpio_pin, relay->channel);
+        }
+    } else {
+        relay->io_conf = (gpio_config_t){0};
+    }
+
+
+    ESP_LOGI(TAG, "Relay sensor loaded successfully from NVS under key: %s", key);
+    return ESP_OK;
+}
+
+/**
+ * @brief Get a relay sensor from in-memory storage
+ * @param channel The relay channel number
+ * @param relay Pointer to the relay unit to be returned
+ * @return esp_err_t result of the operation
+ */
+esp_err_t get_relay_sensor_from_memory_by_channel(int channel, relay_unit_t **relay) {
+    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
+        ESP_LOGE(TAG, "Relay units are not loaded in memory.");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (channel >= CONTACT_SENSORS_COUNT_MIN && channel <= CONTACT_SENSORS_COUNT_MAX && s_sensor_idx_by_channel[channel] != RELAY_INDEX_NONE) {
+        // return pointer to the found relay
+        *relay = &s_units[(int)s_sensor_idx_by_channel[channel]];
+        return ESP_OK;
+    }
+
+    ESP_LOGE(TAG, "Sensor relay with channel %d not found in memory.", channel);
+    return ESP_ERR_NOT_FOUND;
+}
+
+/**
+ * @brief Get a relay sensor from in-memory storage by NVS key
+ * @param key The NVS key
+ * @param relay Pointer to the relay unit to be returned
+ * @return esp_err_t result of the operation
+ */
+esp_err_t get_relay_sensor_from_memory_by_key(const char *key, relay_unit_t **relay) {
+    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
+        ESP_LOGE(TAG, "Relay units are not loaded in memory.");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int idx = relay_index_from_key(key, RELAY_TYPE_SENSOR);
+    if (idx != RELAY_INDEX_NONE) {
+        // return pointer to the found relay
+        *relay = &s_units[idx];
+        return ESP_OK;
+    }
+
+    ESP_LOGE(TAG, "Sensor relay with key %s not found in memory.", key);
+    return ESP_ERR_NOT_FOUND;
+}
+
+/**
+ * @brief Load a pulse counter from NVS
+ *
+ * @param key NVS key
+ * @param relay Pointer to the relay unit to be loaded
+ * @return esp_err_t result of the NVS operation
+ */
+esp_err_t load_relay_pulse_counter_from_nvs(const char *key, relay_unit_t *relay) {
+    int channel = (key != NULL && get_relay_type_from_key(key) == RELAY_TYPE_PULSE_COUNTER) ? atoi(key + strlen(S_KEY_PC_PREFIX)) : -1;
+    esp_err_t err = relay_table_get_unit(RELAY_TYPE_PULSE_COUNTER, channel, relay);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // GPIO is configured when PCNT unit is attached, see relay_pulse_counter_attach()
+    relay->io_conf = (gpio_config_t){0};
+
+    ESP_LOGI(TAG, "Pulse counter loaded successfully from NVS under key: %s", key);
+    return ESP_OK;
+}
+
+/**
+ * @brief Get a pulse counter from in-memory storage
+ * @param channel The pulse counter channel number
+ * @param relay Pointer to the relay unit to be returned
+ * @return esp_err_t result of the operation
+ */
+esp_err_t get_relay_pulse_counter_from_memory_by_channel(int channel, relay_unit_t **relay) {
+    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
+        ESP_LOGE(TAG, "Relay units are not loaded in memory.");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (channel >= PULSE_COUNTERS_COUNT_MIN && channel <= PULSE_COUNTERS_COUNT_MAX && s_pulse_idx_by_channel[channel] != RELAY_INDEX_NONE) {
+        *relay = &s_units[(int)s_pulse_idx_by_channel[channel]];
+        return ESP_OK;
+    }
+
+    ESP_LOGE(TAG, "Pulse counter with channel %d not found in memory.", channel);
+    return ESP_ERR_NOT_FOUND;
+}
+
+/**
+ * @brief Get a pulse counter from in-memory storage by NVS key
+ * @param key The NVS key
+ * @param relay Pointer to the relay unit to be returned
+ * @return esp_err_t result of the operation
+ */
+esp_err_t get_relay_pulse_counter_from_memory_by_key(const char *key, relay_unit_t **relay) {
+    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
+        ESP_LOGE(TAG, "Relay units are not loaded in memory.");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int idx = relay_index_from_key(key, RELAY_TYPE_PULSE_COUNTER);
+    if (idx != RELAY_INDEX_NONE) {
+        *relay = &s_units[idx];
+        return ESP_OK;
+    }
+
+    ESP_LOGE(TAG, "Pulse counter with key %s not found in memory.", key);
+    return ESP_ERR_NOT_FOUND;
+}
+
+/**
+ * @brief Get the NVS key for a relay channel
+ *
+ * @param channel The relay channel number
+ * @return Dynamically allocated string with the NVS key, or NULL if out of range
+ */
+char *get_relay_nvs_key(int channel) {
+    // Check if the channel is within the valid range
+    if (channel < CHANNEL_COUNT_MIN || channel > CHANNEL_COUNT_MAX) {
+        ESP_LOGE(TAG, "Channel %d is out of valid range (%d - %d)", channel, CHANNEL_COUNT_MIN, CHANNEL_COUNT_MAX);
+        return NULL;
+    }
+
+    // Allocate memory for the key string
+    size_t key_size = snprintf(NULL, 0, "%s%d", S_KEY_CH_PREFIX, channel) + 1;
+    char *key = malloc(key_size);
+    if (key == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for NVS key");
+        return NULL;
+    }
+
+    // Create the key string
+    snprintf(key, key_size, "%s%d", S_KEY_CH_PREFIX, channel);
+
+    return key;
+}
+
+/**
+ * @brief Get the NVS key for a contact sensor channel
+ *
+ * @param channel The relay contact sensor number
+ * @return Dynamically allocated string with the NVS key, or NULL if out of range
+ */
+char *get_contact_sensor_nvs_key(int channel) {
+    // Check if the channel is within the valid range
+    if (channel < CONTACT_SENSORS_COUNT_MIN || channel > CONTACT_SENSORS_COUNT_MAX) {
+        ESP_LOGE(TAG, "Channel %d is out of valid range (%d - %d)", channel, CONTACT_SENSORS_COUNT_MIN, CONTACT_SENSORS_COUNT_MAX);
+        return NULL;
+    }
+
+    // Allocate memory for the key string
+    size_t key_size = snprintf(NULL, 0, "%s%d", S_KEY_SN_PREFIX, channel) + 1;
+    char *key = malloc(key_size);
+    if (key == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for NVS key");
+        return NULL;
+    }
+
+    // Create the key string
+    snprintf(key, key_size, "%s%d", S_KEY_SN_PREFIX, channel);
+
+    return key;
+}
+
+/**
+ * @brief Get the NVS key for a pulse counter channel
+ *
+ * @param channel The pulse counter number
+ * @return Dynamically allocated string with the NVS key, or NULL if out of range
+ */
+char *get_pulse_counter_nvs_key(int channel) {
+    // Check if the channel is within the valid range
+    if (channel < PULSE_COUNTERS_COUNT_MIN || channel > PULSE_COUNTERS_COUNT_MAX) {
+        ESP_LOGE(TAG, "Channel %d is out of valid range (%d - %d)", channel, PULSE_COUNTERS_COUNT_MIN, PULSE_COUNTERS_COUNT_MAX);
+        return NULL;
+    }
+
+    // Allocate memory for the key string
+    size_t key_size = snprintf(NULL, 0, "%s%d", S_KEY_PC_PREFIX, channel) + 1;
+    char *key = malloc(key_size);
+    if (key == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for NVS key");
+        return NULL;
+    }
+
+    // Create the key string
+    snprintf(key, key_size, "%s%d", S_KEY_PC_PREFIX, channel);
+
+    return key;
+}
+
+
+/**
+ * @brief: Get NVS key for the provided relay
+ * 
+ * @param relay Pointer to the relay_unit_t structure
+ * @return Dynamically allocated string with the NVS key, or NULL if type or other params are out of range
+ */
+char *get_unit_nvs_key(const relay_unit_t *relay) {
+
+    // is relay an instance ?
+    if (relay == NULL) {
+        ESP_LOGE(TAG, "NULL value for relay unit");
+        return NULL;
+    }
+    // Configure GPIO based on relay type (actuator or sensor)
+    switch (relay->type) {
+        case RELAY_TYPE_SENSOR:
+            return get_contact_sensor_nvs_key(relay->channel);
+            break;
+        case RELAY_TYPE_ACTUATOR:
+            return get_relay_nvs_key(relay->channel);
+            break;
+        case RELAY_TYPE_PULSE_COUNTER:
+            return get_pulse_counter_nvs_key(relay->channel);
+            break;
+        default:
+            ESP_LOGE(TAG, "Invalid relay type: %d", relay->type);
+            return NULL;
+    }
+}
+
+
+/**
+ * @brief Determines the relay type from the relay_key.
+ * 
+ * This function checks the prefix of the provided relay_key and determines whether
+ * the relay is an actuator, a contact sensor or a pulse counter based on the prefix.
+ * 
+ * @param[in] relay_key The key that identifies the relay (e.g., "relay_ch_0", "relay_sn_1" or "relay_pc_0").
+ * @return relay_type_t The type of relay (RELAY_TYPE_ACTUATOR, RELAY_TYPE_SENSOR or RELAY_TYPE_PULSE_COUNTER). 
+ *         Returns -1 if the prefix doesn't match.
+ */
+relay_type_t get_relay_type_from_key(const char *relay_key) {
+    // Check for the actuator prefix
+    if (strncmp(relay_key, S_KEY_CH_PREFIX, strlen(S_KEY_CH_PREFIX)) == 0) {
+        return RELAY_TYPE_ACTUATOR;
+    }
+    // Check for the contact sensor prefix
+    else if (strncmp(relay_key, S_KEY_SN_PREFIX, strlen(S_KEY_SN_PREFIX)) == 0) {
+        return RELAY_TYPE_SENSOR;
+    }
+    // Check for the pulse counter prefix
+    else if (strncmp(relay_key, S_KEY_PC_PREFIX, strlen(S_KEY_PC_PREFIX)) == 0) {
+        return RELAY_TYPE_PULSE_COUNTER;
+    }
+    // Return -1 for unknown types
+    else {
+        ESP_LOGE(TAG, "Unknown relay type for key: %s", relay_key);
+        return -1;
+    }
+}
+
+/**
+ * @brief Serialize relay_unit_t structure to a JSON string
+ *
+ * This function takes a pointer to a relay_unit_t structure and serializes its fields 
+ * into a JSON formatted string. The returned JSON string should be freed by the caller 
+ * using `free()` after use.
+ *
+ * @param[in] relay Pointer to the relay_unit_t structure to be serialized
+ * @return A dynamically allocated JSON string representing the relay_unit_t structure,
+ *         or NULL if serialization fails.
+ */
+char* serialize_relay_unit(const relay_unit_t *relay) {
+
+    // Serialize a consistent copy: the unit may be modified by another task meanwhile
+    relay_unit_t snapshot;
+    if (relay_unit_snapshot(relay, &snapshot) != ESP_OK) {
+        ESP_LOGE(TAG, "NULL value for relay unit");
+        return NULL;
+    }
+    relay = &snapshot;
+
+    cJSON *relay_json = cJSON_CreateObject();
+    if (relay_json == NULL) {
+        ESP_LOGE(TAG, "Failed to create JSON object for relay serialization");
+        return NULL;
+    }
+
+    // Generate relay_key based on type
+    char *relay_key = get_unit_nvs_key(relay);
+    cJSON_AddStringToObject(relay_json, "relay_key", relay_key);
+
+    // Serialize the fields
+    cJSON_AddNumberToObject(relay_json, "channel", relay->channel);
+    cJSON_AddBoolToObject(relay_json, "state", relay->state == RELAY_STATE_ON);
+    cJSON_AddBoolToObject(relay_json, "inverted", relay->inverted);
+    cJSON_AddNumberToObject(relay_json, "gpio_pin", relay->gpio_pin);
+    cJSON_AddBoolToObject(relay_json, "enabled", relay->enabled);
+    cJSON_AddNumberToObject(relay_json, "type", relay->type);
+    cJSON_AddNumberToObject(relay_json, "debounce_ms", relay->debounce_ms);
+    cJSON_AddNumberToObject(relay_json, "pulse_ms", relay->pulse_ms);
+    cJSON_AddNumberToObject(relay_json, "interlock_group", relay->interlock_group);
+    cJSON_AddBoolToObject(relay_json, "zero_cross", relay->zero_cross);
+    cJSON_AddNumberToObject(relay_json, "zc_offset_us", relay->zc_offset_us);
+    cJSON_AddNumberToObject(relay_json, "zc_latency_us", relay->zc_latency_us);
+
+    // Aggregated readings of pulse counters
+    if (relay->type == RELAY_TYPE_PULSE_COUNTER) {
+        cJSON_AddNumberToObject(relay_json, "count", (double)relay->pulse_count);
+        cJSON_AddNumberToObject(relay_json, "rate", relay->pulse_rate);
+    }
+
+    // Wear counters of actuators
+    relay_wear_counters_t wear;
+    if (relay->type == RELAY_TYPE_ACTUATOR && relay_wear_get(relay->channel, &wear) == ESP_OK) {
+        cJSON_AddNumberToObject(relay_json, "cycles", wear.cycles);
+        cJSON_AddNumberToObject(relay_json, "on_time", (double)wear.on_time_s);
+        cJSON_AddNumberToObject(relay_json, "last_change", wear.last_change);
+    }
+
+    // Convert the JSON object to a string
+    char *json_string = cJSON_PrintUnformatted(relay_json);
+    if (json_string == NULL) {
+        ESP_LOGE(TAG, "Failed to convert relay JSON object to string");
+    }
+
+    // Free the JSON object and relay_key
+    cJSON_Delete(relay_json);
+    free(relay_key);
+
+    return json_string;
+}
+
+/**
+ * @brief Deserialize a JSON string to relay_unit_t structure
+ *
+ * This function parses a JSON formatted string and populates the relay_unit_t structure 
+ * with its corresponding fields. The function expects the input JSON string to have the 
+ * same structure as that produced by `serialize_relay_unit()`.
+ *
+ * @param[in] json_str The JSON string to be deserialized
+ * @param[out] relay Pointer to the relay_unit_t structure to populate with deserialized data
+ * @return ESP_OK on success, or ESP_FAIL if deserialization fails or fields are invalid.
+ */
+esp_err_t deserialize_relay_unit(const char *json_str, relay_unit_t *relay) {
+    cJSON *relay_json = cJSON_Parse(json_str);
+    if (relay_json == NULL) {
+        ESP_LOGE(TAG, "Failed to parse JSON string for relay deserialization");
+        return ESP_FAIL;
+    }
+
+    // Deserialize the fields
+    cJSON *channel = cJSON_GetObjectItem(relay_json, "channel");
+    cJSON *state = cJSON_GetObjectItem(relay_json, "state");
+    cJSON *inverted = cJSON_GetObjectItem(relay_json, "inverted");
+    cJSON *gpio_pin = cJSON_GetObjectItem(relay_json, "gpio_pin");
+    cJSON *enabled = cJSON_GetObjectItem(relay_json, "enabled");
+    cJSON *type = cJSON_GetObjectItem(relay_json, "type");
+
+    if (!cJSON_IsNumber(channel) || !cJSON_IsBool(state) || !cJSON_IsBool(inverted) || !cJSON_IsNumber(gpio_pin) || !cJSON_IsBool(enabled) || !cJSON_IsNumber(type)) {
+        ESP_LOGE(TAG, "Invalid or missing fields in JSON object for relay deserialization");
+        cJSON_Delete(relay_json);
+        return ESP_FAIL;
+    }
+
+    relay->channel = channel->valueint;
+    relay->state = state->valueint ? RELAY_STATE_ON : RELAY_STATE_OFF;
+    relay->inverted = inverted->valueint;
+    relay->gpio_pin = gpio_pin->valueint;
+    relay->enabled = enabled->valueint;
+    relay->type = (relay_type_t)type->valueint;
+
+    // optional fields
+    cJSON *debounce_ms = cJSON_GetObjectItem(relay_json, "debounce_ms");
+    relay->debounce_ms = cJSON_IsNumber(debounce_ms) ? (uint16_t)debounce_ms->valueint : 0;
+    cJSON *pulse_ms = cJSON_GetObjectItem(relay_json, "pulse_ms");
+    relay->pulse_ms = cJSON_IsNumber(pulse_ms) ? (uint16_t)pulse_ms->valueint : 0;
+    cJSON *interlock_group = cJSON_GetObjectItem(relay_json, "interlock_group");
+    relay->interlock_group = cJSON_IsNumber(interlock_group) ? (uint8_t)interlock_group->valueint : 0;
+    cJSON *zero_cross = cJSON_GetObjectItem(relay_json, "zero_cross");
+    relay->zero_cross = cJSON_IsTrue(zero_cross);
+    cJSON *zc_offset_us = cJSON_GetObjectItem(relay_json, "zc_offset_us");
+    relay->zc_offset_us = cJSON_IsNumber(zc_offset_us) ? (uint16_t)zc_offset_us->valueint : 0;
+    cJSON *zc_latency_us = cJSON_GetObjectItem(relay_json, "zc_latency_us");
+    relay->zc_latency_us = cJSON_IsNumber(zc_latency_us) ? (uint16_t)zc_latency_us->valueint : 0;
+
+    cJSON_Delete(relay_json);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Create list of safe pins
+ */
+void populate_safe_gpio_pins(char *buffer, size_t buffer_size) {
+    // Initialize the buffer with an empty string
+    buffer[0] = '\0';
+
+    // Iterate over SAFE_GPIO_PINS array and append each pin to the buffer
+    for (int i = 0; i < SAFE_GPIO_COUNT; i++) {
+        // Append a comma after each pin except the last one
+        if (i == SAFE_GPIO_COUNT - 1) {
+            snprintf(buffer + strlen(buffer), buffer_size - strlen(buffer), "%d", SAFE_GPIO_PINS[i]);
+        } else {
+            snprintf(buffer + strlen(buffer), buffer_size - strlen(buffer), "%d, ", SAFE_GPIO_PINS[i]);
+        }
+    }
+}
+
+/**
+ * @brief Retrieves the list of relay actuators from NVS.
+ * 
+ * This function reads the number of relay actuators from NVS, allocates memory 
+ * for the list, and loads each relay actuator's configuration from NVS into the list.
+ * If units are already in memory, a consistent copy of in-memory actuators is returned.
+ * In both cases the list is allocated and has to be freed by the caller.
+ * 
+ * @param[out] relay_list Pointer to the array of relay_unit_t that will hold the relay actuators.
+ * @param[out] count Pointer to store the number of relay actuators retrieved.
+ * 
+ * @return ESP_OK on success, or an error code on failure.
+ */
+esp_err_t get_relay_list(relay_unit_t **relay_list, uint16_t *count) {
+
+    // If in-memory bit is set, return a copy of in-memory actuators
+    if (xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY) {
+        return relay_units_list_copy(RELAY_TYPE_ACTUATOR, relay_list, count);
+    }
+
+    /* If the in-memory bit is not set, read from NVS */
+
+    // Read the number of relay actuators from NVS
+    uint16_t stored_relays_count = 0; // number of actually stored and initialized relays
+    uint16_t relay_ch_count;
+    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_CHANNEL_COUNT, &relay_ch_count));
+
+    // If there are no relays, skip allocation and return success
+    if (relay_ch_count == 0) {
+        ESP_LOGW(TAG, "No relays allocated. NULL array will be returned.");
+        *relay_list = NULL;  // No need to allocate memory for an empty list
+        return ESP_OK;
+    }
+
+    // Allocate memory for the list of relays
+    *relay_list = (relay_unit_t *)calloc(relay_ch_count, sizeof(relay_unit_t));
+    if (*relay_list == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for relay list");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Processing relay array...");
+    for (int i_channel = 0; i_channel < relay_ch_count; i_channel++) {
+        relay_unit_t relay = {0};
+        char *relay_nvs_key = get_relay_nvs_key(i_channel);
+        if (load_relay_actuator_from_nvs(relay_nvs_key, &relay) == ESP_OK) {
+            (*relay_list)[i_channel] = relay;  // Add relay to the list
+            stored_relays_count++;
+        }
+        free(relay_nvs_key);
+    }
+
+    *count = stored_relays_count;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Retrieves the list of contact sensors from NVS.
+ * 
+ * This function reads the number of contact sensors from NVS, allocates memory 
+ * for the list, and loads each contact sensor's configuration from NVS into the list.
+ * If units are already in memory, a consistent copy of in-memory contact sensors is returned.
+ * In both cases the list is allocated and has to be freed by the caller.
+ * 
+ * @param[out] sensor_list Pointer to the array of relay_unit_t that will hold the contact sensors.
+ * @param[out] count Pointer to store the number of contact sensors retrieved.
+ * 
+ * @return ESP_OK on success, or an error code on failure.
+ */
+esp_err_t get_contact_sensor_list(relay_unit_t **sensor_list, uint16_t *count) {
+
+    // If in-memory bit is set, return a copy of in-memory contact sensors
+    if (xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY) {
+        return relay_units_list_copy(RELAY_TYPE_SENSOR, sensor_list, count);
+    }
+
+    /* If the in-memory bit is not set, read from NVS */
+
+    uint16_t stored_sensors_count = 0; // number of actually stored and initialized contact sensors
+
+    // Read the number of contact sensors from NVS
+    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_CONTACT_SENSORS_COUNT, count));
+
+    // If there are no contact sensors, skip allocation and return success
+    if (*count == 0) {
+        ESP_LOGW(TAG, "No contact sensors allocated. NULL array will be returned.");
+        *sensor_list = NULL;  // No need to allocate memory for an empty list
+        return ESP_OK;
+    }
+
+    // Allocate memory for the list of contact sensors
+    *sensor_list = (relay_unit_t *)calloc(*count, sizeof(relay_unit_t));
+    if (*sensor_list == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for contact sensor list");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Loop through and load contact sensors from NVS
+    ESP_LOGI(TAG, "Processing contact sensors array...");
+    for (int i_channel = 0; i_channel < *count; i_channel++) {
+        relay_unit_t relay = {0};
+        char *relay_nvs_key = get_contact_sensor_nvs_key(i_channel);
+        if (load_relay_sensor_from_nvs(relay_nvs_key, &relay) == ESP_OK) {
+            (*sensor_list)[i_channel] = relay;  // Add contact sensor to the list
+            stored_sensors_count++;
+        }
+        free(relay_nvs_key);
+    }
+
+    *count = stored_sensors_count;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Retrieves the list of pulse counters from NVS.
+ * 
+ * Same as get_contact_sensor_list(), but for pulse counters. GPIO of the units is not initialized.
+ * The list is allocated and has to be freed by the caller.
+ * 
+ * @param[out] counter_list Pointer to the array of relay_unit_t that will hold the pulse counters.
+ * @param[out] count Pointer to store the number of pulse counters retrieved.
+ * 
+ * @return ESP_OK on success, or an error code on failure.
+ */
+esp_err_t get_pulse_counter_list(relay_unit_t **counter_list, uint16_t *count) {
+
+    // If in-memory bit is set, return a copy of in-memory pulse counters
+    if (xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY) {
+        return relay_units_list_copy(RELAY_TYPE_PULSE_COUNTER, counter_list, count);
+    }
+
+    /* If the in-memory bit is not set, read from NVS */
+
+    uint16_t stored_counters_count = 0;
+
+    // Read the number of pulse counters from NVS. Missing key means there are none (older configuration).
+    *count = 0;
+    nvs_read_uint16(S_NAMESPACE, S_KEY_PULSE_COUNTERS_COUNT, count);
+
+    if (*count == 0) {
+        *counter_list = NULL;
+        return ESP_OK;
+    }
+
+    *counter_list = (relay_unit_t *)calloc(*count, sizeof(relay_unit_t));
+    if (*counter_list == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for pulse counter list");
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Processing pulse counters array...");
+    for (int i_channel = 0; i_channel < *count; i_channel++) {
+        relay_unit_t relay = {0};
+        char *relay_nvs_key = get_pulse_counter_nvs_key(i_channel);
+        if (load_relay_pulse_counter_from_nvs(relay_nvs_key, &relay) == ESP_OK) {
+            (*counter_list)[stored_counters_count++] = relay;
+        }
+        free(relay_nvs_key);
+    }
+
+    *count = stored_counters_count;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Combines the list of relay actuators and contact sensors into one list.
+ * 
+ * This function retrieves both the relay actuators and contact sensors from NVS, 
+ * allocates memory for a combined list, and appends both lists together. The combined 
+ * list includes all relay actuators and contact sensors.
+ * 
+ * Pulse counters, if any, are appended after the sensors. If units are already in memory, a consistent
+ * copy of all in-memory units is returned. In both cases the list is allocated and has to be freed by the caller.
+ * 
+ * @param[out] relay_list Pointer to the combined array of relay_unit_t that will hold both relays and sensors.
+ * @param[out] total_count Pointer to store the total number of relays and sensors retrieved.
+ * 
+ * @return ESP_OK on success, or an error code on failure.
+ */
+esp_err_t get_all_relay_units(relay_unit_t **relay_list, uint16_t *total_count) {
+
+    // If in-memory bit is set, return a copy of all in-memory units
+    if (xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY) {
+        return relay_units_list_copy(RELAY_LIST_ALL, relay_list, total_count);
+    }
+
+    relay_unit_t *actuators = NULL, *sensors = NULL, *counters = NULL;
+    uint16_t actuator_count = 0, sensor_count = 0, counter_count = 0;
+
+    // NOTE: The order of getting actuators and sensors is important to maintain consistency
+    // in the combined list (actuators first, then sensors).
+
+    // Get actuators (relays) and handle the case where there are no actuators
+    ESP_ERROR_CHECK(get_relay_list(&actuators, &actuator_count));
+
+    // Get contact sensors and handle the case where there are no contact sensors
+    ESP_ERROR_CHECK(get_contact_sensor_list(&sensors, &sensor_count));
+
+    // Get pulse counters
+    ESP_ERROR_CHECK(get_pulse_counter_list(&counters, &counter_count));
+
+    // Calculate the total count
+    *total_count = actuator_count + sensor_count + counter_count;
+
+    ESP_LOGI(TAG, "Found %d actuator(s), %d contact sensor(s) and %d pulse counter(s). Total: %d unit(s).", actuator_count, sensor_count, counter_count, *total_count);
+
+    // If there are no relays or sensors, return success without allocating memory
+    if (*total_count == 0) {
+        *relay_list = NULL;  // No relays or sensors, so no allocation needed
+        // No need to free anything as both lists are NULL
+        return ESP_OK;
+    }
+
+    // Allocate memory for the combined list of relays and sensors
+    // *relay_list = (relay_unit_t *)malloc(sizeof(relay_unit_t) * (*total_count));
+    *relay_list = calloc(*total_count, sizeof(relay_unit_t));
+    if (*relay_list == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for combined relay list");
+        if (actuator_count > 0) {
+            if (INIT_RELAY_ON_LOAD) {
+                ESP_ERROR_CHECK(free_relays_array(actuators, actuator_count));
+            } else {
+                free(actuators);
+            }
+        }
+        if (sensor_count > 0) {
+            if (INIT_SENSORS_ON_LOAD) {
+                ESP_ERROR_CHECK(free_relays_array(sensors, sensor_count));
+            } else {
+                free(sensors);
+            }
+        }
+        free(counters);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Copy actuators to the combined list
+    if (actuator_count > 0) {
+        memcpy(*relay_list, actuators, sizeof(relay_unit_t) * actuator_count);
+        if (INIT_RELAY_ON_LOAD) {
+            ESP_ERROR_CHECK(free_relays_array(actuators, actuator_count));
+        } else {
+            free(actuators);
+        }
+    }
+
+    // Copy sensors to the combined list after actuators
+    if (sensor_count > 0) {
+        memcpy(*relay_list + actuator_count, sensors, sizeof(relay_unit_t) * sensor_count);
+        if (INIT_SENSORS_ON_LOAD) {
+            ESP_ERROR_CHECK(free_relays_array(sensors, sensor_count));
+        } else {
+            free(sensors);
+        }
+    }
+
+    // Copy pulse counters to the combined list after sensors
+    if (counter_count > 0) {
+        memcpy(*relay_list + actuator_count + sensor_count, counters, sizeof(relay_unit_t) * counter_count);
+        free(counters);
+    }
+
+    return ESP_OK;
+}
+
+
+/**
+ * @brief Frees memory allocated for relay_unit_t array, including dynamically allocated io_conf field.
+ *
+ * @param relay_list Pointer to an array of relay_unit_t.
+ * @param count Number of elements in the relay_list array.
+ * @return
+ *     - ESP_OK: Successfully freed all memory.
+ *     - ESP_ERR_INVALID_ARG: relay_list is NULL.
+ */
+esp_err_t free_relays_array(relay_unit_t *relay_list, size_t count) {
+    if (relay_list == NULL || count < 1) {
+        ESP_LOGW(TAG, "relay_list is NULL or array size is zero, nothing to free");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Iterate through each relay and free the dynamically allocated io_conf field
+    for (size_t i = 0; i < count; i++) {
+        relay_gpio_deinit(&relay_list[i]);
+    }
+
+    // Free the relay list itself
+    free(relay_list);
+
+    return ESP_OK;  // Indicate success
+}
+
+
+/**
+ * @brief: Runs relay_sensor_register_isr() for all contact sensors in the system. Recommended to be called once at the start of the app.
+ * 
+ * @return
+ *     - ESP_OK: Successfully freed all memory.
+ *     - ESP_ERR_INVALID_ARG: relay_list is NULL.
+ */
+esp_err_t relay_all_sensors_register_isr() {
+    /* Init the queue */
+    gpio_evt_queue = xQueueCreate(GPIO_EVT_QUEUE_LENGTH, sizeof(gpio_event_t));
+    if (gpio_evt_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create the queue");
+        return ESP_FAIL;  // Exit if queue creation fails
+    }
+
+    /* Init the debounce timer */
+    const esp_timer_create_args_t debounce_timer_args = {
+        .callback = debounce_timer_cb,
+        .name = "gpio_debounce"
+    };
+    if (esp_timer_create(&debounce_timer_args, &s_debounce_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create the debounce timer");
+        return ESP_FAIL;
+    }
+
+    /* Install ISR service with default configuration. The zero-cross detector may have installed it already. */
+    esp_err_t isr_err = gpio_install_isr_service(0);
+    if (isr_err != ESP_OK && isr_err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "Failed to install ISR service with default configuration");
+        return ESP_FAIL;
+    }
+
+    /* Acquisition mode is applied on boot */
+    uint16_t scan_tick_ms = S_DEFAULT_SENSORS_SCAN_TICK;
+    uint16_t scan_filter_m = S_DEFAULT_SENSORS_SCAN_FILTER;
+    if (nvs_read_uint16(S_NAMESPACE, S_KEY_SENSORS_ACQ_MODE, &s_sensors_acq_mode) != ESP_OK) {
+        ESP_LOGW(TAG, "Unable to read contact sensors acquisition mode from NVS. Using ISR mode.");
+        s_sensors_acq_mode = SENSORS_ACQ_MODE_ISR;
+    }
+    if (s_sensors_acq_mode == SENSORS_ACQ_MODE_SCAN) {
+        if (nvs_read_uint16(S_NAMESPACE, S_KEY_SENSORS_SCAN_TICK, &scan_tick_ms) != ESP_OK
+            || scan_tick_ms < SENSORS_SCAN_TICK_MIN || scan_tick_ms > SENSORS_SCAN_TICK_MAX) {
+            ESP_LOGW(TAG, "Invalid or missing %s. Using default %d ms.", S_KEY_SENSORS_SCAN_TICK, S_DEFAULT_SENSORS_SCAN_TICK);
+            scan_tick_ms = S_DEFAULT_SENSORS_SCAN_TICK;
+        }
+        if (nvs_read_uint16(S_NAMESPACE, S_KEY_SENSORS_SCAN_FILTER, &scan_filter_m) != ESP_OK
+            || scan_filter_m < SCAN_FILTER_M_MIN || scan_filter_m > SCAN_FILTER_M_MAX) {
+            ESP_LOGW(TAG, "Invalid or missing %s. Using default %d samples.", S_KEY_SENSORS_SCAN_FILTER, S_DEFAULT_SENSORS_SCAN_FILTER);
+            scan_filter_m = S_DEFAULT_SENSORS_SCAN_FILTER;
+        }
+
+        scan_filter_init(&s_scan_filter, (uint8_t)scan_filter_m, relay_scan_read_inputs());
+        s_scan_tick_ms = scan_tick_ms;
+
+        const esp_timer_create_args_t scan_timer_args = {
+            .callback = relay_scan_timer_cb,
+            .name = "gpio_scan"
+        };
+        if (esp_timer_create(&scan_timer_args, &s_scan_timer) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create the input scan timer");
+            return ESP_FAIL;
+        }
+    }
+
+    /* Process sensors */
+    relay_unit_t *sensors = NULL;
+    uint16_t sensor_count = 0;
+    bool in_memory = (xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY) != 0;
+
+    // ISR dispatch and sensor states are bound to the in-memory units themselves, not to a copy of them.
+    // In memory contact sensors follow the actuators.
+    if (in_memory) {
+        sensors = s_units + s_relays_count;
+        sensor_count = s_sensors_count;
+    } else if (get_contact_sensor_list(&sensors, &sensor_count) != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to get sensors list from NVS");
+        return ESP_FAIL;
+    }
+
+    // check if there're any sensor to deal with
+    if (sensor_count == 0) {
+        ESP_LOGW(TAG, "No sensors found to register ISR for.");
+        return ESP_OK;
+    }
+
+    // register ISR (or add to the input scan) for each sensor
+    for(int i = 0; i < sensor_count; i++) {
+        if (relay_sensor_register_isr(&sensors[i]) != ESP_OK) {
+            ESP_LOGE(TAG, "Unable to register ISR for pin %d", sensors[i].gpio_pin);
+            continue;
+        }
+        if (relay_sensor_gpio_state_refresh(&sensors[i]) != ESP_OK) {
+            ESP_LOGE(TAG, "Unable to refresh state on pin %d", sensors[i].gpio_pin);
+        } else {
+            ESP_LOGI(TAG, "Refreshed state on pin %d, state %d", sensors[i].gpio_pin, sensors[i].state);
+        }
+    }
+
+    if (s_scan_timer != NULL) {
+        if (esp_timer_start_periodic(s_scan_timer, (uint64_t)scan_tick_ms * 1000) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start the input scan timer");
+            return ESP_FAIL;
+        }
+        ESP_LOGI(TAG, "Contact sensors are scanned every %d ms, level settles on %d of %d samples",
+                    scan_tick_ms, s_scan_filter.n, s_scan_filter.m);
+    }
+
+    // cleanup / free if not in-memory mode
+    if (in_memory) {
+        ESP_LOGD(TAG, "Relay units in memory, skipping freeing sensors array.");
+        return ESP_OK;
+    }
+    if (INIT_SENSORS_ON_LOAD) {
+        ESP_ERROR_CHECK(free_relays_array(sensors, sensor_count));
+    } else {
+        free(sensors);
+    }
+
+    return ESP_OK;
+}
+
+
+#if SOC_PCNT_SUPPORTED
+/**
+ * @brief: Release PCNT resources of the pulse counter slot. Safe to call on partially created slots.
+ * 
+ * @param slot Pointer to the pulse counter slot
+ */
+static void relay_pulse_slot_release(relay_pulse_slot_t *slot) {
+    if (slot->pcnt_unit != NULL) {
+        pcnt_unit_stop(slot->pcnt_unit);
+        pcnt_unit_disable(slot->pcnt_unit);
+    }
+    if (slot->pcnt_channel != NULL) {
+        pcnt_del_channel(slot->pcnt_channel);
+        slot->pcnt_channel = NULL;
+    }
+    if (slot->pcnt_unit != NULL) {
+        pcnt_del_unit(slot->pcnt_unit);
+        slot->pcnt_unit = NULL;
+    }
+}
+#endif
+
+/**
+ * @brief: Attach the pulse counter to a PCNT unit and start counting
+ * 
+ * Pulses shorter than PULSE_GLITCH_FILTER_NS are filtered out by hardware. Rising edges are counted,
+ * or falling edges if the unit is inverted. If the counter is already attached, it is re-attached,
+ * so the call applies the new GPIO pin, inversion and enabled flag of the unit. The total count is kept.
+ * 
+ * @param relay Pointer to the relay unit (pulse counter)
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_pulse_counter_attach(relay_unit_t *relay) {
+
+    if (relay == NULL || relay->type != RELAY_TYPE_PULSE_COUNTER) {
+        ESP_LOGE(TAG, "NULL value or not a pulse counter relay unit");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (relay->channel < PULSE_COUNTERS_COUNT_MIN || relay->channel > PULSE_COUNTERS_COUNT_MAX) {
+        ESP_LOGE(TAG, "Pulse counter channel %d is out of range", relay->channel);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    relay_pulse_slot_t *slot = &s_pulse_slots[relay->channel];
+    if (slot->attached) {
+        relay_pulse_counter_detach(relay->channel);
+    }
+
+    if (!relay->enabled) {
+        ESP_LOGI(TAG, "Pulse counter %d is disabled, not attaching it to PCNT", relay->channel);
+        return ESP_OK;
+    }
+
+#if SOC_PCNT_SUPPORTED
+    if (!relay->gpio_initialized) {
+        relay_units_write_lock();
+        esp_err_t err = relay_gpio_init(relay);
+        relay_units_write_unlock();
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to init GPIO pin %d for pulse counter %d", relay->gpio_pin, relay->channel);
+            return err;
+        }
+    }
+
+    // Hardware counter is 16 bit: watch points at the limits let the driver accumulate its overflows
+    pcnt_unit_config_t unit_config = {
+        .low_limit = -PULSE_PCNT_LIMIT,
+        .high_limit = PULSE_PCNT_LIMIT,
+        .flags.accum_count = 1,
+    };
+    esp_err_t err = pcnt_new_unit(&unit_config, &slot->pcnt_unit);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create PCNT unit for pulse counter %d: %s", relay->channel, esp_err_to_name(err));
+        slot->pcnt_unit = NULL;
+        return err;
+    }
+
+    pcnt_glitch_filter_config_t filter_config = {
+        .max_glitch_ns = PULSE_GLITCH_FILTER_NS,
+    };
+    pcnt_chan_config_t chan_config = {
+        .edge_gpio_num = relay->gpio_pin,
+        .level_gpio_num = -1,
+    };
+
+    err = pcnt_unit_set_glitch_filter(slot->pcnt_unit, &filter_config);
+    if (err == ESP_OK) {
+        err = pcnt_new_channel(slot->pcnt_unit, &chan_config, &slot->pcnt_channel);
+    }
+    if (err == ESP_OK) {
+        // One edge per pulse: rising edges, or falling ones for inverted (active low) inputs
+        err = pcnt_channel_set_edge_action(slot->pcnt_channel,
+                    relay->inverted ? PCNT_CHANNEL_EDGE_ACTION_HOLD : PCNT_CHANNEL_EDGE_ACTION_INCREASE,
+                    relay->inverted ? PCNT_CHANNEL_EDGE_ACTION_INCREASE : PCNT_CHANNEL_EDGE_ACTION_HOLD);
+    }
+    if (err == ESP_OK) {
+        err = pcnt_unit_add_watch_point(slot->pcnt_unit, PULSE_PCNT_LIMIT);
+    }
+    if (err == ESP_OK) {
+        err = pcnt_unit_add_watch_point(slot->pcnt_unit, -PULSE_PCNT_LIMIT);
+    }
+    if (err == ESP_OK) {
+        err = pcnt_unit_enable(slot->pcnt_unit);
+    }
+    if (err == ESP_OK) {
+        err = pcnt_unit_clear_count(slot->pcnt_unit);
+    }
+    if (err == ESP_OK) {
+        err = pcnt_unit_start(slot->pcnt_unit);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up PCNT unit for pulse counter %d on GPIO pin %d: %s", relay->channel, relay->gpio_pin, esp_err_to_name(err));
+        relay_pulse_slot_release(slot);
+        return err;
+    }
+
+    // Hardware count starts from zero, the total is kept
+    pulse_counter_rebase(&slot->counter, 0, esp_timer_get_time());
+    slot->attached = true;
+
+    ESP_LOGI(TAG, "Pulse counter %d attached to PCNT on GPIO pin %d, glitch filter %d ns", relay->channel, relay->gpio_pin, PULSE_GLITCH_FILTER_NS);
+    return ESP_OK;
+#else
+    ESP_LOGE(TAG, "PCNT peripheral is not available on this target. Pulse counter %d is not attached.", relay->channel);
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * @brief: Stop counting and release the PCNT unit of the pulse counter. Pulses counted so far are kept in the total.
+ * 
+ * @param channel Pulse counter channel
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_pulse_counter_detach(int channel) {
+
+    if (channel < PULSE_COUNTERS_COUNT_MIN || channel > PULSE_COUNTERS_COUNT_MAX) {
+        ESP_LOGE(TAG, "Pulse counter channel %d is out of range", channel);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    relay_pulse_slot_t *slot = &s_pulse_slots[channel];
+    if (!slot->attached) {
+        return ESP_OK;
+    }
+
+#if SOC_PCNT_SUPPORTED
+    int hw_count = 0;
+    if (pcnt_unit_get_count(slot->pcnt_unit, &hw_count) == ESP_OK) {
+        pulse_counter_update(&slot->counter, hw_count, esp_timer_get_time());
+    }
+    relay_pulse_slot_release(slot);
+#endif
+    slot->attached = false;
+
+    ESP_LOGI(TAG, "Pulse counter %d detached from PCNT", channel);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Sample hardware counts of all attached pulse counters and update count and rate of in-memory units
+ * 
+ * @param publish Trigger MQTT publish of the updated units
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_pulse_counters_sample(bool publish) {
+
+    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
+        ESP_LOGE(TAG, "Relay units are not loaded in memory.");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    for (int channel = 0; channel <= PULSE_COUNTERS_COUNT_MAX; channel++) {
+        relay_pulse_slot_t *slot = &s_pulse_slots[channel];
+        if (!slot->attached) {
+            continue;
+        }
+
+#if SOC_PCNT_SUPPORTED
+        int hw_count = 0;
+        esp_err_t err = pcnt_unit_get_count(slot->pcnt_unit, &hw_count);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to read PCNT count of pulse counter %d: %s", channel, esp_err_to_name(err));
+            continue;
+        }
+        pulse_counter_update(&slot->counter, hw_count, esp_timer_get_time());
+#endif
+
+        // Resolved under the writer lock: relay_units_reconfigure() may move the unit in memory or take it down
+        relay_unit_t *relay = NULL;
+        unit_handle_t unit = {0};
+        relay_units_write_lock();
+        bool found = (get_relay_pulse_counter_from_memory_by_channel(channel, &relay) == ESP_OK);
+        if (found) {
+            relay->pulse_count = slot->counter.total;
+            relay->pulse_rate = slot->counter.rate;
+            unit = get_unit_handle(relay);
+        }
+        relay_units_write_unlock();
+        if (!found) {
+            continue;
+        }
+
+        ESP_LOGD(TAG, "Pulse counter %d: count %llu, rate %.3f/s", channel, (unsigned long long)slot->counter.total, slot->counter.rate);
+
+        if (publish) {
+            trigger_mqtt_publish(unit);
+        }
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief: Task to sample pulse counters and publish aggregated count and rate to MQTT
+ * 
+ * Interval and MQTT connection mode are applied on boot.
+ * 
+ * @param arg Unused parameter for task function signature.
+ */
+static void pulse_counter_task(void *arg) {
+    uint16_t interval_s = S_DEFAULT_PULSE_INTERVAL;
+    if (nvs_read_uint16(S_NAMESPACE, S_KEY_PULSE_INTERVAL, &interval_s) != ESP_OK || interval_s < PULSE_INTERVAL_MIN) {
+        ESP_LOGW(TAG, "Unable to read pulse counters interval from NVS, using default %d s", S_DEFAULT_PULSE_INTERVAL);
+        interval_s = S_DEFAULT_PULSE_INTERVAL;
+    }
+
+    ESP_LOGI(TAG, "Sampling pulse counters every %d s", interval_s);
+
+    // fixed cadence, so the rate is always calculated over the same interval
+    TickType_t last_wake = xTaskGetTickCount();
+    while (1) {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS((uint32_t)interval_s * 1000));
+        relay_pulse_counters_sample(_DEVICE_ENABLE_MQTT && mqtt_config_connection_mode() && IS_MQTT_READY());
+    }
+}
+
+/**
+ * @brief: Start the pulse counters sampling task unless it is running already
+ * 
+ * @return esp_err_t result of the operation
+ */
+static esp_err_t relay_pulse_counter_task_start() {
+    if (s_pulse_counter_task != NULL) {
+        return ESP_OK;
+    }
+
+    if (xTaskCreate(pulse_counter_task, "pulse_counter_task", 4096, NULL, 5, &s_pulse_counter_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create pulse counter task");
+        s_pulse_counter_task = NULL;
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief: Attach all in-memory pulse counters to PCNT units and start the sampling task
+ * 
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_all_pulse_counters_attach() {
+    relay_unit_t *counters = NULL;
+    uint16_t counter_count = 0;
+
+    // PCNT units are bound to in-memory units, which are sampled by the task
+    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
+        ESP_LOGE(TAG, "Relay units are not loaded in memory.");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // In memory pulse counters follow the actuators and the sensors
+    counters = s_units + s_relays_count + s_sensors_count;
+    counter_count = s_pulse_counters_count;
+
+    if (counter_count == 0) {
+        ESP_LOGI(TAG, "No pulse counters found to attach.");
+        return ESP_OK;
+    }
+
+    for (int i = 0; i < counter_count; i++) {
+        if (relay_pulse_counter_attach(&counters[i]) != ESP_OK) {
+            ESP_LOGE(TAG, "Unable to attach pulse counter %d on pin %d", counters[i].channel, counters[i].gpio_pin);
+        }
+    }
+
+    return relay_pulse_counter_task_start();
+}
+
+/**
+ * @brief: Set the state of the relay unit (actuator), activate corresponding GPIO and persist the state to NVS.
+ * 
+ * Switching ON a member of an interlock group switches the other members of the group OFF first. If the group
+ * dead time has not passed yet, the unit stays OFF and is switched ON by the group timer later.
+ * 
+ * @param[in, out] relay Pointer to the relay_unit_t structure
+ * @param state Relay state relay_state_t to set
+ * @param persist Save the update state to NVS. true: sets GPIO level and saves the relay to NVS; false: just sets GPIO level
+ * @return
+ *     - ESP_OK: Successfully completed all operations.
+ *     - ESP_ERR_INVALID_ARG: relay is NULL.
+ *     - ESP_ERR_INVALID_STATE: ON refused on boot, another member of the interlock group is ON.
+ */
+esp_err_t relay_set_state(relay_unit_t *relay, relay_state_t state, bool persist) {
+    return relay_set_state_traced(relay, state, persist, LATENCY_PATH_NONE, 0);
+}
+
+/**
+ * @brief: Set the state of the relay unit (actuator) as the result of an MQTT command or a rule and trace its latency.
+ * 
+ * Same as relay_set_state(), but GPIO write and NVS stages are recorded in the histograms of the given path
+ * and the MQTT publish carries the origin timestamp.
+ * 
+ * @param[in, out] relay Pointer to the relay_unit_t structure
+ * @param state Relay state relay_state_t to set
+ * @param persist Save the update state to NVS
+ * @param latency_path latency_path_t of the event
+ * @param origin_us Time the command was received, esp_timer_get_time() based. 0 disables tracing.
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_set_state_traced(relay_unit_t *relay, relay_state_t state, bool persist, uint8_t latency_path, int64_t origin_us) {
+
+    latency_path_t path = (origin_us > 0) ? (latency_path_t)latency_path : LATENCY_PATH_NONE;
+
+    dump_current_task();
+
+    bool gpio_init_made = false;
+
+    // is relay an instance ?
+    if (relay == NULL) {
+        ESP_LOGE(TAG, "NULL value for relay unit");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // check if the relay is actuator
+    if (relay->type != RELAY_TYPE_ACTUATOR) {
+         ESP_LOGE(TAG, "Setting state not applicable: relay unit is not an actuator. Channel (%d).", relay->channel);
+        return ESP_ERR_INVALID_ARG;       
+    }
+
+    // explicit state wins over a pulse in progress
+    relay_actuator_pulse_cancel(relay);
+
+    // GPIO configuration and state of the unit are modified below: keep readers off until it's done
+    relay_units_write_lock();
 
-    return json_string;
-}
+    // Init GPIO
+    if (!relay->gpio_initialized) {
+        if (relay_gpio_init(relay) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to init GPIO pin before setting the state. Channel (%d). ", relay->channel);
+            relay_units_write_unlock();
+            return ESP_FAIL;
+        } else {
+            ESP_LOGI(TAG, "Initiated GPIO pin. Channel (%d). ", relay->channel);
+            gpio_init_made = true;
+        }
+    }
 
-/**
- * @brief Deserialize a JSON string to relay_unit_t structure
- *
- * This function parses a JSON formatted string and populates the relay_unit_t structure 
- * with its corresponding fields. The function expects the input JSON string to have the 
- * same structure as that produced by `serialize_relay_unit()`.
- *
- * @param[in] json_str The JSON string to be deserialized
- * @param[out] relay Pointer to the relay_unit_t structure to populate with deserialized data
- * @return ESP_OK on success, or ESP_FAIL if deserialization fails or fields are invalid.
- */
-esp_err_t deserialize_relay_unit(const char *json_str, relay_unit_t *relay) {
-    cJSON *relay_json = cJSON_Parse(json_str);
-    if (relay_json == NULL) {
-        ESP_LOGE(TAG, "Failed to parse JSON string for relay deserialization");
+    // set level: actuators are driven through their interlock group, which may switch other members OFF or park the request
+    uint32_t released = 0;
+    bool parked = false;
+    esp_err_t err;
+    if (relay->channel >= 0 && relay->channel <= CHANNEL_COUNT_MAX) {
+        err = relay_interlock_write(relay, state, 0, (uint8_t)path, origin_us, &released, &parked, NULL);
+    } else {
+        err = gpio_set_level((gpio_num_t)relay->gpio_pin, relay->inverted ? (uint32_t)(!state) : (uint32_t)state);
+        relay_rtc_mirror_outputs();
+    }
+    if (err == ESP_ERR_INVALID_STATE) {
+        ESP_LOGW(TAG, "Channel (%d) kept OFF: another member of interlock group %d is ON.", relay->channel, relay->interlock_group);
+        relay->state = RELAY_STATE_OFF;
+        if (gpio_init_made) {
+            ESP_ERROR_CHECK(relay_gpio_deinit(relay));
+        }
+        relay_units_write_unlock();
+        return err;
+    } else if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set GPIO level. Channel (%d), level (%d).", relay->channel, relay->state);
+        ESP_ERROR_CHECK(relay_gpio_deinit(relay));
+        relay_units_write_unlock();
         return ESP_FAIL;
+    } else if (!parked) {
+        latency_record_since(path, LATENCY_STAGE_GPIO_WRITE, origin_us);
+        ESP_LOGI(TAG, ">|>|>| Successfully set GPIO level. Channel (%d), level (%d).", relay->channel, relay->state);
     }
 
-    // Deserialize the fields
-    cJSON *channel = cJSON_GetObjectItem(relay_json, "channel");
-    cJSON *state = cJSON_GetObjectItem(relay_json, "state");
-    cJSON *inverted = cJSON_GetObjectItem(relay_json, "inverted");
-    cJSON *gpio_pin = cJSON_GetObjectItem(relay_json, "gpio_pin");
-    cJSON *enabled = cJSON_GetObjectItem(relay_json, "enabled");
-    cJSON *type = cJSON_GetObjectItem(relay_json, "type");
+    // Update the state in the object once it was successfully set to GPIO. Parked ON is applied after the dead time.
+    relay->state = parked ? RELAY_STATE_OFF : (relay_state_t)state;
+    uint32_t released_units = relay_interlock_mark_released(released);
 
-    if (!cJSON_IsNumber(channel) || !cJSON_IsBool(state) || !cJSON_IsBool(inverted) || !cJSON_IsNumber(gpio_pin) || !cJSON_IsBool(enabled) || !cJSON_IsNumber(type)) {
-        ESP_LOGE(TAG, "Invalid or missing fields in JSON object for relay deserialization");
-        cJSON_Delete(relay_json);
-        return ESP_FAIL;
+    // reset GPIO pin to free memory
+    if (gpio_init_made) {
+        ESP_ERROR_CHECK(relay_gpio_deinit(relay));
     }
 
-    relay->channel = channel->valueint;
-    relay->state = state->valueint ? RELAY_STATE_ON : RELAY_STATE_OFF;
-    relay->inverted = inverted->valueint;
-    relay->gpio_pin = gpio_pin->valueint;
-    relay->enabled = enabled->valueint;
-    relay->type = (relay_type_t)type->valueint;
+    relay_interlock_commit_released(released_units);
 
-    cJSON_Delete(relay_json);
-    return ESP_OK;
-}
+    relay_units_write_unlock();
 
-/**
- * @brief: Create list of safe pins
- */
-void populate_safe_gpio_pins(char *buffer, size_t buffer_size) {
-    // Initialize the buffer with an empty string
-    buffer[0] = '\0';
+    // update via MQTT
+    if (_DEVICE_ENABLE_MQTT && mqtt_config_connection_mode() && IS_MQTT_READY()) {
+        // mqtt_publish_relay_data(relay);
+        // errors are logged by the trigger: the state is applied already, a missed publish must not abort the caller
+        trigger_mqtt_publish_traced(get_unit_handle(relay), path, origin_us);
+    }
 
-    // Iterate over SAFE_GPIO_PINS array and append each pin to the buffer
-    for (int i = 0; i < SAFE_GPIO_COUNT; i++) {
-        // Append a comma after each pin except the last one
-        if (i == SAFE_GPIO_COUNT - 1) {
-            snprintf(buffer + strlen(buffer), buffer_size - strlen(buffer), "%d", SAFE_GPIO_PINS[i]);
-        } else {
-            snprintf(buffer + strlen(buffer), buffer_size - strlen(buffer), "%d, ", SAFE_GPIO_PINS[i]);
+    if (persist) {
+        // persist new state to NVS (write-behind)
+        int64_t t_stage = esp_timer_get_time();
+        if (relay_persist_mark_dirty(relay) != ESP_OK) {
+            ESP_LOGE(TAG, "Unable to save relay unit to NVS");
+            return ESP_FAIL;
         }
+        latency_record_since(path, LATENCY_STAGE_NVS, t_stage);
     }
+
+    return ESP_OK;
 }
 
+
 /**
- * @brief Retrieves the list of relay actuators from NVS.
- * 
- * This function reads the number of relay actuators from NVS, allocates memory 
- * for the list, and loads each relay actuator's configuration from NVS into the list.
+ * @brief: Switch the actuator ON for the given time. The pulse is timed on the device, the OFF level is written
+ * by the pulse timer and only the final (OFF) state is saved and published.
  * 
- * @param[out] relay_list Pointer to the array of relay_unit_t that will hold the relay actuators.
- * @param[out] count Pointer to store the number of relay actuators retrieved.
+ * A new pulse on the same actuator restarts the timer, an explicit state set with relay_set_state() cancels it.
  * 
- * @return ESP_OK on success, or an error code on failure.
+ * @param[in, out] relay Pointer to the in-memory relay unit (actuator)
+ * @param pulse_ms Pulse width in milliseconds (1 - RELAY_PULSE_MS_MAX)
+ * @param latency_path latency_path_t of the event
+ * @param origin_us Time the command was received, esp_timer_get_time() based. 0 disables tracing.
+ * @return esp_err_t result of the operation
  */
-esp_err_t get_relay_list(relay_unit_t **relay_list, uint16_t *count) {
+esp_err_t relay_set_state_pulse(relay_unit_t *relay, uint32_t pulse_ms, uint8_t latency_path, int64_t origin_us) {
 
-    // If in-memory bit is set, return the array from in-memory pointers where type is RELAY_TYPE_ACTUATOR
-    // This will be first 's_relays_count' elements from s_units array, so we return pointer to s_units and count as s_relays_count
-    if (xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY) {
-        ESP_LOGI(TAG, "Relay units already in memory, returning existing list of actuators.");
-        *relay_list = s_units;
-        *count = s_relays_count;
-        return ESP_OK;
+    latency_path_t path = (origin_us > 0) ? (latency_path_t)latency_path : LATENCY_PATH_NONE;
+
+    if (relay == NULL) {
+        ESP_LOGE(TAG, "NULL value for relay unit");
+        return ESP_ERR_INVALID_ARG;
     }
 
-    /* If the in-memory bit is not set, read from NVS */
+    if (relay->type != RELAY_TYPE_ACTUATOR || !relay_is_in_memory(relay)) {
+        ESP_LOGE(TAG, "Pulse not applicable: relay unit is not an in-memory actuator. Channel (%d).", relay->channel);
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    // Read the number of relay actuators from NVS
-    uint16_t stored_relays_count = 0; // number of actually stored and initialized relays
-    uint16_t relay_ch_count;
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_CHANNEL_COUNT, &relay_ch_count));
+    if (pulse_ms == 0 || pulse_ms > RELAY_PULSE_MS_MAX) {
+        ESP_LOGE(TAG, "Invalid pulse width %u ms. Channel (%d).", (unsigned int)pulse_ms, relay->channel);
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    // If there are no relays, skip allocation and return success
-    if (relay_ch_count == 0) {
-        ESP_LOGW(TAG, "No relays allocated. NULL array will be returned.");
-        *relay_list = NULL;  // No need to allocate memory for an empty list
-        return ESP_OK;
+    if (s_actuator_pulse_task == NULL) {
+        ESP_LOGE(TAG, "Actuator pulse timers are not initialized");
+        return ESP_ERR_INVALID_STATE;
     }
 
-    // Allocate memory for the list of relays
-    *relay_list = (relay_unit_t *)calloc(relay_ch_count, sizeof(relay_unit_t));
-    if (*relay_list == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for relay list");
-        return ESP_ERR_NO_MEM;
+    relay_units_write_lock();
+
+    bool gpio_init_made = false;
+    if (!relay->gpio_initialized) {
+        if (relay_gpio_init(relay) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to init GPIO pin before starting the pulse. Channel (%d). ", relay->channel);
+            relay_units_write_unlock();
+            return ESP_FAIL;
+        }
+        gpio_init_made = true;
     }
 
-    ESP_LOGI(TAG, "Processing relay array...");
-    for (int i_channel = 0; i_channel < relay_ch_count; i_channel++) {
-        relay_unit_t relay;
-        char *relay_nvs_key = get_relay_nvs_key(i_channel);
-        if (load_relay_actuator_from_nvs(relay_nvs_key, &relay) == ESP_OK) {
-            (*relay_list)[i_channel] = relay;  // Add relay to the list
-            stored_relays_count++;
+    // ON edge, then the timer right away: the width is measured from this point, or from the zero crossing the edge
+    // waits for
+    relay_actuator_pulse_cancel(relay);
+    uint32_t released = 0;
+    bool parked = false;
+    int64_t edge_delay_us = 0;
+    relay_rtc_pulse_set(relay->gpio_pin, relay->inverted ? 1 : 0);  // a warm reset during the pulse restores OFF
+    esp_err_t err = relay_interlock_write(relay, RELAY_STATE_ON, (uint16_t)pulse_ms, (uint8_t)path, origin_us, &released, &parked, &edge_delay_us);
+    if (err != ESP_OK || parked) {
+        relay_rtc_pulse_clear(relay->gpio_pin);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set GPIO level. Channel (%d): %s", relay->channel, esp_err_to_name(err));
+        if (gpio_init_made) {
+            ESP_ERROR_CHECK(relay_gpio_deinit(relay));
+        }
+        relay_units_write_unlock();
+        return (err == ESP_ERR_INVALID_STATE) ? err : ESP_FAIL;
+    }
+    if (!parked) {
+        int64_t on_us = esp_timer_get_time() + edge_delay_us;
+        err = relay_actuator_pulse_arm(relay, pulse_ms, on_us);
+        if (err != ESP_OK) {
+            // never leave the output ON without the timer to switch it OFF
+            uint32_t none;
+            relay_rtc_pulse_clear(relay->gpio_pin);
+            relay_interlock_write(relay, RELAY_STATE_OFF, 0, LATENCY_PATH_NONE, 0, &none, &parked, NULL);
+            ESP_LOGE(TAG, "Failed to start pulse timer. Channel (%d): %s", relay->channel, esp_err_to_name(err));
+        } else {
+            latency_record_since(path, LATENCY_STAGE_GPIO_WRITE, origin_us);
+            relay->state = RELAY_STATE_ON;
         }
-        free(relay_nvs_key);
     }
+    uint32_t released_units = relay_interlock_mark_released(released);
 
-    *count = stored_relays_count;
+    if (gpio_init_made) {
+        ESP_ERROR_CHECK(relay_gpio_deinit(relay));
+    }
 
-    return ESP_OK;
+    relay_interlock_commit_released(released_units);
+
+    relay_units_write_unlock();
+
+    if (err == ESP_OK && !parked) {
+        ESP_LOGI(TAG, ">|>|>| Pulse of %u ms started. Channel (%d).", (unsigned int)pulse_ms, relay->channel);
+    }
+    return err;
 }
 
 /**
- * @brief Retrieves the list of contact sensors from NVS.
- * 
- * This function reads the number of contact sensors from NVS, allocates memory 
- * for the list, and loads each contact sensor's configuration from NVS into the list.
+ * @brief: Apply a command to the in-memory actuator by its handle
  * 
- * @param[out] sensor_list Pointer to the array of relay_unit_t that will hold the contact sensors.
- * @param[out] count Pointer to store the number of contact sensors retrieved.
+ * The actuator is resolved, its current state and pulse width are read and the new state is set within one writer
+ * section, so relay_units_reconfigure() can't move another unit into its place in between. Used by every task that
+ * gets the unit from a queue, a timer or a table (MQTT commands, rules, schedules, pulse and interlock timers).
  * 
- * @return ESP_OK on success, or an error code on failure.
+ * @param unit Actuator handle
+ * @param command relay_command_t to apply
+ * @param pulse_ms ON is a pulse of this width: RELAY_PULSE_MS_UNIT for the unit's own pulse_ms, 0 for a latching ON
+ * @param latency_path latency_path_t of the event
+ * @param origin_us Time the command was received, esp_timer_get_time() based. 0 disables tracing.
+ * @param[out] state State the command resolved to, may be NULL
+ * @return esp_err_t result of the operation, ESP_ERR_NOT_FOUND if the actuator is not in memory
  */
-esp_err_t get_contact_sensor_list(relay_unit_t **sensor_list, uint16_t *count) {
+esp_err_t relay_actuator_command(unit_handle_t unit, relay_command_t command, uint32_t pulse_ms, uint8_t latency_path, int64_t origin_us, relay_state_t *state) {
 
-    // If in-memory bit is set, return the array from in-memory pointers where type is RELAY_TYPE_SENSOR
-    // This will be the next 's_sensors_count' elements from s_units array starting after 's_relays_count', 
-    // so we return pointer to the first sensor element from s_units and count as s_sensors_count
-    if (xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY) {
-        ESP_LOGI(TAG, "Relay units already in memory, returning existing list of contact sensors.");
-        // shift pointer to the first sensor, jumping over the relays
-        *sensor_list = s_units + s_relays_count; // Pointer arithmetic to get to the first sensor
-        *count = s_sensors_count;
-        return ESP_OK;
-    }
+    latency_path_t path = (origin_us > 0) ? (latency_path_t)latency_path : LATENCY_PATH_NONE;
 
-    /* If the in-memory bit is not set, read from NVS */
-
-    uint16_t stored_sensors_count = 0; // number of actually stored and initialized contact sensors
+    if (unit.type != RELAY_TYPE_ACTUATOR) {
+        ESP_LOGE(TAG, "Command not applicable: relay unit is not an actuator. Channel (%d), type (%d).", unit.index, unit.type);
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    // Read the number of contact sensors from NVS
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_CONTACT_SENSORS_COUNT, count));
+    int64_t t_lookup = esp_timer_get_time();
+    relay_units_write_lock();
 
-    // If there are no contact sensors, skip allocation and return success
-    if (*count == 0) {
-        ESP_LOGW(TAG, "No contact sensors allocated. NULL array will be returned.");
-        *sensor_list = NULL;  // No need to allocate memory for an empty list
-        return ESP_OK;
+    relay_unit_t *relay = relay_unit_by_handle(unit);
+    if (relay == NULL) {
+        relay_units_write_unlock();
+        ESP_LOGE(TAG, "Actuator relay with channel %d not found in memory.", unit.index);
+        return ESP_ERR_NOT_FOUND;
     }
+    latency_record_since(path, LATENCY_STAGE_LOOKUP, t_lookup);
 
-    // Allocate memory for the list of contact sensors
-    *sensor_list = (relay_unit_t *)calloc(*count, sizeof(relay_unit_t));
-    if (*sensor_list == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for contact sensor list");
-        return ESP_ERR_NO_MEM;
+    relay_state_t new_state;
+    if (command == RELAY_COMMAND_TOGGLE) {
+        new_state = (relay->state == RELAY_STATE_ON) ? RELAY_STATE_OFF : RELAY_STATE_ON;
+    } else {
+        new_state = (command == RELAY_COMMAND_ON) ? RELAY_STATE_ON : RELAY_STATE_OFF;
+    }
+    if (pulse_ms == RELAY_PULSE_MS_UNIT) {
+        pulse_ms = relay->pulse_ms;
     }
 
-    // Loop through and load contact sensors from NVS
-    ESP_LOGI(TAG, "Processing contact sensors array...");
-    for (int i_channel = 0; i_channel < *count; i_channel++) {
-        relay_unit_t relay;
-        char *relay_nvs_key = get_contact_sensor_nvs_key(i_channel);
-        if (load_relay_sensor_from_nvs(relay_nvs_key, &relay) == ESP_OK) {
-            (*sensor_list)[i_channel] = relay;  // Add contact sensor to the list
-            stored_sensors_count++;
-        }
-        free(relay_nvs_key);
+    esp_err_t err;
+    if (new_state == RELAY_STATE_ON && pulse_ms > 0) {
+        err = relay_set_state_pulse(relay, pulse_ms, (uint8_t)path, origin_us);
+    } else {
+        err = relay_set_state_traced(relay, new_state, true, (uint8_t)path, origin_us);
     }
 
-    *count = stored_sensors_count;
+    relay_units_write_unlock();
 
-    return ESP_OK;
+    if (state != NULL) {
+        *state = new_state;
+    }
+    return err;
 }
 
 /**
- * @brief Combines the list of relay actuators and contact sensors into one list.
+ * @brief: Set the state of several actuators at once
  * 
- * This function retrieves both the relay actuators and contact sensors from NVS, 
- * allocates memory for a combined list, and appends both lists together. The combined 
- * list includes all relay actuators and contact sensors.
+ * All units are validated and their GPIO pins configured first, then the outputs are driven together
+ * by writing the set and clear masks directly to the GPIO W1TS/W1TC registers. The new states are saved
+ * with one NVS commit and published to MQTT as one event. Units switched ON with a pulse width (given or their own
+ * pulse_ms) are switched OFF by their pulse timers. A batch can switch ON one member per interlock group: other members
+ * of the group are switched OFF, and the member is parked until the group dead time has passed.
  * 
- * @param[out] relay_list Pointer to the combined array of relay_unit_t that will hold both relays and sensors.
- * @param[out] total_count Pointer to store the total number of relays and sensors retrieved.
+ * Actuators are resolved from their handles and the whole batch is applied within one writer section, so
+ * relay_units_reconfigure() can't move units in between.
  * 
- * @return ESP_OK on success, or an error code on failure.
+ * @param units Array of actuator handles
+ * @param states New states, one per unit
+ * @param pulse_ms Pulse widths for units switched ON, one per unit, 0 means the unit's own pulse_ms. Can be NULL.
+ * @param count Number of units
+ * @param[out] skew_us Time between the first and the last output register write, microseconds. Can be NULL.
+ * @return esp_err_t result of the operation. No output is changed if validation fails.
  */
-esp_err_t get_all_relay_units(relay_unit_t **relay_list, uint16_t *total_count) {
+esp_err_t relay_set_states_batch(const unit_handle_t *units, const relay_state_t *states, const uint16_t *pulse_ms, size_t count, int64_t *skew_us) {
 
-    // If in-memory bit is set, return the in-memory list
-    if (xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY) {
-        ESP_LOGI(TAG, "Relay units already in memory, returning existing list.");
-        *relay_list = s_units;
-        *total_count = s_units_count;
-        return ESP_OK;
+    if (units == NULL || states == NULL || count == 0 || count > RELAY_INDEX_UNITS_MAX) {
+        ESP_LOGE(TAG, "Invalid batch of relay units");
+        return ESP_ERR_INVALID_ARG;
     }
 
-    relay_unit_t *actuators = NULL, *sensors = NULL;
-    uint16_t actuator_count = 0, sensor_count = 0;
-
-    // NOTE: The order of getting actuators and sensors is important to maintain consistency
-    // in the combined list (actuators first, then sensors).
-
-    // Get actuators (relays) and handle the case where there are no actuators
-    ESP_ERROR_CHECK(get_relay_list(&actuators, &actuator_count));
-
-    // Get contact sensors and handle the case where there are no contact sensors
-    ESP_ERROR_CHECK(get_contact_sensor_list(&sensors, &sensor_count));
+    relay_units_write_lock();
+
+    // Validation pass: nothing is changed if any unit is not good
+    relay_unit_t *relays[RELAY_INDEX_UNITS_MAX];
+    uint32_t unit_mask = 0;
+    uint32_t interlock_on_mask = 0;
+    esp_err_t err = ESP_OK;
+    for (size_t i = 0; i < count && err == ESP_OK; i++) {
+        err = ESP_ERR_INVALID_ARG;
+        relay_unit_t *relay = relays[i] = relay_unit_by_handle(units[i]);
+        if (relay == NULL) {
+            ESP_LOGE(TAG, "Batch element %d is not an in-memory relay unit", (int)i);
+            break;
+        }
+        if (relay->type != RELAY_TYPE_ACTUATOR) {
+            ESP_LOGE(TAG, "Setting state not applicable: relay unit is not an actuator. Channel (%d).", relay->channel);
+            break;
+        }
+        if (!GPIO_IS_VALID_OUTPUT_GPIO(relay->gpio_pin)) {
+            ESP_LOGE(TAG, "GPIO pin %d of channel %d can not be an output", relay->gpio_pin, relay->channel);
+            break;
+        }
+        if (pulse_ms != NULL && pulse_ms[i] > RELAY_PULSE_MS_MAX) {
+            ESP_LOGE(TAG, "Invalid pulse width %u ms. Channel (%d).", (unsigned int)pulse_ms[i], relay->channel);
+            break;
+        }
+        uint32_t bit = 1UL << (relay - s_units);
+        if (unit_mask & bit) {
+            ESP_LOGE(TAG, "Relay unit channel %d is listed in the batch more than once", relay->channel);
+            break;
+        }
+        unit_mask |= bit;
+        if (states[i] == RELAY_STATE_ON && relay->interlock_group != 0) {
+            if (relay->interlock_group > RELAY_INTERLOCK_GROUPS_MAX || (interlock_on_mask & (1UL << relay->interlock_group))) {
+                ESP_LOGE(TAG, "Batch switches ON more than one member of interlock group %d", relay->interlock_group);
+                break;
+            }
+            interlock_on_mask |= 1UL << relay->interlock_group;
+        }
+        err = ESP_OK;
+    }
+    if (err != ESP_OK) {
+        relay_units_write_unlock();
+        return err;
+    }
 
-    // Calculate the total count
-    *total_count = actuator_count + sensor_count;
+    // Configure the pins and prepare register masks
+    uint32_t init_made_mask = 0;
+    uint64_t set_mask = 0, clear_mask = 0;
+    for (size_t i = 0; i < count; i++) {
+        relay_unit_t *relay = relays[i];
+        relay_actuator_pulse_cancel(relay);
+        if (!relay->gpio_initialized) {
+            if (relay_gpio_init(relay) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to init GPIO pin before setting the state. Channel (%d). ", relay->channel);
+                for (size_t j = 0; j < i; j++) {
+                    if (init_made_mask & (1UL << (relays[j] - s_units))) {
+                        relay_gpio_deinit(relays[j]);
+                    }
+                }
+                relay_units_write_unlock();
+                return ESP_FAIL;
+            }
+            init_made_mask |= 1UL << (relay - s_units);
+        }
 
-    ESP_LOGI(TAG, "Found %d actuator(s) and %d contact sensor(s). Total: %d unit(s).", actuator_count, sensor_count, *total_count);
+        bool level = relay->inverted ? (states[i] == RELAY_STATE_OFF) : (states[i] == RELAY_STATE_ON);
+        if (level) {
+            set_mask |= 1ULL << relay->gpio_pin;
+        } else {
+            clear_mask |= 1ULL << relay->gpio_pin;
+        }
+    }
 
-    // If there are no relays or sensors, return success without allocating memory
-    if (*total_count == 0) {
-        *relay_list = NULL;  // No relays or sensors, so no allocation needed
-        // No need to free anything as both lists are NULL
-        return ESP_OK;
+    // Drive all outputs together. Interlocked members are checked within the same critical section: conflicting
+    // members are switched OFF first, members whose group is still within the dead time are parked instead.
+    uint32_t released = 0, released_by_batch = 0, parked_mask = 0, parked_groups = 0;
+    int64_t wait_us[RELAY_INTERLOCK_GROUPS_MAX + 1];
+    portENTER_CRITICAL(&s_interlock_mux);
+    int64_t now_us = esp_timer_get_time();
+    for (size_t i = 0; i < count; i++) {
+        relay_unit_t *relay = relays[i];
+        if (relay->channel < 0 || relay->channel > CHANNEL_COUNT_MAX) {
+            continue;
+        }
+        relay_interlock_member_update(relay);
+        relay_zc_cancel(relay->channel);    // batches switch together, not at zero crossings
+        relay_interlock_member_t *member = &s_interlock_members[relay->channel];
+        if (member->group == 0) {
+            continue;
+        }
+        if (states[i] == RELAY_STATE_OFF) {
+            if (relay_interlock_output_on(member)) {
+                released_by_batch |= 1UL << i;
+            }
+            continue;
+        }
+        if (!relay_interlock_acquire(relay->channel, now_us, true, &released)) {
+            uint32_t width_ms = (pulse_ms != NULL && pulse_ms[i] > 0) ? pulse_ms[i] : relay->pulse_ms;
+            wait_us[member->group] = relay_interlock_park(relay->channel, (uint16_t)width_ms, LATENCY_PATH_NONE, 0, now_us);
+            parked_groups |= 1UL << member->group;
+            parked_mask |= 1UL << i;
+            set_mask &= ~(1ULL << relay->gpio_pin);
+            clear_mask &= ~(1ULL << relay->gpio_pin);
+        } else {
+            interlock_cancel(&s_interlock_groups[member->group].state, -1);
+        }
+    }
+    uint32_t pulsed_mask = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t width_ms = (pulse_ms != NULL && pulse_ms[i] > 0) ? pulse_ms[i] : relays[i]->pulse_ms;
+        if (states[i] == RELAY_STATE_ON && width_ms > 0 && s_actuator_pulse_task != NULL && !(parked_mask & (1UL << i))) {
+            // a warm reset during the pulse restores OFF
+            relay_rtc_pulse_set(relays[i]->gpio_pin, relays[i]->inverted ? 1 : 0);
+            pulsed_mask |= 1UL << i;
+        }
+    }
+    int64_t t_first = esp_timer_get_time();
+    REG_WRITE(GPIO_OUT_W1TS_REG, (uint32_t)set_mask);
+    REG_WRITE(GPIO_OUT_W1TC_REG, (uint32_t)clear_mask);
+#if SOC_GPIO_PIN_COUNT > 32
+    REG_WRITE(GPIO_OUT1_W1TS_REG, (uint32_t)(set_mask >> 32));
+    REG_WRITE(GPIO_OUT1_W1TC_REG, (uint32_t)(clear_mask >> 32));
+#endif
+    int64_t t_last = esp_timer_get_time();
+    relay_outputs_written();
+    for (uint32_t mask = released_by_batch; mask != 0; mask &= mask - 1) {
+        interlock_released(&s_interlock_groups[s_interlock_members[relays[__builtin_ctz(mask)]->channel].group].state, t_last);
+    }
+    portEXIT_CRITICAL(&s_interlock_mux);
+
+    for (uint32_t mask = parked_groups; mask != 0; mask &= mask - 1) {
+        int group = __builtin_ctz(mask);
+        esp_timer_stop(s_interlock_groups[group].timer);  // not running is fine
+        esp_timer_start_once(s_interlock_groups[group].timer, (uint64_t)wait_us[group]);
     }
+    uint32_t released_units = relay_interlock_mark_released(released);
 
-    // Allocate memory for the combined list of relays and sensors
-    // *relay_list = (relay_unit_t *)malloc(sizeof(relay_unit_t) * (*total_count));
-    *relay_list = calloc(*total_count, sizeof(relay_unit_t));
-    if (*relay_list == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for combined relay list");
-        if (actuator_count > 0) {
-            if (INIT_RELAY_ON_LOAD) {
-                ESP_ERROR_CHECK(free_relays_array(actuators, actuator_count));
-            } else {
-                free(actuators);
+    for (size_t i = 0; i < count; i++) {
+        if (parked_mask & (1UL << i)) {
+            // switched ON once the dead time of the group has passed
+            ESP_LOGI(TAG, "Interlock group %d: channel %d waits for dead time", relays[i]->interlock_group, relays[i]->channel);
+            relays[i]->state = RELAY_STATE_OFF;
+            if (init_made_mask & (1UL << (relays[i] - s_units))) {
+                ESP_ERROR_CHECK(relay_gpio_deinit(relays[i]));
             }
+            continue;
         }
-        if (sensor_count > 0) {
-            if (INIT_SENSORS_ON_LOAD) {
-                ESP_ERROR_CHECK(free_relays_array(sensors, sensor_count));
-            } else {
-                free(sensors);
+        relays[i]->state = states[i];
+        uint32_t width_ms = (pulse_ms != NULL && pulse_ms[i] > 0) ? pulse_ms[i] : relays[i]->pulse_ms;
+        if (pulsed_mask & (1UL << i)) {
+            if (relay_actuator_pulse_arm(relays[i], width_ms, t_first) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to start pulse timer. Channel (%d).", relays[i]->channel);
+                relay_rtc_pulse_clear(relays[i]->gpio_pin);
+                pulsed_mask &= ~(1UL << i);
             }
         }
-        return ESP_ERR_NO_MEM;
+        if (init_made_mask & (1UL << (relays[i] - s_units))) {
+            ESP_ERROR_CHECK(relay_gpio_deinit(relays[i]));
+        }
     }
 
-    // Copy actuators to the combined list
-    if (actuator_count > 0) {
-        memcpy(*relay_list, actuators, sizeof(relay_unit_t) * actuator_count);
-        if (INIT_RELAY_ON_LOAD) {
-            ESP_ERROR_CHECK(free_relays_array(actuators, actuator_count));
-        } else {
-            free(actuators);
+    // persist new states to NVS: one commit for the whole batch, including members switched OFF by the interlock.
+    // Pulsed units are saved by their pulse timers, with the final (OFF) state. Unit indexes are only valid under the lock.
+    unit_handle_t publish[RELAY_INDEX_UNITS_MAX];
+    size_t publish_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        publish[publish_count++] = units[i];
+        if (pulsed_mask & (1UL << i)) {
+            continue;
+        }
+        if (relay_persist_mark_dirty(relays[i]) != ESP_OK) {
+            err = ESP_FAIL;
+        }
+    }
+    for (uint32_t mask = released_units & ~unit_mask; mask != 0; mask &= mask - 1) {
+        relay_unit_t *member = &s_units[__builtin_ctz(mask)];
+        if (relay_persist_mark_dirty(member) != ESP_OK) {
+            err = ESP_FAIL;
         }
+        publish[publish_count++] = get_unit_handle(member);
     }
 
-    // Copy sensors to the combined list after actuators
-    if (sensor_count > 0) {
-        memcpy(*relay_list + actuator_count, sensors, sizeof(relay_unit_t) * sensor_count);
-        if (INIT_SENSORS_ON_LOAD) {
-            ESP_ERROR_CHECK(free_relays_array(sensors, sensor_count));
-        } else {
-            free(sensors);
+    relay_units_write_unlock();
+
+    if (skew_us != NULL) {
+        *skew_us = t_last - t_first;
+    }
+    ESP_LOGI(TAG, ">|>|>| Batch of %d actuator(s) set, output skew %lld us", (int)count, (long long)(t_last - t_first));
+
+    if (relay_persist_flush() != ESP_OK) {
+        err = ESP_FAIL;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to save batch of relay units to NVS");
+    }
+
+    // update via MQTT: one event for the whole batch
+    if (_DEVICE_ENABLE_MQTT && mqtt_config_connection_mode() && IS_MQTT_READY()) {
+        // the batch is applied and saved already: a unit that could not be marked is only logged
+        if (trigger_mqtt_publish_units(publish, publish_count) != ESP_OK) {
+            ESP_LOGW(TAG, "Batch applied, but not all of its units were marked for MQTT publishing");
         }
     }
 
-    return ESP_OK;
+    return err;
 }
 
-
 /**
- * @brief Frees memory allocated for relay_unit_t array, including dynamically allocated io_conf field.
- *
- * @param relay_list Pointer to an array of relay_unit_t.
- * @param count Number of elements in the relay_list array.
- * @return
- *     - ESP_OK: Successfully freed all memory.
- *     - ESP_ERR_INVALID_ARG: relay_list is NULL.
+ * @brief: Get a relay unit (actuator or sensor) from in-memory storage by its position
+ * @param index Index of the unit in in-memory storage (actuators first, then sensors)
+ * @param relay Pointer to the relay unit to be returned
+ * @return esp_err_t result of the operation
  */
-esp_err_t free_relays_array(relay_unit_t *relay_list, size_t count) {
-    if (relay_list == NULL || count < 1) {
-        ESP_LOGW(TAG, "relay_list is NULL or array size is zero, nothing to free");
-        return ESP_ERR_INVALID_ARG;
+esp_err_t get_relay_unit_from_memory_by_index(int index, relay_unit_t **relay) {
+    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
+        ESP_LOGE(TAG, "Relay units are not loaded in memory.");
+        return ESP_ERR_INVALID_STATE;
     }
 
-    // Iterate through each relay and free the dynamically allocated io_conf field
-    for (size_t i = 0; i < count; i++) {
-        relay_gpio_deinit(&relay_list[i]);
+    if (index < 0 || index >= s_units_count) {
+        return ESP_ERR_NOT_FOUND;
     }
 
-    // Free the relay list itself
-    free(relay_list);
-
-    return ESP_OK;  // Indicate success
+    *relay = &s_units[index];
+    return ESP_OK;
 }
 
+/**
+ * @brief: Take down the in-memory unit that is about to be removed by relay_units_reconfigure()
+ * 
+ * Actuators are switched OFF and keep driving the OFF level: a released pin would float and might energise the relay.
+ * The OFF state is put into the units table, so the channel comes back OFF if it's added again. Inputs are released.
+ * Caller holds the writer lock.
+ * 
+ * @param relay Pointer to the in-memory relay unit
+ */
+static void relay_reconfig_unit_down(relay_unit_t *relay) {
+    int channel = relay->channel;
+
+    switch (relay->type) {
+        case RELAY_TYPE_ACTUATOR:
+            if (relay_set_state(relay, RELAY_STATE_OFF, false) != ESP_OK) {
+                ESP_LOGW(TAG, "Unable to switch OFF actuator %d being removed", channel);
+            }
+            if (channel >= 0 && channel <= CHANNEL_COUNT_MAX) {
+                // leave the interlock group, drop its parked request if any
+                portENTER_CRITICAL(&s_interlock_mux);
+                relay_interlock_member_t *member = &s_interlock_members[channel];
+                if (member->group != 0) {
+                    interlock_cancel(&s_interlock_groups[member->group].state, channel);
+                }
+                member->group = 0;
+                member->registered = false;     // the pin may be taken by another unit
+                relay_zc_cancel(channel);
+                portEXIT_CRITICAL(&s_interlock_mux);
+            }
+            relay_table_put_unit(relay);
+            break;
+        case RELAY_TYPE_SENSOR:
+            relay_sensor_unregister_isr(relay->gpio_pin);
+            if (GPIO_IS_VALID_GPIO(relay->gpio_pin)) {
+                gpio_reset_pin((gpio_num_t)relay->gpio_pin);
+            }
+            break;
+        case RELAY_TYPE_PULSE_COUNTER:
+            relay_pulse_counter_detach(channel);
+            if (channel >= 0 && channel <= PULSE_COUNTERS_COUNT_MAX) {
+                // counting starts over if the channel is added again
+                pulse_counter_init(&s_pulse_slots[channel].counter, 0, esp_timer_get_time());
+            }
+            if (GPIO_IS_VALID_GPIO(relay->gpio_pin)) {
+                gpio_reset_pin((gpio_num_t)relay->gpio_pin);
+            }
+            break;
+        default:
+            break;
+    }
+
+    ESP_LOGI(TAG, "Relay unit %s taken down, GPIO pin %d released", get_unit_nvs_key_from_memory(relay), relay->gpio_pin);
+}
 
 /**
- * @brief: Runs relay_sensor_register_isr() for all contact sensors in the system. Recommended to be called once at the start of the app.
+ * @brief: Bring up the unit just added by relay_units_reconfigure(): drive the actuator output, register the sensor ISR
+ *         (or add the pin to the input scan), attach the pulse counter to PCNT
  * 
- * @return
- *     - ESP_OK: Successfully freed all memory.
- *     - ESP_ERR_INVALID_ARG: relay_list is NULL.
+ * @param relay Pointer to the in-memory relay unit
+ * @return esp_err_t result of the operation
  */
-esp_err_t relay_all_sensors_register_isr() {
-    /* Init the queue */
-    gpio_evt_queue = xQueueCreate(10, sizeof(gpio_event_t));
-    if (gpio_evt_queue == NULL) {
-        ESP_LOGE(TAG, "Failed to create the queue");
-        return ESP_FAIL;  // Exit if queue creation fails
+static esp_err_t relay_reconfig_unit_up(relay_unit_t *relay) {
+    esp_err_t err = ESP_OK;
+
+    switch (relay->type) {
+        case RELAY_TYPE_ACTUATOR:
+            err = relay_set_state(relay, relay->state, false);
+            break;
+        case RELAY_TYPE_SENSOR:
+            if (!relay->gpio_initialized) {
+                relay_units_write_lock();
+                err = relay_gpio_init(relay);
+                relay_units_write_unlock();
+            }
+            if (err == ESP_OK) {
+                err = relay_sensor_register_isr(relay);
+            }
+            if (err == ESP_OK) {
+                err = relay_sensor_gpio_state_refresh(relay);
+            }
+            break;
+        case RELAY_TYPE_PULSE_COUNTER:
+            err = relay_pulse_counter_attach(relay);
+            break;
+        default:
+            err = ESP_ERR_INVALID_ARG;
+            break;
     }
 
-    /* Install ISR service with default configuration */
-    if (gpio_install_isr_service(0) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to install ISR service with default configuration");
-        return ESP_FAIL;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to bring up relay unit %s on GPIO pin %d: %s", get_unit_nvs_key_from_memory(relay), relay->gpio_pin, esp_err_to_name(err));
+    } else {
+        ESP_LOGI(TAG, "Relay unit %s brought up on GPIO pin %d", get_unit_nvs_key_from_memory(relay), relay->gpio_pin);
     }
+    return err;
+}
 
-    /* Process sensors */
-    relay_unit_t *sensors = NULL;
-    uint16_t sensor_count = 0;
+/**
+ * @brief: Apply changed unit counts without reboot
+ * 
+ * Reads S_KEY_CHANNEL_COUNT, S_KEY_CONTACT_SENSORS_COUNT and S_KEY_PULSE_COUNTERS_COUNT from NVS and changes in-memory units
+ * incrementally. Units that stay keep running: their outputs, ISRs, PCNT units, pulses and interlock state are not
+ * restarted. They may move within s_units when the array is compacted, under the writer lock: other tasks resolve
+ * in-memory units under the lock and must not keep pointers to them after releasing it.
+ * Removed units are taken down, added ones are loaded from the units table (or created with a free safe GPIO pin) and
+ * brought up. Then only the added and removed units are (un)subscribed in MQTT and (un)published to Home Assistant discovery.
+ * 
+ * @param[out] result Summary of the reconfiguration, may be NULL
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_units_reconfigure(relay_reconfig_result_t *result) {
+    // indexed by relay_type_t, in s_units order
+    static const char *count_keys[RELAY_TYPES_COUNT] = { S_KEY_CHANNEL_COUNT, S_KEY_CONTACT_SENSORS_COUNT, S_KEY_PULSE_COUNTERS_COUNT };
+    static const uint16_t count_max[RELAY_TYPES_COUNT] = { CHANNEL_COUNT_MAX, CONTACT_SENSORS_COUNT_MAX, PULSE_COUNTERS_COUNT_MAX };
 
-    // Get contact sensors and handle the case where there are no contact sensors
-    if(get_contact_sensor_list(&sensors, &sensor_count) != ESP_OK) {
-        ESP_LOGE(TAG, "Unable to get sensors list from NVS");
-        return ESP_FAIL;
+    int64_t t_start = esp_timer_get_time();
+    relay_reconfig_result_t summary = {0};
+
+    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) {
+        ESP_LOGE(TAG, "Relay units are not loaded in memory.");
+        return ESP_ERR_INVALID_STATE;
     }
 
-    // check if there're any sensor to deal with
-    if (sensor_count == 0) {
-        ESP_LOGW(TAG, "No sensors found to register ISR for.");
-        return ESP_OK;
+    // new counts have just been written to NVS by the settings update
+    uint16_t new_counts[RELAY_TYPES_COUNT];
+    for (int t = 0; t < RELAY_TYPES_COUNT; t++) {
+        if (nvs_read_uint16(S_NAMESPACE, count_keys[t], &new_counts[t]) != ESP_OK || new_counts[t] > count_max[t]) {
+            ESP_LOGE(TAG, "Unable to read valid %s from NVS", count_keys[t]);
+            return ESP_ERR_INVALID_ARG;
+        }
     }
 
-    // register ISR for each sensor
-    for(int i = 0; i < sensor_count; i++) {
-        if (relay_sensor_register_isr(&sensors[i]) != ESP_OK) {
-            ESP_LOGE(TAG, "Unable to register ISR for pin %d", sensors[i].gpio_pin);
-            continue;
+    xSemaphoreTake(s_units_reconfig_lock, portMAX_DELAY);
+
+    uint16_t old_counts[] = { (uint16_t)s_relays_count, (uint16_t)s_sensors_count, (uint16_t)s_pulse_counters_count };
+    int removed_total = 0;
+    int added_total = 0;
+    pin_mask_t pins_left;      // pins once the removed units are gone
+    relay_pins_get(&pins_left);
+    for (int t = 0; t < RELAY_TYPES_COUNT; t++) {
+        for (int channel = new_counts[t]; channel < old_counts[t]; channel++) {
+            int idx = relay_index_by_channel((relay_type_t)t, channel);
+            if (idx != RELAY_INDEX_NONE) {
+                removed_total++;
+                pin_mask_release(&pins_left, s_units[idx].gpio_pin);
+            }
         }
-        if (relay_sensor_gpio_state_refresh(&sensors[i]) != ESP_OK) {
-            ESP_LOGE(TAG, "Unable to refresh state on pin %d", sensors[i].gpio_pin);
-        } else {
-            ESP_LOGI(TAG, "Refreshed state on pin %d, state %d", sensors[i].gpio_pin, sensors[i].state);
+        for (int channel = 0; channel < new_counts[t]; channel++) {
+            if (channel >= old_counts[t] || relay_index_by_channel((relay_type_t)t, channel) == RELAY_INDEX_NONE) {
+                added_total++;
+            }
         }
     }
 
-    // cleanup / free if not in-memory mode
-    if (xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY) {
-        ESP_LOGD(TAG, "Relay units in memory, skipping freeing sensors array.");
+    if (removed_total == 0 && added_total == 0) {
+        xSemaphoreGive(s_units_reconfig_lock);
+        ESP_LOGI(TAG, "Relay unit counts not changed, nothing to reconfigure");
+        if (result != NULL) {
+            *result = summary;
+        }
         return ESP_OK;
     }
-    if (INIT_SENSORS_ON_LOAD) {
-        ESP_ERROR_CHECK(free_relays_array(sensors, sensor_count));
-    } else {
-        free(sensors);
+
+    // every added unit may need a pin of its own: refuse before anything is touched
+    uint64_t reserved_pin_mask = relay_reserved_pin_mask();
+    int free_pins = pin_mask_free_count(&pins_left, reserved_pin_mask);
+    if (added_total > free_pins) {
+        xSemaphoreGive(s_units_reconfig_lock);
+        ESP_LOGE(TAG, "No safe GPIO pins left for %d new unit(s), %d free", added_total, free_pins);
+        return ESP_ERR_NOT_FOUND;
     }
 
-    return ESP_OK;
-}
+    relay_unit_t *units = calloc(RELAY_INDEX_UNITS_MAX, sizeof(relay_unit_t));
+    if (units == NULL) {
+        xSemaphoreGive(s_units_reconfig_lock);
+        ESP_LOGE(TAG, "Failed to allocate memory for relay units reconfiguration");
+        return ESP_ERR_NO_MEM;
+    }
 
+    unit_handle_t removed[RELAY_INDEX_UNITS_MAX];
+    unit_handle_t added[RELAY_INDEX_UNITS_MAX];
+    int8_t moved_from[RELAY_INDEX_UNITS_MAX];          // new s_units index => old one, RELAY_INDEX_NONE for added units
+    bool save_unit[RELAY_INDEX_UNITS_MAX] = {false};   // added unit has to be (re)written to the units table
+    size_t removed_count = 0;
+    size_t added_count = 0;
 
-/**
- * @brief: Set the state of the relay unit (actuator), activate corresponding GPIO and persist the state to NVS.
- * 
- * @param[in, out] relay Pointer to the relay_unit_t structure
- * @param state Relay state relay_state_t to set
- * @param persist Save the update state to NVS. true: sets GPIO level and saves the relay to NVS; false: just sets GPIO level
- * @return
- *     - ESP_OK: Successfully completed all operations.
- *     - ESP_ERR_INVALID_ARG: relay is NULL.
- */
-esp_err_t relay_set_state(relay_unit_t *relay, relay_state_t state, bool persist) {
+    // Write-behind flush can't run meanwhile: its dirty bits are s_units indexes, remapped below
+    if (s_persist_lock != NULL) {
+        xSemaphoreTake(s_persist_lock, portMAX_DELAY);
+    }
+    relay_units_write_lock();
+
+    /* 1. Take removed units down, while they are still in memory. Within the writer section: a command resolved
+          before it would otherwise switch a removed actuator back ON. */
+    for (int t = 0; t < RELAY_TYPES_COUNT; t++) {
+        for (int channel = new_counts[t]; channel < old_counts[t]; channel++) {
+            int idx = relay_index_by_channel((relay_type_t)t, channel);
+            if (idx == RELAY_INDEX_NONE) {
+                continue;
+            }
+            removed[removed_count++] = get_unit_handle(&s_units[idx]);
+            relay_reconfig_unit_down(&s_units[idx]);
+        }
+    }
 
-    dump_current_task();
+    /* 2. Lay the units out again: kept units are copied, added ones come from the units table */
+
+    size_t count = 0;
+    pin_mask_t pins = { .safe = s_pins.safe, .used = 0 };
+    for (int t = 0; t < RELAY_TYPES_COUNT; t++) {
+        for (int channel = 0; channel < new_counts[t]; channel++) {
+            int idx = (channel < old_counts[t]) ? relay_index_by_channel((relay_type_t)t, channel) : RELAY_INDEX_NONE;
+            moved_from[count] = (int8_t)idx;
+            if (idx != RELAY_INDEX_NONE) {
+                units[count] = s_units[idx];
+                pin_mask_take(&pins, units[count].gpio_pin);
+            } else {
+                units[count].type = (relay_type_t)t;
+                units[count].channel = channel;
+            }
+            count++;
+        }
+    }
 
-    bool gpio_init_made = false;
+    for (size_t i = 0; i < count; i++) {
+        if (moved_from[i] != RELAY_INDEX_NONE) {
+            continue;
+        }
 
-    // is relay an instance ?
-    if (relay == NULL) {
-        ESP_LOGE(TAG, "NULL value for relay unit");
-        return ESP_ERR_INVALID_ARG;
+        relay_type_t type = units[i].type;
+        int channel = units[i].channel;
+        bool found = (relay_table_get_unit(type, channel, &units[i]) == ESP_OK);
+        int preferred = found ? units[i].gpio_pin : -1;
+
+        // the pin may have been given to another unit while this channel was not in use
+        int pin = pin_mask_claim(&pins, preferred, reserved_pin_mask);
+        if (pin != preferred || !found) {
+            if (found) {
+                ESP_LOGW(TAG, "GPIO pin %d of %s channel %d is taken, moving it to pin %d", units[i].gpio_pin, (type == RELAY_TYPE_ACTUATOR) ? "actuator" : (type == RELAY_TYPE_SENSOR) ? "sensor" : "pulse counter", channel, pin);
+                units[i].gpio_pin = pin;
+            } else if (type == RELAY_TYPE_ACTUATOR) {
+                units[i] = get_actuator_relay(channel, pin);
+            } else if (type == RELAY_TYPE_SENSOR) {
+                units[i] = get_sensor_relay(channel, pin);
+                // brought up with the ISR below
+                if (INIT_SENSORS_ON_GET) {
+                    relay_gpio_deinit(&units[i]);
+                }
+            } else {
+                units[i] = get_pulse_counter_relay(channel, pin);
+            }
+            save_unit[i] = true;
+        }
     }
 
-    // check if the relay is actuator
-    if (relay->type != RELAY_TYPE_ACTUATOR) {
-         ESP_LOGE(TAG, "Setting state not applicable: relay unit is not an actuator. Channel (%d).", relay->channel);
-        return ESP_ERR_INVALID_ARG;       
+    // edges of kept sensors are dispatched to their new place
+    for (size_t i = 0; i < count; i++) {
+        int pin = units[i].gpio_pin;
+        if (moved_from[i] != RELAY_INDEX_NONE && units[i].type == RELAY_TYPE_SENSOR && pin >= 0 && pin < GPIO_NUM_MAX
+            && s_gpio_dispatch[pin] == &s_units[(int)moved_from[i]]) {
+            s_gpio_dispatch[pin] = &s_units[i];
+        }
     }
 
-    // Init GPIO
-    if (!relay->gpio_initialized) {
-        if (relay_gpio_init(relay) != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to init GPIO pin before setting the state. Channel (%d). ", relay->channel);
-            return ESP_FAIL;
-        } else {
-            ESP_LOGI(TAG, "Initiated GPIO pin. Channel (%d). ", relay->channel);
-            gpio_init_made = true;
+    memcpy(s_units, units, sizeof(relay_unit_t) * count);
+    memset(s_units + count, 0, sizeof(relay_unit_t) * (RELAY_INDEX_UNITS_MAX - count));
+    s_units_count = count;
+    s_relays_count = new_counts[RELAY_TYPE_ACTUATOR];
+    s_sensors_count = new_counts[RELAY_TYPE_SENSOR];
+    s_pulse_counters_count = new_counts[RELAY_TYPE_PULSE_COUNTER];
+
+    // pending write-behind changes of kept units follow them, those of removed units were put into the table already
+    portENTER_CRITICAL(&s_persist_mux);
+    uint32_t dirty = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (moved_from[i] != RELAY_INDEX_NONE && (s_persist.dirty_mask & (1UL << moved_from[i]))) {
+            dirty |= 1UL << i;
         }
     }
+    s_persist.dirty_mask = dirty;
+    portEXIT_CRITICAL(&s_persist_mux);
 
-    // set level
-    if (gpio_set_level((gpio_num_t)relay->gpio_pin, relay->inverted ? (uint32_t)(!state) : (uint32_t)state) != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to set GPIO level. Channel (%d), level (%d).", relay->channel, relay->state);
-        ESP_ERROR_CHECK(relay_gpio_deinit(relay));
-        return ESP_FAIL;
-    } else {
-        ESP_LOGI(TAG, ">|>|>| Successfully set GPIO level. Channel (%d), level (%d).", relay->channel, relay->state);
-    }
+    esp_err_t err = relay_units_index_rebuild();
 
-    // Update the state in the object once it was successfully set to GPIO
-    relay->state = (relay_state_t)state;
+    relay_units_write_unlock();
+    if (s_persist_lock != NULL) {
+        xSemaphoreGive(s_persist_lock);
+    }
+    free(units);
 
-    // reset GPIO pin to free memory
-    if (gpio_init_made) {
-        ESP_ERROR_CHECK(relay_gpio_deinit(relay));
+    if (err != ESP_OK) {
+        xSemaphoreGive(s_units_reconfig_lock);
+        ESP_LOGE(TAG, "Failed to rebuild relay units index after reconfiguration");
+        return err;
     }
 
-    // update via MQTT
-    uint16_t mqtt_connection_mode;
-    ESP_ERROR_CHECK(nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_CONNECT, &mqtt_connection_mode));
-    if (_DEVICE_ENABLE_MQTT && mqtt_connection_mode && IS_MQTT_READY()) {
-        // mqtt_publish_relay_data(relay);
-        // ESP_ERROR_CHECK(trigger_mqtt_publish(get_unit_nvs_key(relay), relay->type));
-        char *key = get_unit_nvs_key(relay);
-        ESP_ERROR_CHECK(trigger_mqtt_publish(key, relay->type));
-        free(key);
+    /* 3. Persist new units and the final state of removed ones: one table write */
+    for (size_t i = 0; i < count; i++) {
+        if (save_unit[i]) {
+            relay_table_put_unit(&s_units[i]);
+        }
+    }
+    if (relay_table_save() != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save relay units table after reconfiguration");
     }
 
-    if (persist) {
-        // persist new state to NVS
-        char *relay_nvs_key = get_relay_nvs_key(relay->channel);
-        if (relay_nvs_key == NULL) {
-            ESP_LOGE(TAG, "Failed to get NVS key for channel %d", relay->channel);
-            return ESP_FAIL; // Handle error accordingly
+    /* 4. Bring added units up */
+    for (size_t i = 0; i < count; i++) {
+        if (moved_from[i] != RELAY_INDEX_NONE) {
+            continue;
         }
-        if (save_relay_to_nvs(relay_nvs_key, relay) != ESP_OK) {
-            ESP_LOGE(TAG, "Unable to save relay unit to NVS");
-            return ESP_FAIL;
+        added[added_count++] = get_unit_handle(&s_units[i]);
+        relay_reconfig_unit_up(&s_units[i]);
+    }
+
+    // the input scan and the pulse counters sampling are not started on boot if there were no such units
+    if (s_sensors_count > 0 && s_scan_timer != NULL && !esp_timer_is_active(s_scan_timer)) {
+        if (esp_timer_start_periodic(s_scan_timer, (uint64_t)s_scan_tick_ms * 1000) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start the input scan timer");
         }
-        free(relay_nvs_key);
     }
+    if (s_pulse_counters_count > 0) {
+        relay_pulse_counter_task_start();
+    }
+
+    summary.added = (uint16_t)added_count;
+    summary.removed = (uint16_t)removed_count;
+    summary.units_us = esp_timer_get_time() - t_start;
+
+    /* 5. MQTT and Home Assistant: the delta only */
+    mqtt_units_reconfigured(added, added_count, removed, removed_count);
+    summary.total_us = esp_timer_get_time() - t_start;
+
+    xSemaphoreGive(s_units_reconfig_lock);
+
+    ESP_LOGI(TAG, "Relay units reconfigured: %d added, %d removed, now %d actuators, %d sensors, %d pulse counters. Units %lld us, total %lld us",
+             summary.added, summary.removed, s_relays_count, s_sensors_count, s_pulse_counters_count,
+             (long long)summary.units_us, (long long)summary.total_us);
 
+    if (result != NULL) {
+        *result = summary;
+    }
     return ESP_OK;
 }
 
-
 /**
  * @brief Publishes all relay units' states to MQTT.
  * 
@@ -1345,25 +4556,16 @@ esp_err_t relay_publish_all_to_mqtt(bool subscribe) {
         return err;
     }
 
-    char *relay_key = NULL;
     // Iterate through each relay and publish to MQTT
     for (uint16_t i = 0; i < total_count; i++) {
-        // Get the NVS key for the relay
-        relay_key = get_unit_nvs_key(&relay_list[i]);
-        if (relay_key == NULL) {
-            ESP_LOGE(TAG, "Failed to get NVS key for relay channel %d.", relay_list[i].channel);
-            continue;  // Move to the next relay if key generation fails
-        }
-
         // Trigger MQTT publish for each relay
-        err = trigger_mqtt_publish(relay_key, relay_list[i].type);
+        err = trigger_mqtt_publish(get_unit_handle(&relay_list[i]));
         if (err != ESP_OK) {
             ESP_LOGE(TAG, "Failed to publish relay channel %d to MQTT.", relay_list[i].channel);
         }
 
         // subscribe relay unit to MQTT set topic
         if (!subscribe) {
-            free(relay_key);
             continue;  // Skip subscription if not requested
         }   
         err = mqtt_relay_subscribe(&relay_list[i]);
@@ -1371,15 +4573,13 @@ esp_err_t relay_publish_all_to_mqtt(bool subscribe) {
             ESP_LOGE(TAG, "Failed to subscribe relay channel %d to MQTT.", relay_list[i].channel);
             relay_subscription_error = true;
         }
-        free(relay_key);
     }
 
     if (!relay_subscription_error && subscribe) {
         xEventGroupSetBits(g_sys_events,BIT_MQTT_RELAYS_SUBSCRIBED);
     }
 
-    // Free the dynamically allocated relay_list if it was allocated and not in-memory was in use
-    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) free(relay_list);
+    free(relay_list);
 
 #if _DEVICE_ENGINEERING_BUILD
     // dump relays from memory for debug
@@ -1394,15 +4594,27 @@ esp_err_t relay_publish_all_to_mqtt(bool subscribe) {
  * @brief Task to periodically refresh relay states to MQTT.
  * 
  * This task runs indefinitely, delaying for a specified interval (default 1 minute)
- * before publishing all relay states to MQTT. It logs the success or failure of each
- * refresh operation.
+ * before publishing all relay states to MQTT. Units that didn't change since they were
+ * last published are skipped, except every MQTT heartbeat interval (mqtt_hb_intervl
+ * setting), when all of them are published again. It logs the success or failure of
+ * each refresh operation.
  * 
  * @param arg Unused parameter for task function signature.
  */
 void refresh_relay_states_2_mqtt_task(void *arg) {
+    int64_t heartbeat_us = esp_timer_get_time();
+
     while (1) {
         vTaskDelay(pdMS_TO_TICKS(S_DEFAULT_MQTT_REFRESH_INTERVAL)); // Delay for S_DEFAULT_MQTT_REFRESH_INTERVAL milliseconds (default 1 minute)
 
+        // Heartbeat: publish unchanged units too, for consumers that missed them
+        int64_t now_us = esp_timer_get_time();
+        if (now_us - heartbeat_us >= (int64_t)mqtt_config_heartbeat_interval() * 1000) {
+            ESP_LOGI(TAG, "MQTT heartbeat: all relay states will be published");
+            mqtt_publish_heartbeat();
+            heartbeat_us = now_us;
+        }
+
         ESP_LOGI(TAG, "Refreshing relay states to MQTT...");
 
         // Publish all relay states to MQTT
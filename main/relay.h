@@ -19,7 +19,8 @@ typedef enum {
  */
 typedef enum {
     RELAY_TYPE_ACTUATOR,        // A state-actuated relay switch
-    RELAY_TYPE_SENSOR           // A contact sensor: determining if contact is closed or open
+    RELAY_TYPE_SENSOR,          // A contact sensor: determining if contact is closed or open
+    RELAY_TYPE_PULSE_COUNTER    // A pulse input counted by hardware (PCNT): energy meters, flow meters, anemometers
 } relay_type_t;
 
 /**
@@ -34,14 +35,62 @@ typedef struct {
     relay_type_t type;          // Relay type
     bool gpio_initialized;      // GPIO initialized
     gpio_config_t io_conf;     // GPIO IO configuration
+    uint16_t debounce_ms;       // Debounce window for contact sensors. 0 means DEBOUNCE_TIME_MS.
+    uint16_t pulse_ms;          // Actuators: momentary mode, ON switches back OFF after this time. 0 means latching.
+    uint8_t interlock_group;    // Actuators: members of the same group are never ON together. 0 means no interlock.
+    bool zero_cross;            // Actuators: switch at zc_offset_us after a mains zero crossing (needs the detector)
+    uint16_t zc_offset_us;      // Actuators: switching point after the crossing
+    uint16_t zc_latency_us;     // Actuators: mechanical latency of the relay, the output is driven this much earlier
+    uint64_t pulse_count;       // Pulse counters: pulses counted since boot. Runtime only, not persisted.
+    float pulse_rate;           // Pulse counters: pulses per second over the last sampling interval
 } relay_unit_t;
 
+/**
+ * @brief: Compact handle of a relay unit: its type and index within the type (i.e. channel)
+ * 
+ * Carried in queues, callbacks and internal APIs instead of string keys. Keys are only used at MQTT/HTTP boundaries.
+ */
+typedef struct {
+    uint8_t type;               // relay_type_t
+    uint8_t index;              // channel of the unit
+} unit_handle_t;
+
 // Event type for GPIO events
 typedef struct {
     int gpio_num;  // The GPIO pin number that triggered the event
     int level;     // The level (state) of the GPIO pin (0 or 1)
 } gpio_event_t;
 
+// gpio_num value of the event posted by the debounce timer
+#define GPIO_EVENT_DEBOUNCE_TIMER   (-1)
+// gpio_num value of the event posted by the input scan timer
+#define GPIO_EVENT_SCAN             (-2)
+// gpio_num value of the event posted by the delay timer of a rule, level carries the rule id
+#define GPIO_EVENT_RULE             (-3)
+
+// Command applied to an actuator by relay_actuator_command()
+typedef enum {
+    RELAY_COMMAND_OFF,
+    RELAY_COMMAND_ON,
+    RELAY_COMMAND_TOGGLE
+} relay_command_t;
+
+// Write-behind persistence counters
+typedef struct {
+    uint32_t requests;          // Persist requests (units marked dirty)
+    uint32_t flushes;           // Flushes made (one NVS handle and one commit each)
+    uint32_t units_written;     // Unit blobs actually written to NVS
+    uint32_t writes_saved;      // Flash writes avoided by coalescing: requests - units_written
+} relay_persist_stats_t;
+
+// Hot reconfiguration summary
+typedef struct {
+    uint16_t added;             // Units brought up
+    uint16_t removed;           // Units taken down
+    int64_t units_us;           // Time spent on the units: memory, GPIO, ISRs, PCNT and NVS
+    int64_t total_us;           // Same plus MQTT subscriptions and Home Assistant discovery of the delta
+} relay_reconfig_result_t;
+
 /** SETTINGS AND CONSTANTS **/
 
 #define INIT_RELAY_ON_LOAD     false
@@ -54,10 +103,36 @@ typedef struct {
 extern const int SAFE_GPIO_PINS[SAFE_GPIO_COUNT];
 
 #define DEBOUNCE_TIME_MS 50  // Set the debounce time to 50 milliseconds (adjust as needed)
+#define DEBOUNCE_TIME_MS_MAX 5000
+
+#define PULSE_GLITCH_FILTER_NS  1000    // Pulses shorter than this are filtered out by PCNT glitch filter
+#define PULSE_PCNT_LIMIT        32767   // PCNT hardware counter limits (+/-), the driver accumulates overflows
+
+#define RELAY_PULSE_MS_MAX      60000   // Longest on-device timed actuator pulse
+#define RELAY_PULSE_MS_UNIT     UINT32_MAX  // relay_actuator_command(): pulse width of the unit itself
+
+#define RELAY_INTERLOCK_GROUPS_MAX      8       // Interlock groups 1 - 8, 0 means no interlock
+#define RELAY_INTERLOCK_DEAD_MS_MAX     5000    // Longest dead time between members of an interlock group
+
+#define RELAY_ZC_OFFSET_US_MAX          10000   // Switching point after a zero crossing: up to a 50 Hz half-cycle
+#define RELAY_ZC_LATENCY_US_MAX         50000   // Longest mechanical latency of a relay or contactor
+
+#define RELAY_PERSIST_QUIET_MS      2000    // Flush dirty units once no new changes came for this period
+#define RELAY_PERSIST_MAX_DELAY_MS  10000   // ... but never keep a change in RAM longer than this
 
 /** ROUTINES **/
 esp_err_t init_relay_units_in_memory();
 esp_err_t dump_relay_units_in_memory();
+esp_err_t relay_units_index_rebuild();
+esp_err_t relay_units_reconfigure(relay_reconfig_result_t *result);
+
+void relay_units_write_lock();
+void relay_units_write_unlock();
+void relay_units_hold();
+void relay_units_release();
+esp_err_t relay_unit_snapshot(const relay_unit_t *relay, relay_unit_t *snapshot);
+esp_err_t relay_unit_snapshot_by_handle(unit_handle_t unit, relay_unit_t *snapshot);
+esp_err_t gpio_event_post(int gpio_num, int level);
 
 bool is_gpio_safe(int gpio_pin);
 bool is_gpio_pin_in_use(int pin);
@@ -66,38 +141,69 @@ void populate_safe_gpio_pins(char *buffer, size_t buffer_size);
 
 relay_unit_t get_actuator_relay(int channel, int pin);
 relay_unit_t get_sensor_relay(int channel, int pin);
+relay_unit_t get_pulse_counter_relay(int channel, int pin);
 
 esp_err_t relay_gpio_init(relay_unit_t *relay);
 esp_err_t relay_gpio_deinit(relay_unit_t *relay);
+esp_err_t relay_gpio_deinit_by_handle(unit_handle_t unit);
 esp_err_t relay_sensor_register_isr(relay_unit_t *relay);
+esp_err_t relay_sensor_unregister_isr(int gpio_pin);
+esp_err_t relay_sensor_debounce_reset(relay_unit_t *relay);
 esp_err_t relay_sensor_gpio_state_refresh(relay_unit_t *relay);
+esp_err_t relay_pulse_counter_attach(relay_unit_t *relay);
+esp_err_t relay_pulse_counter_detach(int channel);
+esp_err_t relay_all_pulse_counters_attach();
+esp_err_t relay_pulse_counters_sample(bool publish);
 
 esp_err_t relay_set_state(relay_unit_t *relay, relay_state_t state, bool persist);
+esp_err_t relay_set_state_traced(relay_unit_t *relay, relay_state_t state, bool persist, uint8_t latency_path, int64_t origin_us);
+esp_err_t relay_set_states_batch(const unit_handle_t *units, const relay_state_t *states, const uint16_t *pulse_ms, size_t count, int64_t *skew_us);
+esp_err_t relay_set_state_pulse(relay_unit_t *relay, uint32_t pulse_ms, uint8_t latency_path, int64_t origin_us);
+esp_err_t relay_actuator_command(unit_handle_t unit, relay_command_t command, uint32_t pulse_ms, uint8_t latency_path, int64_t origin_us, relay_state_t *state);
+esp_err_t relay_actuator_pulse_init();
+esp_err_t relay_interlock_init();
 
 void gpio_isr_handler(void *arg);
 void gpio_event_task(void *arg);
 
 esp_err_t save_relay_to_nvs(const char *key, relay_unit_t *relay);
+esp_err_t relay_persist_init();
+esp_err_t relay_persist_mark_dirty(relay_unit_t *relay);
+esp_err_t relay_persist_flush();
+void relay_persist_get_stats(relay_persist_stats_t *stats);
 esp_err_t load_relay_actuator_from_nvs(const char *key, relay_unit_t *relay);
 esp_err_t load_relay_sensor_from_nvs(const char *key, relay_unit_t *relay);
+esp_err_t load_relay_pulse_counter_from_nvs(const char *key, relay_unit_t *relay);
 
 esp_err_t get_relay_actuator_from_memory_by_channel(int channel, relay_unit_t **relay);
 esp_err_t get_relay_sensor_from_memory_by_channel(int channel, relay_unit_t **relay);
+esp_err_t get_relay_pulse_counter_from_memory_by_channel(int channel, relay_unit_t **relay);
 
 esp_err_t get_relay_actuator_from_memory_by_key(const char *key, relay_unit_t **relay);
 esp_err_t get_relay_sensor_from_memory_by_key(const char *key, relay_unit_t **relay);
+esp_err_t get_relay_pulse_counter_from_memory_by_key(const char *key, relay_unit_t **relay);
+esp_err_t get_relay_unit_from_memory_by_gpio(int gpio_pin, relay_unit_t **relay);
+esp_err_t get_relay_unit_from_memory_by_index(int index, relay_unit_t **relay);
+esp_err_t get_relay_unit_from_memory_by_handle(unit_handle_t unit, relay_unit_t **relay);
+
+unit_handle_t get_unit_handle(const relay_unit_t *relay);
+esp_err_t get_unit_handle_from_key(const char *key, unit_handle_t *unit);
 
 char *get_relay_nvs_key(int channel);
 char *get_contact_sensor_nvs_key(int channel);
+char *get_pulse_counter_nvs_key(int channel);
 char *get_unit_nvs_key(const relay_unit_t *relay);
+const char *get_unit_nvs_key_from_memory(const relay_unit_t *relay);
 
 relay_type_t get_relay_type_from_key(const char *relay_key);
 
 char* serialize_relay_unit(const relay_unit_t *relay);
 esp_err_t deserialize_relay_unit(const char *json_str, relay_unit_t *relay);
 
+// List getters return an allocated copy (NULL if there are no units), in memory or loaded from NVS: the caller frees it
 esp_err_t get_relay_list(relay_unit_t **relay_list, uint16_t *count);
 esp_err_t get_contact_sensor_list(relay_unit_t **sensor_list, uint16_t *count);
+esp_err_t get_pulse_counter_list(relay_unit_t **counter_list, uint16_t *count);
 esp_err_t get_all_relay_units(relay_unit_t **relay_list, uint16_t *total_count);
 
 esp_err_t relay_all_sensors_register_isr();
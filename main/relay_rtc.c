@@ -0,0 +1,255 @@
+#include "freertos/FreeRTOS.h"   // must be first
+
+#include <stddef.h>
+#include <string.h>
+
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_crc.h"
+#include "soc/soc.h"
+#include "soc/soc_caps.h"
+#include "soc/gpio_reg.h"
+#include "cJSON.h"
+
+#include "common.h"
+#include "relay_rtc.h"
+
+/* Output mirror */
+// Not initialized by the startup code: keeps its content over warm resets. Writers come from tasks,
+// timer callbacks and interlock critical sections, so the record is updated under its own spinlock.
+static RTC_NOINIT_ATTR relay_rtc_outputs_t s_rtc_outputs;
+static portMUX_TYPE s_rtc_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Output levels as driven, for change detection. Pins in the middle of a timed pulse are mirrored at their
+// OFF level instead: a warm reset must not bring back an ON level whose pulse timer is gone.
+static uint64_t s_rtc_levels = 0;
+static uint64_t s_rtc_pulse_pins = 0;
+static uint64_t s_rtc_pulse_off_levels = 0;
+
+/* Boot restore results */
+static relay_rtc_source_t s_restore_source = RELAY_RTC_SOURCE_NONE;
+static int64_t s_restored_us = 0;          // Time since startup when the outputs were driven
+static uint64_t s_restored_pins = 0;       // Pins restored from the mirror
+static uint64_t s_restored_levels = 0;
+static esp_reset_reason_t s_reset_reason = ESP_RST_UNKNOWN;
+
+static const char *RELAY_RTC_SOURCE_NAMES[] = {"none", "rtc", "nvs"};
+
+/**
+ * @brief: Checksum of the mirror record
+ */
+static inline uint32_t relay_rtc_crc(const relay_rtc_outputs_t *outputs) {
+    return esp_crc32_le(0, (const uint8_t *)outputs, offsetof(relay_rtc_outputs_t, crc));
+}
+
+/**
+ * @brief: Read the GPIO output level registers
+ */
+static inline uint64_t relay_rtc_read_outputs() {
+    uint64_t levels = REG_READ(GPIO_OUT_REG);
+#if SOC_GPIO_PIN_COUNT > 32
+    levels |= (uint64_t)REG_READ(GPIO_OUT1_REG) << 32;
+#endif
+    return levels;
+}
+
+/**
+ * @brief: Rebuild the mirror record from the driven levels and the pulses in progress. Caller holds s_rtc_mux.
+ */
+static inline void relay_rtc_record_update() {
+    uint64_t pulse_pins = s_rtc_pulse_pins & s_rtc_outputs.pin_mask;
+    s_rtc_outputs.level_mask = (s_rtc_levels & ~pulse_pins) | (s_rtc_pulse_off_levels & pulse_pins);
+    s_rtc_outputs.crc = relay_rtc_crc(&s_rtc_outputs);
+}
+
+/**
+ * @brief: Check if RTC memory kept its content over the reset
+ */
+static bool relay_rtc_warm_reset(esp_reset_reason_t reason) {
+    switch (reason) {
+        case ESP_RST_SW:
+        case ESP_RST_PANIC:
+        case ESP_RST_INT_WDT:
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_WDT:
+        case ESP_RST_DEEPSLEEP:
+            return true;
+        default:
+            // power-on, brownout, reset pin: RTC memory content is undefined
+            return false;
+    }
+}
+
+/**
+ * @brief: Drive actuator outputs from the RTC memory mirror. Has to be the very first step of app_main():
+ *         it needs neither NVS nor settings. Does nothing on a cold boot or when the mirror is not valid.
+ *
+ * @return esp_err_t ESP_OK if the outputs were restored, ESP_ERR_NOT_FOUND if there's nothing to restore from
+ */
+esp_err_t relay_rtc_restore_outputs() {
+    s_reset_reason = esp_reset_reason();
+
+    relay_rtc_outputs_t mirror = s_rtc_outputs;
+    bool valid = mirror.magic == RELAY_RTC_MAGIC && mirror.crc == relay_rtc_crc(&mirror)
+                 && (mirror.level_mask & ~mirror.pin_mask) == 0;
+
+    if (!relay_rtc_warm_reset(s_reset_reason) || !valid) {
+        // start over with an empty pin map, it is filled in once the units are loaded
+        portENTER_CRITICAL(&s_rtc_mux);
+        memset(&s_rtc_outputs, 0, sizeof(s_rtc_outputs));
+        s_rtc_outputs.magic = RELAY_RTC_MAGIC;
+        s_rtc_outputs.crc = relay_rtc_crc(&s_rtc_outputs);
+        portEXIT_CRITICAL(&s_rtc_mux);
+        ESP_LOGI(TAG, "No outputs to restore from RTC memory (reset reason %d, mirror %s)", (int)s_reset_reason, valid ? "valid" : "invalid");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint64_t pins = 0;
+    for (uint64_t mask = mirror.pin_mask; mask != 0; mask &= mask - 1) {
+        int pin = __builtin_ctzll(mask);
+        if (GPIO_IS_VALID_OUTPUT_GPIO(pin)) {
+            // level first: the pin starts driving at the right level when it is switched to output
+            gpio_set_level((gpio_num_t)pin, (uint32_t)((mirror.level_mask >> pin) & 1ULL));
+            pins |= 1ULL << pin;
+        }
+    }
+
+    gpio_config_t io_conf = {
+        .pin_bit_mask = pins,
+        .mode = GPIO_MODE_OUTPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE
+    };
+    esp_err_t err = (pins != 0) ? gpio_config(&io_conf) : ESP_OK;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to restore outputs from RTC memory: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    s_restored_pins = pins;
+    s_restored_levels = mirror.level_mask & pins;
+    relay_rtc_outputs_restored(RELAY_RTC_SOURCE_RTC);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Record the moment actuator outputs got their states back. Only the first call counts.
+ *
+ * @param source Where the states were restored from
+ */
+void relay_rtc_outputs_restored(relay_rtc_source_t source) {
+    if (s_restore_source != RELAY_RTC_SOURCE_NONE) {
+        return;
+    }
+    s_restore_source = source;
+    s_restored_us = esp_timer_get_time();
+
+    ESP_LOGI(TAG, "Actuator outputs restored from %s %lld us after startup (reset reason %d, %d output(s) from RTC memory)",
+             RELAY_RTC_SOURCE_NAMES[source], (long long)s_restored_us, (int)s_reset_reason, __builtin_popcountll(s_restored_pins));
+}
+
+/**
+ * @brief: Get the output level restored from RTC memory. NVS may lag behind it because of write-behind
+ *         persistence, so the restored level is the one to keep on a warm reset.
+ *
+ * @param gpio_pin GPIO pin of the actuator
+ * @param[out] level Restored output level
+ * @return true if the pin was restored from RTC memory at this boot
+ */
+bool relay_rtc_restored_level(int gpio_pin, int *level) {
+    if (s_restore_source != RELAY_RTC_SOURCE_RTC || gpio_pin < 0 || gpio_pin > 63 || !(s_restored_pins & (1ULL << gpio_pin))) {
+        return false;
+    }
+    *level = (int)((s_restored_levels >> gpio_pin) & 1ULL);
+    return true;
+}
+
+/**
+ * @brief: Set the actuator pin map of the mirror. Called whenever the in-memory units index is rebuilt.
+ *
+ * @param pin_mask Actuator output pins
+ */
+void relay_rtc_set_pins(uint64_t pin_mask) {
+    portENTER_CRITICAL(&s_rtc_mux);
+    s_rtc_outputs.magic = RELAY_RTC_MAGIC;
+    s_rtc_outputs.reserved = 0;
+    s_rtc_outputs.pin_mask = pin_mask;
+    s_rtc_levels = relay_rtc_read_outputs() & pin_mask;
+    s_rtc_pulse_pins &= pin_mask;
+    relay_rtc_record_update();
+    portEXIT_CRITICAL(&s_rtc_mux);
+}
+
+/**
+ * @brief: Mark the output as driven by a timed pulse: until relay_rtc_pulse_clear() it is mirrored at its OFF level.
+ *         Has to be called before the ON level is written. Safe to call from critical sections.
+ *
+ * @param gpio_pin GPIO pin of the actuator
+ * @param off_level Output level of the OFF state
+ */
+void relay_rtc_pulse_set(int gpio_pin, int off_level) {
+    if (gpio_pin < 0 || gpio_pin > 63) {
+        return;
+    }
+    portENTER_CRITICAL_SAFE(&s_rtc_mux);
+    s_rtc_pulse_pins |= 1ULL << gpio_pin;
+    if (off_level) {
+        s_rtc_pulse_off_levels |= 1ULL << gpio_pin;
+    } else {
+        s_rtc_pulse_off_levels &= ~(1ULL << gpio_pin);
+    }
+    relay_rtc_record_update();
+    portEXIT_CRITICAL_SAFE(&s_rtc_mux);
+}
+
+/**
+ * @brief: The pulse on the output has ended or was cancelled: mirror its level as driven again.
+ *         Safe to call from critical sections.
+ *
+ * @param gpio_pin GPIO pin of the actuator
+ */
+void relay_rtc_pulse_clear(int gpio_pin) {
+    if (gpio_pin < 0 || gpio_pin > 63) {
+        return;
+    }
+    portENTER_CRITICAL_SAFE(&s_rtc_mux);
+    if (s_rtc_pulse_pins & (1ULL << gpio_pin)) {
+        s_rtc_pulse_pins &= ~(1ULL << gpio_pin);
+        relay_rtc_record_update();
+    }
+    portEXIT_CRITICAL_SAFE(&s_rtc_mux);
+}
+
+/**
+ * @brief: Refresh the mirror from the output registers. Called after every actuator output write,
+ *         also from within critical sections: a register read and a CRC over 24 bytes.
+ *
+ * @return Actuator pins whose level changed since the previous refresh
+ */
+uint64_t relay_rtc_mirror_outputs() {
+    portENTER_CRITICAL_SAFE(&s_rtc_mux);
+    uint64_t levels = relay_rtc_read_outputs() & s_rtc_outputs.pin_mask;
+    uint64_t changed = levels ^ s_rtc_levels;
+    s_rtc_levels = levels;
+    relay_rtc_record_update();
+    portEXIT_CRITICAL_SAFE(&s_rtc_mux);
+    return changed;
+}
+
+/**
+ * @brief: Boot restore information for the device status
+ *
+ * @return cJSON object, to be freed by the caller
+ */
+cJSON *relay_rtc_to_JSON() {
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "source", RELAY_RTC_SOURCE_NAMES[s_restore_source]);
+    cJSON_AddNumberToObject(json, "reset_reason", (int)s_reset_reason);
+    cJSON_AddNumberToObject(json, "outputs_restored_us", (double)s_restored_us);
+    cJSON_AddNumberToObject(json, "rtc_outputs", __builtin_popcountll(s_restored_pins));
+    return json;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file relay_rtc.h
+ * @brief Actuator outputs mirrored into RTC memory for a fast restore after a warm reset
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * Every actuator output write refreshes a small checksummed record in RTC_NOINIT memory: the
+ * actuator pin map and the output levels. The record survives software, panic and watchdog
+ * resets, so app_main() drives the outputs back from it before NVS is even opened. On a cold boot
+ * the record doesn't pass the check and the states are restored from NVS as before. Outputs in the
+ * middle of a timed pulse are mirrored at their OFF level: the pulse timer does not survive the reset.
+ */
+#ifndef RELAY_RTC_H
+#define RELAY_RTC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "cJSON.h"
+
+/** TYPES **/
+
+/**
+ * @brief: Output mirror, as kept in RTC memory
+ */
+typedef struct {
+    uint32_t magic;             // RELAY_RTC_MAGIC
+    uint32_t reserved;
+    uint64_t pin_mask;          // Actuator output pins
+    uint64_t level_mask;        // Output levels of these pins
+    uint32_t crc;               // CRC32 of the fields above
+} relay_rtc_outputs_t;
+
+/**
+ * @brief: Where the actuator outputs were restored from at boot
+ */
+typedef enum {
+    RELAY_RTC_SOURCE_NONE,      // Not restored yet
+    RELAY_RTC_SOURCE_RTC,       // Warm reset: RTC memory mirror
+    RELAY_RTC_SOURCE_NVS        // Cold boot or invalid mirror: NVS
+} relay_rtc_source_t;
+
+/** SETTINGS AND CONSTANTS **/
+
+#define RELAY_RTC_MAGIC     0x4F43544E  // "NTCO", bump when the layout or the meaning of the levels changes
+
+/** ROUTINES **/
+esp_err_t relay_rtc_restore_outputs();
+void relay_rtc_outputs_restored(relay_rtc_source_t source);
+bool relay_rtc_restored_level(int gpio_pin, int *level);
+void relay_rtc_set_pins(uint64_t pin_mask);
+void relay_rtc_pulse_set(int gpio_pin, int off_level);
+void relay_rtc_pulse_clear(int gpio_pin);
+uint64_t relay_rtc_mirror_outputs();
+cJSON *relay_rtc_to_JSON();
+
+#endif // RELAY_RTC_H
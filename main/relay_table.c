@@ -0,0 +1,410 @@
+#include "freertos/FreeRTOS.h"   // must be first
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_crc.h"
+#include "nvs.h"
+
+#include "non_volatile_storage.h"
+
+#include "common.h"
+#include "settings.h"
+#include "relay.h"
+#include "relay_table.h"
+
+/* In-RAM image of the table */
+// Records are addressed directly by type and channel. The image is read from NVS once (single blob read)
+// and every save writes the whole table back under S_KEY_UNIT_TABLE with one commit.
+static relay_table_record_t s_table_actuators[CHANNEL_COUNT_MAX + 1];
+static relay_table_record_t s_table_sensors[CONTACT_SENSORS_COUNT_MAX + 1];
+static bool s_table_actuators_present[CHANNEL_COUNT_MAX + 1];
+static bool s_table_sensors_present[CONTACT_SENSORS_COUNT_MAX + 1];
+static relay_table_record_t s_table_pulse_counters[PULSE_COUNTERS_COUNT_MAX + 1];
+static bool s_table_pulse_counters_present[PULSE_COUNTERS_COUNT_MAX + 1];
+
+static bool s_table_loaded = false;
+static SemaphoreHandle_t s_table_lock = NULL;
+
+#define RELAY_TABLE_RECORDS_MAX ((CHANNEL_COUNT_MAX + 1) + (CONTACT_SENSORS_COUNT_MAX + 1) + (PULSE_COUNTERS_COUNT_MAX + 1))
+
+/**
+ * @brief: Get record slot for the type and channel
+ * 
+ * @param type Relay type
+ * @param channel Channel number
+ * @param[out] present Pointer to the presence flag of the slot
+ * @return pointer to the record or NULL if type or channel are out of range
+ */
+static relay_table_record_t *relay_table_slot(relay_type_t type, int channel, bool **present) {
+    if (type == RELAY_TYPE_ACTUATOR && channel >= CHANNEL_COUNT_MIN && channel <= CHANNEL_COUNT_MAX) {
+        *present = &s_table_actuators_present[channel];
+        return &s_table_actuators[channel];
+    }
+    if (type == RELAY_TYPE_SENSOR && channel >= CONTACT_SENSORS_COUNT_MIN && channel <= CONTACT_SENSORS_COUNT_MAX) {
+        *present = &s_table_sensors_present[channel];
+        return &s_table_sensors[channel];
+    }
+    if (type == RELAY_TYPE_PULSE_COUNTER && channel >= PULSE_COUNTERS_COUNT_MIN && channel <= PULSE_COUNTERS_COUNT_MAX) {
+        *present = &s_table_pulse_counters_present[channel];
+        return &s_table_pulse_counters[channel];
+    }
+    return NULL;
+}
+
+/**
+ * @brief: Pack relay unit into the table record
+ */
+static void relay_table_pack(const relay_unit_t *relay, relay_table_record_t *record) {
+    record->type = (uint8_t)relay->type;
+    record->channel = (uint8_t)relay->channel;
+    record->gpio_pin = (int8_t)relay->gpio_pin;
+    // momentary actuators always come back OFF: a pulse interrupted by a reboot must not be resumed as a latched ON
+    bool state_on = (relay->state == RELAY_STATE_ON) && !(relay->type == RELAY_TYPE_ACTUATOR && relay->pulse_ms > 0);
+    record->flags = (state_on ? RELAY_TABLE_FLAG_STATE : 0) |
+                    (relay->inverted ? RELAY_TABLE_FLAG_INVERTED : 0) |
+                    (relay->enabled ? RELAY_TABLE_FLAG_ENABLED : 0) |
+                    (relay->zero_cross ? RELAY_TABLE_FLAG_ZERO_CROSS : 0);
+    record->debounce_ms = relay->debounce_ms;
+    record->pulse_ms = relay->pulse_ms;
+    record->interlock_group = relay->interlock_group;
+    record->zc_offset_us = relay->zc_offset_us;
+    record->zc_latency_us = relay->zc_latency_us;
+}
+
+/**
+ * @brief: Unpack the table record into relay unit. Runtime fields are reset.
+ */
+static void relay_table_unpack(const relay_table_record_t *record, relay_unit_t *relay) {
+    memset(relay, 0, sizeof(relay_unit_t));
+    relay->type = (relay_type_t)record->type;
+    relay->channel = record->channel;
+    relay->gpio_pin = record->gpio_pin;
+    relay->state = (record->flags & RELAY_TABLE_FLAG_STATE) ? RELAY_STATE_ON : RELAY_STATE_OFF;
+    relay->inverted = (record->flags & RELAY_TABLE_FLAG_INVERTED) != 0;
+    relay->enabled = (record->flags & RELAY_TABLE_FLAG_ENABLED) != 0;
+    relay->debounce_ms = record->debounce_ms;
+    relay->pulse_ms = record->pulse_ms;
+    relay->interlock_group = record->interlock_group;
+    relay->zero_cross = (record->flags & RELAY_TABLE_FLAG_ZERO_CROSS) != 0;
+    relay->zc_offset_us = record->zc_offset_us;
+    relay->zc_latency_us = record->zc_latency_us;
+    relay->gpio_initialized = false;
+    relay->io_conf = (gpio_config_t){0};
+}
+
+/**
+ * @brief: Read and validate the table blob from NVS into the RAM image
+ * 
+ * @return ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if there's no table, ESP_ERR_INVALID_CRC or
+ *         ESP_ERR_INVALID_VERSION if the stored table cannot be used
+ */
+static esp_err_t relay_table_read() {
+    nvs_handle_t handle;
+    esp_err_t err = esp32_nvs_open(S_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // query the size first
+    size_t blob_size = 0;
+    err = nvs_get_blob(handle, S_KEY_UNIT_TABLE, NULL, &blob_size);
+    if (err != ESP_OK) {
+        nvs_close(handle);
+        return err;
+    }
+
+    if (blob_size < sizeof(relay_table_header_t)) {
+        nvs_close(handle);
+        ESP_LOGE(TAG, "Relay units table is too short (%u bytes)", (unsigned int)blob_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t *blob = malloc(blob_size);
+    if (blob == NULL) {
+        nvs_close(handle);
+        ESP_LOGE(TAG, "Failed to allocate memory for relay units table");
+        return ESP_ERR_NO_MEM;
+    }
+
+    err = nvs_get_blob(handle, S_KEY_UNIT_TABLE, blob, &blob_size);
+    nvs_close(handle);
+    if (err != ESP_OK) {
+        free(blob);
+        return err;
+    }
+
+    relay_table_header_t header;
+    memcpy(&header, blob, sizeof(header));
+    const uint8_t *records = blob + sizeof(header);
+    size_t records_size = (size_t)header.count * header.record_size;
+
+    if (header.magic != RELAY_TABLE_MAGIC || header.version < 1 || header.record_size == 0) {
+        ESP_LOGE(TAG, "Relay units table has unknown format (magic 0x%08x, version %u)", (unsigned int)header.magic, header.version);
+        free(blob);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    if (sizeof(header) + records_size != blob_size) {
+        ESP_LOGE(TAG, "Relay units table size mismatch: %u records of %u bytes in %u bytes blob", header.count, header.record_size, (unsigned int)blob_size);
+        free(blob);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (esp_crc32_le(0, records, records_size) != header.crc) {
+        ESP_LOGE(TAG, "Relay units table CRC mismatch");
+        free(blob);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    memset(s_table_actuators_present, 0, sizeof(s_table_actuators_present));
+    memset(s_table_sensors_present, 0, sizeof(s_table_sensors_present));
+    memset(s_table_pulse_counters_present, 0, sizeof(s_table_pulse_counters_present));
+
+    // Records written by a newer version may be longer: read the known prefix, zero the rest
+    size_t copy_size = (header.record_size < sizeof(relay_table_record_t)) ? header.record_size : sizeof(relay_table_record_t);
+    for (int i = 0; i < header.count; i++) {
+        relay_table_record_t record = {0};
+        memcpy(&record, records + (size_t)i * header.record_size, copy_size);
+
+        bool *present = NULL;
+        relay_table_record_t *slot = relay_table_slot((relay_type_t)record.type, record.channel, &present);
+        if (slot == NULL) {
+            ESP_LOGW(TAG, "Skipping relay units table record %d: type %u, channel %u", i, record.type, record.channel);
+            continue;
+        }
+        *slot = record;
+        *present = true;
+    }
+
+    free(blob);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Build the RAM image from legacy per-channel relay_unit_t blobs (one-time migration)
+ * 
+ * @return number of migrated units
+ */
+static int relay_table_migrate_legacy() {
+    uint16_t relay_ch_count = 0;
+    uint16_t relay_sn_count = 0;
+    nvs_read_uint16(S_NAMESPACE, S_KEY_CHANNEL_COUNT, &relay_ch_count);
+    nvs_read_uint16(S_NAMESPACE, S_KEY_CONTACT_SENSORS_COUNT, &relay_sn_count);
+
+    memset(s_table_actuators_present, 0, sizeof(s_table_actuators_present));
+    memset(s_table_sensors_present, 0, sizeof(s_table_sensors_present));
+    memset(s_table_pulse_counters_present, 0, sizeof(s_table_pulse_counters_present));
+
+    int migrated = 0;
+    char key[NVS_KEY_NAME_MAX_SIZE];
+
+    for (int i_channel = 0; i_channel < relay_ch_count && i_channel <= CHANNEL_COUNT_MAX; i_channel++) {
+        relay_unit_t relay = {0};
+        snprintf(key, sizeof(key), "%s%d", S_KEY_CH_PREFIX, i_channel);
+        if (nvs_read_blob(S_NAMESPACE, key, &relay, sizeof(relay_unit_t)) == ESP_OK) {
+            relay.type = RELAY_TYPE_ACTUATOR;
+            relay.channel = i_channel;
+            relay_table_pack(&relay, &s_table_actuators[i_channel]);
+            s_table_actuators_present[i_channel] = true;
+            migrated++;
+        }
+    }
+
+    for (int i_channel = 0; i_channel < relay_sn_count && i_channel <= CONTACT_SENSORS_COUNT_MAX; i_channel++) {
+        relay_unit_t relay = {0};
+        snprintf(key, sizeof(key), "%s%d", S_KEY_SN_PREFIX, i_channel);
+        if (nvs_read_blob(S_NAMESPACE, key, &relay, sizeof(relay_unit_t)) == ESP_OK) {
+            relay.type = RELAY_TYPE_SENSOR;
+            relay.channel = i_channel;
+            relay_table_pack(&relay, &s_table_sensors[i_channel]);
+            s_table_sensors_present[i_channel] = true;
+            migrated++;
+        }
+    }
+
+    return migrated;
+}
+
+/**
+ * @brief: Write the RAM image to NVS. Caller has to hold the table lock.
+ * 
+ * @return esp_err_t result of the operation
+ */
+static esp_err_t relay_table_write() {
+    size_t blob_size = sizeof(relay_table_header_t) + RELAY_TABLE_RECORDS_MAX * sizeof(relay_table_record_t);
+    uint8_t *blob = calloc(1, blob_size);
+    if (blob == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for relay units table");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // records: actuators first, then sensors, then pulse counters
+    relay_table_record_t *records = (relay_table_record_t *)(blob + sizeof(relay_table_header_t));
+    uint16_t count = 0;
+    for (int i = 0; i <= CHANNEL_COUNT_MAX; i++) {
+        if (s_table_actuators_present[i]) {
+            records[count++] = s_table_actuators[i];
+        }
+    }
+    for (int i = 0; i <= CONTACT_SENSORS_COUNT_MAX; i++) {
+        if (s_table_sensors_present[i]) {
+            records[count++] = s_table_sensors[i];
+        }
+    }
+    for (int i = 0; i <= PULSE_COUNTERS_COUNT_MAX; i++) {
+        if (s_table_pulse_counters_present[i]) {
+            records[count++] = s_table_pulse_counters[i];
+        }
+    }
+
+    relay_table_header_t header = {
+        .magic = RELAY_TABLE_MAGIC,
+        .version = RELAY_TABLE_VERSION,
+        .record_size = sizeof(relay_table_record_t),
+        .count = count,
+        .reserved = 0,
+        .crc = esp_crc32_le(0, (const uint8_t *)records, count * sizeof(relay_table_record_t))
+    };
+    memcpy(blob, &header, sizeof(header));
+    blob_size = sizeof(header) + count * sizeof(relay_table_record_t);
+
+    nvs_handle_t handle;
+    esp_err_t err = esp32_nvs_open(S_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, S_KEY_UNIT_TABLE, blob, blob_size);
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write relay units table to NVS: %s", esp_err_to_name(err));
+    } else {
+        ESP_LOGD(TAG, "Relay units table saved to NVS: %u unit(s), %u bytes", count, (unsigned int)blob_size);
+    }
+
+    free(blob);
+    return err;
+}
+
+/**
+ * @brief: Load the relay units table from NVS with a single read. If there's no table yet, migrate
+ *         legacy per-channel blobs into it and save it. Safe to call several times.
+ * 
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_table_init() {
+
+    if (s_table_lock == NULL) {
+        s_table_lock = xSemaphoreCreateMutex();
+        if (s_table_lock == NULL) {
+            ESP_LOGE(TAG, "Failed to create relay units table lock");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    xSemaphoreTake(s_table_lock, portMAX_DELAY);
+    if (s_table_loaded) {
+        xSemaphoreGive(s_table_lock);
+        return ESP_OK;
+    }
+
+    int64_t t_start = esp_timer_get_time();
+    esp_err_t err = relay_table_read();
+    if (err == ESP_OK) {
+        s_table_loaded = true;
+        ESP_LOGI(TAG, "Relay units table loaded from NVS in a single read: %lld us", (long long)(esp_timer_get_time() - t_start));
+        xSemaphoreGive(s_table_lock);
+        return ESP_OK;
+    }
+
+    // No usable table: migrate legacy per-channel blobs. Legacy blobs are left in place, so older firmware still boots.
+    ESP_LOGW(TAG, "Relay units table not available (%s). Migrating legacy per-channel records...", esp_err_to_name(err));
+    t_start = esp_timer_get_time();
+    int migrated = relay_table_migrate_legacy();
+    int64_t legacy_us = esp_timer_get_time() - t_start;
+
+    err = relay_table_write();
+    if (err == ESP_OK) {
+        s_table_loaded = true;
+        ESP_LOGI(TAG, "Migrated %d relay unit(s) into the units table. Legacy per-channel load took %lld us", migrated, (long long)legacy_us);
+    }
+
+    xSemaphoreGive(s_table_lock);
+    return err;
+}
+
+/**
+ * @brief: Get the relay unit from the table
+ * 
+ * @param type Relay type
+ * @param channel Channel number
+ * @param[out] relay Pointer to the relay unit to be filled. Runtime fields are reset.
+ * @return ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if there's no such unit in the table
+ */
+esp_err_t relay_table_get_unit(relay_type_t type, int channel, relay_unit_t *relay) {
+    esp_err_t err = relay_table_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    xSemaphoreTake(s_table_lock, portMAX_DELAY);
+    bool *present = NULL;
+    relay_table_record_t *slot = relay_table_slot(type, channel, &present);
+    if (slot == NULL || !*present) {
+        xSemaphoreGive(s_table_lock);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    relay_table_unpack(slot, relay);
+    xSemaphoreGive(s_table_lock);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief: Update the relay unit in the RAM image of the table. Call relay_table_save() to persist.
+ * 
+ * @param relay Pointer to the relay unit
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_table_put_unit(const relay_unit_t *relay) {
+    esp_err_t err = relay_table_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    xSemaphoreTake(s_table_lock, portMAX_DELAY);
+    bool *present = NULL;
+    relay_table_record_t *slot = relay_table_slot(relay->type, relay->channel, &present);
+    if (slot == NULL) {
+        xSemaphoreGive(s_table_lock);
+        ESP_LOGE(TAG, "Relay unit type %d, channel %d is out of units table range", relay->type, relay->channel);
+        return ESP_ERR_INVALID_ARG;
+    }
+    relay_table_pack(relay, slot);
+    *present = true;
+    xSemaphoreGive(s_table_lock);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief: Save the whole table to NVS under one key with one commit
+ * 
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_table_save() {
+    esp_err_t err = relay_table_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    xSemaphoreTake(s_table_lock, portMAX_DELAY);
+    err = relay_table_write();
+    xSemaphoreGive(s_table_lock);
+
+    return err;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file relay_table.h
+ * @brief Versioned, CRC-protected relay units table stored in NVS under a single key
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ */
+#ifndef RELAY_TABLE_H
+#define RELAY_TABLE_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "relay.h"
+
+/** TYPES **/
+
+/**
+ * @brief: Table header. Followed by 'count' records of 'record_size' bytes each.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;             // RELAY_TABLE_MAGIC
+    uint16_t version;           // Format version the table was written with
+    uint16_t record_size;       // Size of a single record, allows to extend records in later versions
+    uint16_t count;             // Number of records
+    uint16_t reserved;
+    uint32_t crc;               // CRC32 of all records
+} relay_table_header_t;
+
+/**
+ * @brief: Packed persistent part of relay_unit_t. Runtime-only fields (GPIO config) are not stored.
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t type;               // relay_type_t
+    uint8_t channel;
+    int8_t gpio_pin;
+    uint8_t flags;              // RELAY_TABLE_FLAG_*
+    uint16_t debounce_ms;
+    uint16_t pulse_ms;          // since version 2
+    uint8_t interlock_group;    // since version 3
+    uint16_t zc_offset_us;      // since version 4
+    uint16_t zc_latency_us;     // since version 4
+} relay_table_record_t;
+
+/** SETTINGS AND CONSTANTS **/
+
+#define RELAY_TABLE_MAGIC       0x52555442  // "RUTB"
+#define RELAY_TABLE_VERSION     4
+
+#define RELAY_TABLE_FLAG_STATE      (1 << 0)
+#define RELAY_TABLE_FLAG_INVERTED   (1 << 1)
+#define RELAY_TABLE_FLAG_ENABLED    (1 << 2)
+#define RELAY_TABLE_FLAG_ZERO_CROSS (1 << 3)    // since version 4
+
+/** ROUTINES **/
+esp_err_t relay_table_init();
+esp_err_t relay_table_get_unit(relay_type_t type, int channel, relay_unit_t *relay);
+esp_err_t relay_table_put_unit(const relay_unit_t *relay);
+esp_err_t relay_table_save();
+
+#endif // RELAY_TABLE_H
@@ -0,0 +1,317 @@
+#include "freertos/FreeRTOS.h"   // must be first
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_crc.h"
+#include "nvs.h"
+
+#include "non_volatile_storage.h"
+
+#include "common.h"
+#include "settings.h"
+#include "time_sync.h"
+#include "relay_wear.h"
+
+/* Wear counters */
+// Slot per actuator channel. Updated from within the interlock critical section on every output change,
+// so the slots are guarded by their own spinlock and the update is a few additions. NVS writes happen in
+// relay_wear_flush() only, serialized by s_wear_lock.
+typedef struct {
+    uint32_t cycles;
+    uint64_t on_time_us;        // Completed ON periods
+    int64_t on_since_us;        // Time the output went ON, 0 if it is OFF
+    int64_t changed_us;         // Time of the last change since boot, 0 if there was none
+    uint32_t last_change;       // Unix time of the last change, as loaded from NVS or resolved since
+} relay_wear_slot_t;
+
+static relay_wear_slot_t s_wear[CHANNEL_COUNT_MAX + 1];
+static bool s_wear_dirty = false;
+static portMUX_TYPE s_wear_mux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t s_wear_lock = NULL;
+
+/**
+ * @brief: Unix time of the last change of the slot. Changes since boot are resolved once the clock is synchronized.
+ *
+ * @param slot Copy of the wear slot
+ * @param now_us Current time since boot
+ * @return Unix time or 0 if unknown
+ */
+static uint32_t relay_wear_last_change(const relay_wear_slot_t *slot, int64_t now_us) {
+    if (slot->changed_us == 0 || !time_is_synced()) {
+        return slot->last_change;
+    }
+    return (uint32_t)(time(NULL) - (time_t)((now_us - slot->changed_us) / 1000000));
+}
+
+/**
+ * @brief: Read the wear table from NVS into RAM
+ *
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if there's no table yet
+ */
+static esp_err_t relay_wear_read() {
+    nvs_handle_t handle;
+    esp_err_t err = esp32_nvs_open(S_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    size_t blob_size = 0;
+    err = nvs_get_blob(handle, S_KEY_WEAR_TABLE, NULL, &blob_size);
+    if (err != ESP_OK) {
+        nvs_close(handle);
+        return err;
+    }
+
+    if (blob_size < sizeof(relay_wear_header_t)) {
+        nvs_close(handle);
+        ESP_LOGE(TAG, "Wear table is too short (%u bytes)", (unsigned int)blob_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t *blob = malloc(blob_size);
+    if (blob == NULL) {
+        nvs_close(handle);
+        ESP_LOGE(TAG, "Failed to allocate memory for wear table");
+        return ESP_ERR_NO_MEM;
+    }
+
+    err = nvs_get_blob(handle, S_KEY_WEAR_TABLE, blob, &blob_size);
+    nvs_close(handle);
+    if (err != ESP_OK) {
+        free(blob);
+        return err;
+    }
+
+    relay_wear_header_t header;
+    memcpy(&header, blob, sizeof(header));
+    const uint8_t *records = blob + sizeof(header);
+    size_t records_size = (size_t)header.count * header.record_size;
+
+    if (header.magic != RELAY_WEAR_MAGIC || header.version < 1 || header.record_size == 0
+        || sizeof(header) + records_size != blob_size) {
+        ESP_LOGE(TAG, "Wear table has unknown format (magic 0x%08x, version %u)", (unsigned int)header.magic, header.version);
+        free(blob);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    if (esp_crc32_le(0, records, records_size) != header.crc) {
+        ESP_LOGE(TAG, "Wear table CRC mismatch");
+        free(blob);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    // Records written by a newer version may be longer: read the known prefix, zero the rest
+    size_t copy_size = (header.record_size < sizeof(relay_wear_record_t)) ? header.record_size : sizeof(relay_wear_record_t);
+    portENTER_CRITICAL(&s_wear_mux);
+    for (int i = 0; i < header.count; i++) {
+        relay_wear_record_t record = {0};
+        memcpy(&record, records + (size_t)i * header.record_size, copy_size);
+        if (record.channel > CHANNEL_COUNT_MAX) {
+            continue;
+        }
+        s_wear[record.channel].cycles = record.cycles;
+        s_wear[record.channel].on_time_us = record.on_time_ms * 1000;
+        s_wear[record.channel].last_change = record.last_change;
+    }
+    portEXIT_CRITICAL(&s_wear_mux);
+
+    free(blob);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Load wear counters from NVS. Has to be called before the outputs are synced with relay_wear_sync().
+ *
+ * @return esp_err_t result of the operation. A missing or broken table is not an error: counting starts from zero.
+ */
+esp_err_t relay_wear_init() {
+
+    if (s_wear_lock != NULL) {
+        // already initialized
+        return ESP_OK;
+    }
+
+    s_wear_lock = xSemaphoreCreateMutex();
+    if (s_wear_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create wear table lock");
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = relay_wear_read();
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(TAG, "No wear table in NVS yet, counting starts from zero");
+    } else if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Wear table not loaded (%s), counting starts from zero", esp_err_to_name(err));
+    }
+
+    portENTER_CRITICAL(&s_wear_mux);
+    s_wear_dirty = false;
+    portEXIT_CRITICAL(&s_wear_mux);
+
+    ESP_LOGI(TAG, "Wear accounting started: counters flushed every %d s and on restart", RELAY_WEAR_FLUSH_INTERVAL_S);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Account an output change of the actuator. Called on every actuator output write, also from within
+ *         critical sections: nothing happens if the output stays as it was.
+ *
+ * @param channel Actuator channel
+ * @param on true if the output is ON now
+ * @param now_us Time of the write
+ */
+void relay_wear_record(int channel, bool on, int64_t now_us) {
+    if (channel < 0 || channel > CHANNEL_COUNT_MAX) {
+        return;
+    }
+
+    portENTER_CRITICAL_SAFE(&s_wear_mux);
+    relay_wear_slot_t *slot = &s_wear[channel];
+    if (on != (slot->on_since_us != 0)) {
+        if (on) {
+            slot->cycles++;
+            slot->on_since_us = (now_us > 0) ? now_us : 1;
+        } else {
+            slot->on_time_us += (uint64_t)(now_us - slot->on_since_us);
+            slot->on_since_us = 0;
+        }
+        slot->changed_us = now_us;
+        s_wear_dirty = true;
+    }
+    portEXIT_CRITICAL_SAFE(&s_wear_mux);
+}
+
+/**
+ * @brief: Take the output state as it is without counting a cycle. Used for outputs restored at boot.
+ *
+ * @param channel Actuator channel
+ * @param on true if the output is ON
+ * @param now_us Current time
+ */
+void relay_wear_sync(int channel, bool on, int64_t now_us) {
+    if (channel < 0 || channel > CHANNEL_COUNT_MAX) {
+        return;
+    }
+
+    portENTER_CRITICAL_SAFE(&s_wear_mux);
+    relay_wear_slot_t *slot = &s_wear[channel];
+    if (on && slot->on_since_us == 0) {
+        slot->on_since_us = (now_us > 0) ? now_us : 1;
+    } else if (!on) {
+        slot->on_since_us = 0;
+    }
+    portEXIT_CRITICAL_SAFE(&s_wear_mux);
+}
+
+/**
+ * @brief: Get wear counters of the actuator
+ *
+ * @param channel Actuator channel
+ * @param[out] counters Counters, ON time includes the current ON period
+ * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG if the channel is out of range
+ */
+esp_err_t relay_wear_get(int channel, relay_wear_counters_t *counters) {
+    if (channel < 0 || channel > CHANNEL_COUNT_MAX || counters == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&s_wear_mux);
+    relay_wear_slot_t slot = s_wear[channel];
+    portEXIT_CRITICAL(&s_wear_mux);
+
+    uint64_t on_time_us = slot.on_time_us + ((slot.on_since_us != 0) ? (uint64_t)(now_us - slot.on_since_us) : 0);
+    counters->cycles = slot.cycles;
+    counters->on_time_s = on_time_us / 1000000;
+    counters->last_change = relay_wear_last_change(&slot, now_us);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Write wear counters to NVS if any of them changed since the last write. ON periods in progress are
+ *         counted up to now. Called periodically by the write-behind task and on restart.
+ *
+ * @return esp_err_t result of the operation
+ */
+esp_err_t relay_wear_flush() {
+
+    if (s_wear_lock == NULL) {
+        return ESP_OK;
+    }
+
+    xSemaphoreTake(s_wear_lock, portMAX_DELAY);
+
+    relay_wear_slot_t slots[CHANNEL_COUNT_MAX + 1];
+    portENTER_CRITICAL(&s_wear_mux);
+    bool dirty = s_wear_dirty;
+    s_wear_dirty = false;
+    memcpy(slots, s_wear, sizeof(slots));
+    portEXIT_CRITICAL(&s_wear_mux);
+
+    if (!dirty) {
+        xSemaphoreGive(s_wear_lock);
+        return ESP_OK;
+    }
+
+    int64_t t_start = esp_timer_get_time();
+    struct __attribute__((packed)) {
+        relay_wear_header_t header;
+        relay_wear_record_t records[CHANNEL_COUNT_MAX + 1];
+    } table;
+
+    for (int channel = 0; channel <= CHANNEL_COUNT_MAX; channel++) {
+        const relay_wear_slot_t *slot = &slots[channel];
+        uint64_t on_time_us = slot->on_time_us + ((slot->on_since_us != 0) ? (uint64_t)(t_start - slot->on_since_us) : 0);
+        table.records[channel] = (relay_wear_record_t){
+            .channel = (uint8_t)channel,
+            .cycles = slot->cycles,
+            .on_time_ms = on_time_us / 1000,
+            .last_change = relay_wear_last_change(slot, t_start)
+        };
+    }
+    table.header = (relay_wear_header_t){
+        .magic = RELAY_WEAR_MAGIC,
+        .version = RELAY_WEAR_VERSION,
+        .record_size = sizeof(relay_wear_record_t),
+        .count = CHANNEL_COUNT_MAX + 1,
+        .reserved = 0,
+        .crc = esp_crc32_le(0, (const uint8_t *)table.records, sizeof(table.records))
+    };
+
+    nvs_handle_t handle;
+    esp_err_t err = esp32_nvs_open(S_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, S_KEY_WEAR_TABLE, &table, sizeof(table));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    portENTER_CRITICAL(&s_wear_mux);
+    if (err != ESP_OK) {
+        // try again with the next flush
+        s_wear_dirty = true;
+    } else {
+        // resolved times survive the next boot, when the clock is not synchronized yet
+        for (int channel = 0; channel <= CHANNEL_COUNT_MAX; channel++) {
+            s_wear[channel].last_change = table.records[channel].last_change;
+        }
+    }
+    portEXIT_CRITICAL(&s_wear_mux);
+
+    xSemaphoreGive(s_wear_lock);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write wear table to NVS: %s", esp_err_to_name(err));
+    } else {
+        ESP_LOGI(TAG, "Wear table saved to NVS in %lld us", (long long)(esp_timer_get_time() - t_start));
+    }
+    return err;
+}
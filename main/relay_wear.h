@@ -0,0 +1,66 @@
+/**
+ * @file relay_wear.h
+ * @brief Wear accounting of actuators: switching cycles, cumulative ON time and the time of the last change
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * Counters are kept in RAM and updated on every actuator output change, whoever made it: commands, pulse
+ * timers, interlock releases and batches. They are written to NVS as a single blob once per
+ * RELAY_WEAR_FLUSH_INTERVAL_S if anything changed and on restart, so the accounting doesn't wear the flash
+ * itself. Outputs restored at boot are not counted as cycles.
+ */
+#ifndef RELAY_WEAR_H
+#define RELAY_WEAR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/** TYPES **/
+
+/**
+ * @brief: Wear record of an actuator channel, as stored in NVS
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t channel;
+    uint8_t reserved[3];
+    uint32_t cycles;            // OFF to ON transitions of the output
+    uint64_t on_time_ms;        // Cumulative time the output was ON
+    uint32_t last_change;       // Unix time of the last output change, 0 if unknown
+} relay_wear_record_t;
+
+/**
+ * @brief: Wear table header. Followed by 'count' records of 'record_size' bytes each.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;             // RELAY_WEAR_MAGIC
+    uint16_t version;
+    uint16_t record_size;
+    uint16_t count;
+    uint16_t reserved;
+    uint32_t crc;               // CRC32 of all records
+} relay_wear_header_t;
+
+/**
+ * @brief: Wear counters of an actuator, as reported
+ */
+typedef struct {
+    uint32_t cycles;            // OFF to ON transitions of the output
+    uint64_t on_time_s;         // Cumulative ON time, including the current ON period
+    uint32_t last_change;       // Unix time of the last output change, 0 if unknown (clock not synchronized yet)
+} relay_wear_counters_t;
+
+/** SETTINGS AND CONSTANTS **/
+
+#define RELAY_WEAR_MAGIC                0x52414557  // "WEAR"
+#define RELAY_WEAR_VERSION              1
+
+#define RELAY_WEAR_FLUSH_INTERVAL_S     1800    // Changed counters are written to NVS this often, and on restart
+
+/** ROUTINES **/
+esp_err_t relay_wear_init();
+void relay_wear_record(int channel, bool on, int64_t now_us);
+void relay_wear_sync(int channel, bool on, int64_t now_us);
+esp_err_t relay_wear_get(int channel, relay_wear_counters_t *counters);
+esp_err_t relay_wear_flush();
+
+#endif // RELAY_WEAR_H
@@ -0,0 +1,435 @@
+#include "freertos/FreeRTOS.h"   // must be first
+
+#include <string.h>
+
+#include "driver/gpio.h"
+#include "driver/gptimer.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "soc/soc.h"
+#include "soc/soc_caps.h"
+#include "soc/gpio_reg.h"
+#include "cJSON.h"
+
+#include "non_volatile_storage.h"
+
+#include "common.h"
+#include "settings.h"
+#include "relay.h"
+#include "zerocross.h"
+#include "relay_zc.h"
+
+/* Zero-cross detector */
+// Crossings are timestamped with the raw count of s_zc_timer, so planned edges and the alarm share one time base.
+// The tracker is updated by the detector ISR and read by the tasks planning edges, under its own spinlock.
+static zc_tracker_t s_zc_tracker;
+static portMUX_TYPE s_zc_mux = portMUX_INITIALIZER_UNLOCKED;
+static gptimer_handle_t s_zc_timer = NULL;
+static int s_zc_pin = -1;                   // Pin the detector is attached to
+// Detector pin as configured in settings, read once: pin allocation asks for it in loops.
+// Reloaded by relay_zc_config_reload() when the setting changes, the detector itself moves on reboot.
+static int s_zc_config_pin = RELAY_ZC_PIN_UNKNOWN;
+
+/* Pending edges */
+// Edge per actuator channel, guarded by the output lock of the caller: the interlock critical section.
+typedef struct {
+    bool pending;
+    int gpio_pin;
+    uint8_t level;
+    uint32_t phase_us;          // Drive point after a crossing
+    int64_t requested_us;       // Time the edge was requested
+    int64_t earliest_us;        // Never written before this time
+    int64_t due_us;             // Alarm time, refreshed by every crossing
+} relay_zc_edge_t;
+
+static relay_zc_edge_t s_zc_edges[CHANNEL_COUNT_MAX + 1];
+static portMUX_TYPE *s_outputs_mux = NULL;
+static relay_zc_written_cb_t s_outputs_written = NULL;
+
+/* Statistics */
+static uint32_t s_zc_aligned = 0;           // Edges written by the alarm
+static uint32_t s_zc_unaligned = 0;         // Edges written right away: no lock on the mains
+static int64_t s_zc_delay_max_us = 0;       // Longest delay added to an edge
+static int64_t s_zc_late_max_us = 0;        // Longest time an edge was written after its due time
+
+/**
+ * @brief: Read the output level of the pin from the GPIO output register
+ */
+static inline uint32_t relay_zc_output_level(int gpio_pin) {
+#if SOC_GPIO_PIN_COUNT > 32
+    if (gpio_pin >= 32) {
+        return (REG_READ(GPIO_OUT1_REG) >> (gpio_pin - 32)) & 1U;
+    }
+#endif
+    return (REG_READ(GPIO_OUT_REG) >> gpio_pin) & 1U;
+}
+
+/**
+ * @brief: Arm the alarm for the earliest pending edge. Caller holds the output lock.
+ *
+ * @return esp_err_t result of the operation, ESP_OK if there's nothing to arm
+ */
+static esp_err_t relay_zc_arm() {
+    int64_t due_us = INT64_MAX;
+    for (int channel = 0; channel <= CHANNEL_COUNT_MAX; channel++) {
+        if (s_zc_edges[channel].pending && s_zc_edges[channel].due_us < due_us) {
+            due_us = s_zc_edges[channel].due_us;
+        }
+    }
+    if (due_us == INT64_MAX) {
+        return ESP_OK;
+    }
+
+    // an alarm set in the past would never fire: edges overdue already are written by an alarm right away
+    uint64_t now;
+    gptimer_get_raw_count(s_zc_timer, &now);
+    if (due_us < (int64_t)now + RELAY_ZC_ALARM_MIN_US) {
+        due_us = (int64_t)now + RELAY_ZC_ALARM_MIN_US;
+    }
+
+    gptimer_alarm_config_t alarm_config = {
+        .alarm_count = (uint64_t)due_us,
+        .flags.auto_reload_on_alarm = false
+    };
+    return gptimer_set_alarm_action(s_zc_timer, &alarm_config);
+}
+
+/**
+ * @brief: Zero-cross detector ISR. Records the crossing and re-arms the alarm from it.
+ *
+ * Not placed in IRAM: gptimer control functions are in flash (CONFIG_GPTIMER_CTRL_FUNC_IN_IRAM is not set),
+ * so the GPIO ISR service is installed without ESP_INTR_FLAG_IRAM and the ISR is held off during flash writes.
+ *
+ * @param arg Unused
+ */
+static void relay_zc_isr_handler(void *arg) {
+    uint64_t now;
+    gptimer_get_raw_count(s_zc_timer, &now);
+
+    portENTER_CRITICAL_ISR(&s_zc_mux);
+    bool crossing = zc_tracker_edge(&s_zc_tracker, (int64_t)now);
+    portEXIT_CRITICAL_ISR(&s_zc_mux);
+
+    if (!crossing) {
+        return;
+    }
+
+    // edges due within this half-cycle are planned from this crossing, later ones are refreshed by the next crossings
+    portENTER_CRITICAL_ISR(s_outputs_mux);
+    bool pending = false;
+    for (int channel = 0; channel <= CHANNEL_COUNT_MAX; channel++) {
+        relay_zc_edge_t *edge = &s_zc_edges[channel];
+        if (!edge->pending) {
+            continue;
+        }
+        int64_t due_us = (int64_t)now + edge->phase_us;
+        if (due_us >= edge->earliest_us) {
+            edge->due_us = due_us;
+        }
+        pending = true;
+    }
+    if (pending) {
+        relay_zc_arm();
+    }
+    portEXIT_CRITICAL_ISR(s_outputs_mux);
+}
+
+/**
+ * @brief: Alarm ISR. Writes the edges that are due and arms the alarm for the next one.
+ *
+ * @param timer Timer handle
+ * @param edata Alarm event data
+ * @param user_ctx Unused
+ * @return false: no task is woken up
+ */
+static bool relay_zc_alarm_cb(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx) {
+    uint64_t now;
+    gptimer_get_raw_count(timer, &now);
+
+    portENTER_CRITICAL_ISR(s_outputs_mux);
+    bool written = false;
+    for (int channel = 0; channel <= CHANNEL_COUNT_MAX; channel++) {
+        relay_zc_edge_t *edge = &s_zc_edges[channel];
+        if (!edge->pending || edge->due_us > (int64_t)edata->count_value + RELAY_ZC_ALARM_SLACK_US) {
+            continue;
+        }
+        gpio_set_level((gpio_num_t)edge->gpio_pin, edge->level);
+        edge->pending = false;
+        written = true;
+
+        s_zc_aligned++;
+        if (edge->due_us - edge->requested_us > s_zc_delay_max_us) {
+            s_zc_delay_max_us = edge->due_us - edge->requested_us;
+        }
+        if ((int64_t)now - edge->due_us > s_zc_late_max_us) {
+            s_zc_late_max_us = (int64_t)now - edge->due_us;
+        }
+    }
+    if (written && s_outputs_written != NULL) {
+        s_outputs_written();
+    }
+    relay_zc_arm();
+    portEXIT_CRITICAL_ISR(s_outputs_mux);
+
+    return false;
+}
+
+/**
+ * @brief: Re-read the zero-cross detector pin from settings. Called after the setting was updated.
+ *
+ * @return esp_err_t result of the NVS read. On failure the pin is taken as not configured.
+ */
+esp_err_t relay_zc_config_reload() {
+    uint16_t pin = S_DEFAULT_ZERO_CROSS_PIN;
+    esp_err_t err = nvs_read_uint16(S_NAMESPACE, S_KEY_ZERO_CROSS_PIN, &pin);
+    s_zc_config_pin = (err != ESP_OK || pin == 0) ? -1 : (int)pin;
+    return err;
+}
+
+/**
+ * @brief: Get the zero-cross detector pin as configured in settings. NVS is read on the first call only.
+ *
+ * @return GPIO pin or -1 if there's no detector
+ */
+int relay_zc_gpio_pin() {
+    if (s_zc_config_pin == RELAY_ZC_PIN_UNKNOWN) {
+        relay_zc_config_reload();
+    }
+    return s_zc_config_pin;
+}
+
+/**
+ * @brief: Start zero-cross synchronised switching if the detector is configured
+ *
+ * @param outputs_mux Lock of the actuator outputs, taken by the ISRs to write pending edges
+ * @param outputs_written Called after pending edges were written, with the lock held
+ * @return esp_err_t result of the operation. No detector configured is not an error: edges are written right away.
+ */
+esp_err_t relay_zc_init(portMUX_TYPE *outputs_mux, relay_zc_written_cb_t outputs_written) {
+
+    if (s_zc_timer != NULL) {
+        // already initialized
+        return ESP_OK;
+    }
+
+    s_outputs_mux = outputs_mux;
+    s_outputs_written = outputs_written;
+    zc_tracker_init(&s_zc_tracker);
+    memset(s_zc_edges, 0, sizeof(s_zc_edges));
+
+    int pin = relay_zc_gpio_pin();
+    if (pin < 0) {
+        ESP_LOGI(TAG, "No zero-cross detector configured, actuators switch right away");
+        return ESP_OK;
+    }
+    if (!is_gpio_safe(pin) || !GPIO_IS_VALID_GPIO(pin)) {
+        ESP_LOGE(TAG, "Zero-cross detector pin %d is not in the safe GPIO list", pin);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    gptimer_handle_t timer = NULL;
+    gptimer_config_t timer_config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = RELAY_ZC_TIMER_RESOLUTION_HZ
+    };
+    esp_err_t err = gptimer_new_timer(&timer_config, &timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create zero-cross timer: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    gptimer_event_callbacks_t callbacks = {
+        .on_alarm = relay_zc_alarm_cb
+    };
+    err = gptimer_register_event_callbacks(timer, &callbacks, NULL);
+    if (err == ESP_OK) {
+        err = gptimer_enable(timer);
+        if (err == ESP_OK) {
+            err = gptimer_start(timer);
+            if (err != ESP_OK) {
+                gptimer_disable(timer);
+            }
+        }
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start zero-cross timer: %s", esp_err_to_name(err));
+        gptimer_del_timer(timer);
+        return err;
+    }
+    s_zc_timer = timer;
+
+    // detectors have open collector outputs: pull-up, and both edges, see zerocross.h
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 1ULL << pin,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_ANYEDGE
+    };
+    err = gpio_config(&io_conf);
+    if (err == ESP_OK) {
+        // the service may be installed by the contact sensors already
+        err = gpio_install_isr_service(0);
+        if (err == ESP_ERR_INVALID_STATE) {
+            err = ESP_OK;
+        }
+    }
+    if (err == ESP_OK) {
+        err = gpio_isr_handler_add((gpio_num_t)pin, relay_zc_isr_handler, NULL);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to attach zero-cross detector to GPIO pin %d: %s", pin, esp_err_to_name(err));
+        return err;
+    }
+    s_zc_pin = pin;
+
+    ESP_LOGI(TAG, "Zero-cross detector started on GPIO pin %d", pin);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Check if edges can be aligned right now: the detector follows the mains
+ *
+ * @return true if the tracker is locked
+ */
+bool relay_zc_locked() {
+    if (s_zc_timer == NULL) {
+        return false;
+    }
+
+    uint64_t now;
+    gptimer_get_raw_count(s_zc_timer, &now);
+    portENTER_CRITICAL_SAFE(&s_zc_mux);
+    bool locked = zc_tracker_locked(&s_zc_tracker, (int64_t)now);
+    portEXIT_CRITICAL_SAFE(&s_zc_mux);
+    return locked;
+}
+
+/**
+ * @brief: Plan an output edge at the switching point after the next zero crossing. Replaces any edge pending
+ *         for the channel. Caller holds the output lock.
+ *
+ * @param channel Actuator channel
+ * @param gpio_pin Output pin
+ * @param level Output level to write
+ * @param offset_us Switching point after the crossing
+ * @param latency_us Mechanical latency of the relay
+ * @param[out] delay_us Delay until the edge is written
+ * @return esp_err_t ESP_OK if the edge is pending, ESP_ERR_NOT_SUPPORTED without a detector, ESP_ERR_INVALID_STATE
+ *         if the output already has the level or the mains is not tracked: the caller writes the level itself
+ */
+esp_err_t relay_zc_schedule(int channel, int gpio_pin, uint32_t level, uint16_t offset_us, uint16_t latency_us, int64_t *delay_us) {
+    *delay_us = 0;
+
+    if (s_zc_timer == NULL || channel < 0 || channel > CHANNEL_COUNT_MAX) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    relay_zc_edge_t *edge = &s_zc_edges[channel];
+    edge->pending = false;
+
+    if (relay_zc_output_level(gpio_pin) == level) {
+        // nothing switches: no need to wait
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint64_t now;
+    gptimer_get_raw_count(s_zc_timer, &now);
+    portENTER_CRITICAL_SAFE(&s_zc_mux);
+    zc_tracker_t tracker = s_zc_tracker;
+    portEXIT_CRITICAL_SAFE(&s_zc_mux);
+
+    zc_plan_t plan;
+    if (!zc_tracker_plan(&tracker, (int64_t)now, offset_us, latency_us, RELAY_ZC_MARGIN_US, &plan)) {
+        s_zc_unaligned++;
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    edge->gpio_pin = gpio_pin;
+    edge->level = (uint8_t)level;
+    edge->phase_us = plan.phase_us;
+    edge->requested_us = (int64_t)now;
+    edge->earliest_us = (int64_t)now + RELAY_ZC_MARGIN_US;
+    edge->due_us = plan.drive_us;
+    edge->pending = true;
+
+    esp_err_t err = relay_zc_arm();
+    if (err != ESP_OK) {
+        edge->pending = false;
+        s_zc_unaligned++;
+        return err;
+    }
+
+    *delay_us = plan.delay_us;
+    return ESP_OK;
+}
+
+/**
+ * @brief: Check if an edge is pending for the channel. Caller holds the output lock.
+ *
+ * @param channel Actuator channel
+ * @param[out] level Level the edge is going to write
+ * @return true if an edge is pending
+ */
+bool relay_zc_pending(int channel, uint32_t *level) {
+    if (channel < 0 || channel > CHANNEL_COUNT_MAX || !s_zc_edges[channel].pending) {
+        return false;
+    }
+    *level = s_zc_edges[channel].level;
+    return true;
+}
+
+/**
+ * @brief: Drop the edge pending for the channel, if any. Caller holds the output lock.
+ *
+ * @param channel Actuator channel
+ * @return true if an edge was pending
+ */
+bool relay_zc_cancel(int channel) {
+    if (channel < 0 || channel > CHANNEL_COUNT_MAX || !s_zc_edges[channel].pending) {
+        return false;
+    }
+    // the alarm may still fire: it finds nothing to write and re-arms for the other edges
+    s_zc_edges[channel].pending = false;
+    return true;
+}
+
+/**
+ * @brief: Zero-cross switching information for the device status
+ *
+ * @return cJSON object, to be freed by the caller
+ */
+cJSON *relay_zc_to_JSON() {
+    cJSON *json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "gpio_pin", s_zc_pin);
+    if (s_zc_timer == NULL) {
+        cJSON_AddBoolToObject(json, "locked", false);
+        return json;
+    }
+
+    uint64_t now;
+    gptimer_get_raw_count(s_zc_timer, &now);
+    portENTER_CRITICAL(&s_zc_mux);
+    zc_tracker_t tracker = s_zc_tracker;
+    portEXIT_CRITICAL(&s_zc_mux);
+
+    portENTER_CRITICAL(s_outputs_mux);
+    uint32_t aligned = s_zc_aligned;
+    uint32_t unaligned = s_zc_unaligned;
+    int64_t delay_max_us = s_zc_delay_max_us;
+    int64_t late_max_us = s_zc_late_max_us;
+    portEXIT_CRITICAL(s_outputs_mux);
+
+    cJSON_AddBoolToObject(json, "locked", zc_tracker_locked(&tracker, (int64_t)now));
+    cJSON_AddNumberToObject(json, "mains_hz", (tracker.half_period_us != 0) ? 500000.0 / tracker.half_period_us : 0);
+    cJSON_AddNumberToObject(json, "half_cycle_us", tracker.half_period_us);
+    cJSON_AddNumberToObject(json, "crossings", tracker.crossings);
+    cJSON_AddNumberToObject(json, "rejected_edges", tracker.rejected);
+    cJSON_AddNumberToObject(json, "aligned", aligned);
+    cJSON_AddNumberToObject(json, "unaligned", unaligned);
+    cJSON_AddNumberToObject(json, "delay_max_us", (double)delay_max_us);
+    cJSON_AddNumberToObject(json, "delay_worst_case_us", zc_worst_case_delay_us(&tracker, RELAY_ZC_MARGIN_US));
+    cJSON_AddNumberToObject(json, "late_max_us", (double)late_max_us);
+    return json;
+}
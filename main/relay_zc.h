@@ -0,0 +1,47 @@
+/**
+ * @file relay_zc.h
+ * @brief Zero-cross synchronised switching of actuators driving AC loads
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * An optional zero-cross detector on relay_zc_pin timestamps mains crossings against a free-running
+ * 1 MHz gptimer. An output edge of an actuator with zero_cross set is not written right away but
+ * planned at its switching point after a crossing, minus the mechanical latency of the relay, and
+ * written by the gptimer alarm. Every crossing re-arms the alarm from the fresh timestamp, so the
+ * edge doesn't drift with the mains frequency. Edges are written under the output lock of the caller
+ * (the interlock critical section), so pending edges and direct writes never interleave.
+ */
+#ifndef RELAY_ZC_H
+#define RELAY_ZC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "cJSON.h"
+
+/** TYPES **/
+
+/**
+ * @brief: Called by the alarm ISR, with the output lock held, after pending edges were written
+ */
+typedef void (*relay_zc_written_cb_t)(void);
+
+/** SETTINGS AND CONSTANTS **/
+
+#define RELAY_ZC_TIMER_RESOLUTION_HZ    1000000 // gptimer ticks are microseconds
+#define RELAY_ZC_MARGIN_US              200     // Edges are never planned closer than this to now: time to arm the alarm
+#define RELAY_ZC_ALARM_SLACK_US         20      // Edges due within this time are written by the same alarm
+#define RELAY_ZC_ALARM_MIN_US           10      // Alarm is never set closer than this to the current count
+#define RELAY_ZC_PIN_UNKNOWN            (-2)    // Detector pin setting not read yet
+
+/** ROUTINES **/
+esp_err_t relay_zc_init(portMUX_TYPE *outputs_mux, relay_zc_written_cb_t outputs_written);
+int relay_zc_gpio_pin();
+esp_err_t relay_zc_config_reload();
+bool relay_zc_locked();
+esp_err_t relay_zc_schedule(int channel, int gpio_pin, uint32_t level, uint16_t offset_us, uint16_t latency_us, int64_t *delay_us);
+bool relay_zc_pending(int channel, uint32_t *level);
+bool relay_zc_cancel(int channel);
+cJSON *relay_zc_to_JSON();
+
+#endif // RELAY_ZC_H
@@ -0,0 +1,647 @@
+#include "freertos/FreeRTOS.h"   // must be first
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_crc.h"
+#include "nvs.h"
+#include "cJSON.h"
+
+#include "non_volatile_storage.h"
+
+#include "common.h"
+#include "settings.h"
+#include "relay.h"
+#include "latency.h"
+#include "rules.h"
+
+/* Rules table */
+// Slot per rule id. s_rules_by_sensor is the compiled lookup: contact sensor channel => mask of enabled rules
+// it triggers. Evaluation (gpio_event_task) and updates (HTTP API) meet under s_rules_mux, updates are
+// serialized and saved to NVS under s_rules_lock.
+static rule_record_t s_rules[RULES_MAX];
+static bool s_rules_present[RULES_MAX];
+static uint32_t s_rules_by_sensor[CONTACT_SENSORS_COUNT_MAX + 1];
+static portMUX_TYPE s_rules_mux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t s_rules_lock = NULL;
+
+/* Delayed actions */
+// One-shot timer per rule. The timer only posts GPIO_EVENT_RULE, the action itself runs in gpio_event_task()
+// with the sensor state captured when the rule was triggered. A new trigger restarts the delay.
+typedef struct {
+    esp_timer_handle_t timer;
+    relay_state_t trigger_state;    // Sensor state at the trigger
+    int64_t edge_us;                // Sensor edge time, origin for latency tracing
+} rule_pending_t;
+
+static rule_pending_t s_rules_pending[RULES_MAX];
+
+static const char *RULE_EDGE_NAMES[] = {"on", "off", "any"};
+static const char *RULE_ACTION_NAMES[] = {"off", "on", "toggle", "follow"};
+
+/**
+ * @brief: Rebuild sensor channel => rules lookup. Caller holds s_rules_mux.
+ */
+static void rules_compile() {
+    memset(s_rules_by_sensor, 0, sizeof(s_rules_by_sensor));
+    for (int id = 0; id < RULES_MAX; id++) {
+        if (!s_rules_present[id] || !(s_rules[id].flags & RULE_FLAG_ENABLED)) {
+            continue;
+        }
+        if (s_rules[id].trigger_channel <= CONTACT_SENSORS_COUNT_MAX) {
+            s_rules_by_sensor[s_rules[id].trigger_channel] |= 1UL << id;
+        }
+    }
+}
+
+/**
+ * @brief: Read rules table from NVS into RAM
+ *
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if there's no table
+ */
+static esp_err_t rules_read() {
+    nvs_handle_t handle;
+    esp_err_t err = esp32_nvs_open(S_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    size_t blob_size = 0;
+    err = nvs_get_blob(handle, S_KEY_RULES_TABLE, NULL, &blob_size);
+    if (err != ESP_OK) {
+        nvs_close(handle);
+        return err;
+    }
+
+    if (blob_size < sizeof(rules_table_header_t)) {
+        nvs_close(handle);
+        ESP_LOGE(TAG, "Rules table is too short (%u bytes)", (unsigned int)blob_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t *blob = malloc(blob_size);
+    if (blob == NULL) {
+        nvs_close(handle);
+        ESP_LOGE(TAG, "Failed to allocate memory for rules table");
+        return ESP_ERR_NO_MEM;
+    }
+
+    err = nvs_get_blob(handle, S_KEY_RULES_TABLE, blob, &blob_size);
+    nvs_close(handle);
+    if (err != ESP_OK) {
+        free(blob);
+        return err;
+    }
+
+    rules_table_header_t header;
+    memcpy(&header, blob, sizeof(header));
+    const uint8_t *records = blob + sizeof(header);
+    size_t records_size = (size_t)header.count * header.record_size;
+
+    if (header.magic != RULES_TABLE_MAGIC || header.version < 1 || header.record_size == 0
+        || sizeof(header) + records_size != blob_size) {
+        ESP_LOGE(TAG, "Rules table has unknown format (magic 0x%08x, version %u)", (unsigned int)header.magic, header.version);
+        free(blob);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    if (esp_crc32_le(0, records, records_size) != header.crc) {
+        ESP_LOGE(TAG, "Rules table CRC mismatch");
+        free(blob);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    // Records written by a newer version may be longer: read the known prefix, zero the rest
+    size_t copy_size = (header.record_size < sizeof(rule_record_t)) ? header.record_size : sizeof(rule_record_t);
+    memset(s_rules_present, 0, sizeof(s_rules_present));
+    for (int i = 0; i < header.count; i++) {
+        rule_record_t record = {0};
+        memcpy(&record, records + (size_t)i * header.record_size, copy_size);
+        if (record.id >= RULES_MAX) {
+            ESP_LOGW(TAG, "Skipping rules table record %d: id %u", i, record.id);
+            continue;
+        }
+        s_rules[record.id] = record;
+        s_rules_present[record.id] = true;
+    }
+
+    free(blob);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Write all rules to NVS. Caller holds s_rules_lock.
+ *
+ * @return esp_err_t result of the operation
+ */
+static esp_err_t rules_write() {
+    uint8_t blob[sizeof(rules_table_header_t) + RULES_MAX * sizeof(rule_record_t)];
+    rule_record_t *records = (rule_record_t *)(blob + sizeof(rules_table_header_t));
+    uint16_t count = 0;
+
+    portENTER_CRITICAL(&s_rules_mux);
+    for (int id = 0; id < RULES_MAX; id++) {
+        if (s_rules_present[id]) {
+            records[count++] = s_rules[id];
+        }
+    }
+    portEXIT_CRITICAL(&s_rules_mux);
+
+    rules_table_header_t header = {
+        .magic = RULES_TABLE_MAGIC,
+        .version = RULES_TABLE_VERSION,
+        .record_size = sizeof(rule_record_t),
+        .count = count,
+        .reserved = 0,
+        .crc = esp_crc32_le(0, (const uint8_t *)records, count * sizeof(rule_record_t))
+    };
+    memcpy(blob, &header, sizeof(header));
+    size_t blob_size = sizeof(header) + count * sizeof(rule_record_t);
+
+    nvs_handle_t handle;
+    esp_err_t err = esp32_nvs_open(S_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, S_KEY_RULES_TABLE, blob, blob_size);
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write rules table to NVS: %s", esp_err_to_name(err));
+    } else {
+        ESP_LOGI(TAG, "Rules table saved to NVS: %u rule(s)", count);
+    }
+    return err;
+}
+
+/**
+ * @brief: Delayed rule timer callback. Hands the rule over to gpio_event_task().
+ *
+ * @param arg Rule id
+ */
+static void rules_timer_cb(void *arg) {
+    if (gpio_event_post(GPIO_EVENT_RULE, (int)(intptr_t)arg) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to post delayed action of rule %d", (int)(intptr_t)arg);
+    }
+}
+
+/**
+ * @brief: Load rules from NVS, compile the lookup and create timers of delayed actions.
+ *         Relay units have to be in memory: rules refer to them by handle.
+ *
+ * @return esp_err_t result of the operation
+ */
+esp_err_t rules_init() {
+
+    if (s_rules_lock != NULL) {
+        // already initialized
+        return ESP_OK;
+    }
+
+    s_rules_lock = xSemaphoreCreateMutex();
+    if (s_rules_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create rules lock");
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int id = 0; id < RULES_MAX; id++) {
+        const esp_timer_create_args_t rule_timer_args = {
+            .callback = rules_timer_cb,
+            .arg = (void *)(intptr_t)id,
+            .name = "rule_delay"
+        };
+        esp_err_t err = esp_timer_create(&rule_timer_args, &s_rules_pending[id].timer);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create timer of rule %d: %s", id, esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    esp_err_t err = rules_read();
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(TAG, "No rules defined");
+    } else if (err != ESP_OK) {
+        // a broken table must not stop the device: start with no rules, the next update overwrites it
+        ESP_LOGE(TAG, "Unable to load rules table: %s. Rules are disabled.", esp_err_to_name(err));
+        memset(s_rules_present, 0, sizeof(s_rules_present));
+    }
+
+    portENTER_CRITICAL(&s_rules_mux);
+    rules_compile();
+    portEXIT_CRITICAL(&s_rules_mux);
+
+    int count = 0;
+    for (int id = 0; id < RULES_MAX; id++) {
+        count += s_rules_present[id] ? 1 : 0;
+    }
+    ESP_LOGI(TAG, "Loaded %d rule(s)", count);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Check the condition of the rule
+ *
+ * @param rule Pointer to the rule
+ * @return true if the rule has no condition or the condition unit is in the required state
+ */
+static bool rules_condition_met(const rule_record_t *rule) {
+    if (!(rule->flags & RULE_FLAG_CONDITION)) {
+        return true;
+    }
+
+    unit_handle_t unit = { .type = rule->cond_type, .index = rule->cond_channel };
+    relay_unit_t snapshot;
+    if (relay_unit_snapshot_by_handle(unit, &snapshot) != ESP_OK) {
+        return false;
+    }
+    return snapshot.state == (relay_state_t)rule->cond_state;
+}
+
+/**
+ * @brief: Apply the action of the rule to all its target actuators
+ *
+ * @param rule Pointer to the rule
+ * @param trigger_state State of the triggering sensor
+ * @param edge_us Sensor edge time, origin for latency tracing
+ */
+static void rules_apply(const rule_record_t *rule, relay_state_t trigger_state, int64_t edge_us) {
+    uint32_t targets = rule->target_mask;
+
+    while (targets != 0) {
+        int channel = __builtin_ctz(targets);
+        targets &= targets - 1;
+
+        relay_command_t command;
+        switch ((rule_action_t)rule->action) {
+            case RULE_ACTION_ON:
+                command = RELAY_COMMAND_ON;
+                break;
+            case RULE_ACTION_TOGGLE:
+                command = RELAY_COMMAND_TOGGLE;
+                break;
+            case RULE_ACTION_FOLLOW:
+                command = (trigger_state == RELAY_STATE_ON) ? RELAY_COMMAND_ON : RELAY_COMMAND_OFF;
+                break;
+            default:
+                command = RELAY_COMMAND_OFF;
+                break;
+        }
+
+        // the target is resolved when the rule fires, toggle reads its state within the same writer section
+        unit_handle_t unit = { .type = RELAY_TYPE_ACTUATOR, .index = (uint8_t)channel };
+        uint32_t pulse_ms = (rule->pulse_ms > 0) ? rule->pulse_ms : RELAY_PULSE_MS_UNIT;
+        relay_state_t state = RELAY_STATE_OFF;
+        esp_err_t err = relay_actuator_command(unit, command, pulse_ms, LATENCY_PATH_RULE, edge_us, &state);
+        if (err == ESP_ERR_NOT_FOUND) {
+            ESP_LOGW(TAG, "Rule %d: target actuator %d not found", rule->id, channel);
+            continue;
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Rule %d: failed to switch actuator %d", rule->id, channel);
+        } else {
+            ESP_LOGI(TAG, "Rule %d: actuator %d set to %d in %lld us since the sensor edge", rule->id, channel,
+                        (int)state, (long long)(esp_timer_get_time() - edge_us));
+        }
+    }
+}
+
+/**
+ * @brief: Run the rules triggered by the contact sensor. Called by gpio_event_task() once the new state is settled.
+ *
+ * @param sensor Pointer to the in-memory contact sensor with the new state
+ * @param edge_us ISR timestamp of the edge
+ */
+void rules_on_sensor_change(const relay_unit_t *sensor, int64_t edge_us) {
+    if (sensor->channel < 0 || sensor->channel > CONTACT_SENSORS_COUNT_MAX) {
+        return;
+    }
+
+    uint32_t rules = s_rules_by_sensor[sensor->channel];
+    relay_state_t trigger_state = sensor->state;
+
+    while (rules != 0) {
+        int id = __builtin_ctz(rules);
+        rules &= rules - 1;
+
+        // work on a copy: the rule may be updated from the HTTP API meanwhile
+        portENTER_CRITICAL(&s_rules_mux);
+        rule_record_t rule = s_rules[id];
+        bool active = s_rules_present[id] && (rule.flags & RULE_FLAG_ENABLED);
+        portEXIT_CRITICAL(&s_rules_mux);
+
+        if (!active) {
+            continue;
+        }
+        if (rule.trigger_edge == RULE_EDGE_ON && trigger_state != RELAY_STATE_ON) {
+            continue;
+        }
+        if (rule.trigger_edge == RULE_EDGE_OFF && trigger_state != RELAY_STATE_OFF) {
+            continue;
+        }
+        if (!rules_condition_met(&rule)) {
+            ESP_LOGD(TAG, "Rule %d: condition not met", id);
+            continue;
+        }
+
+        if (rule.delay_ms == 0) {
+            rules_apply(&rule, trigger_state, edge_us);
+            continue;
+        }
+
+        s_rules_pending[id].trigger_state = trigger_state;
+        s_rules_pending[id].edge_us = edge_us;
+        esp_timer_stop(s_rules_pending[id].timer);  // not running is fine
+        if (esp_timer_start_once(s_rules_pending[id].timer, (uint64_t)rule.delay_ms * 1000) != ESP_OK) {
+            ESP_LOGE(TAG, "Rule %d: failed to start delay timer", id);
+        }
+    }
+}
+
+/**
+ * @brief: Run the delayed action of the rule. Called by gpio_event_task() on GPIO_EVENT_RULE.
+ *
+ * @param id Rule id
+ */
+void rules_run_delayed(int id) {
+    if (id < 0 || id >= RULES_MAX) {
+        return;
+    }
+
+    portENTER_CRITICAL(&s_rules_mux);
+    rule_record_t rule = s_rules[id];
+    bool active = s_rules_present[id] && (rule.flags & RULE_FLAG_ENABLED);
+    portEXIT_CRITICAL(&s_rules_mux);
+
+    if (!active) {
+        return;
+    }
+    rules_apply(&rule, s_rules_pending[id].trigger_state, s_rules_pending[id].edge_us);
+}
+
+/**
+ * @brief: Create or replace the rule and save the rules table to NVS
+ *
+ * @param rule Pointer to the validated rule (see rule_from_JSON())
+ * @return esp_err_t result of the operation
+ */
+esp_err_t rules_put(const rule_record_t *rule) {
+    if (rule == NULL || rule->id >= RULES_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_rules_lock == NULL) {
+        ESP_LOGE(TAG, "Rules are not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_rules_lock, portMAX_DELAY);
+
+    esp_timer_stop(s_rules_pending[rule->id].timer);  // pending action of the old rule is dropped
+
+    portENTER_CRITICAL(&s_rules_mux);
+    s_rules[rule->id] = *rule;
+    s_rules_present[rule->id] = true;
+    rules_compile();
+    portEXIT_CRITICAL(&s_rules_mux);
+
+    esp_err_t err = rules_write();
+    xSemaphoreGive(s_rules_lock);
+    return err;
+}
+
+/**
+ * @brief: Delete the rule and save the rules table to NVS
+ *
+ * @param id Rule id
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND if there's no such rule
+ */
+esp_err_t rules_delete(int id) {
+    if (id < 0 || id >= RULES_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_rules_lock == NULL) {
+        ESP_LOGE(TAG, "Rules are not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_rules_lock, portMAX_DELAY);
+
+    if (!s_rules_present[id]) {
+        xSemaphoreGive(s_rules_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_timer_stop(s_rules_pending[id].timer);
+
+    portENTER_CRITICAL(&s_rules_mux);
+    s_rules_present[id] = false;
+    rules_compile();
+    portEXIT_CRITICAL(&s_rules_mux);
+
+    esp_err_t err = rules_write();
+    xSemaphoreGive(s_rules_lock);
+    return err;
+}
+
+/**
+ * @brief: Build the key of the unit referred by the rule
+ *
+ * @param type Relay type
+ * @param channel Channel of the unit
+ * @param[out] key Output buffer, at least NVS_KEY_NAME_MAX_SIZE long
+ */
+static void rules_unit_key(relay_type_t type, int channel, char *key) {
+    const char *prefix = (type == RELAY_TYPE_SENSOR) ? S_KEY_SN_PREFIX :
+                         (type == RELAY_TYPE_PULSE_COUNTER) ? S_KEY_PC_PREFIX : S_KEY_CH_PREFIX;
+    snprintf(key, NVS_KEY_NAME_MAX_SIZE, "%s%d", prefix, channel);
+}
+
+/**
+ * @brief: Look up a name in the list
+ *
+ * @return index of the name or -1 if not found
+ */
+static int rules_name_index(const char *name, const char **names, int count) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief: Serialize the rule into JSON. Units are referred to by their keys.
+ *
+ * @param rule Pointer to the rule
+ * @return cJSON object, to be freed by the caller
+ */
+cJSON *rule_to_JSON(const rule_record_t *rule) {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    cJSON *json = cJSON_CreateObject();
+
+    cJSON_AddNumberToObject(json, "id", rule->id);
+    cJSON_AddBoolToObject(json, "enabled", (rule->flags & RULE_FLAG_ENABLED) != 0);
+
+    cJSON *trigger = cJSON_AddObjectToObject(json, "trigger");
+    rules_unit_key(RELAY_TYPE_SENSOR, rule->trigger_channel, key);
+    cJSON_AddStringToObject(trigger, "relay_key", key);
+    cJSON_AddStringToObject(trigger, "edge", RULE_EDGE_NAMES[rule->trigger_edge <= RULE_EDGE_ANY ? rule->trigger_edge : RULE_EDGE_ANY]);
+
+    if (rule->flags & RULE_FLAG_CONDITION) {
+        cJSON *condition = cJSON_AddObjectToObject(json, "condition");
+        rules_unit_key((relay_type_t)rule->cond_type, rule->cond_channel, key);
+        cJSON_AddStringToObject(condition, "relay_key", key);
+        cJSON_AddBoolToObject(condition, "state", rule->cond_state == RELAY_STATE_ON);
+    }
+
+    cJSON *action = cJSON_AddObjectToObject(json, "action");
+    cJSON *targets = cJSON_AddArrayToObject(action, "relay_keys");
+    for (int channel = 0; channel <= CHANNEL_COUNT_MAX; channel++) {
+        if (rule->target_mask & (1U << channel)) {
+            rules_unit_key(RELAY_TYPE_ACTUATOR, channel, key);
+            cJSON_AddItemToArray(targets, cJSON_CreateString(key));
+        }
+    }
+    cJSON_AddStringToObject(action, "state", RULE_ACTION_NAMES[rule->action <= RULE_ACTION_FOLLOW ? rule->action : RULE_ACTION_OFF]);
+    cJSON_AddNumberToObject(action, "delay_ms", rule->delay_ms);
+    cJSON_AddNumberToObject(action, "pulse_ms", rule->pulse_ms);
+
+    return json;
+}
+
+/**
+ * @brief: Serialize all rules into JSON array
+ *
+ * @return cJSON array, to be freed by the caller
+ */
+cJSON *rules_to_JSON() {
+    cJSON *array = cJSON_CreateArray();
+
+    for (int id = 0; id < RULES_MAX; id++) {
+        portENTER_CRITICAL(&s_rules_mux);
+        bool present = s_rules_present[id];
+        rule_record_t rule = s_rules[id];
+        portEXIT_CRITICAL(&s_rules_mux);
+
+        if (present) {
+            cJSON_AddItemToArray(array, rule_to_JSON(&rule));
+        }
+    }
+    return array;
+}
+
+/**
+ * @brief: Parse and validate the rule from JSON
+ *
+ * Format: {"id": 0, "enabled": true,
+ *          "trigger": {"relay_key": "relay_sn_0", "edge": "on|off|any"},
+ *          "condition": {"relay_key": "relay_ch_1", "state": false},                              (optional)
+ *          "action": {"relay_keys": ["relay_ch_0"], "state": "on|off|toggle|follow", "delay_ms": 0, "pulse_ms": 0}}
+ *
+ * @param json Rule JSON object
+ * @param[out] rule Parsed rule
+ * @return esp_err_t ESP_OK if the rule is valid, ESP_ERR_INVALID_ARG otherwise
+ */
+esp_err_t rule_from_JSON(const cJSON *json, rule_record_t *rule) {
+    memset(rule, 0, sizeof(rule_record_t));
+    unit_handle_t unit;
+
+    cJSON *id = cJSON_GetObjectItem(json, "id");
+    if (!cJSON_IsNumber(id) || id->valueint < 0 || id->valueint >= RULES_MAX) {
+        ESP_LOGE(TAG, "Rule: missing or invalid 'id' (0 - %d)", RULES_MAX - 1);
+        return ESP_ERR_INVALID_ARG;
+    }
+    rule->id = (uint8_t)id->valueint;
+
+    cJSON *enabled = cJSON_GetObjectItem(json, "enabled");
+    if (enabled == NULL || cJSON_IsTrue(enabled)) {
+        rule->flags |= RULE_FLAG_ENABLED;
+    }
+
+    // trigger: contact sensor
+    cJSON *trigger = cJSON_GetObjectItem(json, "trigger");
+    cJSON *trigger_key = cJSON_GetObjectItem(trigger, "relay_key");
+    if (!cJSON_IsString(trigger_key) || get_unit_handle_from_key(trigger_key->valuestring, &unit) != ESP_OK
+        || unit.type != RELAY_TYPE_SENSOR) {
+        ESP_LOGE(TAG, "Rule %d: trigger has to be a contact sensor", rule->id);
+        return ESP_ERR_INVALID_ARG;
+    }
+    rule->trigger_channel = unit.index;
+
+    cJSON *edge = cJSON_GetObjectItem(trigger, "edge");
+    int edge_idx = RULE_EDGE_ANY;
+    if (edge != NULL) {
+        edge_idx = cJSON_IsString(edge) ? rules_name_index(edge->valuestring, RULE_EDGE_NAMES, RULE_EDGE_ANY + 1) : -1;
+        if (edge_idx < 0) {
+            ESP_LOGE(TAG, "Rule %d: invalid trigger edge", rule->id);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    rule->trigger_edge = (uint8_t)edge_idx;
+
+    // optional condition: actuator or sensor state
+    cJSON *condition = cJSON_GetObjectItem(json, "condition");
+    if (condition != NULL && !cJSON_IsNull(condition)) {
+        cJSON *cond_key = cJSON_GetObjectItem(condition, "relay_key");
+        cJSON *cond_state = cJSON_GetObjectItem(condition, "state");
+        if (!cJSON_IsString(cond_key) || get_unit_handle_from_key(cond_key->valuestring, &unit) != ESP_OK
+            || unit.type == RELAY_TYPE_PULSE_COUNTER || !cJSON_IsBool(cond_state)) {
+            ESP_LOGE(TAG, "Rule %d: condition needs an actuator or sensor 'relay_key' and boolean 'state'", rule->id);
+            return ESP_ERR_INVALID_ARG;
+        }
+        rule->flags |= RULE_FLAG_CONDITION;
+        rule->cond_type = unit.type;
+        rule->cond_channel = unit.index;
+        rule->cond_state = cJSON_IsTrue(cond_state) ? RELAY_STATE_ON : RELAY_STATE_OFF;
+    }
+
+    // action on actuators
+    cJSON *action = cJSON_GetObjectItem(json, "action");
+    cJSON *targets = cJSON_GetObjectItem(action, "relay_keys");
+    if (!cJSON_IsArray(targets) || cJSON_GetArraySize(targets) < 1) {
+        ESP_LOGE(TAG, "Rule %d: action needs a non-empty 'relay_keys' list", rule->id);
+        return ESP_ERR_INVALID_ARG;
+    }
+    cJSON *target;
+    cJSON_ArrayForEach(target, targets) {
+        if (!cJSON_IsString(target) || get_unit_handle_from_key(target->valuestring, &unit) != ESP_OK
+            || unit.type != RELAY_TYPE_ACTUATOR) {
+            ESP_LOGE(TAG, "Rule %d: action targets have to be actuators", rule->id);
+            return ESP_ERR_INVALID_ARG;
+        }
+        rule->target_mask |= (uint16_t)(1U << unit.index);
+    }
+
+    cJSON *state = cJSON_GetObjectItem(action, "state");
+    int action_idx = cJSON_IsString(state) ? rules_name_index(state->valuestring, RULE_ACTION_NAMES, RULE_ACTION_FOLLOW + 1) : -1;
+    if (action_idx < 0) {
+        ESP_LOGE(TAG, "Rule %d: invalid action state", rule->id);
+        return ESP_ERR_INVALID_ARG;
+    }
+    rule->action = (uint8_t)action_idx;
+
+    cJSON *delay_ms = cJSON_GetObjectItem(action, "delay_ms");
+    if (delay_ms != NULL) {
+        if (!cJSON_IsNumber(delay_ms) || delay_ms->valueint < 0 || delay_ms->valueint > RULE_DELAY_MS_MAX) {
+            ESP_LOGE(TAG, "Rule %d: invalid delay (0 - %d ms)", rule->id, RULE_DELAY_MS_MAX);
+            return ESP_ERR_INVALID_ARG;
+        }
+        rule->delay_ms = (uint16_t)delay_ms->valueint;
+    }
+
+    cJSON *pulse_ms = cJSON_GetObjectItem(action, "pulse_ms");
+    if (pulse_ms != NULL) {
+        if (!cJSON_IsNumber(pulse_ms) || pulse_ms->valueint < 0 || pulse_ms->valueint > RELAY_PULSE_MS_MAX) {
+            ESP_LOGE(TAG, "Rule %d: invalid pulse width (0 - %d ms)", rule->id, RELAY_PULSE_MS_MAX);
+            return ESP_ERR_INVALID_ARG;
+        }
+        rule->pulse_ms = (uint16_t)pulse_ms->valueint;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file rules.h
+ * @brief On-device rules: contact sensor changes switching actuators without the MQTT round trip
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * Rules are kept in a small table stored in NVS under a single key. Every contact sensor channel
+ * has a precompiled mask of the rules it triggers, so gpio_event_task() finds the rules of a
+ * settled sensor with one array access and runs their actions right away, before the new sensor
+ * state is saved or published. Delayed actions are fired by a one-shot timer per rule and are
+ * executed by gpio_event_task() as well.
+ */
+#ifndef RULES_H
+#define RULES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "cJSON.h"
+
+#include "relay.h"
+
+/** TYPES **/
+
+/**
+ * @brief: Sensor change that triggers the rule
+ */
+typedef enum {
+    RULE_EDGE_ON,               // Sensor state changed to ON (contact closed, after inversion)
+    RULE_EDGE_OFF,              // Sensor state changed to OFF
+    RULE_EDGE_ANY               // Any change
+} rule_edge_t;
+
+/**
+ * @brief: Action applied to the target actuators
+ */
+typedef enum {
+    RULE_ACTION_OFF,            // Switch OFF
+    RULE_ACTION_ON,             // Switch ON (for pulse_ms if set)
+    RULE_ACTION_TOGGLE,         // Flip the current state
+    RULE_ACTION_FOLLOW          // Take the state of the triggering sensor
+} rule_action_t;
+
+/**
+ * @brief: Packed rule record, as stored in NVS
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t id;                 // Slot of the rule, 0 - RULES_MAX-1
+    uint8_t flags;              // RULE_FLAG_*
+    uint8_t trigger_channel;    // Contact sensor channel
+    uint8_t trigger_edge;       // rule_edge_t
+    uint8_t cond_type;          // relay_type_t of the condition unit (if RULE_FLAG_CONDITION)
+    uint8_t cond_channel;       // Channel of the condition unit
+    uint8_t cond_state;         // relay_state_t the condition unit has to be in
+    uint8_t action;             // rule_action_t
+    uint16_t target_mask;       // Target actuators, bit per channel
+    uint16_t delay_ms;          // Delay of the action, 0 means immediate
+    uint16_t pulse_ms;          // ON action: switch back OFF after this time. 0 means the target's own pulse_ms.
+} rule_record_t;
+
+/**
+ * @brief: Rules table header. Followed by 'count' records of 'record_size' bytes each.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;             // RULES_TABLE_MAGIC
+    uint16_t version;
+    uint16_t record_size;
+    uint16_t count;
+    uint16_t reserved;
+    uint32_t crc;               // CRC32 of all records
+} rules_table_header_t;
+
+/** SETTINGS AND CONSTANTS **/
+
+#define RULES_MAX               16
+#define RULE_DELAY_MS_MAX       60000
+
+#define RULES_TABLE_MAGIC       0x454C5552  // "RULE"
+#define RULES_TABLE_VERSION     1
+
+#define RULE_FLAG_ENABLED       (1 << 0)
+#define RULE_FLAG_CONDITION     (1 << 1)
+
+/** ROUTINES **/
+esp_err_t rules_init();
+void rules_on_sensor_change(const relay_unit_t *sensor, int64_t edge_us);
+void rules_run_delayed(int id);
+
+esp_err_t rules_put(const rule_record_t *rule);
+esp_err_t rules_delete(int id);
+
+cJSON *rule_to_JSON(const rule_record_t *rule);
+cJSON *rules_to_JSON();
+esp_err_t rule_from_JSON(const cJSON *json, rule_record_t *rule);
+
+#endif // RULES_H
@@ -0,0 +1,111 @@
+#include "scan.h"
+
+/**
+ * @brief: Compare bit-sliced per-pin counts against a constant
+ *
+ * @param count Bit-sliced counts, count[0] is LSB
+ * @param k Constant to compare with
+ * @return mask of pins whose count is greater than or equal to k
+ */
+static uint64_t scan_count_ge(const uint64_t count[SCAN_COUNT_BITS], unsigned k) {
+    // borrow out of (count - k) computed for all pins at once: no borrow means count >= k
+    uint64_t borrow = 0;
+    for (int i = 0; i < SCAN_COUNT_BITS; i++) {
+        if ((k >> i) & 1U) {
+            borrow = ~count[i] | borrow;
+        } else {
+            borrow = ~count[i] & borrow;
+        }
+    }
+    return ~borrow;
+}
+
+/**
+ * @brief: Initialize the filter with the current levels of the pins. No pins are scanned until added with scan_filter_set_pin().
+ *
+ * @param f Pointer to the filter state
+ * @param m Samples in the window (SCAN_FILTER_M_MIN - SCAN_FILTER_M_MAX)
+ * @param sample Current raw levels of the pins, one bit per pin
+ * @return false if m is out of range
+ */
+bool scan_filter_init(scan_filter_t *f, uint8_t m, uint64_t sample) {
+    if (m < SCAN_FILTER_M_MIN || m > SCAN_FILTER_M_MAX) {
+        return false;
+    }
+
+    f->m = m;
+    f->n = m / 2 + 1;
+    f->head = 0;
+    f->mask = 0;
+    f->state = sample;
+    for (int i = 0; i < SCAN_FILTER_M_MAX; i++) {
+        f->history[i] = sample;
+    }
+    // pins that are high have seen m ones so far, low ones have seen none
+    for (int i = 0; i < SCAN_COUNT_BITS; i++) {
+        f->count[i] = ((m >> i) & 1U) ? sample : 0;
+    }
+    return true;
+}
+
+/**
+ * @brief: Add the pin to or remove it from the scan and reset its filter to the given level
+ *
+ * @param f Pointer to the filter state
+ * @param bit Bit of the pin in the sample word (GPIO number)
+ * @param scanned true to report changes of the pin, false to stop
+ * @param level Current level of the pin
+ */
+void scan_filter_set_pin(scan_filter_t *f, int bit, bool scanned, int level) {
+    if (bit < 0 || bit > 63) {
+        return;
+    }
+
+    uint64_t b = 1ULL << bit;
+    uint64_t v = level ? b : 0;
+
+    f->mask = scanned ? (f->mask | b) : (f->mask & ~b);
+    f->state = (f->state & ~b) | v;
+    for (int i = 0; i < SCAN_FILTER_M_MAX; i++) {
+        f->history[i] = (f->history[i] & ~b) | v;
+    }
+    for (int i = 0; i < SCAN_COUNT_BITS; i++) {
+        f->count[i] = (f->count[i] & ~b) | (((f->m >> i) & 1U) ? v : 0);
+    }
+}
+
+/**
+ * @brief: Feed the next sample of all pins into the filter
+ *
+ * @param f Pointer to the filter state
+ * @param sample Raw levels of the pins, one bit per pin
+ * @return mask of scanned pins whose filtered level flipped. New levels are in f->state.
+ */
+uint64_t scan_filter_update(scan_filter_t *f, uint64_t sample) {
+    uint64_t oldest = f->history[f->head];
+    f->history[f->head] = sample;
+    f->head = (uint8_t)((f->head + 1) % f->m);
+
+    // count += sample entering the window, count -= sample leaving it. Ripple carry / borrow over the bit slices.
+    uint64_t carry = sample & ~oldest;
+    uint64_t borrow = oldest & ~sample;
+    for (int i = 0; i < SCAN_COUNT_BITS; i++) {
+        uint64_t c = f->count[i] & carry;
+        f->count[i] ^= carry;
+        carry = c;
+    }
+    for (int i = 0; i < SCAN_COUNT_BITS; i++) {
+        uint64_t b = ~f->count[i] & borrow;
+        f->count[i] ^= borrow;
+        borrow = b;
+    }
+
+    // N ones => 1, N zeros (i.e. at most M - N ones) => 0, otherwise keep the level
+    uint64_t rise = scan_count_ge(f->count, f->n);
+    uint64_t fall = ~scan_count_ge(f->count, (unsigned)(f->m - f->n + 1));
+    uint64_t state = (f->state | rise) & ~fall;
+
+    uint64_t changed = (state ^ f->state) & f->mask;
+    f->state = state;
+    return changed;
+}
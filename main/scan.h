@@ -0,0 +1,45 @@
+/**
+ * @file scan.h
+ * @brief Bit-parallel N-of-M input filter for periodic scanning of many input pins at once
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * The core is plain C with no ESP-IDF dependencies: the caller reads the GPIO input register(s)
+ * once per tick and passes the whole word in, one bit per pin. Every pin keeps the count of
+ * ones among its last M samples in a vertical (bit-sliced) counter, so a tick costs the same
+ * handful of word operations whether 1 or 64 pins are scanned. A pin flips to 1 once N of the
+ * last M samples are 1 and back to 0 once N of them are 0. N is the strict majority of M, so
+ * both thresholds never hold at the same time and shorter bursts are ignored.
+ */
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** SETTINGS AND CONSTANTS **/
+
+#define SCAN_FILTER_M_MIN       1
+#define SCAN_FILTER_M_MAX       15      // fits SCAN_COUNT_BITS-bit per-pin counters
+#define SCAN_COUNT_BITS         4
+
+/** TYPES **/
+
+/**
+ * @brief: Filter state of up to 64 input pins
+ */
+typedef struct {
+    uint64_t mask;                          // Pins being scanned. Other bits are never reported.
+    uint64_t state;                         // Filtered level of every pin
+    uint64_t history[SCAN_FILTER_M_MAX];    // Last M raw samples, ring buffer
+    uint64_t count[SCAN_COUNT_BITS];        // Bit-sliced count of ones in history per pin, count[0] is LSB
+    uint8_t head;                           // Index of the oldest sample in history
+    uint8_t m;                              // Samples in the window
+    uint8_t n;                              // Samples needed to flip the state: m / 2 + 1
+} scan_filter_t;
+
+/** ROUTINES **/
+bool scan_filter_init(scan_filter_t *f, uint8_t m, uint64_t sample);
+void scan_filter_set_pin(scan_filter_t *f, int bit, bool scanned, int level);
+uint64_t scan_filter_update(scan_filter_t *f, uint64_t sample);
+
+#endif // SCAN_H
@@ -0,0 +1,745 @@
+#include "freertos/FreeRTOS.h"   // must be first
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_crc.h"
+#include "nvs.h"
+#include "cJSON.h"
+
+#include "non_volatile_storage.h"
+
+#include "common.h"
+#include "flags.h"
+#include "settings.h"
+#include "relay.h"
+#include "latency.h"
+#include "timer_wheel.h"
+#include "time_sync.h"
+#include "schedule.h"
+
+/* Schedules table */
+// Slot per schedule id, each with its wheel entry. The table, the wheel and the NVS copy are updated
+// under s_schedules_lock, by the HTTP API and by the schedule task.
+static schedule_record_t s_schedules[SCHEDULES_MAX];
+static bool s_schedules_present[SCHEDULES_MAX];
+static SemaphoreHandle_t s_schedules_lock = NULL;
+
+/* Timer wheel */
+// Ticks are seconds of the wall clock. The wheel is built once the clock is synchronized and rebuilt
+// when the clock moves back.
+static timer_wheel_t s_wheel;
+static timer_wheel_entry_t s_schedule_timers[SCHEDULES_MAX];
+static bool s_wheel_ready = false;
+static TaskHandle_t s_schedule_task = NULL;
+
+#define SCHEDULE_SLEEP_MS_MAX   3600000     // Keeps the tick conversion in range, the wheel needs no wake-ups
+
+static const char *SCHEDULE_ACTION_NAMES[] = {"off", "on", "toggle"};
+
+static const char *SCHEDULE_CRON_MACROS[][2] = {
+    {"@yearly",   "0 0 1 1 *"},
+    {"@annually", "0 0 1 1 *"},
+    {"@monthly",  "0 0 1 * *"},
+    {"@weekly",   "0 0 * * 0"},
+    {"@daily",    "0 0 * * *"},
+    {"@midnight", "0 0 * * *"},
+    {"@hourly",   "0 * * * *"},
+};
+
+/**
+ * @brief: Read schedule table from NVS into RAM
+ *
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NVS_NOT_FOUND if there's no table
+ */
+static esp_err_t schedule_read() {
+    nvs_handle_t handle;
+    esp_err_t err = esp32_nvs_open(S_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    size_t blob_size = 0;
+    err = nvs_get_blob(handle, S_KEY_SCHEDULE_TABLE, NULL, &blob_size);
+    if (err != ESP_OK) {
+        nvs_close(handle);
+        return err;
+    }
+
+    if (blob_size < sizeof(schedule_table_header_t)) {
+        nvs_close(handle);
+        ESP_LOGE(TAG, "Schedule table is too short (%u bytes)", (unsigned int)blob_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t *blob = malloc(blob_size);
+    if (blob == NULL) {
+        nvs_close(handle);
+        ESP_LOGE(TAG, "Failed to allocate memory for schedule table");
+        return ESP_ERR_NO_MEM;
+    }
+
+    err = nvs_get_blob(handle, S_KEY_SCHEDULE_TABLE, blob, &blob_size);
+    nvs_close(handle);
+    if (err != ESP_OK) {
+        free(blob);
+        return err;
+    }
+
+    schedule_table_header_t header;
+    memcpy(&header, blob, sizeof(header));
+    const uint8_t *records = blob + sizeof(header);
+    size_t records_size = (size_t)header.count * header.record_size;
+
+    if (header.magic != SCHEDULE_TABLE_MAGIC || header.version < 1 || header.record_size == 0
+        || sizeof(header) + records_size != blob_size) {
+        ESP_LOGE(TAG, "Schedule table has unknown format (magic 0x%08x, version %u)", (unsigned int)header.magic, header.version);
+        free(blob);
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    if (esp_crc32_le(0, records, records_size) != header.crc) {
+        ESP_LOGE(TAG, "Schedule table CRC mismatch");
+        free(blob);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    // Records written by a newer version may be longer: read the known prefix, zero the rest
+    size_t copy_size = (header.record_size < sizeof(schedule_record_t)) ? header.record_size : sizeof(schedule_record_t);
+    memset(s_schedules_present, 0, sizeof(s_schedules_present));
+    for (int i = 0; i < header.count; i++) {
+        schedule_record_t record = {0};
+        memcpy(&record, records + (size_t)i * header.record_size, copy_size);
+        if (record.id >= SCHEDULES_MAX) {
+            ESP_LOGW(TAG, "Skipping schedule table record %d: id %u", i, record.id);
+            continue;
+        }
+        record.cron[SCHEDULE_CRON_LENGTH - 1] = '\0';
+        s_schedules[record.id] = record;
+        s_schedules_present[record.id] = true;
+    }
+
+    free(blob);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Write all schedules to NVS. Caller holds s_schedules_lock.
+ *
+ * @return esp_err_t result of the operation
+ */
+static esp_err_t schedule_write() {
+    size_t blob_cap = sizeof(schedule_table_header_t) + SCHEDULES_MAX * sizeof(schedule_record_t);
+    uint8_t *blob = malloc(blob_cap);
+    if (blob == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate memory for schedule table");
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint8_t *records = blob + sizeof(schedule_table_header_t);
+    uint16_t count = 0;
+    for (int id = 0; id < SCHEDULES_MAX; id++) {
+        if (s_schedules_present[id]) {
+            memcpy(records + (size_t)count * sizeof(schedule_record_t), &s_schedules[id], sizeof(schedule_record_t));
+            count++;
+        }
+    }
+
+    schedule_table_header_t header = {
+        .magic = SCHEDULE_TABLE_MAGIC,
+        .version = SCHEDULE_TABLE_VERSION,
+        .record_size = sizeof(schedule_record_t),
+        .count = count,
+        .reserved = 0,
+        .crc = esp_crc32_le(0, records, count * sizeof(schedule_record_t))
+    };
+    memcpy(blob, &header, sizeof(header));
+    size_t blob_size = sizeof(header) + count * sizeof(schedule_record_t);
+
+    nvs_handle_t handle;
+    esp_err_t err = esp32_nvs_open(S_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, S_KEY_SCHEDULE_TABLE, blob, blob_size);
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    free(blob);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write schedule table to NVS: %s", esp_err_to_name(err));
+    } else {
+        ESP_LOGI(TAG, "Schedule table saved to NVS: %u schedule(s)", count);
+    }
+    return err;
+}
+
+/**
+ * @brief: Check the day against day of month and day of week fields. As in cron, a day matches
+ *         either of them when both are restricted.
+ */
+static bool schedule_day_matches(const schedule_record_t *schedule, const struct tm *tm) {
+    bool dom = (schedule->days >> tm->tm_mday) & 1;
+    bool dow = (schedule->weekdays >> tm->tm_wday) & 1;
+
+    if (schedule->cron_flags & SCHEDULE_CRON_DOM_ANY) {
+        return dow;
+    }
+    if (schedule->cron_flags & SCHEDULE_CRON_DOW_ANY) {
+        return dom;
+    }
+    return dom || dow;
+}
+
+/**
+ * @brief: Find the next run of the schedule in local time. Non-matching months, days and hours are
+ *         skipped as a whole, so the search takes a few dozen steps at most for real expressions.
+ *
+ * @param schedule Pointer to the schedule
+ * @param after Time to search from: the run is strictly after it
+ * @return time_t the next run, -1 if there's none within the search bound
+ */
+time_t schedule_next_run(const schedule_record_t *schedule, time_t after) {
+    time_t t = after - (after % 60) + 60;
+    struct tm tm;
+    localtime_r(&t, &tm);
+
+    for (int step = 0; step < SCHEDULE_SEARCH_STEPS_MAX; step++) {
+        if (!(schedule->months & (1U << (tm.tm_mon + 1)))) {
+            tm.tm_mon++;
+            tm.tm_mday = 1;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+        } else if (!schedule_day_matches(schedule, &tm)) {
+            tm.tm_mday++;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+        } else if (!(schedule->hours & (1UL << tm.tm_hour))) {
+            tm.tm_hour++;
+            tm.tm_min = 0;
+        } else if (!(schedule->minutes & (1ULL << tm.tm_min))) {
+            tm.tm_min++;
+        } else {
+            return t;
+        }
+
+        // let mktime() normalize the overflowing field and resolve DST
+        tm.tm_sec = 0;
+        tm.tm_isdst = -1;
+        t = mktime(&tm);
+        localtime_r(&t, &tm);
+    }
+    return (time_t)-1;
+}
+
+/**
+ * @brief: Put the next run of the schedule into the wheel, or take it out if the schedule is
+ *         disabled or deleted. Caller holds s_schedules_lock.
+ *
+ * @param id Schedule id
+ * @param now Current time: the next run is strictly after it
+ */
+static void schedule_arm(int id, time_t now) {
+    if (!s_wheel_ready) {
+        return;
+    }
+    if (!s_schedules_present[id] || !(s_schedules[id].flags & SCHEDULE_FLAG_ENABLED)) {
+        timer_wheel_del(&s_wheel, &s_schedule_timers[id]);
+        return;
+    }
+
+    time_t next = schedule_next_run(&s_schedules[id], now);
+    if (next < 0 || next > (time_t)UINT32_MAX - 1) {
+        ESP_LOGW(TAG, "Schedule %d: '%s' never runs", id, s_schedules[id].cron);
+        timer_wheel_del(&s_wheel, &s_schedule_timers[id]);
+        return;
+    }
+    timer_wheel_add(&s_wheel, &s_schedule_timers[id], (uint32_t)next);
+}
+
+/**
+ * @brief: Build the wheel from scratch. Caller holds s_schedules_lock.
+ *
+ * @param now Current time
+ */
+static void schedule_rebuild(time_t now) {
+    timer_wheel_init(&s_wheel, (uint32_t)now);
+    memset(s_schedule_timers, 0, sizeof(s_schedule_timers));
+    s_wheel_ready = true;
+
+    for (int id = 0; id < SCHEDULES_MAX; id++) {
+        schedule_arm(id, now);
+    }
+    ESP_LOGI(TAG, "Schedules armed: %u", (unsigned int)s_wheel.count);
+}
+
+/**
+ * @brief: Apply the action of the schedule to its actuator
+ *
+ * @param schedule Pointer to the schedule
+ */
+static void schedule_apply(const schedule_record_t *schedule) {
+    relay_command_t command;
+    switch ((schedule_action_t)schedule->action) {
+        case SCHEDULE_ACTION_ON:
+            command = RELAY_COMMAND_ON;
+            break;
+        case SCHEDULE_ACTION_TOGGLE:
+            command = RELAY_COMMAND_TOGGLE;
+            break;
+        default:
+            command = RELAY_COMMAND_OFF;
+            break;
+    }
+
+    // the actuator is resolved when the schedule fires, toggle reads its state within the same writer section
+    unit_handle_t unit = { .type = RELAY_TYPE_ACTUATOR, .index = (uint8_t)schedule->channel };
+    uint32_t pulse_ms = (schedule->pulse_ms > 0) ? schedule->pulse_ms : RELAY_PULSE_MS_UNIT;
+    relay_state_t state = RELAY_STATE_OFF;
+    esp_err_t err = relay_actuator_command(unit, command, pulse_ms, LATENCY_PATH_NONE, 0, &state);
+    if (err == ESP_ERR_NOT_FOUND) {
+        ESP_LOGW(TAG, "Schedule %d: actuator %d not found", schedule->id, schedule->channel);
+        return;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Schedule %d: failed to switch actuator %d", schedule->id, schedule->channel);
+    } else {
+        ESP_LOGI(TAG, "Schedule %d: actuator %d set to %d", schedule->id, schedule->channel, (int)state);
+    }
+}
+
+/**
+ * @brief: Schedule task. Waits for the clock to be synchronized, then sleeps until the next tick of
+ *         the wheel, runs the expired schedules and re-arms them. Table updates and SNTP
+ *         synchronizations wake it up through the task notification.
+ *
+ * @param arg Unused
+ */
+static void schedule_task(void *arg) {
+    xEventGroupWaitBits(g_sys_events, BIT_TIME_SYNCED, pdFALSE, pdTRUE, portMAX_DELAY);
+    ESP_LOGI(TAG, "Clock is synchronized, starting schedules");
+
+    while (true) {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        uint32_t due = 0;
+
+        xSemaphoreTake(s_schedules_lock, portMAX_DELAY);
+        if (!s_wheel_ready || (uint32_t)tv.tv_sec < s_wheel.now) {
+            if (s_wheel_ready) {
+                ESP_LOGW(TAG, "Clock moved back by %lu s, rescheduling", (unsigned long)(s_wheel.now - (uint32_t)tv.tv_sec));
+            }
+            schedule_rebuild(tv.tv_sec);
+        } else {
+            timer_wheel_entry_t *expired = timer_wheel_advance(&s_wheel, (uint32_t)tv.tv_sec);
+            while (expired != NULL) {
+                timer_wheel_entry_t *next = expired->next;
+                int id = (int)(expired - s_schedule_timers);
+                due |= 1UL << id;
+                schedule_arm(id, tv.tv_sec);
+                expired = next;
+            }
+        }
+        uint32_t next_tick = timer_wheel_next_tick(&s_wheel);
+        xSemaphoreGive(s_schedules_lock);
+
+        while (due != 0) {
+            int id = __builtin_ctz(due);
+            due &= due - 1;
+
+            // work on a copy: the schedule may be updated from the HTTP API meanwhile
+            xSemaphoreTake(s_schedules_lock, portMAX_DELAY);
+            schedule_record_t schedule = s_schedules[id];
+            bool active = s_schedules_present[id] && (schedule.flags & SCHEDULE_FLAG_ENABLED);
+            xSemaphoreGive(s_schedules_lock);
+
+            if (active) {
+                schedule_apply(&schedule);
+            }
+        }
+
+        TickType_t wait = portMAX_DELAY;
+        if (next_tick != TIMER_WHEEL_NO_DEADLINE) {
+            gettimeofday(&tv, NULL);
+            int64_t wait_ms = ((int64_t)next_tick - tv.tv_sec) * 1000 - tv.tv_usec / 1000;
+            if (wait_ms < 0) {
+                wait_ms = 0;
+            } else if (wait_ms > SCHEDULE_SLEEP_MS_MAX) {
+                wait_ms = SCHEDULE_SLEEP_MS_MAX;
+            }
+            // one tick more, so the wake-up is not rounded down to the end of the previous second
+            wait = pdMS_TO_TICKS((uint32_t)wait_ms) + 1;
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+/**
+ * @brief: Load schedules from NVS and start the schedule task. Relay units have to be in memory:
+ *         schedules refer to them by handle.
+ *
+ * @return esp_err_t result of the operation
+ */
+esp_err_t schedule_init() {
+
+    if (s_schedules_lock != NULL) {
+        // already initialized
+        return ESP_OK;
+    }
+
+    s_schedules_lock = xSemaphoreCreateMutex();
+    if (s_schedules_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create schedules lock");
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = schedule_read();
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(TAG, "No schedules defined");
+    } else if (err != ESP_OK) {
+        // a broken table must not stop the device: start with no schedules, the next update overwrites it
+        ESP_LOGE(TAG, "Unable to load schedule table: %s. Schedules are disabled.", esp_err_to_name(err));
+        memset(s_schedules_present, 0, sizeof(s_schedules_present));
+    }
+
+    int count = 0;
+    for (int id = 0; id < SCHEDULES_MAX; id++) {
+        count += s_schedules_present[id] ? 1 : 0;
+    }
+    ESP_LOGI(TAG, "Loaded %d schedule(s)", count);
+
+    if (xTaskCreate(schedule_task, "schedule_task", 4096, NULL, 5, &s_schedule_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create schedule task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief: Wake up the schedule task to re-read the clock and the wheel
+ */
+void schedule_notify() {
+    if (s_schedule_task != NULL) {
+        xTaskNotifyGive(s_schedule_task);
+    }
+}
+
+/**
+ * @brief: Create or replace the schedule and save the schedule table to NVS
+ *
+ * @param schedule Pointer to the validated schedule (see schedule_from_JSON())
+ * @return esp_err_t result of the operation
+ */
+esp_err_t schedule_put(const schedule_record_t *schedule) {
+    if (schedule == NULL || schedule->id >= SCHEDULES_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_schedules_lock == NULL) {
+        ESP_LOGE(TAG, "Schedules are not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_schedules_lock, portMAX_DELAY);
+    s_schedules[schedule->id] = *schedule;
+    s_schedules_present[schedule->id] = true;
+    schedule_arm(schedule->id, time(NULL));
+    esp_err_t err = schedule_write();
+    xSemaphoreGive(s_schedules_lock);
+
+    // the new run may be earlier than the one the task sleeps until
+    schedule_notify();
+    return err;
+}
+
+/**
+ * @brief: Delete the schedule and save the schedule table to NVS
+ *
+ * @param id Schedule id
+ * @return esp_err_t ESP_OK on success, ESP_ERR_NOT_FOUND if there's no such schedule
+ */
+esp_err_t schedule_delete(int id) {
+    if (id < 0 || id >= SCHEDULES_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_schedules_lock == NULL) {
+        ESP_LOGE(TAG, "Schedules are not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(s_schedules_lock, portMAX_DELAY);
+
+    if (!s_schedules_present[id]) {
+        xSemaphoreGive(s_schedules_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    s_schedules_present[id] = false;
+    schedule_arm(id, time(NULL));
+    esp_err_t err = schedule_write();
+    xSemaphoreGive(s_schedules_lock);
+    return err;
+}
+
+/**
+ * @brief: Parse a number of the cron field
+ *
+ * @return true if the whole string is a decimal number
+ */
+static bool schedule_parse_number(const char *str, int *value) {
+    char *end = NULL;
+    long v = strtol(str, &end, 10);
+    if (end == str || *end != '\0' || v < 0 || v > 255) {
+        return false;
+    }
+    *value = (int)v;
+    return true;
+}
+
+/**
+ * @brief: Parse one cron field: '*', 'N', 'N-M', any of them with '/step', and comma separated lists
+ *
+ * @param field Field text, modified while parsing
+ * @param min Lowest allowed value
+ * @param max Highest allowed value
+ * @param[out] mask Bit per matching value
+ * @return esp_err_t ESP_OK if the field is valid, ESP_ERR_INVALID_ARG otherwise
+ */
+static esp_err_t schedule_parse_field(char *field, int min, int max, uint64_t *mask) {
+    *mask = 0;
+    char *save = NULL;
+
+    for (char *item = strtok_r(field, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        int lo, hi, step = 1;
+
+        char *slash = strchr(item, '/');
+        if (slash != NULL) {
+            *slash = '\0';
+            if (!schedule_parse_number(slash + 1, &step) || step < 1) {
+                return ESP_ERR_INVALID_ARG;
+            }
+        }
+
+        if (strcmp(item, "*") == 0) {
+            lo = min;
+            hi = max;
+        } else {
+            char *dash = strchr(item, '-');
+            if (dash != NULL) {
+                *dash = '\0';
+                if (!schedule_parse_number(item, &lo) || !schedule_parse_number(dash + 1, &hi)) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+            } else {
+                if (!schedule_parse_number(item, &lo)) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+                hi = (slash != NULL) ? max : lo;    // 'N/step' runs from N to the end of the range
+            }
+        }
+
+        if (lo < min || hi > max || lo > hi) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        for (int v = lo; v <= hi; v += step) {
+            *mask |= 1ULL << v;
+        }
+    }
+
+    return (*mask != 0) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+/**
+ * @brief: Parse the cron expression into the bitmasks of the schedule
+ *
+ * Format: "minute hour day-of-month month day-of-week", e.g. "30 7 * * 1-5", or one of @yearly,
+ * @monthly, @weekly, @daily, @hourly. Day of week is 0-7, both 0 and 7 are Sunday.
+ *
+ * @param cron Cron expression
+ * @param[out] schedule Schedule to fill in: bitmasks, cron flags and the source expression
+ * @return esp_err_t ESP_OK if the expression is valid, ESP_ERR_INVALID_ARG otherwise
+ */
+esp_err_t schedule_parse_cron(const char *cron, schedule_record_t *schedule) {
+    if (cron == NULL || strlen(cron) == 0 || strlen(cron) >= SCHEDULE_CRON_LENGTH) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const char *expr = cron;
+    for (int i = 0; i < sizeof(SCHEDULE_CRON_MACROS) / sizeof(SCHEDULE_CRON_MACROS[0]); i++) {
+        if (strcmp(cron, SCHEDULE_CRON_MACROS[i][0]) == 0) {
+            expr = SCHEDULE_CRON_MACROS[i][1];
+            break;
+        }
+    }
+
+    char buf[SCHEDULE_CRON_LENGTH];
+    strncpy(buf, expr, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *fields[5];
+    int count = 0;
+    char *save = NULL;
+    for (char *field = strtok_r(buf, " \t", &save); field != NULL; field = strtok_r(NULL, " \t", &save)) {
+        if (count == 5) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        fields[count++] = field;
+    }
+    if (count != 5) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t cron_flags = 0;
+    cron_flags |= (fields[2][0] == '*') ? SCHEDULE_CRON_DOM_ANY : 0;
+    cron_flags |= (fields[4][0] == '*') ? SCHEDULE_CRON_DOW_ANY : 0;
+
+    uint64_t minutes, hours, days, months, weekdays;
+    if (schedule_parse_field(fields[0], 0, 59, &minutes) != ESP_OK
+        || schedule_parse_field(fields[1], 0, 23, &hours) != ESP_OK
+        || schedule_parse_field(fields[2], 1, 31, &days) != ESP_OK
+        || schedule_parse_field(fields[3], 1, 12, &months) != ESP_OK
+        || schedule_parse_field(fields[4], 0, 7, &weekdays) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (weekdays & (1 << 7)) {
+        weekdays = (weekdays | 1) & 0x7F;
+    }
+
+    schedule->minutes = minutes;
+    schedule->hours = (uint32_t)hours;
+    schedule->days = (uint32_t)days;
+    schedule->months = (uint16_t)months;
+    schedule->weekdays = (uint8_t)weekdays;
+    schedule->cron_flags = cron_flags;
+    strncpy(schedule->cron, cron, SCHEDULE_CRON_LENGTH - 1);
+    schedule->cron[SCHEDULE_CRON_LENGTH - 1] = '\0';
+    return ESP_OK;
+}
+
+/**
+ * @brief: Serialize the schedule into JSON. The actuator is referred to by its key.
+ *
+ * @param schedule Pointer to the schedule
+ * @return cJSON object, to be freed by the caller
+ */
+cJSON *schedule_to_JSON(const schedule_record_t *schedule) {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    cJSON *json = cJSON_CreateObject();
+
+    cJSON_AddNumberToObject(json, "id", schedule->id);
+    cJSON_AddBoolToObject(json, "enabled", (schedule->flags & SCHEDULE_FLAG_ENABLED) != 0);
+    snprintf(key, sizeof(key), "%s%d", S_KEY_CH_PREFIX, schedule->channel);
+    cJSON_AddStringToObject(json, "relay_key", key);
+    cJSON_AddStringToObject(json, "cron", schedule->cron);
+    cJSON_AddStringToObject(json, "state", SCHEDULE_ACTION_NAMES[schedule->action <= SCHEDULE_ACTION_TOGGLE ? schedule->action : SCHEDULE_ACTION_OFF]);
+    cJSON_AddNumberToObject(json, "pulse_ms", schedule->pulse_ms);
+
+    time_t next = -1;
+    if (time_is_synced() && (schedule->flags & SCHEDULE_FLAG_ENABLED)) {
+        next = schedule_next_run(schedule, time(NULL));
+    }
+    if (next >= 0) {
+        cJSON_AddNumberToObject(json, "next_run", (double)next);
+    } else {
+        cJSON_AddNullToObject(json, "next_run");
+    }
+
+    return json;
+}
+
+/**
+ * @brief: Serialize all schedules into JSON array
+ *
+ * @return cJSON array, to be freed by the caller
+ */
+cJSON *schedules_to_JSON() {
+    cJSON *array = cJSON_CreateArray();
+    if (s_schedules_lock == NULL) {
+        return array;
+    }
+
+    for (int id = 0; id < SCHEDULES_MAX; id++) {
+        xSemaphoreTake(s_schedules_lock, portMAX_DELAY);
+        bool present = s_schedules_present[id];
+        schedule_record_t schedule = s_schedules[id];
+        xSemaphoreGive(s_schedules_lock);
+
+        if (present) {
+            cJSON_AddItemToArray(array, schedule_to_JSON(&schedule));
+        }
+    }
+    return array;
+}
+
+/**
+ * @brief: Parse and validate the schedule from JSON
+ *
+ * Format: {"id": 0, "enabled": true, "relay_key": "relay_ch_0", "cron": "30 7 * * 1-5",
+ *          "state": "on|off|toggle", "pulse_ms": 0}
+ *
+ * @param json Schedule JSON object
+ * @param[out] schedule Parsed schedule
+ * @return esp_err_t ESP_OK if the schedule is valid, ESP_ERR_INVALID_ARG otherwise
+ */
+esp_err_t schedule_from_JSON(const cJSON *json, schedule_record_t *schedule) {
+    memset(schedule, 0, sizeof(schedule_record_t));
+    unit_handle_t unit;
+
+    cJSON *id = cJSON_GetObjectItem(json, "id");
+    if (!cJSON_IsNumber(id) || id->valueint < 0 || id->valueint >= SCHEDULES_MAX) {
+        ESP_LOGE(TAG, "Schedule: missing or invalid 'id' (0 - %d)", SCHEDULES_MAX - 1);
+        return ESP_ERR_INVALID_ARG;
+    }
+    schedule->id = (uint8_t)id->valueint;
+
+    cJSON *enabled = cJSON_GetObjectItem(json, "enabled");
+    if (enabled == NULL || cJSON_IsTrue(enabled)) {
+        schedule->flags |= SCHEDULE_FLAG_ENABLED;
+    }
+
+    cJSON *relay_key = cJSON_GetObjectItem(json, "relay_key");
+    if (!cJSON_IsString(relay_key) || get_unit_handle_from_key(relay_key->valuestring, &unit) != ESP_OK
+        || unit.type != RELAY_TYPE_ACTUATOR) {
+        ESP_LOGE(TAG, "Schedule %d: target has to be an actuator", schedule->id);
+        return ESP_ERR_INVALID_ARG;
+    }
+    schedule->channel = unit.index;
+
+    cJSON *cron = cJSON_GetObjectItem(json, "cron");
+    if (!cJSON_IsString(cron) || schedule_parse_cron(cron->valuestring, schedule) != ESP_OK) {
+        ESP_LOGE(TAG, "Schedule %d: invalid cron expression", schedule->id);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    cJSON *state = cJSON_GetObjectItem(json, "state");
+    int action = -1;
+    for (int i = 0; cJSON_IsString(state) && i <= SCHEDULE_ACTION_TOGGLE; i++) {
+        if (strcmp(state->valuestring, SCHEDULE_ACTION_NAMES[i]) == 0) {
+            action = i;
+            break;
+        }
+    }
+    if (action < 0) {
+        ESP_LOGE(TAG, "Schedule %d: invalid state", schedule->id);
+        return ESP_ERR_INVALID_ARG;
+    }
+    schedule->action = (uint8_t)action;
+
+    cJSON *pulse_ms = cJSON_GetObjectItem(json, "pulse_ms");
+    if (pulse_ms != NULL) {
+        if (!cJSON_IsNumber(pulse_ms) || pulse_ms->valueint < 0 || pulse_ms->valueint > RELAY_PULSE_MS_MAX) {
+            ESP_LOGE(TAG, "Schedule %d: invalid pulse width (0 - %d ms)", schedule->id, RELAY_PULSE_MS_MAX);
+            return ESP_ERR_INVALID_ARG;
+        }
+        schedule->pulse_ms = (uint16_t)pulse_ms->valueint;
+    }
+
+    return ESP_OK;
+}
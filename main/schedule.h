@@ -0,0 +1,94 @@
+/**
+ * @file schedule.h
+ * @brief Cron-like schedules switching actuators at wall clock times
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * Schedules are kept in a small table stored in NVS under a single key. Each schedule has a cron
+ * expression (minute, hour, day of month, month, day of week) compiled into bitmasks and switches
+ * one actuator. The next run of every enabled schedule sits in a hierarchical timer wheel, and a
+ * single task sleeps until the wheel's next tick: there is no periodic polling of the table.
+ * Schedules run only once the clock is synchronized over SNTP.
+ */
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "esp_err.h"
+#include "cJSON.h"
+
+#include "relay.h"
+
+/** TYPES **/
+
+/**
+ * @brief: Action applied to the actuator
+ */
+typedef enum {
+    SCHEDULE_ACTION_OFF,        // Switch OFF
+    SCHEDULE_ACTION_ON,         // Switch ON (for pulse_ms if set)
+    SCHEDULE_ACTION_TOGGLE      // Flip the current state
+} schedule_action_t;
+
+/** SETTINGS AND CONSTANTS **/
+
+#define SCHEDULES_MAX               32
+#define SCHEDULE_CRON_LENGTH        32      // Cron expression, including the terminating zero
+
+#define SCHEDULE_TABLE_MAGIC        0x44484353  // "SCHD"
+#define SCHEDULE_TABLE_VERSION      1
+
+#define SCHEDULE_FLAG_ENABLED       (1 << 0)
+
+#define SCHEDULE_CRON_DOM_ANY       (1 << 0)    // Day of month field is '*'
+#define SCHEDULE_CRON_DOW_ANY       (1 << 1)    // Day of week field is '*'
+
+#define SCHEDULE_CATCH_UP_S         120     // Clock moving forward by more than this skips the missed runs
+#define SCHEDULE_SEARCH_STEPS_MAX   2000    // Bound of the next run search (covers Feb 29 in the next leap year)
+
+/**
+ * @brief: Packed schedule record, as stored in NVS
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t id;                 // Slot of the schedule, 0 - SCHEDULES_MAX-1
+    uint8_t flags;              // SCHEDULE_FLAG_*
+    uint8_t channel;            // Target actuator channel
+    uint8_t action;             // schedule_action_t
+    uint16_t pulse_ms;          // ON action: switch back OFF after this time. 0 means the target's own pulse_ms.
+    uint64_t minutes;           // Bits 0-59
+    uint32_t hours;             // Bits 0-23
+    uint32_t days;              // Bits 1-31
+    uint16_t months;            // Bits 1-12
+    uint8_t weekdays;           // Bits 0-6, Sunday is 0
+    uint8_t cron_flags;         // SCHEDULE_CRON_*
+    char cron[SCHEDULE_CRON_LENGTH];    // Source expression, as set by the user
+} schedule_record_t;
+
+/**
+ * @brief: Schedule table header. Followed by 'count' records of 'record_size' bytes each.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;             // SCHEDULE_TABLE_MAGIC
+    uint16_t version;
+    uint16_t record_size;
+    uint16_t count;
+    uint16_t reserved;
+    uint32_t crc;               // CRC32 of all records
+} schedule_table_header_t;
+
+/** ROUTINES **/
+esp_err_t schedule_init();
+void schedule_notify();
+
+esp_err_t schedule_put(const schedule_record_t *schedule);
+esp_err_t schedule_delete(int id);
+
+esp_err_t schedule_parse_cron(const char *cron, schedule_record_t *schedule);
+time_t schedule_next_run(const schedule_record_t *schedule, time_t after);
+
+cJSON *schedule_to_JSON(const schedule_record_t *schedule);
+cJSON *schedules_to_JSON();
+esp_err_t schedule_from_JSON(const cJSON *json, schedule_record_t *schedule);
+
+#endif // SCHEDULE_H
@@ -0,0 +1,73 @@
+#include <string.h>
+
+#include "seqlock.h"
+
+/**
+ * @brief: Enter the writer section. Writers have to be serialized by the caller.
+ *
+ * @param sl Pointer to the sequence lock
+ */
+void seqlock_write_begin(seqlock_t *sl) {
+    sl->seq++;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief: Leave the writer section
+ *
+ * @param sl Pointer to the sequence lock
+ */
+void seqlock_write_end(seqlock_t *sl) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    sl->seq++;
+}
+
+/**
+ * @brief: Start a read section
+ *
+ * @param sl Pointer to the sequence lock
+ * @return counter to pass to seqlock_read_retry(). Odd if a writer is active: the read is going to be retried.
+ */
+uint32_t seqlock_read_begin(const seqlock_t *sl) {
+    uint32_t seq = sl->seq;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return seq;
+}
+
+/**
+ * @brief: Check the read section: what was read is consistent only if no writer was active in between
+ *
+ * @param sl Pointer to the sequence lock
+ * @param start Counter returned by seqlock_read_begin()
+ * @return true if the data has to be read again
+ */
+bool seqlock_read_retry(const seqlock_t *sl, uint32_t start) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return (start & 1) || sl->seq != start;
+}
+
+/**
+ * @brief: Copy the data consistently, lock-free
+ *
+ * @param sl Pointer to the sequence lock
+ * @param[out] dst Destination
+ * @param src Data guarded by the lock
+ * @param size Number of bytes to copy
+ * @param attempts Copies to try before giving up
+ * @return true if the copy is consistent, false if writers were active in every attempt: take their lock and copy
+ */
+bool seqlock_read_copy(const seqlock_t *sl, void *dst, const void *src, size_t size, int attempts) {
+    for (int attempt = 0; attempt < attempts; attempt++) {
+        uint32_t seq = seqlock_read_begin(sl);
+        if (seq & 1) {
+            continue;
+        }
+
+        memcpy(dst, src, size);
+
+        if (!seqlock_read_retry(sl, seq)) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,35 @@
+/**
+ * @file seqlock.h
+ * @brief Sequence lock: lock-free consistent reads of data changed by serialized writers
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * The core is plain C with no ESP-IDF dependencies. Writers are serialized by the caller (relay.c holds the
+ * recursive writer mutex of the relay units) and bump the counter to odd when they start and back to even when
+ * they are done. Readers never block writers: they copy the data and retry if the counter was odd or changed
+ * meanwhile. A reader that keeps losing gives up after a bounded number of attempts and takes the writers'
+ * mutex instead, so a low priority writer can't be starved.
+ */
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** TYPES **/
+
+/**
+ * @brief: Sequence counter, odd while a writer is in its section
+ */
+typedef struct {
+    volatile uint32_t seq;
+} seqlock_t;
+
+/** ROUTINES **/
+void seqlock_write_begin(seqlock_t *sl);
+void seqlock_write_end(seqlock_t *sl);
+uint32_t seqlock_read_begin(const seqlock_t *sl);
+bool seqlock_read_retry(const seqlock_t *sl, uint32_t start);
+bool seqlock_read_copy(const seqlock_t *sl, void *dst, const void *src, size_t size, int attempts);
+
+#endif // SEQLOCK_H
@@ -24,6 +24,9 @@
 #include "non_volatile_storage.h"
 #include "ca_cert_manager.h"
 #include "relay.h"
+#include "scan.h"
+#include "relay_rtc.h"
+#include "relay_zc.h"
 #include "web.h"
 
 #define BUFFSIZE 1024
@@ -213,6 +216,36 @@ esp_err_t base_settings_init() {
         is_dynamically_allocated = false;
     }
 
+    // Parameter: MQTT publish profile
+    uint16_t mqtt_publish_profile;
+    if (nvs_read_uint16(S_NAMESPACE, S_KEY_MQTT_PUBLISH_PROFILE, &mqtt_publish_profile) == ESP_OK) {
+        ESP_LOGI(TAG, "Found parameter %s in NVS: %i", S_KEY_MQTT_PUBLISH_PROFILE, mqtt_publish_profile);
+    } else {
+        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_MQTT_PUBLISH_PROFILE);
+        mqtt_publish_profile = S_DEFAULT_MQTT_PUBLISH_PROFILE;
+        if (nvs_write_uint16(S_NAMESPACE, S_KEY_MQTT_PUBLISH_PROFILE, mqtt_publish_profile) == ESP_OK) {
+            ESP_LOGI(TAG, "Successfully created key %s with value %i", S_KEY_MQTT_PUBLISH_PROFILE, mqtt_publish_profile);
+        } else {
+            ESP_LOGE(TAG, "Failed creating key %s with value %i", S_KEY_MQTT_PUBLISH_PROFILE, mqtt_publish_profile);
+            return ESP_FAIL;
+        }
+    }
+
+    // Parameter: Publish unchanged units to MQTT again every X milliseconds
+    uint32_t mqtt_hb_intervl;
+    if (nvs_read_uint32(S_NAMESPACE, S_KEY_MQTT_HEARTBEAT_INTERVAL, &mqtt_hb_intervl) == ESP_OK) {
+        ESP_LOGI(TAG, "Found parameter %s in NVS: %li", S_KEY_MQTT_HEARTBEAT_INTERVAL, mqtt_hb_intervl);
+    } else {
+        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_MQTT_HEARTBEAT_INTERVAL);
+        mqtt_hb_intervl = S_DEFAULT_MQTT_HEARTBEAT_INTERVAL;
+        if (nvs_write_uint32(S_NAMESPACE, S_KEY_MQTT_HEARTBEAT_INTERVAL, mqtt_hb_intervl) == ESP_OK) {
+            ESP_LOGI(TAG, "Successfully created key %s with value %li", S_KEY_MQTT_HEARTBEAT_INTERVAL, mqtt_hb_intervl);
+        } else {
+            ESP_LOGE(TAG, "Failed creating key %s with value %li", S_KEY_MQTT_HEARTBEAT_INTERVAL, mqtt_hb_intervl);
+            return ESP_FAIL;
+        }
+    }
+
     // Parameter: HomeAssistant MQTT Integration prefix
     char *ha_prefix = NULL;
     if (nvs_read_string(S_NAMESPACE, S_KEY_HA_PREFIX, &ha_prefix) == ESP_OK) {
@@ -425,6 +458,46 @@ esp_err_t base_settings_init() {
         }
     }
 
+    // Parameter: SNTP server
+    char *sntp_server = NULL;
+    if (nvs_read_string(S_NAMESPACE, S_KEY_SNTP_SERVER, &sntp_server) == ESP_OK) {
+        ESP_LOGI(TAG, "Found parameter %s in NVS: %s", S_KEY_SNTP_SERVER, sntp_server);
+        is_dynamically_allocated = true;
+    } else {
+        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_SNTP_SERVER);
+        sntp_server = S_DEFAULT_SNTP_SERVER;
+        if (nvs_write_string(S_NAMESPACE, S_KEY_SNTP_SERVER, sntp_server) == ESP_OK) {
+            ESP_LOGI(TAG, "Successfully created key %s with value %s", S_KEY_SNTP_SERVER, sntp_server);
+        } else {
+            ESP_LOGE(TAG, "Failed creating key %s with value %s", S_KEY_SNTP_SERVER, sntp_server);
+            return ESP_FAIL;
+        }
+    }
+    if (is_dynamically_allocated) {
+        free(sntp_server); // for string (char*) params only
+        is_dynamically_allocated = false;
+    }
+
+    // Parameter: Time zone
+    char *time_zone = NULL;
+    if (nvs_read_string(S_NAMESPACE, S_KEY_TIME_ZONE, &time_zone) == ESP_OK) {
+        ESP_LOGI(TAG, "Found parameter %s in NVS: %s", S_KEY_TIME_ZONE, time_zone);
+        is_dynamically_allocated = true;
+    } else {
+        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_TIME_ZONE);
+        time_zone = S_DEFAULT_TIME_ZONE;
+        if (nvs_write_string(S_NAMESPACE, S_KEY_TIME_ZONE, time_zone) == ESP_OK) {
+            ESP_LOGI(TAG, "Successfully created key %s with value %s", S_KEY_TIME_ZONE, time_zone);
+        } else {
+            ESP_LOGE(TAG, "Failed creating key %s with value %s", S_KEY_TIME_ZONE, time_zone);
+            return ESP_FAIL;
+        }
+    }
+    if (is_dynamically_allocated) {
+        free(time_zone); // for string (char*) params only
+        is_dynamically_allocated = false;
+    }
+
     return ESP_OK;
 
 }
@@ -482,6 +555,111 @@ esp_err_t device_settings_init() {
         }
     }
 
+    // Parameter: Pulse counters count
+    uint16_t relay_pc_count;
+    if (nvs_read_uint16(S_NAMESPACE, S_KEY_PULSE_COUNTERS_COUNT, &relay_pc_count) == ESP_OK) {
+        ESP_LOGI(TAG, "Found parameter %s in NVS: %i", S_KEY_PULSE_COUNTERS_COUNT, relay_pc_count);
+    } else {
+        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_PULSE_COUNTERS_COUNT);
+        relay_pc_count = S_DEFAULT_PULSE_COUNTERS_COUNT;
+        if (nvs_write_uint16(S_NAMESPACE, S_KEY_PULSE_COUNTERS_COUNT, relay_pc_count) == ESP_OK) {
+            ESP_LOGI(TAG, "Successfully created key %s with value %i", S_KEY_PULSE_COUNTERS_COUNT, relay_pc_count);
+        } else {
+            ESP_LOGE(TAG, "Failed creating key %s with value %i", S_KEY_PULSE_COUNTERS_COUNT, relay_pc_count);
+            return ESP_FAIL;
+        }
+    }
+
+    // Parameter: Pulse counters publish interval
+    uint16_t relay_pc_intrvl;
+    if (nvs_read_uint16(S_NAMESPACE, S_KEY_PULSE_INTERVAL, &relay_pc_intrvl) == ESP_OK) {
+        ESP_LOGI(TAG, "Found parameter %s in NVS: %i", S_KEY_PULSE_INTERVAL, relay_pc_intrvl);
+    } else {
+        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_PULSE_INTERVAL);
+        relay_pc_intrvl = S_DEFAULT_PULSE_INTERVAL;
+        if (nvs_write_uint16(S_NAMESPACE, S_KEY_PULSE_INTERVAL, relay_pc_intrvl) == ESP_OK) {
+            ESP_LOGI(TAG, "Successfully created key %s with value %i", S_KEY_PULSE_INTERVAL, relay_pc_intrvl);
+        } else {
+            ESP_LOGE(TAG, "Failed creating key %s with value %i", S_KEY_PULSE_INTERVAL, relay_pc_intrvl);
+            return ESP_FAIL;
+        }
+    }
+
+    // Parameter: Interlock groups dead time
+    uint16_t relay_ilk_dead;
+    if (nvs_read_uint16(S_NAMESPACE, S_KEY_INTERLOCK_DEAD_TIME, &relay_ilk_dead) == ESP_OK) {
+        ESP_LOGI(TAG, "Found parameter %s in NVS: %i", S_KEY_INTERLOCK_DEAD_TIME, relay_ilk_dead);
+    } else {
+        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_INTERLOCK_DEAD_TIME);
+        relay_ilk_dead = S_DEFAULT_INTERLOCK_DEAD_TIME;
+        if (nvs_write_uint16(S_NAMESPACE, S_KEY_INTERLOCK_DEAD_TIME, relay_ilk_dead) == ESP_OK) {
+            ESP_LOGI(TAG, "Successfully created key %s with value %i", S_KEY_INTERLOCK_DEAD_TIME, relay_ilk_dead);
+        } else {
+            ESP_LOGE(TAG, "Failed creating key %s with value %i", S_KEY_INTERLOCK_DEAD_TIME, relay_ilk_dead);
+            return ESP_FAIL;
+        }
+    }
+
+    // Parameter: Zero-cross detector input pin
+    uint16_t relay_zc_pin;
+    if (nvs_read_uint16(S_NAMESPACE, S_KEY_ZERO_CROSS_PIN, &relay_zc_pin) == ESP_OK) {
+        ESP_LOGI(TAG, "Found parameter %s in NVS: %i", S_KEY_ZERO_CROSS_PIN, relay_zc_pin);
+    } else {
+        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_ZERO_CROSS_PIN);
+        relay_zc_pin = S_DEFAULT_ZERO_CROSS_PIN;
+        if (nvs_write_uint16(S_NAMESPACE, S_KEY_ZERO_CROSS_PIN, relay_zc_pin) == ESP_OK) {
+            ESP_LOGI(TAG, "Successfully created key %s with value %i", S_KEY_ZERO_CROSS_PIN, relay_zc_pin);
+        } else {
+            ESP_LOGE(TAG, "Failed creating key %s with value %i", S_KEY_ZERO_CROSS_PIN, relay_zc_pin);
+            return ESP_FAIL;
+        }
+    }
+
+    // Parameter: Contact sensors acquisition mode
+    uint16_t relay_sn_acq;
+    if (nvs_read_uint16(S_NAMESPACE, S_KEY_SENSORS_ACQ_MODE, &relay_sn_acq) == ESP_OK) {
+        ESP_LOGI(TAG, "Found parameter %s in NVS: %i", S_KEY_SENSORS_ACQ_MODE, relay_sn_acq);
+    } else {
+        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_SENSORS_ACQ_MODE);
+        relay_sn_acq = S_DEFAULT_SENSORS_ACQ_MODE;
+        if (nvs_write_uint16(S_NAMESPACE, S_KEY_SENSORS_ACQ_MODE, relay_sn_acq) == ESP_OK) {
+            ESP_LOGI(TAG, "Successfully created key %s with value %i", S_KEY_SENSORS_ACQ_MODE, relay_sn_acq);
+        } else {
+            ESP_LOGE(TAG, "Failed creating key %s with value %i", S_KEY_SENSORS_ACQ_MODE, relay_sn_acq);
+            return ESP_FAIL;
+        }
+    }
+
+    // Parameter: Contact sensors scan tick
+    uint16_t relay_sn_tick;
+    if (nvs_read_uint16(S_NAMESPACE, S_KEY_SENSORS_SCAN_TICK, &relay_sn_tick) == ESP_OK) {
+        ESP_LOGI(TAG, "Found parameter %s in NVS: %i", S_KEY_SENSORS_SCAN_TICK, relay_sn_tick);
+    } else {
+        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_SENSORS_SCAN_TICK);
+        relay_sn_tick = S_DEFAULT_SENSORS_SCAN_TICK;
+        if (nvs_write_uint16(S_NAMESPACE, S_KEY_SENSORS_SCAN_TICK, relay_sn_tick) == ESP_OK) {
+            ESP_LOGI(TAG, "Successfully created key %s with value %i", S_KEY_SENSORS_SCAN_TICK, relay_sn_tick);
+        } else {
+            ESP_LOGE(TAG, "Failed creating key %s with value %i", S_KEY_SENSORS_SCAN_TICK, relay_sn_tick);
+            return ESP_FAIL;
+        }
+    }
+
+    // Parameter: Contact sensors scan filter window
+    uint16_t relay_sn_filter;
+    if (nvs_read_uint16(S_NAMESPACE, S_KEY_SENSORS_SCAN_FILTER, &relay_sn_filter) == ESP_OK) {
+        ESP_LOGI(TAG, "Found parameter %s in NVS: %i", S_KEY_SENSORS_SCAN_FILTER, relay_sn_filter);
+    } else {
+        ESP_LOGW(TAG, "Unable to find parameter %s in NVS. Initiating...", S_KEY_SENSORS_SCAN_FILTER);
+        relay_sn_filter = S_DEFAULT_SENSORS_SCAN_FILTER;
+        if (nvs_write_uint16(S_NAMESPACE, S_KEY_SENSORS_SCAN_FILTER, relay_sn_filter) == ESP_OK) {
+            ESP_LOGI(TAG, "Successfully created key %s with value %i", S_KEY_SENSORS_SCAN_FILTER, relay_sn_filter);
+        } else {
+            ESP_LOGE(TAG, "Failed creating key %s with value %i", S_KEY_SENSORS_SCAN_FILTER, relay_sn_filter);
+            return ESP_FAIL;
+        }
+    }
+
     // now, let's iterate via all relays stored in the memory and try load/initiate them
     ESP_LOGI(TAG, "Settings: Initiating relays");
     for (int i_channel = 0; i_channel < channel_count; i_channel++) {
@@ -532,7 +710,24 @@ esp_err_t device_settings_init() {
             }
 
         }
-        
+
+        // after a warm reset the output is already driven from RTC memory, which may be newer than NVS (write-behind).
+        // Outputs pulsed at the time of the reset are mirrored OFF, and momentary units never come back ON.
+        int rtc_level;
+        if (relay_rtc_restored_level(relay->gpio_pin, &rtc_level)) {
+            relay_state_t rtc_state = (rtc_level ^ (relay->inverted ? 1 : 0)) ? RELAY_STATE_ON : RELAY_STATE_OFF;
+            if (relay->pulse_ms > 0) {
+                rtc_state = RELAY_STATE_OFF;
+            }
+            if (rtc_state != relay->state) {
+                ESP_LOGI(TAG, "Relay channel %i: keeping state %d restored from RTC memory (NVS has %d)", i_channel, rtc_state, relay->state);
+                relay->state = rtc_state;
+                if (save_relay_to_nvs(relay_nvs_key, relay) != ESP_OK) {
+                    ESP_LOGW(TAG, "Failed to save restored state of relay channel %i to NVS", i_channel);
+                }
+            }
+        }
+
         // set relay state to GPIO
         esp_err_t err = relay_set_state(relay, relay->state, false);
         if (err != ESP_OK) {
@@ -599,6 +794,39 @@ esp_err_t device_settings_init() {
         free(relay);
     }
 
+    // and finally pulse counters
+    ESP_LOGI(TAG, "Settings: Initiating pulse counters");
+    for (int i_channel = 0; i_channel < relay_pc_count; i_channel++) {
+        relay_unit_t relay = {0};
+        char *relay_nvs_key = get_pulse_counter_nvs_key(i_channel);
+        if (relay_nvs_key == NULL) {
+            ESP_LOGE(TAG, "Failed to get NVS key for channel %d", i_channel);
+            return ESP_FAIL;
+        }
+        if (load_relay_pulse_counter_from_nvs(relay_nvs_key, &relay) == ESP_OK) {
+            ESP_LOGI(TAG, "Found pulse counter channel %i stored in NVS at %s. PIN %i", i_channel, relay_nvs_key, relay.gpio_pin);
+        } else {
+            ESP_LOGW(TAG, "Unable to find pulse counter channel %i stored in NVS at %s. Initiating...", i_channel, relay_nvs_key);
+
+            int gpio_pin = get_next_available_safe_gpio_pin();
+            if (gpio_pin < 0) {
+                ESP_LOGE(TAG, "No safe GPIO pins left! Cannot assign one to the relay unit. Aborting!");
+                free(relay_nvs_key);
+                return ESP_FAIL;
+            }
+            relay = get_pulse_counter_relay(i_channel, gpio_pin);
+
+            // Save the pulse counter configuration to NVS
+            if (save_relay_to_nvs(relay_nvs_key, &relay) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to save pulse counter configuration to NVS");
+                free(relay_nvs_key);
+                return ESP_FAIL;
+            }
+        }
+
+        free(relay_nvs_key);
+    }
+
     return ESP_OK;
 }
 
@@ -830,6 +1058,19 @@ esp_err_t apply_setting(const char *key,
         ESP_LOGI(TAG, "Successfully updated setting '%s'", key);
     }
 
+    // MQTT hot path works from a RAM snapshot of these settings: rebuild it
+    if (strcmp(key, S_KEY_MQTT_CONNECT) == 0 || strcmp(key, S_KEY_MQTT_PREFIX) == 0 || strcmp(key, S_KEY_HA_PREFIX) == 0 ||
+        strcmp(key, S_KEY_MQTT_PUBLISH_PROFILE) == 0 || strcmp(key, S_KEY_MQTT_HEARTBEAT_INTERVAL) == 0) {
+        if (mqtt_config_reload() != ESP_OK) {
+            ESP_LOGW(TAG, "Unable to reload MQTT settings after '%s' was updated", key);
+        }
+    }
+
+    // Pin allocation works from the cached zero-cross detector pin: refresh it
+    if (strcmp(key, S_KEY_ZERO_CROSS_PIN) == 0 && relay_zc_config_reload() != ESP_OK) {
+        ESP_LOGW(TAG, "Unable to reload zero-cross detector pin after '%s' was updated", key);
+    }
+
     set_result(out, ESP_OK, "Updated setting '%s'%s%s%s",
                key,
                out->has_old ? " (was " : "",
@@ -1353,6 +1594,13 @@ void system_reboot_task(void *param) {
     ESP_LOGI(TAG, "Reboot sequence task initiated");
     vTaskDelay(1000 / portTICK_PERIOD_MS);  // Delay for 1 second
 
+    // Flush pending relay unit changes
+    if (relay_persist_flush() != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to flush pending relay unit changes to NVS");
+    } else {
+        ESP_LOGI(TAG, "Pending relay unit changes flushed to NVS");
+    }
+
     // Stop the MQTT client
     if (mqtt_stop() != ESP_OK) {
         ESP_LOGW(TAG, "Failed to stop the MQTT client");
@@ -1722,6 +1970,49 @@ static esp_err_t handle_setting_mqtt_connect(const char *key, const cJSON *v, se
     return ESP_OK; // generic writer will store it
 }
 
+/**
+ * @brief: Handle MQTT publish profile setting validation handler
+ * 
+ * @param v: cJSON object containing the new MQTT publish profile value
+ * @param[out] out: Pointer to setting_update_msg_t structure to store the result
+ * 
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG otherwise
+ */
+static esp_err_t handle_setting_mqtt_pub_prof(const char *key, const cJSON *v, setting_update_msg_t *out) {
+
+    int profile = (int)v->valuedouble;
+
+    if (!mqtt_publish_profile_is_valid(profile)) {
+        set_result(out, ESP_ERR_INVALID_ARG,
+                   "mqtt_pub_prof invalid (%d). Allowed: %d..%d",
+                   profile,
+                   MQTT_PUBLISH_PROFILE_LEGACY,
+                   MQTT_PUBLISH_PROFILE_STATE);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK; // generic writer will store it
+}
+
+/**
+ * @brief: Handle MQTT heartbeat interval setting validation handler
+ * 
+ * @param v: cJSON object containing the new interval value
+ * @param[out] out: Pointer to setting_update_msg_t structure to store the result
+ * 
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG otherwise
+ */
+static esp_err_t handle_setting_mqtt_hb_intervl(const char *key, const cJSON *v, setting_update_msg_t *out) {
+
+    // check if the value is within allowed range (MQTT_HEARTBEAT_INTERVAL_MIN and MQTT_HEARTBEAT_INTERVAL_MAX)
+    if (v->valueint < MQTT_HEARTBEAT_INTERVAL_MIN || v->valueint > MQTT_HEARTBEAT_INTERVAL_MAX) {
+        set_result(out, ESP_ERR_INVALID_ARG, "MQTT heartbeat interval value out of range (%d - %d)", MQTT_HEARTBEAT_INTERVAL_MIN, MQTT_HEARTBEAT_INTERVAL_MAX);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
 /**
  * @brief: Handle MQTT port setting validation handler
  * 
@@ -1798,6 +2089,146 @@ static esp_err_t handle_setting_relay_sn_count(const char *key, const cJSON *v,
     return ESP_OK;
 }
 
+/**
+ * @brief: Handle Contact sensors acquisition mode setting validation handler
+ * 
+ * @param v: cJSON object containing the new acquisition mode value
+ * @param[out] out: Pointer to setting_update_msg_t structure to store the result
+ * 
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ */
+static esp_err_t handle_setting_relay_sn_acq(const char *key, const cJSON *v, setting_update_msg_t *out) {
+
+    if (v->valueint != SENSORS_ACQ_MODE_ISR && v->valueint != SENSORS_ACQ_MODE_SCAN) {
+        set_result(out, ESP_ERR_INVALID_ARG, "Invalid contact sensors acquisition mode (%d - ISR, %d - scan)", SENSORS_ACQ_MODE_ISR, SENSORS_ACQ_MODE_SCAN);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief: Handle Contact sensors scan tick setting validation handler
+ * 
+ * @param v: cJSON object containing the new scan tick value
+ * @param[out] out: Pointer to setting_update_msg_t structure to store the result
+ * 
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ */
+static esp_err_t handle_setting_relay_sn_tick(const char *key, const cJSON *v, setting_update_msg_t *out) {
+
+    // check if the value is within allowed range (SENSORS_SCAN_TICK_MIN and SENSORS_SCAN_TICK_MAX)
+    if (v->valueint < SENSORS_SCAN_TICK_MIN || v->valueint > SENSORS_SCAN_TICK_MAX) {
+        set_result(out, ESP_ERR_INVALID_ARG, "Contact sensors scan tick value out of range (%d - %d)", SENSORS_SCAN_TICK_MIN, SENSORS_SCAN_TICK_MAX);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief: Handle Contact sensors scan filter window setting validation handler
+ * 
+ * @param v: cJSON object containing the new number of samples in the filter window
+ * @param[out] out: Pointer to setting_update_msg_t structure to store the result
+ * 
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ */
+static esp_err_t handle_setting_relay_sn_filter(const char *key, const cJSON *v, setting_update_msg_t *out) {
+
+    // check if the value is within allowed range (SCAN_FILTER_M_MIN and SCAN_FILTER_M_MAX)
+    if (v->valueint < SCAN_FILTER_M_MIN || v->valueint > SCAN_FILTER_M_MAX) {
+        set_result(out, ESP_ERR_INVALID_ARG, "Contact sensors scan filter window out of range (%d - %d)", SCAN_FILTER_M_MIN, SCAN_FILTER_M_MAX);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief: Handle Pulse counters count setting validation handler
+ * 
+ * @param v: cJSON object containing the new pulse counters count value
+ * @param[out] out: Pointer to setting_update_msg_t structure to store the result
+ * 
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ */
+static esp_err_t handle_setting_relay_pc_count(const char *key, const cJSON *v, setting_update_msg_t *out) {
+
+    // check if the value is within allowed range (PULSE_COUNTERS_COUNT_MIN and PULSE_COUNTERS_COUNT_MAX)
+    if (v->valueint < PULSE_COUNTERS_COUNT_MIN || v->valueint > PULSE_COUNTERS_COUNT_MAX) {
+        set_result(out, ESP_ERR_INVALID_ARG, "Pulse counters count value out of range (%d - %d)", PULSE_COUNTERS_COUNT_MIN, PULSE_COUNTERS_COUNT_MAX);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief: Handle Pulse counters publish interval setting validation handler
+ * 
+ * @param v: cJSON object containing the new interval value, seconds
+ * @param[out] out: Pointer to setting_update_msg_t structure to store the result
+ * 
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ */
+static esp_err_t handle_setting_relay_pc_intrvl(const char *key, const cJSON *v, setting_update_msg_t *out) {
+
+    // check if the value is within allowed range (PULSE_INTERVAL_MIN and PULSE_INTERVAL_MAX)
+    if (v->valueint < PULSE_INTERVAL_MIN || v->valueint > PULSE_INTERVAL_MAX) {
+        set_result(out, ESP_ERR_INVALID_ARG, "Pulse counters interval value out of range (%d - %d)", PULSE_INTERVAL_MIN, PULSE_INTERVAL_MAX);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief: Handle Interlock groups dead time setting validation handler
+ * 
+ * @param v: cJSON object containing the new dead time value, ms
+ * @param[out] out: Pointer to setting_update_msg_t structure to store the result
+ * 
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ */
+static esp_err_t handle_setting_relay_ilk_dead(const char *key, const cJSON *v, setting_update_msg_t *out) {
+
+    // check if the value is within allowed range (0 and RELAY_INTERLOCK_DEAD_MS_MAX)
+    if (v->valueint < 0 || v->valueint > RELAY_INTERLOCK_DEAD_MS_MAX) {
+        set_result(out, ESP_ERR_INVALID_ARG, "Interlock dead time value out of range (0 - %d)", RELAY_INTERLOCK_DEAD_MS_MAX);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief: Handle Zero-cross detector pin setting validation handler
+ * 
+ * @param v: cJSON object containing the new GPIO pin, 0 disables zero-cross switching
+ * @param[out] out: Pointer to setting_update_msg_t structure to store the result
+ * 
+ * @return ESP_OK on success, ESP_FAIL otherwise
+ */
+static esp_err_t handle_setting_relay_zc_pin(const char *key, const cJSON *v, setting_update_msg_t *out) {
+
+    if (v->valueint == 0) {
+        return ESP_OK;
+    }
+
+    // the detector is an input like the contact sensors: it has to be a safe pin not used by any unit
+    if (!is_gpio_safe(v->valueint)) {
+        set_result(out, ESP_ERR_INVALID_ARG, "Zero-cross detector pin %d is not in the safe GPIO list", v->valueint);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (v->valueint != relay_zc_gpio_pin() && is_gpio_pin_in_use(v->valueint)) {
+        set_result(out, ESP_ERR_INVALID_ARG, "Zero-cross detector pin %d is already used by a unit", v->valueint);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
 
 /**
  * @brief: Handle Network logging type setting validation handler
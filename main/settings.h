@@ -23,16 +23,33 @@
 #define CA_CERT_TYPE_LENGTH      6
 #define CA_CERT_LENGTH           8192
 #define NET_LOGGING_HOST_LENGTH   256
+#define SNTP_SERVER_LENGTH       64
+#define TIME_ZONE_LENGTH         64
 
 #define HA_UPDATE_INTERVAL_MIN  60000           // Once a minute
 #define HA_UPDATE_INTERVAL_MAX  86400000        // Once a day (24 hr)
 
+#define MQTT_HEARTBEAT_INTERVAL_MIN  60000      // Once a minute: every refresh
+#define MQTT_HEARTBEAT_INTERVAL_MAX  86400000   // Once a day (24 hr)
+
 #define CHANNEL_COUNT_MIN  0
 #define CHANNEL_COUNT_MAX  15
 
 #define CONTACT_SENSORS_COUNT_MIN  0
 #define CONTACT_SENSORS_COUNT_MAX  8
 
+#define SENSORS_ACQ_MODE_ISR    0   // Per-pin edge interrupts with debounce windows
+#define SENSORS_ACQ_MODE_SCAN   1   // Periodic scan of the GPIO input registers with N-of-M filter
+
+#define SENSORS_SCAN_TICK_MIN  1    // ms
+#define SENSORS_SCAN_TICK_MAX  10
+
+#define PULSE_COUNTERS_COUNT_MIN  0
+#define PULSE_COUNTERS_COUNT_MAX  4
+
+#define PULSE_INTERVAL_MIN  1       // seconds
+#define PULSE_INTERVAL_MAX  3600
+
 #define RELAY_REFRESH_INTERVAL_MIN  1
 #define RELAY_REFRESH_INTERVAL_MAX  10000
 
@@ -77,15 +94,32 @@
 #define S_KEY_MQTT_USER         "mqtt_user"
 #define S_KEY_MQTT_PASSWORD     "mqtt_password"
 #define S_KEY_MQTT_PREFIX       "mqtt_prefix"
+#define S_KEY_MQTT_PUBLISH_PROFILE      "mqtt_pub_prof"
+#define S_KEY_MQTT_HEARTBEAT_INTERVAL   "mqtt_hb_intervl"
 
 #define S_KEY_HA_PREFIX                 "ha_prefix"
 #define S_KEY_HA_UPDATE_INTERVAL        "ha_upd_intervl"
 
 #define S_KEY_CH_PREFIX                 "relay_ch_"
 #define S_KEY_SN_PREFIX                 "relay_sn_"
+#define S_KEY_PC_PREFIX                 "relay_pc_"
 #define S_KEY_CHANNEL_COUNT             "relay_ch_count"
 #define S_KEY_CONTACT_SENSORS_COUNT     "relay_sn_count"
+#define S_KEY_SENSORS_ACQ_MODE          "relay_sn_acq"
+#define S_KEY_SENSORS_SCAN_TICK         "relay_sn_tick"
+#define S_KEY_SENSORS_SCAN_FILTER       "relay_sn_filter"
+#define S_KEY_PULSE_COUNTERS_COUNT      "relay_pc_count"
+#define S_KEY_PULSE_INTERVAL            "relay_pc_intrvl"
+#define S_KEY_INTERLOCK_DEAD_TIME       "relay_ilk_dead"
+#define S_KEY_ZERO_CROSS_PIN            "relay_zc_pin"
 #define S_KEY_RELAY_REFRESH_INTERVAL    "relay_refr_int"
+#define S_KEY_UNIT_TABLE                "relay_units"
+#define S_KEY_RULES_TABLE               "relay_rules"
+#define S_KEY_SCHEDULE_TABLE            "relay_sched"
+#define S_KEY_WEAR_TABLE                "relay_wear"
+
+#define S_KEY_SNTP_SERVER               "sntp_server"
+#define S_KEY_TIME_ZONE                 "time_zone"
 
 #define S_KEY_OTA_UPDATE_URL            "ota_update_url"
 #define S_KEY_OTA_UPDATE_RESET_CONFIG   "ota_upd_rescfg"
@@ -112,8 +146,10 @@
 #define S_DEFAULT_MQTT_USER         ""
 #define S_DEFAULT_MQTT_PASSWORD     ""
 #define S_DEFAULT_MQTT_PREFIX       "relay_board"
+#define S_DEFAULT_MQTT_PUBLISH_PROFILE  MQTT_PUBLISH_PROFILE_LEGACY
 
 #define S_DEFAULT_MQTT_REFRESH_INTERVAL  60000   // 1 minute
+#define S_DEFAULT_MQTT_HEARTBEAT_INTERVAL   900000  // Publish unchanged units again every 15 minutes
 
 #define S_DEFAULT_HA_PREFIX             "homeassistant"
 #define S_DEFAULT_HA_UPDATE_INTERVAL    600000              // Update Home Assistant definitions every 10 minutes
@@ -127,8 +163,18 @@
 
 #define S_DEFAULT_CHANNEL_COUNT                  2
 #define S_DEFAULT_CONTACT_SENSORS_COUNT          0
+#define S_DEFAULT_SENSORS_ACQ_MODE               SENSORS_ACQ_MODE_ISR
+#define S_DEFAULT_SENSORS_SCAN_TICK              2          // ms
+#define S_DEFAULT_SENSORS_SCAN_FILTER            5          // samples in the window (M), 3 of them settle the level
+#define S_DEFAULT_PULSE_COUNTERS_COUNT           0
+#define S_DEFAULT_PULSE_INTERVAL                 10         // seconds
+#define S_DEFAULT_INTERLOCK_DEAD_TIME            100        // ms
+#define S_DEFAULT_ZERO_CROSS_PIN                 0          // 0 - no zero-cross detector
 #define S_DEFAULT_RELAY_REFRESH_INTERVAL         1000       // ms
 
+#define S_DEFAULT_SNTP_SERVER                    "pool.ntp.org"
+#define S_DEFAULT_TIME_ZONE                      "UTC0"     // POSIX TZ string, e.g. "CET-1CEST,M3.5.0,M10.5.0/3"
+
 #define S_DEFAULT_OTA_UPDATE_URL                 "https://dist-repo-public.s3.eu-central-1.amazonaws.com/firmware/ESPRelayBoard/latest/ESPRelayBoard.bin"
 #define S_DEFAULT_OTA_UPDATE_RESET_CONFIG       0   // 0 - Do not reset config, 1 - Reset config to defaults (except Wi-Fi) before applying update. 
     // This can be useful if the device becomes inaccessible due to misconfiguration and you want to ensure that the new firmware will be applied with default settings.
@@ -203,9 +249,18 @@ typedef struct {
 static esp_err_t handle_setting_ha_upd_intervl(const char *key, const cJSON *v, setting_update_msg_t *out);
 static esp_err_t handle_setting_mqtt_connect(const char *key, const cJSON *v, setting_update_msg_t *out);
 static esp_err_t handle_setting_mqtt_port(const char *key, const cJSON *v, setting_update_msg_t *out);
+static esp_err_t handle_setting_mqtt_pub_prof(const char *key, const cJSON *v, setting_update_msg_t *out);
+static esp_err_t handle_setting_mqtt_hb_intervl(const char *key, const cJSON *v, setting_update_msg_t *out);
 static esp_err_t handle_setting_relay_refr_int(const char *key, const cJSON *v, setting_update_msg_t *out);
 static esp_err_t handle_setting_relay_ch_count(const char *key, const cJSON *v, setting_update_msg_t *out);
 static esp_err_t handle_setting_relay_sn_count(const char *key, const cJSON *v, setting_update_msg_t *out);
+static esp_err_t handle_setting_relay_sn_acq(const char *key, const cJSON *v, setting_update_msg_t *out);
+static esp_err_t handle_setting_relay_sn_tick(const char *key, const cJSON *v, setting_update_msg_t *out);
+static esp_err_t handle_setting_relay_sn_filter(const char *key, const cJSON *v, setting_update_msg_t *out);
+static esp_err_t handle_setting_relay_pc_count(const char *key, const cJSON *v, setting_update_msg_t *out);
+static esp_err_t handle_setting_relay_pc_intrvl(const char *key, const cJSON *v, setting_update_msg_t *out);
+static esp_err_t handle_setting_relay_ilk_dead(const char *key, const cJSON *v, setting_update_msg_t *out);
+static esp_err_t handle_setting_relay_zc_pin(const char *key, const cJSON *v, setting_update_msg_t *out);
 static esp_err_t handle_setting_net_log_type(const char *key, const cJSON *v, setting_update_msg_t *out);
 static esp_err_t handle_setting_net_log_port(const char *key, const cJSON *v, setting_update_msg_t *out);
 static esp_err_t handle_setting_net_log_stdout(const char *key, const cJSON *v, setting_update_msg_t *out);
@@ -226,10 +281,21 @@ static const setting_entry_t s_settings[] = {
     { S_KEY_MQTT_USER, NULL, MQTT_USER_LENGTH, SETTING_TYPE_STRING },
     { S_KEY_MQTT_PASSWORD, NULL, MQTT_PASSWORD_LENGTH, SETTING_TYPE_STRING },
     { S_KEY_MQTT_PREFIX, NULL, MQTT_PREFIX_LENGTH, SETTING_TYPE_STRING },
+    { S_KEY_MQTT_PUBLISH_PROFILE, handle_setting_mqtt_pub_prof, 0, SETTING_TYPE_UINT16 },
+    { S_KEY_MQTT_HEARTBEAT_INTERVAL, handle_setting_mqtt_hb_intervl, 0, SETTING_TYPE_UINT32 },
     { S_KEY_HA_PREFIX, NULL, HA_PREFIX_LENGTH, SETTING_TYPE_STRING },
     { S_KEY_RELAY_REFRESH_INTERVAL, handle_setting_relay_refr_int, 0, SETTING_TYPE_UINT16 },
     { S_KEY_CHANNEL_COUNT, handle_setting_relay_ch_count, 0, SETTING_TYPE_UINT16 },
     { S_KEY_CONTACT_SENSORS_COUNT, handle_setting_relay_sn_count, 0, SETTING_TYPE_UINT16 },
+    { S_KEY_SENSORS_ACQ_MODE, handle_setting_relay_sn_acq, 0, SETTING_TYPE_UINT16 },
+    { S_KEY_SENSORS_SCAN_TICK, handle_setting_relay_sn_tick, 0, SETTING_TYPE_UINT16 },
+    { S_KEY_SENSORS_SCAN_FILTER, handle_setting_relay_sn_filter, 0, SETTING_TYPE_UINT16 },
+    { S_KEY_PULSE_COUNTERS_COUNT, handle_setting_relay_pc_count, 0, SETTING_TYPE_UINT16 },
+    { S_KEY_PULSE_INTERVAL, handle_setting_relay_pc_intrvl, 0, SETTING_TYPE_UINT16 },
+    { S_KEY_INTERLOCK_DEAD_TIME, handle_setting_relay_ilk_dead, 0, SETTING_TYPE_UINT16 },
+    { S_KEY_ZERO_CROSS_PIN, handle_setting_relay_zc_pin, 0, SETTING_TYPE_UINT16 },
+    { S_KEY_SNTP_SERVER, NULL, SNTP_SERVER_LENGTH, SETTING_TYPE_STRING },
+    { S_KEY_TIME_ZONE, NULL, TIME_ZONE_LENGTH, SETTING_TYPE_STRING },
     { S_KEY_NET_LOGGING_TYPE, handle_setting_net_log_type, 0, SETTING_TYPE_UINT16 },
     { S_KEY_NET_LOGGING_HOST, NULL, NET_LOGGING_HOST_LENGTH, SETTING_TYPE_STRING },
     { S_KEY_NET_LOGGING_PORT, handle_setting_net_log_port, 0, SETTING_TYPE_UINT16 },
@@ -17,6 +17,9 @@
 #include "settings.h"
 #include "relay.h"
 #include "mqtt.h"
+#include "latency.h"
+#include "relay_rtc.h"
+#include "relay_zc.h"
 
 static heap_trace_record_t trace_buffer[NUM_RECORDS];  // Buffer to store the trace records
 
@@ -257,6 +260,13 @@ esp_err_t device_status_init(device_status_t *status_data) {
     status_data->memguard_mode = memguard_mode;
 #endif
 
+    relay_persist_stats_t persist_stats;
+    relay_persist_get_stats(&persist_stats);
+    status_data->persist_requests = persist_stats.requests;
+    status_data->persist_flushes = persist_stats.flushes;
+    status_data->persist_units_written = persist_stats.units_written;
+    status_data->persist_writes_saved = persist_stats.writes_saved;
+
     ESP_LOGD(STATUS_TAG, "Device status initialized: Free heap (%u bytes), Min free heap (%u bytes), Time since boot (%llu microseconds)", 
              status_data->free_heap, status_data->min_free_heap, (unsigned long long)status_data->time_since_boot);
 
@@ -297,6 +307,33 @@ cJSON *device_status_to_JSON(device_status_t *s_data) {
     }
 #endif
 
+    cJSON_AddNumberToObject(root, "persist_requests", s_data->persist_requests);
+    cJSON_AddNumberToObject(root, "persist_flushes", s_data->persist_flushes);
+    cJSON_AddNumberToObject(root, "persist_units_written", s_data->persist_units_written);
+    cJSON_AddNumberToObject(root, "persist_writes_saved", s_data->persist_writes_saved);
+
+    cJSON *j_boot_restore = relay_rtc_to_JSON();
+    if (j_boot_restore != NULL) {
+        cJSON_AddItemToObject(root, "boot_restore", j_boot_restore);
+    }
+
+    cJSON *j_zero_cross = relay_zc_to_JSON();
+    if (j_zero_cross != NULL) {
+        cJSON_AddItemToObject(root, "zero_cross", j_zero_cross);
+    }
+
+    cJSON *j_mqtt = mqtt_stats_to_JSON();
+    if (j_mqtt != NULL) {
+        cJSON_AddItemToObject(root, "mqtt", j_mqtt);
+    }
+
+#if _DEVICE_ENABLE_STATUS_LATENCY
+    cJSON *j_latency = latency_to_JSON();
+    if (j_latency != NULL) {
+        cJSON_AddItemToObject(root, "latency", j_latency);
+    }
+#endif
+
     return root;
 
 }
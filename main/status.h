@@ -25,6 +25,10 @@ typedef struct {
     int64_t time_since_boot;
     size_t memguard_threshold;
     uint16_t memguard_mode;
+    uint32_t persist_requests;
+    uint32_t persist_flushes;
+    uint32_t persist_units_written;
+    uint32_t persist_writes_saved;
 } device_status_t;
 
 void status_init(void);
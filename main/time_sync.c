@@ -0,0 +1,99 @@
+#include "freertos/FreeRTOS.h"   // must be first
+#include "freertos/event_groups.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "esp_log.h"
+#include "esp_sntp.h"
+
+#include "non_volatile_storage.h"
+
+#include "common.h"
+#include "flags.h"
+#include "settings.h"
+#include "schedule.h"
+#include "time_sync.h"
+
+// lwIP keeps the pointer to the server name, so it has to outlive the call
+static char s_sntp_server[SNTP_SERVER_LENGTH];
+
+/**
+ * @brief: SNTP time synchronization callback. Wakes up the schedule task: the clock may have moved.
+ *
+ * @param tv New time
+ */
+static void time_sync_notification_cb(struct timeval *tv) {
+    bool first = !time_is_synced();
+    xEventGroupSetBits(g_sys_events, BIT_TIME_SYNCED);
+
+    if (first) {
+        struct tm tm;
+        char buf[32];
+        localtime_r(&tv->tv_sec, &tm);
+        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S %Z", &tm);
+        ESP_LOGI(TAG, "Time synchronized over SNTP: %s", buf);
+    }
+    schedule_notify();
+}
+
+/**
+ * @brief: Apply the time zone setting to the C library. Local time is used by schedules and in the logs.
+ *
+ * @return esp_err_t result of the operation
+ */
+esp_err_t time_zone_init() {
+    char *time_zone = NULL;
+    esp_err_t err = nvs_read_string(S_NAMESPACE, S_KEY_TIME_ZONE, &time_zone);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to read time zone from NVS: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    setenv("TZ", time_zone, 1);
+    tzset();
+    ESP_LOGI(TAG, "Time zone set to %s", time_zone);
+    free(time_zone);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Start SNTP client. Needs the network: call once Wi-Fi is connected.
+ *
+ * @return esp_err_t result of the operation
+ */
+esp_err_t time_sync_init() {
+    if (esp_sntp_enabled()) {
+        // already started
+        return ESP_OK;
+    }
+
+    char *sntp_server = NULL;
+    esp_err_t err = nvs_read_string(S_NAMESPACE, S_KEY_SNTP_SERVER, &sntp_server);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Unable to read SNTP server from NVS: %s", esp_err_to_name(err));
+        return err;
+    }
+    strncpy(s_sntp_server, sntp_server, sizeof(s_sntp_server) - 1);
+    s_sntp_server[sizeof(s_sntp_server) - 1] = '\0';
+    free(sntp_server);
+
+    esp_sntp_setoperatingmode(ESP_SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, s_sntp_server);
+    sntp_set_time_sync_notification_cb(time_sync_notification_cb);
+    esp_sntp_init();
+
+    ESP_LOGI(TAG, "SNTP started with server %s", s_sntp_server);
+    return ESP_OK;
+}
+
+/**
+ * @brief: Check if the wall clock has been synchronized at least once
+ *
+ * @return true if the time is valid
+ */
+bool time_is_synced() {
+    return (xEventGroupGetBits(g_sys_events) & BIT_TIME_SYNCED) != 0;
+}
@@ -0,0 +1,21 @@
+/**
+ * @file time_sync.h
+ * @brief Wall clock: time zone and SNTP synchronization
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * The time zone (POSIX TZ string) is applied at boot, SNTP is started once the network is up.
+ * BIT_TIME_SYNCED is set after the first successful synchronization: until then the wall clock
+ * is not trusted and scheduled actions are not run.
+ */
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+/** ROUTINES **/
+esp_err_t time_zone_init();
+esp_err_t time_sync_init();
+bool time_is_synced();
+
+#endif // TIME_SYNC_H
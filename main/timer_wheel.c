@@ -0,0 +1,205 @@
+#include <stddef.h>
+
+#include "timer_wheel.h"
+
+#define TIMER_WHEEL_SLOT_MASK   (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_SPAN        ((uint64_t)1 << (TIMER_WHEEL_LEVEL_BITS * TIMER_WHEEL_LEVELS))
+
+/**
+ * @brief: Rotate the slot bitmap right, so bit 0 is the given slot
+ */
+static inline uint64_t timer_wheel_rotr(uint64_t bits, unsigned int shift) {
+    shift &= TIMER_WHEEL_SLOT_MASK;
+    return (shift == 0) ? bits : ((bits >> shift) | (bits << (TIMER_WHEEL_SLOTS - shift)));
+}
+
+/**
+ * @brief: Initialize empty wheel
+ *
+ * @param wheel Pointer to the wheel
+ * @param now Current tick: entries due at or before it expire on the next advance
+ */
+void timer_wheel_init(timer_wheel_t *wheel, uint32_t now) {
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            wheel->slots[level][slot].next = &wheel->slots[level][slot];
+            wheel->slots[level][slot].prev = &wheel->slots[level][slot];
+        }
+        wheel->occupied[level] = 0;
+    }
+    wheel->now = now;
+    wheel->count = 0;
+}
+
+/**
+ * @brief: Link the entry into the slot matching its expiry, relative to the first unprocessed tick
+ *
+ * @param wheel Pointer to the wheel
+ * @param entry Unlinked entry with 'expires' set
+ * @param base First tick that is not processed yet
+ */
+static void timer_wheel_place(timer_wheel_t *wheel, timer_wheel_entry_t *entry, uint32_t base) {
+    uint64_t expires = (entry->expires < base) ? base : entry->expires;
+    uint64_t delta = expires - base;
+
+    if (delta >= TIMER_WHEEL_SPAN) {
+        // beyond the horizon: park in the top level, it is re-inserted when that slot turns over
+        expires = base + TIMER_WHEEL_SPAN - 1;
+        delta = TIMER_WHEEL_SPAN - 1;
+    }
+
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (TIMER_WHEEL_LEVEL_BITS * (level + 1)))) {
+        level++;
+    }
+    int slot = (int)((expires >> (TIMER_WHEEL_LEVEL_BITS * level)) & TIMER_WHEEL_SLOT_MASK);
+
+    timer_wheel_entry_t *head = &wheel->slots[level][slot];
+    entry->next = head;
+    entry->prev = head->prev;
+    head->prev->next = entry;
+    head->prev = entry;
+    entry->level = (uint8_t)level;
+    entry->slot = (uint8_t)slot;
+    entry->linked = true;
+    wheel->occupied[level] |= (uint64_t)1 << slot;
+}
+
+/**
+ * @brief: Unlink the entry from its slot
+ */
+static void timer_wheel_unlink(timer_wheel_t *wheel, timer_wheel_entry_t *entry) {
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+
+    timer_wheel_entry_t *head = &wheel->slots[entry->level][entry->slot];
+    if (head->next == head) {
+        wheel->occupied[entry->level] &= ~((uint64_t)1 << entry->slot);
+    }
+    entry->next = NULL;
+    entry->prev = NULL;
+    entry->linked = false;
+}
+
+/**
+ * @brief: Add the entry to the wheel. An entry already in the wheel is moved.
+ *
+ * @param wheel Pointer to the wheel
+ * @param entry Pointer to the entry
+ * @param expires Absolute tick the entry is due at. Past ticks expire on the next advance.
+ */
+void timer_wheel_add(timer_wheel_t *wheel, timer_wheel_entry_t *entry, uint32_t expires) {
+    if (entry->linked) {
+        timer_wheel_del(wheel, entry);
+    }
+    entry->expires = expires;
+    timer_wheel_place(wheel, entry, wheel->now + 1);
+    wheel->count++;
+}
+
+/**
+ * @brief: Remove the entry from the wheel. Entries not in the wheel are ignored.
+ *
+ * @param wheel Pointer to the wheel
+ * @param entry Pointer to the entry
+ */
+void timer_wheel_del(timer_wheel_t *wheel, timer_wheel_entry_t *entry) {
+    if (!entry->linked) {
+        return;
+    }
+    timer_wheel_unlink(wheel, entry);
+    wheel->count--;
+}
+
+/**
+ * @brief: Find the next tick the wheel has work at: an entry expires or a higher level slot has to
+ *         be moved down. No entry expires before this tick, so the owner can sleep until it.
+ *
+ * @param wheel Pointer to the wheel
+ * @return uint32_t the tick, TIMER_WHEEL_NO_DEADLINE if the wheel is empty
+ */
+uint32_t timer_wheel_next_tick(const timer_wheel_t *wheel) {
+    uint64_t first = (uint64_t)wheel->now + 1;
+    uint64_t next = UINT64_MAX;
+
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        if (wheel->occupied[level] == 0) {
+            continue;
+        }
+        // slots of this level are visited every 2^(6*level) ticks: find the first visit of an occupied one
+        unsigned int shift = TIMER_WHEEL_LEVEL_BITS * level;
+        uint64_t bucket = (first + ((uint64_t)1 << shift) - 1) >> shift;
+        uint64_t pending = timer_wheel_rotr(wheel->occupied[level], (unsigned int)(bucket & TIMER_WHEEL_SLOT_MASK));
+        uint64_t tick = (bucket + (uint64_t)__builtin_ctzll(pending)) << shift;
+        if (tick < next) {
+            next = tick;
+        }
+    }
+
+    return (next > UINT32_MAX) ? TIMER_WHEEL_NO_DEADLINE : (uint32_t)next;
+}
+
+/**
+ * @brief: Move the entries of the slot down the levels. Called at the tick the slot turns over.
+ */
+static void timer_wheel_cascade(timer_wheel_t *wheel, int level, int slot, uint32_t tick) {
+    timer_wheel_entry_t *head = &wheel->slots[level][slot];
+    timer_wheel_entry_t *entry = head->next;
+
+    head->next = head;
+    head->prev = head;
+    wheel->occupied[level] &= ~((uint64_t)1 << slot);
+
+    while (entry != head) {
+        timer_wheel_entry_t *next = entry->next;
+        timer_wheel_place(wheel, entry, tick);
+        entry = next;
+    }
+}
+
+/**
+ * @brief: Advance the wheel to the given tick and collect expired entries. Ticks with no work are
+ *         skipped, so the cost does not depend on how far the wheel moves.
+ *
+ * @param wheel Pointer to the wheel
+ * @param now Current tick. Moving back is ignored.
+ * @return timer_wheel_entry_t* list of expired entries linked by 'next', NULL if none. The entries are
+ *         out of the wheel: read 'next' before adding an entry back.
+ */
+timer_wheel_entry_t *timer_wheel_advance(timer_wheel_t *wheel, uint32_t now) {
+    timer_wheel_entry_t *expired = NULL;
+    timer_wheel_entry_t **tail = &expired;
+
+    while (wheel->now < now) {
+        uint32_t tick = timer_wheel_next_tick(wheel);
+        if (tick == TIMER_WHEEL_NO_DEADLINE || tick > now) {
+            wheel->now = now;
+            break;
+        }
+
+        // top-down, so entries moved to a lower level slot that turns over at the same tick are moved again
+        for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+            unsigned int shift = TIMER_WHEEL_LEVEL_BITS * level;
+            if ((tick & ((1UL << shift) - 1)) == 0) {
+                int slot = (int)((tick >> shift) & TIMER_WHEEL_SLOT_MASK);
+                if (wheel->occupied[level] & ((uint64_t)1 << slot)) {
+                    timer_wheel_cascade(wheel, level, slot, tick);
+                }
+            }
+        }
+
+        int slot = (int)(tick & TIMER_WHEEL_SLOT_MASK);
+        timer_wheel_entry_t *head = &wheel->slots[0][slot];
+        while (head->next != head) {
+            timer_wheel_entry_t *entry = head->next;
+            timer_wheel_unlink(wheel, entry);
+            wheel->count--;
+            *tail = entry;
+            tail = &entry->next;
+        }
+        wheel->now = tick;
+    }
+
+    *tail = NULL;
+    return expired;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file timer_wheel.h
+ * @brief Hierarchical timer wheel with one second resolution
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * The core is plain C with no ESP-IDF dependencies: time is passed in by the caller. Four levels
+ * of 64 slots cover 2^24 seconds (~194 days) ahead, entries further away wait in the top level and
+ * are re-inserted when it turns over. Adding and removing an entry is O(1). Every level keeps a
+ * bitmap of its non-empty slots, so the next tick with work to do is found with a few bit scans
+ * and the owner can sleep until then instead of ticking every second.
+ */
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** TYPES **/
+
+/**
+ * @brief: Timer entry. Embedded into the owner's record, the wheel does not allocate.
+ */
+typedef struct timer_wheel_entry {
+    struct timer_wheel_entry *next;
+    struct timer_wheel_entry *prev;
+    uint32_t expires;               // Absolute tick (second) the entry is due at
+    uint8_t level;                  // Position in the wheel, valid while linked
+    uint8_t slot;
+    bool linked;                    // Entry is in the wheel
+} timer_wheel_entry_t;
+
+/** SETTINGS AND CONSTANTS **/
+
+#define TIMER_WHEEL_LEVEL_BITS  6
+#define TIMER_WHEEL_SLOTS       (1 << TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_LEVELS      4
+
+#define TIMER_WHEEL_NO_DEADLINE UINT32_MAX
+
+/**
+ * @brief: Timer wheel. Slots are circular lists with the slot itself as the head.
+ */
+typedef struct {
+    timer_wheel_entry_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_WHEEL_LEVELS];  // Bit per non-empty slot
+    uint32_t now;                           // Last processed tick
+    uint32_t count;                         // Entries in the wheel
+} timer_wheel_t;
+
+/** ROUTINES **/
+void timer_wheel_init(timer_wheel_t *wheel, uint32_t now);
+void timer_wheel_add(timer_wheel_t *wheel, timer_wheel_entry_t *entry, uint32_t expires);
+void timer_wheel_del(timer_wheel_t *wheel, timer_wheel_entry_t *entry);
+uint32_t timer_wheel_next_tick(const timer_wheel_t *wheel);
+timer_wheel_entry_t *timer_wheel_advance(timer_wheel_t *wheel, uint32_t now);
+
+#endif // TIMER_WHEEL_H
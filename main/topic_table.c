@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "topic_table.h"
+
+/* Suffix of every topic kind, appended to the base (or the command base for TOPIC_KIND_SET) */
+static const char *const TOPIC_SUFFIX[TOPIC_KIND_MAX] = {
+    [TOPIC_KIND_JSON] = "",
+    [TOPIC_KIND_STATE] = "/state",
+    [TOPIC_KIND_CHANNEL] = "/channel",
+    [TOPIC_KIND_INVERTED] = "/inverted",
+    [TOPIC_KIND_GPIO_PIN] = "/gpio_pin",
+    [TOPIC_KIND_ENABLED] = "/enabled",
+    [TOPIC_KIND_TYPE] = "/type",
+    [TOPIC_KIND_COUNT] = "/count",
+    [TOPIC_KIND_RATE] = "/rate",
+    [TOPIC_KIND_SET] = "/set",
+};
+
+/**
+ * @brief: Append "a/b/c/d" + suffix to the arena, NUL-terminated
+ *
+ * @return offset of the appended topic
+ */
+static uint32_t topic_table_append(char *arena, size_t *used, const char *const parts[4], const char *suffix) {
+    uint32_t offset = (uint32_t)*used;
+    char *p = arena + *used;
+    for (int i = 0; i < 4 && parts[i] != NULL; i++) {
+        if (i > 0) {
+            *p++ = '/';
+        }
+        size_t len = strlen(parts[i]);
+        memcpy(p, parts[i], len);
+        p += len;
+    }
+    size_t len = strlen(suffix);
+    memcpy(p, suffix, len + 1);
+    p += len + 1;
+    *used = p - arena;
+    return offset;
+}
+
+/**
+ * @brief: Length of "a/b/c/d" + suffix, with the NUL
+ */
+static size_t topic_table_length(const char *const parts[4], const char *suffix) {
+    size_t len = strlen(suffix) + 1;
+    for (int i = 0; i < 4 && parts[i] != NULL; i++) {
+        len += strlen(parts[i]) + (i > 0 ? 1 : 0);
+    }
+    return len;
+}
+
+/**
+ * @brief: Build the topic table
+ *
+ * The size is calculated first, so the whole table takes one allocation. On failure the table is left empty.
+ *
+ * @param[out] table Table to build. Must be empty or freed before.
+ * @param prefix MQTT topic prefix
+ * @param device_id Device ID
+ * @param availability_path Path of the device availability topic
+ * @param units Units to build the topics for
+ * @param unit_count Number of units
+ * @param slots Unit slots in the table, every unit's slot must be below it
+ * @return true on success, false on an invalid slot or allocation failure
+ */
+bool topic_table_build(topic_table_t *table, const char *prefix, const char *device_id, const char *availability_path,
+                       const topic_unit_spec_t *units, size_t unit_count, uint16_t slots) {
+    memset(table, 0, sizeof(*table));
+
+    const char *device_parts[4] = { prefix, device_id, availability_path, NULL };
+    size_t offsets_size = (size_t)slots * TOPIC_KIND_MAX * sizeof(uint32_t);
+    size_t size = offsets_size + topic_table_length(device_parts, "");
+
+    for (size_t u = 0; u < unit_count; u++) {
+        if (units[u].slot >= slots) {
+            return false;
+        }
+        const char *state_parts[4] = { prefix, device_id, units[u].key, units[u].state_path };
+        const char *command_parts[4] = { prefix, device_id, units[u].key, units[u].command_path };
+        for (int k = 0; k < TOPIC_KIND_MAX; k++) {
+            if (units[u].kinds & (1u << k)) {
+                size += topic_table_length((k == TOPIC_KIND_SET) ? command_parts : state_parts, TOPIC_SUFFIX[k]);
+            }
+        }
+    }
+
+    char *arena = malloc(size);
+    if (arena == NULL) {
+        return false;
+    }
+
+    uint32_t *offsets = (uint32_t *)arena;
+    for (size_t i = 0; i < (size_t)slots * TOPIC_KIND_MAX; i++) {
+        offsets[i] = TOPIC_TABLE_NONE;
+    }
+
+    size_t used = offsets_size;
+    table->availability = topic_table_append(arena, &used, device_parts, "");
+
+    for (size_t u = 0; u < unit_count; u++) {
+        const char *state_parts[4] = { prefix, device_id, units[u].key, units[u].state_path };
+        const char *command_parts[4] = { prefix, device_id, units[u].key, units[u].command_path };
+        uint32_t *unit_offsets = offsets + (size_t)units[u].slot * TOPIC_KIND_MAX;
+        for (int k = 0; k < TOPIC_KIND_MAX; k++) {
+            if (units[u].kinds & (1u << k)) {
+                unit_offsets[k] = topic_table_append(arena, &used, (k == TOPIC_KIND_SET) ? command_parts : state_parts, TOPIC_SUFFIX[k]);
+            }
+        }
+    }
+
+    table->arena = arena;
+    table->size = size;
+    table->slots = slots;
+    table->units = (uint16_t)unit_count;
+    return true;
+}
+
+/**
+ * @brief: Free the topic table and leave it empty
+ *
+ * @param table Pointer to the table
+ */
+void topic_table_free(topic_table_t *table) {
+    free(table->arena);
+    memset(table, 0, sizeof(*table));
+}
@@ -0,0 +1,99 @@
+/**
+ * @file topic_table.h
+ * @brief Precomputed MQTT topics of all units, stored in a single arena
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * The core is plain C with no ESP-IDF dependencies. Topics of every unit are built once, when the
+ * units or the MQTT prefix change, into one allocation: a table of offsets (slot x topic kind)
+ * followed by the NUL-terminated topics. Publishing, subscribing and command handling then only
+ * index into the table instead of formatting the same strings over and over. A slot is a fixed
+ * position of a unit chosen by the caller (e.g. by its type and channel), so lookups are O(1)
+ * and don't depend on the order of units in memory.
+ */
+#ifndef TOPIC_TABLE_H
+#define TOPIC_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/** TYPES **/
+
+/**
+ * @brief: Topics of a unit, "<base>" is "<prefix>/<device_id>/<key>/<state_path>"
+ */
+typedef enum {
+    TOPIC_KIND_JSON = 0,        // <base>: the whole unit as JSON
+    TOPIC_KIND_STATE,           // <base>/state
+    TOPIC_KIND_CHANNEL,         // <base>/channel
+    TOPIC_KIND_INVERTED,        // <base>/inverted
+    TOPIC_KIND_GPIO_PIN,        // <base>/gpio_pin
+    TOPIC_KIND_ENABLED,         // <base>/enabled
+    TOPIC_KIND_TYPE,            // <base>/type
+    TOPIC_KIND_COUNT,           // <base>/count, pulse counters
+    TOPIC_KIND_RATE,            // <base>/rate, pulse counters
+    TOPIC_KIND_SET,             // <prefix>/<device_id>/<key>/<command_path>/set: command topic
+    TOPIC_KIND_MAX
+} topic_kind_t;
+
+#define TOPIC_KINDS_ALL         ((1u << TOPIC_KIND_MAX) - 1)
+#define TOPIC_KINDS_BASIC       (TOPIC_KINDS_ALL & ~((1u << TOPIC_KIND_COUNT) | (1u << TOPIC_KIND_RATE)))
+
+/**
+ * @brief: Unit to build the topics for
+ */
+typedef struct {
+    uint16_t slot;              // Position of the unit in the table, below the slot count
+    uint16_t kinds;             // Bit per topic_kind_t to build, others are looked up as NULL
+    const char *key;            // Unit key, e.g. "relay_ch_1"
+    const char *state_path;     // Path of the state topics, e.g. "switch"
+    const char *command_path;   // Path of the command topic
+} topic_unit_spec_t;
+
+/**
+ * @brief: Topic table
+ */
+typedef struct {
+    char *arena;                // Offsets (slots x TOPIC_KIND_MAX) followed by the topics. NULL if not built.
+    size_t size;                // Bytes allocated
+    uint16_t slots;             // Unit slots in the table
+    uint16_t units;             // Units built
+    uint32_t availability;      // Offset of the device availability topic
+} topic_table_t;
+
+/** SETTINGS AND CONSTANTS **/
+
+#define TOPIC_TABLE_NONE        UINT32_MAX      // Offset of a topic that was not built
+
+/** ROUTINES **/
+bool topic_table_build(topic_table_t *table, const char *prefix, const char *device_id, const char *availability_path,
+                       const topic_unit_spec_t *units, size_t unit_count, uint16_t slots);
+void topic_table_free(topic_table_t *table);
+
+/**
+ * @brief: Topic of a unit
+ *
+ * @param table Pointer to the table
+ * @param slot Slot of the unit
+ * @param kind Topic to get
+ * @return the topic, NULL if the table, the unit or this topic of it was not built
+ */
+static inline const char *topic_table_get(const topic_table_t *table, uint16_t slot, topic_kind_t kind) {
+    if (table->arena == NULL || slot >= table->slots || (unsigned)kind >= TOPIC_KIND_MAX) {
+        return NULL;
+    }
+    uint32_t offset = ((const uint32_t *)table->arena)[(size_t)slot * TOPIC_KIND_MAX + kind];
+    return (offset != TOPIC_TABLE_NONE) ? table->arena + offset : NULL;
+}
+
+/**
+ * @brief: Availability topic of the device: "<prefix>/<device_id>/<availability_path>"
+ *
+ * @param table Pointer to the table
+ * @return the topic, NULL if the table was not built
+ */
+static inline const char *topic_table_availability(const topic_table_t *table) {
+    return (table->arena != NULL) ? table->arena + table->availability : NULL;
+}
+
+#endif // TOPIC_TABLE_H
@@ -0,0 +1,40 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "unit_key.h"
+
+/**
+ * @brief: Parse the channel of a unit key
+ *
+ * Only the canonical form is accepted, the one "%s%d" formats: decimal digits without leading zeros
+ * and nothing after them. So "relay_ch_01" or "relay_ch_1 " never resolve to channel 1.
+ *
+ * @param key Unit key, e.g. "relay_ch_3"
+ * @param prefix Key prefix of the unit type, e.g. "relay_ch_"
+ * @param channel_max Highest valid channel
+ * @return the channel (0 - channel_max), UNIT_KEY_NONE if the key is not a canonical key of this type and range
+ */
+int unit_key_channel(const char *key, const char *prefix, int channel_max) {
+    if (key == NULL || prefix == NULL) {
+        return UNIT_KEY_NONE;
+    }
+
+    size_t prefix_len = strlen(prefix);
+    if (strncmp(key, prefix, prefix_len) != 0) {
+        return UNIT_KEY_NONE;
+    }
+
+    const char *p = key + prefix_len;
+    if (*p < '0' || *p > '9' || (p[0] == '0' && p[1] != '\0')) {
+        return UNIT_KEY_NONE;
+    }
+
+    int channel = 0;
+    for (; *p >= '0' && *p <= '9'; p++) {
+        channel = channel * 10 + (*p - '0');
+        if (channel > channel_max) {
+            return UNIT_KEY_NONE;
+        }
+    }
+    return (*p == '\0') ? channel : UNIT_KEY_NONE;
+}
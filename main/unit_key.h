@@ -0,0 +1,20 @@
+/**
+ * @file unit_key.h
+ * @brief Parsing of unit NVS keys ("<prefix><channel>", e.g. "relay_ch_3") into channels
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * The core is plain C with no ESP-IDF dependencies. Keys are resolved by parsing the channel out of the
+ * key instead of formatting and comparing the key of every unit, so relay.c finds a unit by key with one
+ * access into its directly addressed channel tables.
+ */
+#ifndef UNIT_KEY_H
+#define UNIT_KEY_H
+
+/** SETTINGS AND CONSTANTS **/
+
+#define UNIT_KEY_NONE           (-1)
+
+/** ROUTINES **/
+int unit_key_channel(const char *key, const char *prefix, int channel_max);
+
+#endif // UNIT_KEY_H
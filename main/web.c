@@ -19,6 +19,9 @@
 #include "relay.h"
 #include "web.h"
 #include "status.h"
+#include "rules.h"
+#include "schedule.h"
+#include "time_sync.h"
 // #include "hass.h"
 #include "mqtt.h"
 #include "wifi.h"
@@ -52,7 +55,7 @@ void run_http_server(void *param) {
 
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
 #if _DEVICE_ENABLE_WEB
-    config.max_uri_handlers = 24;
+    config.max_uri_handlers = 28;
 #else
     config.max_uri_handlers = 16;
 #endif
@@ -198,6 +201,17 @@ void run_http_server(void *param) {
         ESP_LOGI(TAG, "Register %s => %s", update_relay_uri.uri, esp_err_to_name(err));
         h_count++;
 
+        // Register the batch relay update handler
+        httpd_uri_t relays_batch_uri = {
+            .uri      = "/api/relays/batch",
+            .method   = HTTP_POST,
+            .handler  = relays_batch_post_handler,
+            .user_ctx = NULL
+        };
+        err = httpd_register_uri_handler(server, &relays_batch_uri);
+        ESP_LOGI(TAG, "Register %s => %s", relays_batch_uri.uri, esp_err_to_name(err));
+        h_count++;
+
         // Register the status web service handler
         httpd_uri_t status_webserver_get_uri = {
             .uri       = "/api/status",
@@ -276,6 +290,68 @@ void run_http_server(void *param) {
         ESP_LOGI(TAG, "Register %s => %s", api_control_uri.uri, esp_err_to_name(err));
         h_count++;
 
+        // On-device rules
+        httpd_uri_t rules_get_uri = {
+            .uri      = "/api/rules",
+            .method   = HTTP_GET,
+            .handler  = rules_get_handler,
+            .user_ctx = NULL
+        };
+        err = httpd_register_uri_handler(server, &rules_get_uri);
+        ESP_LOGI(TAG, "Register %s => %s", rules_get_uri.uri, esp_err_to_name(err));
+        h_count++;
+
+        httpd_uri_t rules_update_uri = {
+            .uri      = "/api/rules/update",
+            .method   = HTTP_POST,
+            .handler  = rules_update_post_handler,
+            .user_ctx = NULL
+        };
+        err = httpd_register_uri_handler(server, &rules_update_uri);
+        ESP_LOGI(TAG, "Register %s => %s", rules_update_uri.uri, esp_err_to_name(err));
+        h_count++;
+
+        httpd_uri_t rules_delete_uri = {
+            .uri      = "/api/rules/delete",
+            .method   = HTTP_POST,
+            .handler  = rules_delete_post_handler,
+            .user_ctx = NULL
+        };
+        err = httpd_register_uri_handler(server, &rules_delete_uri);
+        ESP_LOGI(TAG, "Register %s => %s", rules_delete_uri.uri, esp_err_to_name(err));
+        h_count++;
+
+        // Schedules
+        httpd_uri_t schedules_get_uri = {
+            .uri      = "/api/schedules",
+            .method   = HTTP_GET,
+            .handler  = schedules_get_handler,
+            .user_ctx = NULL
+        };
+        err = httpd_register_uri_handler(server, &schedules_get_uri);
+        ESP_LOGI(TAG, "Register %s => %s", schedules_get_uri.uri, esp_err_to_name(err));
+        h_count++;
+
+        httpd_uri_t schedules_update_uri = {
+            .uri      = "/api/schedules/update",
+            .method   = HTTP_POST,
+            .handler  = schedules_update_post_handler,
+            .user_ctx = NULL
+        };
+        err = httpd_register_uri_handler(server, &schedules_update_uri);
+        ESP_LOGI(TAG, "Register %s => %s", schedules_update_uri.uri, esp_err_to_name(err));
+        h_count++;
+
+        httpd_uri_t schedules_delete_uri = {
+            .uri      = "/api/schedules/delete",
+            .method   = HTTP_POST,
+            .handler  = schedules_delete_post_handler,
+            .user_ctx = NULL
+        };
+        err = httpd_register_uri_handler(server, &schedules_delete_uri);
+        ESP_LOGI(TAG, "Register %s => %s", schedules_delete_uri.uri, esp_err_to_name(err));
+        h_count++;
+
 #endif     
         ESP_LOGI(TAG, "%d HTTP handlers registered. Server ready!", h_count);
     } else {
@@ -1178,6 +1254,9 @@ static esp_err_t submit_config_handler(httpd_req_t *req) {
     ESP_ERROR_CHECK(nvs_write_uint16(S_NAMESPACE, S_KEY_NET_LOGGING_PORT, net_log_port));
     ESP_ERROR_CHECK(nvs_write_uint16(S_NAMESPACE, S_KEY_NET_LOGGING_KEEP_STDOUT, net_log_stdout));
 
+    // MQTT connection mode and prefixes may have changed
+    mqtt_config_reload();
+
 
     /** Load and display settings */
 
@@ -1779,10 +1858,26 @@ static esp_err_t relays_get_handler(httpd_req_t *req) {
 /**
  * @brief Handler for /api/relay/update endpoint
  *
+ * The unit is resolved once and updated in several steps, some of them blocking on NVS and drivers: in-memory units
+ * are held in place meanwhile, so a concurrent reconfiguration can't move another unit under the pointer.
+ *
  * @param req HTTP request
  * @return ESP_OK or ESP_FAIL
  */
 static esp_err_t update_relay_post_handler(httpd_req_t *req) {
+    relay_units_hold();
+    esp_err_t err = update_relay_unit(req);
+    relay_units_release();
+    return err;
+}
+
+/**
+ * @brief Update the relay unit from the /api/relay/update request. Called with in-memory units held in place.
+ *
+ * @param req HTTP request
+ * @return ESP_OK or ESP_FAIL
+ */
+static esp_err_t update_relay_unit(httpd_req_t *req) {
     char content[512];
     esp_err_t err;
 
@@ -1858,6 +1953,8 @@ static esp_err_t update_relay_post_handler(httpd_req_t *req) {
     relay_unit_t *relay = NULL;
     if (relay_type == RELAY_TYPE_SENSOR) {
         err = get_relay_sensor_from_memory_by_key(relay_key, &relay);
+    } else if (relay_type == RELAY_TYPE_PULSE_COUNTER) {
+        err = get_relay_pulse_counter_from_memory_by_key(relay_key, &relay);
     } else {
         err = get_relay_actuator_from_memory_by_key(relay_key, &relay);
     }
@@ -1869,10 +1966,72 @@ static esp_err_t update_relay_post_handler(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
-    // capture old gpio_pin
+    // capture old gpio_pin and debounce window
     int gpio_pin_old = relay->gpio_pin;
+    uint16_t debounce_ms_old = relay->debounce_ms;
+
+    // Validate debounce window if provided in the JSON
+    cJSON *relay_debounce_item = cJSON_GetObjectItem(data, "relay_debounce_ms");
+    if (relay_debounce_item != NULL && cJSON_IsNumber(relay_debounce_item)) {
+        if (relay_debounce_item->valueint < 0 || relay_debounce_item->valueint > DEBOUNCE_TIME_MS_MAX) {
+            ESP_LOGE(TAG, "Invalid debounce window: %d", relay_debounce_item->valueint);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid debounce window");
+            cJSON_Delete(json);
+            return ESP_FAIL;
+        }
+    }
+
+    // Validate pulse width if provided in the JSON
+    cJSON *relay_pulse_item = cJSON_GetObjectItem(data, "relay_pulse_ms");
+    if (relay_pulse_item != NULL && cJSON_IsNumber(relay_pulse_item)) {
+        if (relay->type != RELAY_TYPE_ACTUATOR || relay_pulse_item->valueint < 0 || relay_pulse_item->valueint > RELAY_PULSE_MS_MAX) {
+            ESP_LOGE(TAG, "Invalid pulse width: %d", relay_pulse_item->valueint);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid pulse width");
+            cJSON_Delete(json);
+            return ESP_FAIL;
+        }
+    }
+
+    // Validate interlock group if provided in the JSON
+    cJSON *relay_interlock_item = cJSON_GetObjectItem(data, "relay_interlock_group");
+    if (relay_interlock_item != NULL && cJSON_IsNumber(relay_interlock_item)) {
+        if (relay->type != RELAY_TYPE_ACTUATOR || relay_interlock_item->valueint < 0 || relay_interlock_item->valueint > RELAY_INTERLOCK_GROUPS_MAX) {
+            ESP_LOGE(TAG, "Invalid interlock group: %d", relay_interlock_item->valueint);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid interlock group");
+            cJSON_Delete(json);
+            return ESP_FAIL;
+        }
+    }
+
+    // Validate zero-cross switching parameters if provided in the JSON
+    cJSON *relay_zero_cross_item = cJSON_GetObjectItem(data, "relay_zero_cross");
+    if (relay_zero_cross_item != NULL && cJSON_IsBool(relay_zero_cross_item) && relay->type != RELAY_TYPE_ACTUATOR) {
+        ESP_LOGE(TAG, "Zero-cross switching is not applicable to relay unit type %d", relay->type);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Zero-cross switching is for actuators only");
+        cJSON_Delete(json);
+        return ESP_FAIL;
+    }
+    cJSON *relay_zc_offset_item = cJSON_GetObjectItem(data, "relay_zc_offset_us");
+    if (relay_zc_offset_item != NULL && cJSON_IsNumber(relay_zc_offset_item)) {
+        if (relay->type != RELAY_TYPE_ACTUATOR || relay_zc_offset_item->valueint < 0 || relay_zc_offset_item->valueint > RELAY_ZC_OFFSET_US_MAX) {
+            ESP_LOGE(TAG, "Invalid zero-cross offset: %d", relay_zc_offset_item->valueint);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid zero-cross offset");
+            cJSON_Delete(json);
+            return ESP_FAIL;
+        }
+    }
+    cJSON *relay_zc_latency_item = cJSON_GetObjectItem(data, "relay_zc_latency_us");
+    if (relay_zc_latency_item != NULL && cJSON_IsNumber(relay_zc_latency_item)) {
+        if (relay->type != RELAY_TYPE_ACTUATOR || relay_zc_latency_item->valueint < 0 || relay_zc_latency_item->valueint > RELAY_ZC_LATENCY_US_MAX) {
+            ESP_LOGE(TAG, "Invalid relay latency: %d", relay_zc_latency_item->valueint);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid relay latency");
+            cJSON_Delete(json);
+            return ESP_FAIL;
+        }
+    }
 
     // Validate GPIO pin if provided in the JSON
+    int gpio_pin_new = gpio_pin_old;
     cJSON *relay_gpio_pin_item = cJSON_GetObjectItem(data, "relay_gpio_pin");
     if (relay_gpio_pin_item != NULL && cJSON_IsNumber(relay_gpio_pin_item)) {
         int gpio_pin = relay_gpio_pin_item->valueint;
@@ -1886,16 +2045,26 @@ static esp_err_t update_relay_post_handler(httpd_req_t *req) {
         }
 
         // if we provide a new GPIO pin -- make sure it is not use
-        if (gpio_pin_old != relay->gpio_pin && is_gpio_pin_in_use(gpio_pin)) {
+        if (gpio_pin != gpio_pin_old && is_gpio_pin_in_use(gpio_pin)) {
             ESP_LOGE(TAG, "GPIO pin %d is in use", gpio_pin);
             httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "GPIO pin is in use");
             cJSON_Delete(json);
             return ESP_FAIL;
         }
-        relay->gpio_pin = gpio_pin;
+        gpio_pin_new = gpio_pin;
     }
 
     // Update relay properties based on the JSON data (if provided)
+    // The unit is shared with other tasks: apply all changes in one writer section, so readers never see a half-updated unit
+    relay_units_write_lock();
+
+    relay->gpio_pin = gpio_pin_new;
+
+    // keep GPIO lookup index in sync with the new pin
+    if (gpio_pin_old != relay->gpio_pin) {
+        relay_units_index_rebuild();
+    }
+
     cJSON *relay_state_item = cJSON_GetObjectItem(data, "relay_state");
     if (relay_state_item != NULL && cJSON_IsBool(relay_state_item)) {
         relay->state = relay_state_item->valueint ? RELAY_STATE_ON : RELAY_STATE_OFF;
@@ -1911,8 +2080,72 @@ static esp_err_t update_relay_post_handler(httpd_req_t *req) {
         relay->inverted = relay_inverted_item->valueint;
     }
 
-    // save to NVS: actuators -- via setting the state, sensors -- just saving
-    if (relay->type == RELAY_TYPE_ACTUATOR) {
+    if (relay_debounce_item != NULL && cJSON_IsNumber(relay_debounce_item)) {
+        relay->debounce_ms = (uint16_t)relay_debounce_item->valueint;
+    }
+
+    if (relay_pulse_item != NULL && cJSON_IsNumber(relay_pulse_item)) {
+        relay->pulse_ms = (uint16_t)relay_pulse_item->valueint;
+    }
+
+    if (relay_interlock_item != NULL && cJSON_IsNumber(relay_interlock_item)) {
+        relay->interlock_group = (uint8_t)relay_interlock_item->valueint;
+    }
+
+    if (relay_zero_cross_item != NULL && cJSON_IsBool(relay_zero_cross_item)) {
+        relay->zero_cross = cJSON_IsTrue(relay_zero_cross_item);
+    }
+
+    if (relay_zc_offset_item != NULL && cJSON_IsNumber(relay_zc_offset_item)) {
+        relay->zc_offset_us = (uint16_t)relay_zc_offset_item->valueint;
+    }
+
+    if (relay_zc_latency_item != NULL && cJSON_IsNumber(relay_zc_latency_item)) {
+        relay->zc_latency_us = (uint16_t)relay_zc_latency_item->valueint;
+    }
+
+    // momentary actuator switched ON: the state is set by the pulse below
+    bool start_pulse = (relay->type == RELAY_TYPE_ACTUATOR && relay->pulse_ms > 0 && relay->state == RELAY_STATE_ON
+                        && relay_state_item != NULL && cJSON_IsTrue(relay_state_item));
+
+    relay_units_write_unlock();
+
+    // save to NVS: actuators -- via setting the state, sensors and pulse counters -- just saving
+    if (relay->type == RELAY_TYPE_PULSE_COUNTER) {
+        err = save_relay_to_nvs(relay_key, relay);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to save relay to NVS");
+            cJSON_Delete(json);
+            httpd_resp_send_500(req);
+            return ESP_FAIL;
+        }
+
+        // re-attach to PCNT: applies new pin, inversion (counted edge) and enabled flag. Total count is kept.
+        if (gpio_pin_old != relay->gpio_pin) {
+            relay_units_write_lock();
+            relay_gpio_deinit(relay);
+            relay_units_write_unlock();
+        }
+        err = relay_pulse_counter_attach(relay);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to attach pulse counter to GPIO pin %d", relay->gpio_pin);
+            cJSON_Delete(json);
+            httpd_resp_send_500(req);
+            return ESP_FAIL;
+        }
+    } else if (relay->type == RELAY_TYPE_ACTUATOR && start_pulse) {
+        err = relay_set_state_pulse(relay, relay->pulse_ms, LATENCY_PATH_NONE, 0);
+        if (err == ESP_OK) {
+            // save the rest of the changes, the momentary state itself is not persisted
+            err = relay_persist_mark_dirty(relay);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start the pulse and save the relay to NVS");
+            cJSON_Delete(json);
+            httpd_resp_send_500(req);
+            return ESP_FAIL;
+        }
+    } else if (relay->type == RELAY_TYPE_ACTUATOR) {
         err = relay_set_state(relay, relay->state, true);
         if (err != ESP_OK) {
             ESP_LOGE(TAG, "Failed to set relay state and save it to NVS");
@@ -1932,7 +2165,10 @@ static esp_err_t update_relay_post_handler(httpd_req_t *req) {
 
         // if pin changed -- re-assign the ISR
         if (gpio_pin_old != relay->gpio_pin) {
+            relay_sensor_unregister_isr(gpio_pin_old);
+            relay_units_write_lock();
             err = relay_gpio_init(relay);
+            relay_units_write_unlock();
             if (err != ESP_OK) {
                 ESP_LOGE(TAG, "Failed to init new pin number %d when updating the sensor unit", relay->gpio_pin);
                 cJSON_Delete(json);
@@ -1946,6 +2182,9 @@ static esp_err_t update_relay_post_handler(httpd_req_t *req) {
                 httpd_resp_send_500(req);
                 return ESP_FAIL;
             }           
+        } else if (debounce_ms_old != relay->debounce_ms) {
+            // same pin, new debounce window
+            relay_sensor_debounce_reset(relay);
         }
     }
 
@@ -1982,6 +2221,155 @@ static esp_err_t update_relay_post_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+/**
+ * @brief Handler for /api/relays/batch endpoint. Switches several actuators as one transaction.
+ *
+ * All entries are validated first, then the outputs are driven together and saved with one NVS commit.
+ *
+ * @param req HTTP request
+ * @return ESP_OK or ESP_FAIL
+ */
+static esp_err_t relays_batch_post_handler(httpd_req_t *req) {
+    /*
+        Request format:
+        {
+            "device_id": "<device_id>",
+            "device_serial": "<device_serial>",
+            "data": [
+                { "relay_key": "relay_ch_0", "state": true },
+                { "relay_key": "relay_ch_1", "state": false },
+                { "relay_key": "relay_ch_2", "state": true, "pulse_ms": 500 }
+            ]
+        }
+    */
+    char content[MAX_JSON_BUFFER_SIZE];
+    esp_err_t err;
+
+    // Get the POST data
+    int total_len = req->content_len;
+    int received = 0;
+    if (total_len >= sizeof(content)) {
+        ESP_LOGE(TAG, "Content size overflowing the buffer!");
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    while (received < total_len) {
+        int ret = httpd_req_recv(req, content + received, total_len - received);
+        if (ret <= 0) {
+            ESP_LOGE(TAG, "Unexpected error while reading from request: %i", ret);
+            httpd_resp_send_500(req);
+            return ESP_FAIL;
+        }
+        received += ret;
+    }
+    content[received] = '\0';
+
+    // Parse the incoming JSON data
+    cJSON *json = cJSON_Parse(content);
+    if (json == NULL) {
+        ESP_LOGE(TAG, "Failed to parse JSON");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to parse JSON");
+        return ESP_FAIL;
+    }
+
+    // Validate device ID and serial from NVS
+    if (validate_device_identity_from_json(json) != ESP_OK) {
+        ESP_LOGE(TAG, "Device identity validation failed: invalid serial or ID");
+        httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "Device identity validation failed: invalid serial or ID");
+        cJSON_Delete(json);
+        return ESP_FAIL;
+    }
+
+    // Get the 'data' array from JSON
+    cJSON *data = cJSON_GetObjectItem(json, "data");
+    int count = cJSON_GetArraySize(data);
+    if (!cJSON_IsArray(data) || count < 1 || count > CHANNEL_COUNT_MAX + 1) {
+        ESP_LOGE(TAG, "Missing, empty or too long 'data' array in JSON");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing, empty or too long 'data' array");
+        cJSON_Delete(json);
+        return ESP_FAIL;
+    }
+
+    // Validation pass: resolve every entry before anything is changed
+    unit_handle_t units[CHANNEL_COUNT_MAX + 1];
+    relay_state_t states[CHANNEL_COUNT_MAX + 1];
+    uint16_t pulses_ms[CHANNEL_COUNT_MAX + 1];
+    for (int i = 0; i < count; i++) {
+        cJSON *entry = cJSON_GetArrayItem(data, i);
+        cJSON *relay_key_item = cJSON_GetObjectItem(entry, "relay_key");
+        cJSON *state_item = cJSON_GetObjectItem(entry, "state");
+        cJSON *pulse_ms_item = cJSON_GetObjectItem(entry, "pulse_ms");
+        if (!cJSON_IsString(relay_key_item) || relay_key_item->valuestring == NULL || !cJSON_IsBool(state_item)) {
+            ESP_LOGE(TAG, "Batch entry %d: missing or malformed 'relay_key' or 'state'", i);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing or malformed 'relay_key' or 'state'");
+            cJSON_Delete(json);
+            return ESP_FAIL;
+        }
+        if (pulse_ms_item != NULL && (!cJSON_IsNumber(pulse_ms_item) || pulse_ms_item->valueint < 0 || pulse_ms_item->valueint > RELAY_PULSE_MS_MAX)) {
+            ESP_LOGE(TAG, "Batch entry %d: invalid 'pulse_ms'", i);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid 'pulse_ms'");
+            cJSON_Delete(json);
+            return ESP_FAIL;
+        }
+        pulses_ms[i] = (pulse_ms_item != NULL) ? (uint16_t)pulse_ms_item->valueint : 0;
+
+        if (get_unit_handle_from_key(relay_key_item->valuestring, &units[i]) != ESP_OK || units[i].type != RELAY_TYPE_ACTUATOR) {
+            ESP_LOGE(TAG, "Batch entry %d: unknown actuator %s", i, relay_key_item->valuestring);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown actuator relay_key");
+            cJSON_Delete(json);
+            return ESP_FAIL;
+        }
+        states[i] = cJSON_IsTrue(state_item) ? RELAY_STATE_ON : RELAY_STATE_OFF;
+    }
+
+    // Apply the batch
+    int64_t skew_us = 0;
+    err = relay_set_states_batch(units, states, pulses_ms, count, &skew_us);
+    if (err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid batch: duplicate or not applicable units");
+        cJSON_Delete(json);
+        return ESP_FAIL;
+    } else if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to apply batch of relay states");
+        httpd_resp_send_500(req);
+        cJSON_Delete(json);
+        return ESP_FAIL;
+    }
+    cJSON_Delete(json);
+
+    // Create response JSON
+    cJSON *response = cJSON_CreateObject();
+    cJSON *relay_array = cJSON_AddArrayToObject(response, "data");
+    for (int i = 0; i < count; i++) {
+        relay_unit_t snapshot;
+        if (relay_unit_snapshot_by_handle(units[i], &snapshot) != ESP_OK) {
+            continue;
+        }
+        char *relay_json_str = serialize_relay_unit(&snapshot);
+        if (relay_json_str != NULL) {
+            cJSON_AddItemToArray(relay_array, cJSON_Parse(relay_json_str));
+            free(relay_json_str);
+        }
+    }
+
+    cJSON *status = cJSON_CreateObject();
+    cJSON_AddStringToObject(status, "error", "OK");
+    cJSON_AddNumberToObject(status, "code", 0);
+    cJSON_AddNumberToObject(status, "count", count);
+    cJSON_AddNumberToObject(status, "skew_us", (double)skew_us);
+    cJSON_AddItemToObject(response, "status", status);
+
+    // Send the response
+    char *response_str = cJSON_PrintUnformatted(response);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response_str, strlen(response_str));
+
+    // Clean up
+    cJSON_Delete(response);
+    free(response_str);
+    return ESP_OK;
+}
+
 /**
  * @brief Handler for /api/setting/update endpoint
  *
@@ -2087,6 +2475,7 @@ static esp_err_t set_setting_value_post_handler(httpd_req_t *req) {
     int success_count = 0;
     int failure_count = 0;
     int total_count = 0;
+    bool unit_counts_changed = false;   // applied without reboot, see below
 
     // Response root
     cJSON *resp_root = cJSON_CreateObject();
@@ -2139,6 +2528,10 @@ static esp_err_t set_setting_value_post_handler(httpd_req_t *req) {
             failure_count++;           
         } else {
             success_count++;
+            if (strcmp(setting_key, S_KEY_CHANNEL_COUNT) == 0 || strcmp(setting_key, S_KEY_CONTACT_SENSORS_COUNT) == 0
+                || strcmp(setting_key, S_KEY_PULSE_COUNTERS_COUNT) == 0) {
+                unit_counts_changed = true;
+            }
         }
 
         // Attach this key’s object
@@ -2173,6 +2566,25 @@ static esp_err_t set_setting_value_post_handler(httpd_req_t *req) {
         }
     }
 
+    // Unit counts are applied right away: only the added and removed units are touched
+    if (unit_counts_changed && !reboot_required) {
+        relay_reconfig_result_t reconfig = {0};
+        esp_err_t err = relay_units_reconfigure(&reconfig);
+
+        cJSON *resp_reconfig = cJSON_CreateObject();
+        cJSON_AddNumberToObject(resp_reconfig, "status", (err == ESP_OK) ? 0 : 1);
+        cJSON_AddStringToObject(resp_reconfig, "error_msg", esp_err_to_name(err));
+        cJSON_AddNumberToObject(resp_reconfig, "added", reconfig.added);
+        cJSON_AddNumberToObject(resp_reconfig, "removed", reconfig.removed);
+        cJSON_AddNumberToObject(resp_reconfig, "units_us", (double)reconfig.units_us);
+        cJSON_AddNumberToObject(resp_reconfig, "total_us", (double)reconfig.total_us);
+        cJSON_AddItemToObject(resp_root, "reconfigure", resp_reconfig);
+
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Settings update: Failed to apply new unit counts without reboot: %s", esp_err_to_name(err));
+        }
+    }
+
     // Serialize and send
     char *resp_str = cJSON_PrintUnformatted(resp_root);
     if (!resp_str) {
@@ -2210,6 +2622,14 @@ static esp_err_t set_setting_value_post_handler(httpd_req_t *req) {
                         "status": 0 // 0 = success, 1 = failed
                         "error_msg": "<ERROR_MESSAGE_IF_ANY>"
                     }
+            },
+            "reconfigure": {            // only if unit counts were changed and no reboot was requested
+                "status": 0,            // 0 = success, 1 = failed
+                "error_msg": "ESP_OK",
+                "added": <units added>,
+                "removed": <units removed>,
+                "units_us": <time spent on units, us>,
+                "total_us": <time including MQTT and Home Assistant updates, us>
             }
         }   
      */
@@ -2454,7 +2874,7 @@ static esp_err_t relays_data_get_handler(httpd_req_t *req) {
     // Add the relay array to the response as "data"
     cJSON_AddItemToObject(response, "data", relay_array);
 
-    // Get all relays and sensors
+    // Get a consistent copy of all relays and sensors
     relay_unit_t *relay_list = NULL;
     uint16_t total_count = 0;
     esp_err_t err = get_all_relay_units(&relay_list, &total_count);
@@ -2480,9 +2900,8 @@ static esp_err_t relays_data_get_handler(httpd_req_t *req) {
         }
     }
 
-    // Free the relay list memory
-    // ESP_ERROR_CHECK(free_relays_array(relay_list, total_count));
-    if (!(xEventGroupGetBits(g_sys_events) & BIT_UNITS_IN_MEMORY)) free(relay_list);
+    // Free the relay list memory (snapshot is always a copy)
+    free(relay_list);
 
     // Create and add a status object to the response
     cJSON *status = cJSON_CreateObject();
@@ -3250,6 +3669,338 @@ static esp_err_t api_control_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+/**
+ * @brief Handler for /api/rules endpoint. Lists on-device rules.
+ *
+ * @param req HTTP request
+ * @return ESP_OK or ESP_FAIL
+ */
+static esp_err_t rules_get_handler(httpd_req_t *req) {
+    cJSON *response = cJSON_CreateObject();
+    if (response == NULL) {
+        ESP_LOGE(TAG, "Failed to create JSON response");
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    cJSON_AddItemToObject(response, "data", rules_to_JSON());
+
+    cJSON *status = cJSON_CreateObject();
+    cJSON_AddStringToObject(status, "error", "OK");
+    cJSON_AddNumberToObject(status, "code", 0);
+    cJSON_AddNumberToObject(status, "max", RULES_MAX);
+    cJSON_AddItemToObject(response, "status", status);
+
+    char *response_str = cJSON_PrintUnformatted(response);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response_str, strlen(response_str));
+
+    cJSON_Delete(response);
+    free(response_str);
+    return ESP_OK;
+}
+
+/**
+ * @brief Read the body of POST request into the buffer and parse it as JSON. Sends the error response on failure.
+ *
+ * @param req HTTP request
+ * @param[out] json Parsed JSON, to be freed by the caller
+ * @return ESP_OK or ESP_FAIL
+ */
+static esp_err_t api_read_request_json(httpd_req_t *req, cJSON **json) {
+    char content[MAX_JSON_BUFFER_SIZE];
+
+    int total_len = req->content_len;
+    int received = 0;
+    if (total_len >= sizeof(content)) {
+        ESP_LOGE(TAG, "Content size overflowing the buffer!");
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    while (received < total_len) {
+        int ret = httpd_req_recv(req, content + received, total_len - received);
+        if (ret <= 0) {
+            ESP_LOGE(TAG, "Unexpected error while reading from request: %i", ret);
+            httpd_resp_send_500(req);
+            return ESP_FAIL;
+        }
+        received += ret;
+    }
+    content[received] = '\0';
+
+    *json = cJSON_Parse(content);
+    if (*json == NULL) {
+        ESP_LOGE(TAG, "Failed to parse JSON");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to parse JSON");
+        return ESP_FAIL;
+    }
+
+    if (validate_device_identity_from_json(*json) != ESP_OK) {
+        ESP_LOGE(TAG, "Device identity validation failed: invalid serial or ID");
+        httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "Device identity validation failed: invalid serial or ID");
+        cJSON_Delete(*json);
+        *json = NULL;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for /api/rules/update endpoint. Creates or replaces the rule with the given id.
+ *
+ * @param req HTTP request
+ * @return ESP_OK or ESP_FAIL
+ */
+static esp_err_t rules_update_post_handler(httpd_req_t *req) {
+    /*
+        Request format:
+        {
+            "device_id": "<device_id>",
+            "device_serial": "<device_serial>",
+            "data": {
+                "id": 0,
+                "enabled": true,
+                "trigger": { "relay_key": "relay_sn_0", "edge": "on" },
+                "condition": { "relay_key": "relay_ch_1", "state": false },
+                "action": { "relay_keys": ["relay_ch_0"], "state": "on", "delay_ms": 0, "pulse_ms": 500 }
+            }
+        }
+    */
+    cJSON *json = NULL;
+    if (api_read_request_json(req, &json) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    rule_record_t rule;
+    cJSON *data = cJSON_GetObjectItem(json, "data");
+    if (!cJSON_IsObject(data) || rule_from_JSON(data, &rule) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing or invalid rule in 'data'");
+        cJSON_Delete(json);
+        return ESP_FAIL;
+    }
+    cJSON_Delete(json);
+
+    if (rules_put(&rule) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save rule %d", rule.id);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    cJSON *response = cJSON_CreateObject();
+    cJSON_AddItemToObject(response, "data", rule_to_JSON(&rule));
+    cJSON *status = cJSON_CreateObject();
+    cJSON_AddStringToObject(status, "error", "OK");
+    cJSON_AddNumberToObject(status, "code", 0);
+    cJSON_AddItemToObject(response, "status", status);
+
+    char *response_str = cJSON_PrintUnformatted(response);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response_str, strlen(response_str));
+
+    cJSON_Delete(response);
+    free(response_str);
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for /api/rules/delete endpoint
+ *
+ * @param req HTTP request
+ * @return ESP_OK or ESP_FAIL
+ */
+static esp_err_t rules_delete_post_handler(httpd_req_t *req) {
+    /*
+        Request format:
+        {
+            "device_id": "<device_id>",
+            "device_serial": "<device_serial>",
+            "data": { "id": 0 }
+        }
+    */
+    cJSON *json = NULL;
+    if (api_read_request_json(req, &json) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    cJSON *id_item = cJSON_GetObjectItem(cJSON_GetObjectItem(json, "data"), "id");
+    if (!cJSON_IsNumber(id_item)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing or invalid 'id' in 'data'");
+        cJSON_Delete(json);
+        return ESP_FAIL;
+    }
+    int id = id_item->valueint;
+    cJSON_Delete(json);
+
+    esp_err_t err = rules_delete(id);
+    if (err == ESP_ERR_NOT_FOUND || err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Rule not found");
+        return ESP_FAIL;
+    } else if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to delete rule %d", id);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    cJSON *response = cJSON_CreateObject();
+    cJSON *status = cJSON_CreateObject();
+    cJSON_AddStringToObject(status, "error", "OK");
+    cJSON_AddNumberToObject(status, "code", 0);
+    cJSON_AddNumberToObject(status, "id", id);
+    cJSON_AddItemToObject(response, "status", status);
+
+    char *response_str = cJSON_PrintUnformatted(response);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response_str, strlen(response_str));
+
+    cJSON_Delete(response);
+    free(response_str);
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for /api/schedules endpoint. Lists schedules and the state of the clock.
+ *
+ * @param req HTTP request
+ * @return ESP_OK or ESP_FAIL
+ */
+static esp_err_t schedules_get_handler(httpd_req_t *req) {
+    cJSON *response = cJSON_CreateObject();
+    if (response == NULL) {
+        ESP_LOGE(TAG, "Failed to create JSON response");
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    cJSON_AddItemToObject(response, "data", schedules_to_JSON());
+
+    cJSON *status = cJSON_CreateObject();
+    cJSON_AddStringToObject(status, "error", "OK");
+    cJSON_AddNumberToObject(status, "code", 0);
+    cJSON_AddNumberToObject(status, "max", SCHEDULES_MAX);
+    cJSON_AddBoolToObject(status, "time_synced", time_is_synced());
+    cJSON_AddNumberToObject(status, "time", (double)time(NULL));
+    cJSON_AddItemToObject(response, "status", status);
+
+    char *response_str = cJSON_PrintUnformatted(response);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response_str, strlen(response_str));
+
+    cJSON_Delete(response);
+    free(response_str);
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for /api/schedules/update endpoint. Creates or replaces the schedule with the given id.
+ *
+ * @param req HTTP request
+ * @return ESP_OK or ESP_FAIL
+ */
+static esp_err_t schedules_update_post_handler(httpd_req_t *req) {
+    /*
+        Request format:
+        {
+            "device_id": "<device_id>",
+            "device_serial": "<device_serial>",
+            "data": {
+                "id": 0,
+                "enabled": true,
+                "relay_key": "relay_ch_0",
+                "cron": "30 7 * * 1-5",
+                "state": "on",
+                "pulse_ms": 0
+            }
+        }
+    */
+    cJSON *json = NULL;
+    if (api_read_request_json(req, &json) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    schedule_record_t schedule;
+    cJSON *data = cJSON_GetObjectItem(json, "data");
+    if (!cJSON_IsObject(data) || schedule_from_JSON(data, &schedule) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing or invalid schedule in 'data'");
+        cJSON_Delete(json);
+        return ESP_FAIL;
+    }
+    cJSON_Delete(json);
+
+    if (schedule_put(&schedule) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save schedule %d", schedule.id);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    cJSON *response = cJSON_CreateObject();
+    cJSON_AddItemToObject(response, "data", schedule_to_JSON(&schedule));
+    cJSON *status = cJSON_CreateObject();
+    cJSON_AddStringToObject(status, "error", "OK");
+    cJSON_AddNumberToObject(status, "code", 0);
+    cJSON_AddItemToObject(response, "status", status);
+
+    char *response_str = cJSON_PrintUnformatted(response);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response_str, strlen(response_str));
+
+    cJSON_Delete(response);
+    free(response_str);
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for /api/schedules/delete endpoint
+ *
+ * @param req HTTP request
+ * @return ESP_OK or ESP_FAIL
+ */
+static esp_err_t schedules_delete_post_handler(httpd_req_t *req) {
+    /*
+        Request format:
+        {
+            "device_id": "<device_id>",
+            "device_serial": "<device_serial>",
+            "data": { "id": 0 }
+        }
+    */
+    cJSON *json = NULL;
+    if (api_read_request_json(req, &json) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    cJSON *id_item = cJSON_GetObjectItem(cJSON_GetObjectItem(json, "data"), "id");
+    if (!cJSON_IsNumber(id_item)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing or invalid 'id' in 'data'");
+        cJSON_Delete(json);
+        return ESP_FAIL;
+    }
+    int id = id_item->valueint;
+    cJSON_Delete(json);
+
+    esp_err_t err = schedule_delete(id);
+    if (err == ESP_ERR_NOT_FOUND || err == ESP_ERR_INVALID_ARG) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Schedule not found");
+        return ESP_FAIL;
+    } else if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to delete schedule %d", id);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    cJSON *response = cJSON_CreateObject();
+    cJSON *status = cJSON_CreateObject();
+    cJSON_AddStringToObject(status, "error", "OK");
+    cJSON_AddNumberToObject(status, "code", 0);
+    cJSON_AddNumberToObject(status, "id", id);
+    cJSON_AddItemToObject(response, "status", status);
+
+    char *response_str = cJSON_PrintUnformatted(response);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response_str, strlen(response_str));
+
+    cJSON_Delete(response);
+    free(response_str);
+    return ESP_OK;
+}
+
 /** Server routines */
 
 /**
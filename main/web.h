@@ -36,12 +36,20 @@ static esp_err_t static_stream_handler(httpd_req_t *req);
 // API Handlers
 static esp_err_t status_data_handler(httpd_req_t *req);
 static esp_err_t update_relay_post_handler(httpd_req_t *req);
+static esp_err_t update_relay_unit(httpd_req_t *req);
+static esp_err_t relays_batch_post_handler(httpd_req_t *req);
 static esp_err_t set_setting_value_post_handler(httpd_req_t *req);
 static esp_err_t get_settings_all_handler(httpd_req_t *req);
 static esp_err_t get_setting_one_handler(httpd_req_t *req);
 static esp_err_t get_ca_certificate_handler(httpd_req_t *req);
 static esp_err_t relays_data_get_handler(httpd_req_t *req);
 static esp_err_t api_control_handler(httpd_req_t *req);
+static esp_err_t rules_get_handler(httpd_req_t *req);
+static esp_err_t rules_update_post_handler(httpd_req_t *req);
+static esp_err_t rules_delete_post_handler(httpd_req_t *req);
+static esp_err_t schedules_get_handler(httpd_req_t *req);
+static esp_err_t schedules_update_post_handler(httpd_req_t *req);
+static esp_err_t schedules_delete_post_handler(httpd_req_t *req);
 
 
 void assign_static_page_variables(char *html_output);
@@ -0,0 +1,68 @@
+#include "writebehind.h"
+
+/**
+ * @brief: Initialize the dirty set
+ *
+ * @param wb Pointer to the dirty set
+ * @param quiet_us Quiet period: the flush is postponed by every new change for this long
+ * @param max_delay_us Longest time a change waits for the flush
+ */
+void writebehind_init(writebehind_t *wb, uint32_t quiet_us, uint32_t max_delay_us) {
+    wb->dirty_mask = 0;
+    wb->first_dirty_us = 0;
+    wb->quiet_us = quiet_us;
+    wb->max_delay_us = max_delay_us;
+    wb->requests = 0;
+    wb->flushes = 0;
+    wb->units_written = 0;
+}
+
+/**
+ * @brief: Mark units dirty
+ *
+ * @param wb Pointer to the dirty set
+ * @param units Bit per unit
+ * @param now_us Current time in microseconds
+ * @return time until the flush is due, microseconds, at least 1: the caller (re)arms its flush timer with it
+ */
+int64_t writebehind_mark(writebehind_t *wb, uint32_t units, int64_t now_us) {
+    if (wb->dirty_mask == 0) {
+        wb->first_dirty_us = now_us;
+    }
+    wb->dirty_mask |= units;
+    wb->requests++;
+
+    // restart the quiet period, but do not postpone the flush beyond the max delay cap
+    int64_t delay_us = wb->quiet_us;
+    int64_t cap_us = wb->first_dirty_us + (int64_t)wb->max_delay_us - now_us;
+    if (cap_us < delay_us) {
+        delay_us = cap_us;
+    }
+    return (delay_us > 0) ? delay_us : 1;
+}
+
+/**
+ * @brief: Take the dirty set for a flush. The units have to be read after this call.
+ *
+ * @param wb Pointer to the dirty set
+ * @return bit per unit to save, 0 if there's nothing to flush
+ */
+uint32_t writebehind_take(writebehind_t *wb) {
+    uint32_t dirty = wb->dirty_mask;
+    wb->dirty_mask = 0;
+    return dirty;
+}
+
+/**
+ * @brief: Complete a flush. Units that failed to save are marked dirty again, without restarting the quiet period:
+ *         they go with the next flush.
+ *
+ * @param wb Pointer to the dirty set
+ * @param written Number of units saved
+ * @param failed Bit per unit that failed to save
+ */
+void writebehind_done(writebehind_t *wb, uint32_t written, uint32_t failed) {
+    wb->dirty_mask |= failed;
+    wb->flushes++;
+    wb->units_written += written;
+}
@@ -0,0 +1,38 @@
+/**
+ * @file writebehind.h
+ * @brief Write-behind dirty set: which units to flush and when
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * The core is plain C with no ESP-IDF dependencies: time is passed in by the caller, and the
+ * caller serializes access (relay.c holds s_persist_mux). A unit is marked dirty after its state
+ * changed in RAM; the flush takes the whole set at once and saves what the units hold at that
+ * moment, so a change marked while a flush is running is never lost: it is either read by that
+ * flush or stays marked for the next one.
+ */
+#ifndef WRITEBEHIND_H
+#define WRITEBEHIND_H
+
+#include <stdint.h>
+
+/** TYPES **/
+
+/**
+ * @brief: Dirty set of up to 32 units
+ */
+typedef struct {
+    uint32_t dirty_mask;            // Bit per unit changed since the last flush took the set
+    int64_t first_dirty_us;         // Time of the first change not flushed yet
+    uint32_t quiet_us;              // Flush once no new changes came for this period
+    uint32_t max_delay_us;          // ... but never later than this after the first change
+    uint32_t requests;              // Units marked
+    uint32_t flushes;               // Flushes done
+    uint32_t units_written;         // Units saved by the flushes
+} writebehind_t;
+
+/** ROUTINES **/
+void writebehind_init(writebehind_t *wb, uint32_t quiet_us, uint32_t max_delay_us);
+int64_t writebehind_mark(writebehind_t *wb, uint32_t units, int64_t now_us);
+uint32_t writebehind_take(writebehind_t *wb);
+void writebehind_done(writebehind_t *wb, uint32_t written, uint32_t failed);
+
+#endif // WRITEBEHIND_H
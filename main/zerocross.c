@@ -0,0 +1,99 @@
+#include "zerocross.h"
+
+/**
+ * @brief: Initialize the zero-crossing tracker
+ *
+ * @param tracker Pointer to the tracker
+ */
+void zc_tracker_init(zc_tracker_t *tracker) {
+    tracker->last_us = 0;
+    tracker->half_period_us = 0;
+    tracker->run = 0;
+    tracker->crossings = 0;
+    tracker->rejected = 0;
+}
+
+/**
+ * @brief: Check if the tracker follows the mains: enough regular crossings, the last one not too long ago
+ *
+ * @param tracker Pointer to the tracker
+ * @param now_us Current time in microseconds
+ * @return true if edges can be planned against the crossings
+ */
+bool zc_tracker_locked(const zc_tracker_t *tracker, int64_t now_us) {
+    return tracker->run >= ZC_LOCK_HALF_CYCLES && tracker->half_period_us != 0
+           && now_us - tracker->last_us <= ZC_LOCK_TIMEOUT_US;
+}
+
+/**
+ * @brief: Time after a crossing to drive the output at, so that the contacts switch offset_us after a crossing
+ *
+ * Latency longer than the half-cycle is fine: the drive time then falls into an earlier half-cycle.
+ *
+ * @param half_period_us Half-cycle of the mains
+ * @param offset_us Switching point after the crossing
+ * @param latency_us Mechanical latency of the relay: time from the drive to the contacts switching
+ * @return drive time after a crossing, 0 to half_period_us - 1
+ */
+uint32_t zc_phase(uint32_t half_period_us, int32_t offset_us, int32_t latency_us) {
+    if (half_period_us == 0) {
+        return 0;
+    }
+    int64_t phase_us = ((int64_t)offset_us - latency_us) % (int64_t)half_period_us;
+    if (phase_us < 0) {
+        phase_us += half_period_us;
+    }
+    return (uint32_t)phase_us;
+}
+
+/**
+ * @brief: Plan an output edge at the first drive point that is at least margin_us away
+ *
+ * Drive points repeat every half-cycle, so the added delay is below one half-cycle plus the margin.
+ *
+ * @param tracker Pointer to the tracker
+ * @param now_us Current time in microseconds
+ * @param offset_us Switching point after the crossing
+ * @param latency_us Mechanical latency of the relay
+ * @param margin_us Time needed to arm the edge
+ * @param[out] plan Planned edge
+ * @return true on success, false if the tracker is not locked
+ */
+bool zc_tracker_plan(const zc_tracker_t *tracker, int64_t now_us, int32_t offset_us, int32_t latency_us,
+                     uint32_t margin_us, zc_plan_t *plan) {
+    if (!zc_tracker_locked(tracker, now_us)) {
+        return false;
+    }
+
+    int64_t last_us = tracker->last_us;
+    int64_t half_us = tracker->half_period_us;
+    uint32_t phase_us = zc_phase((uint32_t)half_us, offset_us, latency_us);
+
+    int64_t drive_us = last_us + phase_us;
+    int64_t earliest_us = now_us + margin_us;
+    uint32_t half_cycles = 0;
+    if (drive_us < earliest_us) {
+        half_cycles = (uint32_t)((earliest_us - drive_us + half_us - 1) / half_us);
+        drive_us += (int64_t)half_cycles * half_us;
+    }
+
+    plan->drive_us = drive_us;
+    plan->phase_us = phase_us;
+    plan->half_cycles = half_cycles;
+    plan->delay_us = drive_us - now_us;
+    return true;
+}
+
+/**
+ * @brief: Longest delay an edge can get from the alignment
+ *
+ * @param tracker Pointer to the tracker
+ * @param margin_us Time needed to arm the edge
+ * @return worst-case added delay in microseconds, 0 if no half-cycle was measured yet
+ */
+uint32_t zc_worst_case_delay_us(const zc_tracker_t *tracker, uint32_t margin_us) {
+    if (tracker->half_period_us == 0) {
+        return 0;
+    }
+    return tracker->half_period_us + margin_us;
+}
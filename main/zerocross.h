@@ -0,0 +1,93 @@
+/**
+ * @file zerocross.h
+ * @brief Mains zero-crossing tracker and phase alignment of output edges
+ * @author Roman Pavlyuk <roman.pavlyuk@gmail.com>
+ *
+ * The core is plain C with no ESP-IDF dependencies: edge timestamps are passed in by the caller.
+ * The tracker takes any edge of the zero-cross detector and keeps the ones spaced by a plausible
+ * half-cycle (50 or 60 Hz mains), so both pulse detectors (one short pulse per crossing, both of its
+ * edges seen) and square wave detectors (an edge per crossing) work. Once locked, an output edge can be
+ * planned at a fixed offset after a crossing, with the mechanical latency of the relay taken off so that
+ * the contacts, not the coil, switch at that phase. The edge is never delayed by more than one
+ * half-cycle plus the scheduling margin.
+ */
+#ifndef ZEROCROSS_H
+#define ZEROCROSS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** TYPES **/
+
+/**
+ * @brief: Zero-crossing tracker
+ */
+typedef struct {
+    volatile int64_t last_us;           // Time of the last accepted crossing, 0 if none yet
+    volatile uint32_t half_period_us;   // Smoothed half-cycle, 0 until the first one was measured
+    volatile uint32_t run;              // Consecutive half-cycles of plausible length
+    volatile uint32_t crossings;        // Accepted crossings
+    volatile uint32_t rejected;         // Edges too close to the previous crossing: second edge of a pulse or noise
+} zc_tracker_t;
+
+/**
+ * @brief: Output edge planned against the zero crossings
+ */
+typedef struct {
+    int64_t drive_us;                   // Time to write the output
+    uint32_t phase_us;                  // Drive time after the preceding crossing
+    uint32_t half_cycles;               // Crossings from the last seen one up to the drive time
+    int64_t delay_us;                   // Delay added to the edge: drive_us - now
+} zc_plan_t;
+
+/** SETTINGS AND CONSTANTS **/
+
+#define ZC_HALF_PERIOD_MIN_US   7000    // 71 Hz: closer edges are rejected
+#define ZC_HALF_PERIOD_MAX_US   12000   // 41 Hz: a longer gap means missed crossings
+#define ZC_LOCK_HALF_CYCLES     4       // Consecutive plausible half-cycles before the tracker is locked
+#define ZC_LOCK_TIMEOUT_US      (3 * ZC_HALF_PERIOD_MAX_US)    // Lock is lost when no crossings came for this long
+#define ZC_SMOOTHING_SHIFT      3       // Half-cycle is averaged with 1/8 weight of the new measurement
+
+/** ROUTINES **/
+void zc_tracker_init(zc_tracker_t *tracker);
+bool zc_tracker_locked(const zc_tracker_t *tracker, int64_t now_us);
+uint32_t zc_phase(uint32_t half_period_us, int32_t offset_us, int32_t latency_us);
+bool zc_tracker_plan(const zc_tracker_t *tracker, int64_t now_us, int32_t offset_us, int32_t latency_us,
+                     uint32_t margin_us, zc_plan_t *plan);
+uint32_t zc_worst_case_delay_us(const zc_tracker_t *tracker, uint32_t margin_us);
+
+/**
+ * @brief: Record an edge of the zero-cross detector. Safe to call from ISR.
+ *
+ * Defined inline so the ISR doesn't pay for a call on every edge.
+ *
+ * @param tracker Pointer to the tracker
+ * @param edge_us Time of the edge in microseconds
+ * @return true if the edge was taken as a crossing
+ */
+static inline bool zc_tracker_edge(zc_tracker_t *tracker, int64_t edge_us) {
+    int64_t gap_us = edge_us - tracker->last_us;
+
+    if (tracker->last_us != 0 && gap_us < ZC_HALF_PERIOD_MIN_US) {
+        tracker->rejected++;
+        return false;
+    }
+
+    if (tracker->last_us == 0 || gap_us > ZC_HALF_PERIOD_MAX_US) {
+        // first edge or crossings were missed: start over from this one, the half-cycle estimate stays
+        tracker->run = 0;
+    } else if (tracker->half_period_us == 0) {
+        tracker->half_period_us = (uint32_t)gap_us;
+        tracker->run++;
+    } else {
+        int32_t error_us = (int32_t)gap_us - (int32_t)tracker->half_period_us;
+        tracker->half_period_us = (uint32_t)((int32_t)tracker->half_period_us + error_us / (1 << ZC_SMOOTHING_SHIFT));
+        tracker->run++;
+    }
+
+    tracker->last_us = edge_us;
+    tracker->crossings++;
+    return true;
+}
+
+#endif // ZEROCROSS_H
@@ -0,0 +1,324 @@
+/**
+ * @file test_command_path.c
+ * @brief Heap allocations per MQTT toggle on the command and publish path, before and after unit handles
+ *
+ * malloc(), calloc(), realloc() and free() are counted while a toggle runs, including the ones strdup() and
+ * strndup() make inside the C library. The old path is the code mqtt.c and relay.c had while string keys
+ * travelled in the queues: MQTT_EVENT_DATA copied topic and payload to the heap and split the topic with
+ * get_element_from_path() and str_split(), relay_set_state() allocated the key of the unit and
+ * trigger_mqtt_publish() duplicated it for the event task. The new path parses the key in place
+ * (mqtt_topic_unit_key(), unit_key_channel()), passes the unit handle by value, marks the pending set and
+ * looks the publish topics up in the topic table. Formatting and sending the payload is the same on both.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "unit_key.h"
+#include "pending.h"
+#include "topic_table.h"
+#include "test_common.h"
+
+#define PREFIX          "relay_board"
+#define DEVICE_ID       "a0b1c2d3e4f5"
+#define KEY_PREFIX      "relay_ch_"     // S_KEY_CH_PREFIX
+#define ACTUATORS       16
+#define SLOTS           30              // MQTT_TOPIC_SLOTS
+#define TOGGLES         1000
+
+/* Counting allocator */
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static bool s_counting;
+static uint64_t s_allocs, s_frees, s_bytes;
+
+void *malloc(size_t size) {
+    if (s_counting) {
+        s_allocs++;
+        s_bytes += size;
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    if (s_counting) {
+        s_allocs++;
+        s_bytes += n * size;
+    }
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (s_counting) {
+        s_allocs++;
+        s_bytes += size;
+    }
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    if (s_counting && ptr != NULL) {
+        s_frees++;
+    }
+    __libc_free(ptr);
+}
+
+/* Unit handles and state shared by both paths */
+
+typedef struct {
+    uint8_t type;
+    uint8_t index;
+} unit_handle_t;
+
+static int s_state[ACTUATORS];
+static volatile size_t s_sink;
+
+/* Old path: string keys */
+
+/**
+ * @brief: str_split() as mqtt.c had it: the array and every token on the heap
+ */
+static char **str_split(char *a_str, const char a_delim, size_t *element_count) {
+    char **result = 0;
+    size_t count = 0;
+    char *tmp = a_str;
+    char *last_comma = 0;
+    char delim[2] = { a_delim, 0 };
+
+    while (*tmp) {
+        if (a_delim == *tmp) {
+            count++;
+            last_comma = tmp;
+        }
+        tmp++;
+    }
+    count += last_comma < (a_str + strlen(a_str) - 1);
+    count++;
+
+    result = malloc(sizeof(char *) * count);
+    if (result) {
+        size_t idx = 0;
+        char *token = strtok(a_str, delim);
+        while (token) {
+            result[idx++] = strdup(token);
+            token = strtok(0, delim);
+        }
+        result[idx] = 0;
+    }
+    *element_count = count;
+    return result;
+}
+
+/**
+ * @brief: get_element_from_path() as mqtt.c had it. Frees the token array, not the tokens.
+ */
+static char *get_element_from_path(const char *path, int index) {
+    char *path_copy = strdup(path);
+    if (!path_copy) {
+        return NULL;
+    }
+    size_t count = 0;
+    char **tokens = str_split(path_copy, '/', &count);
+    if (!tokens) {
+        free(path_copy);
+        return NULL;
+    }
+    char *result = ((size_t)index < count && tokens[index]) ? strdup(tokens[index]) : NULL;
+    free(tokens);
+    free(path_copy);
+    return result;
+}
+
+/**
+ * @brief: get_unit_nvs_key() of an actuator
+ */
+static char *get_unit_nvs_key(int channel) {
+    size_t key_size = (size_t)snprintf(NULL, 0, "%s%d", KEY_PREFIX, channel) + 1;
+    char *key = malloc(key_size);
+    if (key != NULL) {
+        snprintf(key, key_size, "%s%d", KEY_PREFIX, channel);
+    }
+    return key;
+}
+
+/**
+ * @brief: One toggle: MQTT_EVENT_DATA, mqtt_subscribe_relays_task(), relay_set_state(), mqtt_event_task()
+ */
+static bool toggle_old(const char *topic, size_t topic_len, const char *data, size_t data_len) {
+    // MQTT_EVENT_DATA
+    char *topic_buf = malloc(topic_len + 1);
+    char *data_buf = malloc(data_len + 1);
+    if (topic_buf == NULL || data_buf == NULL) {
+        free(topic_buf);
+        free(data_buf);
+        return false;
+    }
+    memcpy(topic_buf, topic, topic_len);
+    topic_buf[topic_len] = '\0';
+    memcpy(data_buf, data, data_len);
+    data_buf[data_len] = '\0';
+    char *relay_key = get_element_from_path(topic_buf, 2);
+    int state = (strcmp(data_buf, "true") == 0) ? 1 : 0;
+    free(topic_buf);
+    free(data_buf);
+    if (relay_key == NULL) {
+        return false;
+    }
+
+    // mqtt_subscribe_relays_task(): resolve the key, relay_set_state()
+    int channel = unit_key_channel(relay_key, KEY_PREFIX, ACTUATORS - 1);
+    free(relay_key);
+    if (channel == UNIT_KEY_NONE) {
+        return false;
+    }
+    s_state[channel] = state;
+
+    // trigger_mqtt_publish(): key duplicated into the event
+    char *key = get_unit_nvs_key(channel);
+    char *event_key = strdup(key);
+    free(key);
+
+    // mqtt_event_task(): resolve the key again, publish, free the event key
+    channel = unit_key_channel(event_key, KEY_PREFIX, ACTUATORS - 1);
+    s_sink += (size_t)s_state[channel];
+    free(event_key);
+    return true;
+}
+
+/* New path: unit handles */
+
+static pending_set_t s_pending;
+static topic_table_t s_topics;
+
+/**
+ * @brief: mqtt_topic_unit_key()
+ */
+static const char *topic_unit_key(const char *topic, size_t topic_len, size_t *key_len) {
+    size_t prefix_len = strlen(PREFIX);
+    size_t device_id_len = strlen(DEVICE_ID);
+    if (topic_len < prefix_len + device_id_len + 2
+        || memcmp(topic, PREFIX, prefix_len) != 0 || topic[prefix_len] != '/'
+        || memcmp(topic + prefix_len + 1, DEVICE_ID, device_id_len) != 0 || topic[prefix_len + 1 + device_id_len] != '/') {
+        return NULL;
+    }
+    const char *key = topic + prefix_len + device_id_len + 2;
+    const char *key_end = memchr(key, '/', (size_t)(topic + topic_len - key));
+    *key_len = (size_t)((key_end != NULL ? key_end : topic + topic_len) - key);
+    return key;
+}
+
+/**
+ * @brief: One toggle: MQTT_EVENT_DATA, mqtt_subscribe_relays_task(), relay_actuator_command(), mqtt_event_task()
+ */
+static bool toggle_new(const char *topic, size_t topic_len, const char *data, size_t data_len) {
+    // MQTT_EVENT_DATA: resolve_unit_handle_from_topic(), the command event goes to the queue by value
+    size_t key_len = 0;
+    const char *segment = topic_unit_key(topic, topic_len, &key_len);
+    char relay_key[16];     // NVS_KEY_NAME_MAX_SIZE
+    if (segment == NULL || key_len == 0 || key_len >= sizeof(relay_key)) {
+        return false;
+    }
+    memcpy(relay_key, segment, key_len);
+    relay_key[key_len] = '\0';
+    int channel = unit_key_channel(relay_key, KEY_PREFIX, ACTUATORS - 1);
+    if (channel == UNIT_KEY_NONE) {
+        return false;
+    }
+    unit_handle_t unit = { .type = 0, .index = (uint8_t)channel };
+    int state = (data_len == 4 && strncmp(data, "true", 4) == 0) ? 1 : 0;
+
+    // relay_actuator_command(), trigger_mqtt_publish_units(): the unit is marked in its topic slot
+    s_state[unit.index] = state;
+    pending_set_mark(&s_pending, unit.index + 1);
+
+    // mqtt_event_task(): take the pending set, publish from the topic table
+    for (uint32_t mask = pending_set_take(&s_pending); mask != 0; mask &= mask - 1) {
+        int slot = __builtin_ctz(mask);
+        const char *state_topic = topic_table_get(&s_topics, (uint16_t)slot, TOPIC_KIND_STATE);
+        if (state_topic == NULL) {
+            return false;
+        }
+        s_sink += (size_t)state_topic[0] + (size_t)s_state[slot - 1];
+    }
+    return true;
+}
+
+static void build_topics(void) {
+    static char keys[ACTUATORS][16];
+    topic_unit_spec_t specs[ACTUATORS];
+    for (int u = 0; u < ACTUATORS; u++) {
+        snprintf(keys[u], sizeof(keys[u]), "%s%d", KEY_PREFIX, u);
+        specs[u] = (topic_unit_spec_t){
+            .key = keys[u], .slot = (uint16_t)(u + 1), .kinds = TOPIC_KINDS_BASIC,
+            .state_path = "switch", .command_path = "switch"
+        };
+    }
+    CHECK(topic_table_build(&s_topics, PREFIX, DEVICE_ID, "status", specs, ACTUATORS, SLOTS));
+}
+
+typedef struct {
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t bytes;
+    int toggles;
+} alloc_stats_t;
+
+static void run(bool (*toggle)(const char *, size_t, const char *, size_t), alloc_stats_t *stats) {
+    char topics[ACTUATORS][64];
+    for (int u = 0; u < ACTUATORS; u++) {
+        snprintf(topics[u], sizeof(topics[u]), "%s/%s/%s%d/switch/set", PREFIX, DEVICE_ID, KEY_PREFIX, u);
+    }
+
+    s_allocs = s_frees = s_bytes = 0;
+    stats->toggles = 0;
+    s_counting = true;
+    for (int i = 0; i < TOGGLES; i++) {
+        const char *data = (i & 1) ? "false" : "true";
+        const char *topic = topics[i % ACTUATORS];
+        stats->toggles += toggle(topic, strlen(topic), data, strlen(data));
+    }
+    s_counting = false;
+    stats->allocs = s_allocs;
+    stats->frees = s_frees;
+    stats->bytes = s_bytes;
+}
+
+static void test_allocations(void) {
+    alloc_stats_t before, after;
+    build_topics();
+
+    run(toggle_old, &before);
+    run(toggle_new, &after);
+
+    CHECK_EQ_INT(before.toggles, TOGGLES);
+    CHECK_EQ_INT(after.toggles, TOGGLES);
+    CHECK(before.allocs >= 5ULL * TOGGLES);
+    CHECK_EQ_INT(after.allocs, 0);
+    CHECK_EQ_INT(after.frees, 0);
+
+    // both paths leave every unit in the state of its last command
+    int expected[ACTUATORS];
+    for (int i = 0; i < TOGGLES; i++) {
+        expected[i % ACTUATORS] = !(i & 1);
+    }
+    for (int u = 0; u < ACTUATORS; u++) {
+        CHECK_EQ_INT(s_state[u], expected[u]);
+    }
+
+    printf("per toggle   allocations  bytes  never freed\n");
+    printf("string keys  %11.1f  %5.1f  %11.1f\n", (double)before.allocs / TOGGLES, (double)before.bytes / TOGGLES,
+           (double)(before.allocs - before.frees) / TOGGLES);
+    printf("handles      %11.1f  %5.1f  %11.1f\n", (double)after.allocs / TOGGLES, (double)after.bytes / TOGGLES,
+           (double)(after.allocs - after.frees) / TOGGLES);
+
+    topic_table_free(&s_topics);
+}
+
+int main(void) {
+    test_allocations();
+    TEST_DONE();
+}
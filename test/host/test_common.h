@@ -0,0 +1,37 @@
+/**
+ * @file test_common.h
+ * @brief Minimal assertion helpers shared by the host tests
+ */
+#ifndef TEST_COMMON_H
+#define TEST_COMMON_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int s_test_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        s_test_failures++; \
+    } \
+} while (0)
+
+#define CHECK_EQ_INT(actual, expected) do { \
+    long long _a = (long long)(actual), _e = (long long)(expected); \
+    if (_a != _e) { \
+        fprintf(stderr, "%s:%d: %s == %lld, expected %lld\n", __FILE__, __LINE__, #actual, _a, _e); \
+        s_test_failures++; \
+    } \
+} while (0)
+
+#define TEST_DONE() do { \
+    if (s_test_failures) { \
+        fprintf(stderr, "%d check(s) failed\n", s_test_failures); \
+        return EXIT_FAILURE; \
+    } \
+    printf("OK\n"); \
+    return EXIT_SUCCESS; \
+} while (0)
+
+#endif // TEST_COMMON_H
@@ -0,0 +1,158 @@
+/**
+ * @file test_debounce.c
+ * @brief Edge-train tests of the per-pin debounce state machine (main/debounce.c)
+ *
+ * Every test drives the pin the way relay.c does: the ISR calls debounce_pin_edge() on every edge
+ * and gpio_event_task() calls debounce_pin_poll() at debounce_pin_deadline().
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "debounce.h"
+#include "test_common.h"
+
+#define WINDOW_US   5000
+
+/**
+ * @brief: Feed an edge train: level alternates starting with first_level, one edge every step_us
+ *
+ * @return number of edges that reported the pin idle (i.e. would have posted an event)
+ */
+static int feed_train(debounce_pin_t *pin, int first_level, int edges, int64_t start_us, int64_t step_us) {
+    int posts = 0;
+    int level = first_level;
+    for (int i = 0; i < edges; i++) {
+        if (debounce_pin_edge(pin, level, start_us + i * step_us)) {
+            posts++;
+        }
+        level = !level;
+    }
+    return posts;
+}
+
+static void test_clean_edge(void) {
+    debounce_pin_t pin;
+    debounce_pin_init(&pin, 0, WINDOW_US);
+    CHECK_EQ_INT(debounce_pin_deadline(&pin), DEBOUNCE_NO_DEADLINE);
+    CHECK_EQ_INT(debounce_pin_poll(&pin, 0, 1000), DEBOUNCE_IDLE);
+
+    CHECK(debounce_pin_edge(&pin, 1, 1000));
+    CHECK_EQ_INT(debounce_pin_deadline(&pin), 1000 + WINDOW_US);
+    CHECK_EQ_INT(debounce_pin_poll(&pin, 1, 1000 + WINDOW_US - 1), DEBOUNCE_PENDING);
+    CHECK_EQ_INT(debounce_pin_poll(&pin, 1, 1000 + WINDOW_US), DEBOUNCE_CHANGED);
+    CHECK_EQ_INT(pin.stable_level, 1);
+    CHECK_EQ_INT(debounce_pin_poll(&pin, 1, 1000 + 2 * WINDOW_US), DEBOUNCE_IDLE);
+}
+
+static void test_bounce_burst(void) {
+    debounce_pin_t pin;
+    debounce_pin_init(&pin, 0, WINDOW_US);
+
+    // Contact closes with 9 bounces 150 us apart, ends at level 1
+    int posts = feed_train(&pin, 1, 9, 0, 150);
+    CHECK_EQ_INT(posts, 1);
+    CHECK_EQ_INT(pin.first_edge_us, 0);
+    CHECK_EQ_INT(debounce_pin_deadline(&pin), 8 * 150 + WINDOW_US);
+
+    // Polled too early (e.g. at the deadline computed after the first edge): still pending
+    CHECK_EQ_INT(debounce_pin_poll(&pin, 1, WINDOW_US), DEBOUNCE_PENDING);
+    CHECK_EQ_INT(debounce_pin_poll(&pin, 1, debounce_pin_deadline(&pin)), DEBOUNCE_CHANGED);
+    CHECK_EQ_INT(pin.stable_level, 1);
+
+    // Contact opens with its own burst, ends at level 0
+    int64_t start = 100000;
+    posts = feed_train(&pin, 0, 7, start, 300);
+    CHECK_EQ_INT(posts, 1);
+    CHECK_EQ_INT(debounce_pin_poll(&pin, 0, debounce_pin_deadline(&pin)), DEBOUNCE_CHANGED);
+    CHECK_EQ_INT(pin.stable_level, 0);
+}
+
+static void test_glitch_shorter_than_window(void) {
+    debounce_pin_t pin;
+    debounce_pin_init(&pin, 0, WINDOW_US);
+
+    // 100 us spike: up and back down
+    CHECK(debounce_pin_edge(&pin, 1, 2000));
+    CHECK(!debounce_pin_edge(&pin, 0, 2100));
+    CHECK_EQ_INT(debounce_pin_poll(&pin, 0, debounce_pin_deadline(&pin)), DEBOUNCE_BOUNCED);
+    CHECK_EQ_INT(pin.stable_level, 0);
+
+    // Spike so short the falling edge was never seen: the level read at poll time wins
+    CHECK(debounce_pin_edge(&pin, 1, 20000));
+    CHECK_EQ_INT(debounce_pin_poll(&pin, 0, debounce_pin_deadline(&pin)), DEBOUNCE_BOUNCED);
+    CHECK_EQ_INT(pin.stable_level, 0);
+
+    // Even number of edges in a burst is a bounce too
+    CHECK_EQ_INT(feed_train(&pin, 1, 6, 40000, 400), 1);
+    CHECK_EQ_INT(debounce_pin_poll(&pin, 0, debounce_pin_deadline(&pin)), DEBOUNCE_BOUNCED);
+    CHECK_EQ_INT(pin.stable_level, 0);
+}
+
+static void test_chatter_never_settles_early(void) {
+    debounce_pin_t pin;
+    debounce_pin_init(&pin, 1, WINDOW_US);
+
+    // Edges every 1 ms for 100 ms, polled at every deadline like the debounce timer does
+    int64_t t = 0;
+    int level = 0;
+    int posts = 0;
+    for (int i = 0; i < 100; i++, t += 1000, level = !level) {
+        if (debounce_pin_edge(&pin, level, t)) {
+            posts++;
+        }
+        CHECK_EQ_INT(debounce_pin_poll(&pin, level, t + 999), DEBOUNCE_PENDING);
+    }
+    CHECK_EQ_INT(posts, 1);
+    CHECK_EQ_INT(pin.stable_level, 1);
+
+    // Chatter stops at level 0 (last edge of the loop was level 1, then one more edge)
+    CHECK(!debounce_pin_edge(&pin, 0, t));
+    CHECK_EQ_INT(debounce_pin_deadline(&pin), t + WINDOW_US);
+    CHECK_EQ_INT(debounce_pin_poll(&pin, 0, t + WINDOW_US), DEBOUNCE_CHANGED);
+    CHECK_EQ_INT(pin.stable_level, 0);
+}
+
+static void test_drop(void) {
+    debounce_pin_t pin;
+    debounce_pin_init(&pin, 0, WINDOW_US);
+
+    // The ISR could not post the first edge: the train is dropped and the next edge posts again
+    CHECK(debounce_pin_edge(&pin, 1, 0));
+    debounce_pin_drop(&pin);
+    CHECK_EQ_INT(debounce_pin_deadline(&pin), DEBOUNCE_NO_DEADLINE);
+    CHECK_EQ_INT(debounce_pin_poll(&pin, 1, WINDOW_US), DEBOUNCE_IDLE);
+    CHECK_EQ_INT(pin.stable_level, 0);
+
+    CHECK(debounce_pin_edge(&pin, 1, 10000));
+    CHECK_EQ_INT(debounce_pin_poll(&pin, 1, 10000 + WINDOW_US), DEBOUNCE_CHANGED);
+    CHECK_EQ_INT(pin.stable_level, 1);
+}
+
+static void test_pins_settle_independently(void) {
+    debounce_pin_t a, b;
+    debounce_pin_init(&a, 0, WINDOW_US);
+    debounce_pin_init(&b, 0, 2 * WINDOW_US);
+
+    // Interleaved bursts on two pins
+    for (int i = 0; i < 10; i++) {
+        debounce_pin_edge(&a, i & 1 ? 0 : 1, i * 200);
+        debounce_pin_edge(&b, i & 1 ? 1 : 0, i * 200 + 100);
+    }
+    // a ends at 0 (bounce), b ends at 1 (change) with a longer window
+    CHECK(debounce_pin_deadline(&a) < debounce_pin_deadline(&b));
+    CHECK_EQ_INT(debounce_pin_poll(&b, 1, debounce_pin_deadline(&a)), DEBOUNCE_PENDING);
+    CHECK_EQ_INT(debounce_pin_poll(&a, 0, debounce_pin_deadline(&a)), DEBOUNCE_BOUNCED);
+    CHECK_EQ_INT(debounce_pin_poll(&b, 1, debounce_pin_deadline(&b)), DEBOUNCE_CHANGED);
+    CHECK_EQ_INT(a.stable_level, 0);
+    CHECK_EQ_INT(b.stable_level, 1);
+}
+
+int main(void) {
+    test_clean_edge();
+    test_bounce_burst();
+    test_glitch_shorter_than_window();
+    test_chatter_never_settles_early();
+    test_drop();
+    test_pins_settle_independently();
+    TEST_DONE();
+}
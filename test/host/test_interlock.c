@@ -0,0 +1,346 @@
+/**
+ * @file test_interlock.c
+ * @brief Interlock groups (main/interlock.c): racing commands never leave two members ON together
+ *
+ * The model is relay.c: command threads switch members of two groups ON and OFF at random, every write going
+ * through s_interlock_mux the way relay_interlock_write() does it, and a resume thread stands in for the group
+ * timer and relay_interlock_resume(). Contacts of a member open up to a mains half-cycle after it is switched
+ * OFF (zero-cross switching). Every ON interval is logged with the time the contacts closed and opened, and in
+ * each group the next member may only close once the dead time has passed after the last one opened.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "interlock.h"
+#include "test_common.h"
+
+#define GROUPS          2
+#define MEMBERS         3           // per group
+#define CHANNELS        (GROUPS * MEMBERS)
+#define THREADS         4
+#define COMMANDS        4000        // per thread
+#define PAUSE_US        400         // between the commands of a thread, at most
+#define DEAD_US         200
+#define ZC_DELAY_US     50          // contacts open at most this late
+#define LOG_MAX         (THREADS * COMMANDS * 2)
+
+typedef struct {
+    bool on;                        // output register holds the ON level
+    int64_t closed_us;              // contacts closed
+} member_t;
+
+typedef struct {
+    int8_t channel;
+    int64_t closed_us;
+    int64_t open_us;
+} interval_t;
+
+static pthread_mutex_t s_mux = PTHREAD_MUTEX_INITIALIZER;       // s_interlock_mux
+static interlock_group_t s_groups[GROUPS];
+static int64_t s_deadline[GROUPS];                              // group timers, 0 if stopped
+static member_t s_members[CHANNELS];
+static interval_t *s_log;
+static size_t s_logged;
+static atomic_int s_stop;
+static uint32_t s_switched_on, s_parked, s_resumed, s_superseded;
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int group_of(int channel) {
+    return channel / MEMBERS;
+}
+
+static void test_decisions(void) {
+    interlock_group_t g;
+    interlock_request_t req;
+    interlock_group_init(&g);
+
+    // never released: nothing to wait for
+    CHECK(interlock_decide_on(&g, false, false, 1000, DEAD_US) == INTERLOCK_ON);
+    CHECK(interlock_may_release(0, false));
+    CHECK(interlock_may_release(1u << 2, true));
+    CHECK(!interlock_may_release(1u << 2, false));
+
+    // contacts open at 1050: dead until 1250, whatever the member switched OFF last
+    interlock_released(&g, 1050);
+    interlock_released(&g, 1010);
+    CHECK_EQ_INT(g.released_us, 1050);
+    CHECK(interlock_decide_on(&g, false, false, 1000, DEAD_US) == INTERLOCK_WAIT);
+    CHECK(interlock_decide_on(&g, false, false, 1249, DEAD_US) == INTERLOCK_WAIT);
+    CHECK(interlock_decide_on(&g, false, false, 1250, DEAD_US) == INTERLOCK_ON);
+
+    // without dead time the group still waits for the contacts to open
+    CHECK(interlock_decide_on(&g, false, false, 1049, 0) == INTERLOCK_WAIT);
+    CHECK(interlock_decide_on(&g, false, false, 1050, 0) == INTERLOCK_ON);
+
+    // already ON, or restoring outputs on boot
+    CHECK(interlock_decide_on(&g, true, false, 1000, DEAD_US) == INTERLOCK_ON);
+    CHECK(interlock_decide_on(&g, false, true, 1000, DEAD_US) == INTERLOCK_ON);
+
+    // parked: the newest request wins, OFF of another member leaves it
+    CHECK(!interlock_take(&g, &req));
+    interlock_request_t first = { .channel = 1, .pulse_ms = 500, .latency_path = 2, .origin_us = 900 };
+    CHECK_EQ_INT(interlock_park(&g, &first, 1000, DEAD_US), 250);
+    interlock_request_t second = { .channel = 2, .pulse_ms = 0, .latency_path = 0, .origin_us = 1100 };
+    CHECK_EQ_INT(interlock_park(&g, &second, 1300, DEAD_US), 1);
+    CHECK(!interlock_cancel(&g, 1));
+    CHECK(interlock_take(&g, &req));
+    CHECK_EQ_INT(req.channel, 2);
+    CHECK_EQ_INT(req.origin_us, 1100);
+    CHECK(!interlock_take(&g, &req));
+
+    // OFF of the parked member, or ON of any member, drops it
+    interlock_park(&g, &first, 1000, DEAD_US);
+    CHECK(interlock_cancel(&g, 1));
+    CHECK(!interlock_take(&g, &req));
+    interlock_park(&g, &first, 1000, DEAD_US);
+    CHECK(interlock_cancel(&g, -1));
+    CHECK(!interlock_cancel(&g, -1));
+}
+
+/**
+ * @brief: relay_interlock_switch_off(). Caller holds s_mux.
+ */
+static void switch_off(int channel, int64_t now, unsigned int *seed) {
+    member_t *m = &s_members[channel];
+    if (!m->on) {
+        return;
+    }
+    m->on = false;
+    int64_t open_us = now + rand_r(seed) % (ZC_DELAY_US + 1);
+    interlock_released(&s_groups[group_of(channel)], open_us);
+    if (s_logged < LOG_MAX) {
+        s_log[s_logged++] = (interval_t){ .channel = (int8_t)channel, .closed_us = m->closed_us, .open_us = open_us };
+    }
+}
+
+/**
+ * @brief: relay_interlock_acquire(): switch the conflicting members OFF and decide. Caller holds s_mux.
+ */
+static interlock_decision_t acquire(int channel, int64_t now, unsigned int *seed) {
+    int group = group_of(channel);
+    uint32_t conflicts = 0;
+    for (int other = group * MEMBERS; other < (group + 1) * MEMBERS; other++) {
+        if (other != channel && s_members[other].on) {
+            conflicts |= 1u << other;
+        }
+    }
+    if (!interlock_may_release(conflicts, true)) {
+        return INTERLOCK_CONFLICT;
+    }
+    for (; conflicts != 0; conflicts &= conflicts - 1) {
+        switch_off(__builtin_ctz(conflicts), now, seed);
+    }
+    return interlock_decide_on(&s_groups[group], s_members[channel].on, false, now, DEAD_US);
+}
+
+/**
+ * @brief: relay_interlock_write()
+ *
+ * @param split Decide and switch in two critical sections: the race one section rules out
+ */
+static void command(int channel, bool on, bool split, unsigned int *seed) {
+    interlock_group_t *g = &s_groups[group_of(channel)];
+
+    pthread_mutex_lock(&s_mux);
+    int64_t now = now_us();
+    if (!on) {
+        interlock_cancel(g, channel);
+        switch_off(channel, now, seed);
+        pthread_mutex_unlock(&s_mux);
+        return;
+    }
+
+    interlock_decision_t decision = acquire(channel, now, seed);
+    if (split) {
+        pthread_mutex_unlock(&s_mux);
+        sched_yield();
+        pthread_mutex_lock(&s_mux);
+        now = now_us();
+    }
+    if (decision == INTERLOCK_ON) {
+        if (interlock_cancel(g, -1)) {
+            s_superseded++;
+        }
+        if (!s_members[channel].on) {
+            s_members[channel].on = true;
+            s_members[channel].closed_us = now;
+            s_switched_on++;
+        }
+    } else if (decision == INTERLOCK_WAIT) {
+        const interlock_request_t request = { .channel = (int8_t)channel };
+        s_deadline[group_of(channel)] = now + interlock_park(g, &request, now, DEAD_US);
+        s_parked++;
+    }
+    pthread_mutex_unlock(&s_mux);
+}
+
+typedef struct {
+    unsigned int seed;
+    bool split;
+} commander_t;
+
+static void *commander(void *arg) {
+    commander_t *c = arg;
+    for (int i = 0; i < COMMANDS; i++) {
+        int channel = rand_r(&c->seed) % CHANNELS;
+        // mostly ON: those are the requests that have to wait
+        command(channel, rand_r(&c->seed) % 4 != 0, c->split, &c->seed);
+        // around the dead time: some requests find the group dead, some don't
+        int64_t until = now_us() + rand_r(&c->seed) % PAUSE_US;
+        while (now_us() < until) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief: Group timers and relay_interlock_resume(): take the parked request, re-issue it as a new command
+ */
+static void *resumer(void *arg) {
+    commander_t *c = arg;
+    while (!atomic_load(&s_stop)) {
+        for (int group = 0; group < GROUPS; group++) {
+            interlock_request_t request;
+            pthread_mutex_lock(&s_mux);
+            bool expired = s_deadline[group] != 0 && now_us() >= s_deadline[group];
+            bool parked = false;
+            if (expired) {
+                s_deadline[group] = 0;
+                parked = interlock_take(&s_groups[group], &request);
+            }
+            pthread_mutex_unlock(&s_mux);
+
+            if (parked) {
+                s_resumed++;
+                command(request.channel, true, c->split, &c->seed);
+            }
+        }
+        sched_yield();
+    }
+    return NULL;
+}
+
+static int interval_cmp(const void *a, const void *b) {
+    const interval_t *x = a, *y = b;
+    return (x->closed_us > y->closed_us) - (x->closed_us < y->closed_us);
+}
+
+/**
+ * @brief: Check the ON intervals of every group: a member closes only after the dead time past the last opening
+ *
+ * @return number of intervals overlapping or closing within the dead time of an earlier one
+ */
+static int check_intervals(int64_t *gap_min) {
+    int violations = 0;
+    interval_t *sorted = malloc(sizeof(interval_t) * (s_logged + 1));
+
+    *gap_min = INT64_MAX;
+    for (int group = 0; group < GROUPS; group++) {
+        size_t n = 0;
+        for (size_t i = 0; i < s_logged; i++) {
+            if (group_of(s_log[i].channel) == group) {
+                sorted[n++] = s_log[i];
+            }
+        }
+        qsort(sorted, n, sizeof(interval_t), interval_cmp);
+
+        int64_t open_max = INT64_MIN;
+        for (size_t i = 0; i < n; i++) {
+            if (i > 0) {
+                int64_t gap = sorted[i].closed_us - open_max;
+                if (gap < DEAD_US) {
+                    violations++;
+                }
+                if (gap < *gap_min) {
+                    *gap_min = gap;
+                }
+            }
+            if (sorted[i].open_us > open_max) {
+                open_max = sorted[i].open_us;
+            }
+        }
+    }
+    free(sorted);
+    return violations;
+}
+
+static int run(bool split, int64_t *gap_min) {
+    pthread_t threads[THREADS], resume;
+    commander_t commanders[THREADS + 1];
+
+    memset(s_members, 0, sizeof(s_members));
+    memset(s_deadline, 0, sizeof(s_deadline));
+    for (int group = 0; group < GROUPS; group++) {
+        interlock_group_init(&s_groups[group]);
+    }
+    s_logged = 0;
+    s_switched_on = s_parked = s_resumed = s_superseded = 0;
+    atomic_store(&s_stop, 0);
+
+    for (int i = 0; i <= THREADS; i++) {
+        commanders[i] = (commander_t){ .seed = (unsigned int)(i + 1), .split = split };
+    }
+    pthread_create(&resume, NULL, resumer, &commanders[THREADS]);
+    for (int i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, commander, &commanders[i]);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    atomic_store(&s_stop, 1);
+    pthread_join(resume, NULL);
+
+    // members still ON close their intervals now
+    unsigned int seed = 0;
+    int64_t end = now_us();
+    for (int channel = 0; channel < CHANNELS; channel++) {
+        switch_off(channel, end, &seed);
+    }
+    return check_intervals(gap_min);
+}
+
+static void test_race(void) {
+    int64_t gap_min;
+    s_log = malloc(sizeof(interval_t) * LOG_MAX);
+    CHECK(s_log != NULL);
+    if (s_log == NULL) {
+        return;
+    }
+
+    int violations = run(false, &gap_min);
+    CHECK_EQ_INT(violations, 0);
+    CHECK(gap_min >= DEAD_US);
+    CHECK(s_switched_on > GROUPS);
+    CHECK(s_parked > 0);
+    CHECK(s_resumed > 0);
+    CHECK(s_logged < LOG_MAX);
+    printf("%d commands: %u switched ON, %u parked, %u resumed, %u parked superseded\n", THREADS * COMMANDS,
+           (unsigned)s_switched_on, (unsigned)s_parked, (unsigned)s_resumed, (unsigned)s_superseded);
+    printf("%zu ON intervals, 0 overlapping, shortest gap %lld us (dead time %d us)\n", s_logged, (long long)gap_min,
+           DEAD_US);
+
+    // for comparison only: decided in one critical section, switched in another
+    violations = run(true, &gap_min);
+    printf("split critical section: %d of %zu intervals within the dead time of another, shortest gap %lld us\n",
+           violations, s_logged, (long long)gap_min);
+
+    free(s_log);
+}
+
+int main(void) {
+    test_decisions();
+    test_race();
+    TEST_DONE();
+}
@@ -0,0 +1,182 @@
+/**
+ * @file test_pending.c
+ * @brief MQTT pending set (main/pending.c): coalescing and a stress test at 10,000 toggles per second
+ *
+ * The stress test models mqtt.c: producers toggle a unit, mark it under s_mqtt_pending_mux and give the
+ * event task a notification; the publisher takes the whole set, publishes the state each unit has at that
+ * moment at 2.87 ms per unit, and sleeps on the notification when nothing is pending. Producers must never
+ * wait for the publisher, and once they stop and the publisher drains, every unit's last published state
+ * has to be its final one.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+
+#include "pending.h"
+#include "test_common.h"
+
+#define UNITS           15
+#define PRODUCERS       3
+#define RATE            10000       // toggles per second, all producers together
+#define DURATION_MS     1000
+#define PUBLISH_US      2870        // mqtt_publish_relay_data() per unit, status "publish_us_avg" example
+
+static pending_set_t s_pending;
+static pthread_mutex_t s_mux = PTHREAD_MUTEX_INITIALIZER;       // s_mqtt_pending_mux
+static sem_t s_notify;                                          // task notification of the event task
+static atomic_bool s_notified;
+static atomic_int s_state[UNITS];                               // in-memory units
+static int s_published[UNITS];                                  // last state sent to the broker
+static uint64_t s_units_published;
+static atomic_int s_stop;
+static atomic_uint_fast64_t s_mark_ns_total, s_mark_ns_max;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_ns(int64_t ns) {
+    struct timespec ts = { .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 };
+    nanosleep(&ts, NULL);
+}
+
+static void test_coalescing(void) {
+    pending_set_t ps = {0};
+    CHECK_EQ_INT(pending_set_take(&ps), 0);
+    CHECK_EQ_INT(ps.passes, 0);
+
+    CHECK(pending_set_mark(&ps, 0));
+    CHECK(pending_set_mark(&ps, 29));
+    CHECK(!pending_set_mark(&ps, 0));
+    CHECK(!pending_set_mark(&ps, 0));
+    CHECK_EQ_INT(ps.marks, 4);
+    CHECK_EQ_INT(ps.coalesced, 2);
+
+    CHECK_EQ_INT(pending_set_take(&ps), (1u << 0) | (1u << 29));
+    CHECK_EQ_INT(pending_set_take(&ps), 0);
+    CHECK_EQ_INT(ps.passes, 1);
+    CHECK_EQ_INT(ps.pass_units_max, 2);
+
+    // a unit marked after the take is pending again, for the next pass
+    CHECK(pending_set_mark(&ps, 0));
+    CHECK_EQ_INT(pending_set_take(&ps), 1u << 0);
+    CHECK_EQ_INT(ps.passes, 2);
+    CHECK_EQ_INT(ps.pass_units_max, 2);
+}
+
+/**
+ * @brief: mqtt_mark_pending(): mark the unit and notify the event task
+ */
+static void mark(int unit) {
+    int64_t t0 = now_ns();
+    pthread_mutex_lock(&s_mux);
+    pending_set_mark(&s_pending, unit);
+    pthread_mutex_unlock(&s_mux);
+    // xTaskNotifyGive(): the event task is woken once, however many notifications it missed
+    if (!atomic_exchange(&s_notified, true)) {
+        sem_post(&s_notify);
+    }
+    uint64_t ns = (uint64_t)(now_ns() - t0);
+
+    atomic_fetch_add(&s_mark_ns_total, ns);
+    uint64_t max = atomic_load(&s_mark_ns_max);
+    while (ns > max && !atomic_compare_exchange_weak(&s_mark_ns_max, &max, ns)) {
+    }
+}
+
+static void *producer(void *arg) {
+    unsigned int seed = (unsigned int)(uintptr_t)arg;
+    int64_t period = 1000000000LL * PRODUCERS / RATE;
+    int64_t next = now_ns();
+
+    while (!atomic_load(&s_stop)) {
+        int unit = rand_r(&seed) % UNITS;
+        atomic_fetch_xor(&s_state[unit], 1);
+        mark(unit);
+
+        next += period;
+        int64_t now = now_ns();
+        if (next > now) {
+            sleep_ns(next - now);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief: mqtt_event_task()
+ */
+static void *publisher(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&s_mux);
+        uint32_t pending = pending_set_take(&s_pending);
+        pthread_mutex_unlock(&s_mux);
+
+        if (pending == 0) {
+            if (atomic_load(&s_stop) == 2) {
+                return NULL;
+            }
+            // ulTaskNotifyTake(pdTRUE, portMAX_DELAY)
+            sem_wait(&s_notify);
+            atomic_store(&s_notified, false);
+            continue;
+        }
+
+        for (uint32_t mask = pending; mask != 0; mask &= mask - 1) {
+            int unit = __builtin_ctz(mask);
+            s_published[unit] = atomic_load(&s_state[unit]);
+            s_units_published++;
+            sleep_ns(PUBLISH_US * 1000LL);
+        }
+    }
+}
+
+static void test_stress(void) {
+    pthread_t pub, prod[PRODUCERS];
+    sem_init(&s_notify, 0, 0);
+
+    pthread_create(&pub, NULL, publisher, NULL);
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_create(&prod[i], NULL, producer, (void *)(uintptr_t)(i + 1));
+    }
+    sleep_ns(DURATION_MS * 1000000LL);
+    atomic_store(&s_stop, 1);
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_join(prod[i], NULL);
+    }
+
+    // the publisher drains what is left before it stops
+    atomic_store(&s_stop, 2);
+    sem_post(&s_notify);
+    pthread_join(pub, NULL);
+
+    int mismatches = 0;
+    for (int u = 0; u < UNITS; u++) {
+        if (s_published[u] != atomic_load(&s_state[u])) {
+            mismatches++;
+        }
+    }
+    CHECK_EQ_INT(mismatches, 0);
+    CHECK_EQ_INT(s_pending.mask, 0);
+    CHECK(s_pending.marks > RATE * DURATION_MS / 1000 / 2);
+    CHECK(s_pending.coalesced > s_pending.marks / 2);
+    CHECK(s_units_published <= (uint64_t)s_pending.passes * UNITS);
+
+    printf("%u marks (%.1f%% coalesced), %llu publishes in %u passes, max %u units per pass\n",
+           (unsigned)s_pending.marks, 100.0 * s_pending.coalesced / s_pending.marks,
+           (unsigned long long)s_units_published, (unsigned)s_pending.passes, (unsigned)s_pending.pass_units_max);
+    printf("mark: avg %llu ns, max %llu ns\n", (unsigned long long)(atomic_load(&s_mark_ns_total) / s_pending.marks),
+           (unsigned long long)atomic_load(&s_mark_ns_max));
+}
+
+int main(void) {
+    test_coalescing();
+    test_stress();
+    TEST_DONE();
+}
@@ -0,0 +1,198 @@
+/**
+ * @file test_pin_mask.c
+ * @brief GPIO occupancy (main/pin_mask.c): pin reassignment, removal of units and exhaustion of the safe pins
+ *
+ * The safe pins are the SAFE_GPIO_PINS list of relay.c. The random test models relay_units_reconfigure():
+ * units are added and removed at random, and every added unit claims the pin it had before or the lowest
+ * free one. The used mask has to match the pins the units own, no two units may share a pin, and the
+ * zero-cross detector pin is never given out.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pin_mask.h"
+#include "test_common.h"
+
+#define SAFE_COUNT      26          // SAFE_GPIO_COUNT
+#define UNITS_MAX       30          // RELAY_INDEX_UNITS_MAX
+#define ZC_PIN          27          // zero-cross detector input
+
+static const int s_safe_pins[SAFE_COUNT] = {4, 5, 6, 7, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 39};
+
+static uint64_t s_rand = 0x853C49E6748FEA9BULL;
+
+static uint32_t rand32(void) {
+    // xorshift64*
+    s_rand ^= s_rand >> 12;
+    s_rand ^= s_rand << 25;
+    s_rand ^= s_rand >> 27;
+    return (uint32_t)((s_rand * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static void test_safe(void) {
+    pin_mask_t pm;
+    pin_mask_init(&pm, s_safe_pins, SAFE_COUNT);
+    CHECK_EQ_INT(pm.used, 0);
+    CHECK_EQ_INT(__builtin_popcountll(pm.safe), SAFE_COUNT);
+
+    CHECK(pin_mask_is_safe(&pm, 4));
+    CHECK(pin_mask_is_safe(&pm, 39));
+    CHECK(!pin_mask_is_safe(&pm, 0));
+    CHECK(!pin_mask_is_safe(&pm, 8));
+    CHECK(!pin_mask_is_safe(&pm, -1));
+    CHECK(!pin_mask_is_safe(&pm, 64));
+    CHECK(!pin_mask_is_safe(&pm, 1000));
+
+    // unassigned units and garbage pins don't touch the mask
+    pin_mask_take(&pm, -1);
+    pin_mask_take(&pm, 64);
+    CHECK_EQ_INT(pm.used, 0);
+    CHECK(!pin_mask_is_used(&pm, -1));
+}
+
+static void test_reassignment(void) {
+    pin_mask_t pm;
+    pin_mask_init(&pm, s_safe_pins, SAFE_COUNT);
+    uint64_t zc = 1ULL << ZC_PIN;
+
+    // the pin a unit had is kept while it is free
+    CHECK_EQ_INT(pin_mask_claim(&pm, 12, zc), 12);
+    CHECK(pin_mask_is_used(&pm, 12));
+    CHECK_EQ_INT(pin_mask_next_free(&pm, zc), 4);
+
+    // given to another unit meanwhile: moved to the lowest free pin
+    CHECK_EQ_INT(pin_mask_claim(&pm, 12, zc), 4);
+    CHECK_EQ_INT(pin_mask_claim(&pm, 12, zc), 5);
+
+    // not safe, reserved for the detector, or no pin yet: the lowest free one as well
+    CHECK_EQ_INT(pin_mask_claim(&pm, 8, zc), 6);
+    CHECK_EQ_INT(pin_mask_claim(&pm, ZC_PIN, zc), 7);
+    CHECK_EQ_INT(pin_mask_claim(&pm, -1, zc), 13);
+    CHECK(!pin_mask_is_used(&pm, 8));
+    CHECK(!pin_mask_is_used(&pm, ZC_PIN));
+
+    // a unit moved by hand gives its old pin back
+    pin_mask_release(&pm, 13);
+    CHECK_EQ_INT(pin_mask_claim(&pm, 21, zc), 21);
+    CHECK_EQ_INT(pin_mask_next_free(&pm, zc), 13);
+    CHECK_EQ_INT(pm.used, (1ULL << 4) | (1ULL << 5) | (1ULL << 6) | (1ULL << 7) | (1ULL << 12) | (1ULL << 21));
+}
+
+static void test_removal(void) {
+    pin_mask_t pm;
+    pin_mask_init(&pm, s_safe_pins, SAFE_COUNT);
+    for (int i = 0; i < 8; i++) {
+        pin_mask_take(&pm, s_safe_pins[i]);
+    }
+    CHECK_EQ_INT(pin_mask_free_count(&pm, 0), SAFE_COUNT - 8);
+    CHECK_EQ_INT(pin_mask_next_free(&pm, 0), 16);
+
+    // removed units free their pins, the lowest is handed out first
+    pin_mask_release(&pm, 13);
+    pin_mask_release(&pm, 5);
+    CHECK_EQ_INT(pin_mask_free_count(&pm, 0), SAFE_COUNT - 6);
+    CHECK_EQ_INT(pin_mask_next_free(&pm, 0), 5);
+    CHECK_EQ_INT(pin_mask_claim(&pm, -1, 0), 5);
+    CHECK_EQ_INT(pin_mask_claim(&pm, -1, 0), 13);
+    CHECK_EQ_INT(pin_mask_claim(&pm, -1, 0), 16);
+
+    // releasing a pin twice, or one never taken, changes nothing
+    pin_mask_release(&pm, 16);
+    pin_mask_release(&pm, 16);
+    pin_mask_release(&pm, 8);
+    CHECK_EQ_INT(pin_mask_free_count(&pm, 0), SAFE_COUNT - 8);
+}
+
+static void test_exhaustion(void) {
+    pin_mask_t pm;
+    pin_mask_init(&pm, s_safe_pins, SAFE_COUNT);
+    uint64_t zc = 1ULL << ZC_PIN;
+
+    // every safe pin but the detector's can be given out, in ascending order
+    int last = -1;
+    for (int i = 0; i < SAFE_COUNT - 1; i++) {
+        CHECK_EQ_INT(pin_mask_free_count(&pm, zc), SAFE_COUNT - 1 - i);
+        int pin = pin_mask_claim(&pm, -1, zc);
+        CHECK(pin > last && pin != ZC_PIN && pin_mask_is_safe(&pm, pin));
+        last = pin;
+    }
+
+    CHECK_EQ_INT(pin_mask_free_count(&pm, zc), 0);
+    CHECK_EQ_INT(pin_mask_next_free(&pm, zc), -1);
+    uint64_t used = pm.used;
+    CHECK_EQ_INT(pin_mask_claim(&pm, -1, zc), -1);
+    CHECK_EQ_INT(pin_mask_claim(&pm, 4, zc), -1);
+    CHECK_EQ_INT(pm.used, used);
+
+    // the detector's pin is free again once it moves elsewhere
+    CHECK_EQ_INT(pin_mask_free_count(&pm, 0), 1);
+    CHECK_EQ_INT(pin_mask_claim(&pm, -1, 0), ZC_PIN);
+    CHECK_EQ_INT(pm.used, pm.safe);
+}
+
+/**
+ * @brief: relay_units_reconfigure() at random: units come and go, added ones claim their old pin if they can
+ */
+static void test_random(void) {
+    pin_mask_t pm;
+    int pin_of[UNITS_MAX];          // -1 if the unit is not configured
+    int stored_pin[UNITS_MAX];      // pin in the units table, kept while the unit is not configured
+    uint64_t zc = 1ULL << ZC_PIN;
+    int refused = 0, moved = 0;
+
+    pin_mask_init(&pm, s_safe_pins, SAFE_COUNT);
+    for (int u = 0; u < UNITS_MAX; u++) {
+        pin_of[u] = -1;
+        stored_pin[u] = -1;
+    }
+
+    for (int step = 0; step < 200000; step++) {
+        int u = (int)(rand32() % UNITS_MAX);
+        if (pin_of[u] >= 0) {
+            // removals are rarer than additions: the board fills up and runs out of pins now and then
+            if (rand32() % 3 == 0) {
+                pin_mask_release(&pm, pin_of[u]);
+                pin_of[u] = -1;
+            }
+        } else if (pin_mask_free_count(&pm, zc) == 0) {
+            // the precheck refuses the unit before anything is touched
+            CHECK_EQ_INT(pin_mask_claim(&pm, stored_pin[u], zc), -1);
+            refused++;
+        } else {
+            int pin = pin_mask_claim(&pm, stored_pin[u], zc);
+            CHECK(pin >= 0);
+            if (stored_pin[u] >= 0 && pin != stored_pin[u]) {
+                moved++;
+            }
+            pin_of[u] = stored_pin[u] = pin;
+        }
+
+        uint64_t owned = 0;
+        int shared = 0;
+        for (int v = 0; v < UNITS_MAX; v++) {
+            if (pin_of[v] >= 0) {
+                shared += (owned & (1ULL << pin_of[v])) != 0;
+                owned |= 1ULL << pin_of[v];
+            }
+        }
+        if (owned != pm.used || shared != 0 || (owned & zc) || (owned & ~pm.safe)) {
+            fprintf(stderr, "step %d: used %llx, owned %llx, %d shared\n", step, (unsigned long long)pm.used,
+                    (unsigned long long)owned, shared);
+            s_test_failures++;
+            break;
+        }
+    }
+    CHECK(refused > 0);
+    CHECK(moved > 0);
+    printf("200000 reconfigurations: %d units moved to another pin, %d refused with all pins taken\n", moved, refused);
+}
+
+int main(void) {
+    test_safe();
+    test_reassignment();
+    test_removal();
+    test_exhaustion();
+    test_random();
+    TEST_DONE();
+}
@@ -0,0 +1,170 @@
+/**
+ * @file test_pulse.c
+ * @brief Pulse counter aggregation (main/pulse.c) against a simulated PCNT counter
+ *
+ * The simulated counter is what relay.c reads with pcnt_unit_get_count(): the 16-bit hardware count plus the
+ * overflows the driver accumulates, i.e. a free-running int that only counts up. It is sampled once per
+ * interval like pulse_counter_task() does, and the total and rate have to match the pulses fed in.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "pulse.h"
+#include "test_common.h"
+
+#define INTERVAL_US     10000000        // S_KEY_PULSE_INTERVAL default, 10 s
+
+/**
+ * @brief: Simulated accumulated PCNT count
+ */
+typedef struct {
+    uint32_t count;
+} sim_counter_t;
+
+static uint64_t s_rand = 0x853C49E6748FEA9BULL;
+
+static uint32_t rand32(void) {
+    // xorshift64*
+    s_rand ^= s_rand >> 12;
+    s_rand ^= s_rand << 25;
+    s_rand ^= s_rand >> 27;
+    return (uint32_t)((s_rand * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static void sim_pulses(sim_counter_t *sim, uint32_t pulses) {
+    sim->count += pulses;
+}
+
+static int32_t sim_read(const sim_counter_t *sim) {
+    return (int32_t)sim->count;
+}
+
+static bool rate_near(float rate, double expected) {
+    return fabs((double)rate - expected) <= expected * 1e-5 + 1e-6;
+}
+
+static void test_steady(void) {
+    sim_counter_t sim = { .count = 1234 };
+    pulse_counter_t pc;
+    int64_t now = 5000000;
+    pulse_counter_init(&pc, sim_read(&sim), now);
+    CHECK_EQ_INT(pc.total, 0);
+    CHECK(pc.rate == 0.0f);
+
+    // S0 meter at 1000 imp/kWh under a 3.6 kW load: 1 pulse per second
+    for (int i = 0; i < 6; i++) {
+        sim_pulses(&sim, 10);
+        now += INTERVAL_US;
+        CHECK_EQ_INT(pulse_counter_update(&pc, sim_read(&sim), now), 10);
+        CHECK(rate_near(pc.rate, 1.0));
+    }
+    CHECK_EQ_INT(pc.total, 60);
+
+    // idle input: count stays, rate drops to zero
+    now += INTERVAL_US;
+    CHECK_EQ_INT(pulse_counter_update(&pc, sim_read(&sim), now), 0);
+    CHECK(pc.rate == 0.0f);
+    CHECK_EQ_INT(pc.total, 60);
+}
+
+static void test_wrap(void) {
+    // accumulated count close to the int limit: the wrap must not lose or invent pulses
+    sim_counter_t sim = { .count = (uint32_t)INT32_MAX - 500 };
+    pulse_counter_t pc;
+    int64_t now = 0;
+    pulse_counter_init(&pc, sim_read(&sim), now);
+
+    sim_pulses(&sim, 1000);
+    now += INTERVAL_US;
+    CHECK(sim_read(&sim) < 0);
+    CHECK_EQ_INT(pulse_counter_update(&pc, sim_read(&sim), now), 1000);
+    CHECK(rate_near(pc.rate, 100.0));
+
+    sim.count = UINT32_MAX - 20;
+    pulse_counter_rebase(&pc, sim_read(&sim), now);
+    sim_pulses(&sim, 41);
+    now += INTERVAL_US;
+    CHECK_EQ_INT(pulse_counter_update(&pc, sim_read(&sim), now), 41);
+    CHECK_EQ_INT(pc.total, 1041);
+}
+
+static void test_rebase(void) {
+    sim_counter_t sim = { .count = 0 };
+    pulse_counter_t pc;
+    int64_t now = 0;
+    pulse_counter_init(&pc, sim_read(&sim), now);
+
+    sim_pulses(&sim, 250);
+    now += INTERVAL_US;
+    pulse_counter_update(&pc, sim_read(&sim), now);
+    CHECK_EQ_INT(pc.total, 250);
+
+    // unit re-attached (e.g. the GPIO pin changed): the hardware count restarts from zero, the total stays
+    sim.count = 0;
+    now += 1000;
+    pulse_counter_rebase(&pc, sim_read(&sim), now);
+    CHECK(pc.rate == 0.0f);
+    CHECK_EQ_INT(pc.total, 250);
+
+    sim_pulses(&sim, 30);
+    now += INTERVAL_US;
+    CHECK_EQ_INT(pulse_counter_update(&pc, sim_read(&sim), now), 30);
+    CHECK_EQ_INT(pc.total, 280);
+    CHECK(rate_near(pc.rate, 3.0));
+}
+
+static void test_same_time(void) {
+    sim_counter_t sim = { .count = 0 };
+    pulse_counter_t pc;
+    int64_t now = 0;
+    pulse_counter_init(&pc, sim_read(&sim), now);
+
+    sim_pulses(&sim, 50);
+    now += INTERVAL_US;
+    pulse_counter_update(&pc, sim_read(&sim), now);
+    CHECK(rate_near(pc.rate, 5.0));
+
+    // sampled twice at the same time (publish right after a sample): pulses counted, rate kept
+    sim_pulses(&sim, 2);
+    CHECK_EQ_INT(pulse_counter_update(&pc, sim_read(&sim), now), 2);
+    CHECK_EQ_INT(pc.total, 52);
+    CHECK(rate_near(pc.rate, 5.0));
+}
+
+static void test_random(void) {
+    // anemometer / flow meter: up to a few kHz, jittered sampling, long run across several wraps
+    sim_counter_t sim = { .count = rand32() };
+    pulse_counter_t pc;
+    int64_t now = 0;
+    uint64_t fed = 0;
+    pulse_counter_init(&pc, sim_read(&sim), now);
+
+    for (int i = 0; i < 200000; i++) {
+        uint32_t hz = rand32() % 5000;
+        int64_t interval = INTERVAL_US - 50000 + (int64_t)(rand32() % 100000);
+        uint32_t pulses = (uint32_t)((uint64_t)hz * (uint64_t)interval / 1000000);
+        sim_pulses(&sim, pulses);
+        fed += pulses;
+        now += interval;
+
+        CHECK_EQ_INT(pulse_counter_update(&pc, sim_read(&sim), now), pulses);
+        if (!rate_near(pc.rate, (double)pulses * 1000000.0 / (double)interval)) {
+            fprintf(stderr, "sample %d: rate %f, expected %f\n", i, (double)pc.rate, (double)pulses * 1000000.0 / (double)interval);
+            s_test_failures++;
+            break;
+        }
+    }
+    CHECK_EQ_INT(pc.total, fed);
+    CHECK(fed > UINT32_MAX);
+    printf("%llu pulses over %.1f days\n", (unsigned long long)fed, (double)now / 86400e6);
+}
+
+int main(void) {
+    test_steady();
+    test_wrap();
+    test_rebase();
+    test_same_time();
+    test_random();
+    TEST_DONE();
+}
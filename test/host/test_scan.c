@@ -0,0 +1,227 @@
+/**
+ * @file test_scan.c
+ * @brief Bit-parallel N-of-M scan filter (main/scan.c): per-pin reference model and cost per second
+ *
+ * The reference keeps the last M samples of every pin separately and counts them, which is what the
+ * bit-sliced counters of scan.c have to match tick by tick for every window size. The cost part feeds
+ * 8, 32 and 64 inputs through the filter at a 1 ms tick and through the ISR path's debounce core
+ * (main/debounce.c) at one edge train per input per second, and prints the host CPU time per second
+ * of input. It only reports: interrupt entry and the event queue are not modelled on the host, so the
+ * ISR path costs edges/s times the per-interrupt overhead of the chip on top of what is printed.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "scan.h"
+#include "debounce.h"
+#include "test_common.h"
+
+#define PINS            64
+
+/**
+ * @brief: Reference filter of a single pin
+ */
+typedef struct {
+    uint8_t history[SCAN_FILTER_M_MAX];
+    uint8_t head;
+    uint8_t state;
+} ref_pin_t;
+
+static uint64_t s_rand = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rand64(void) {
+    // xorshift64*
+    s_rand ^= s_rand >> 12;
+    s_rand ^= s_rand << 25;
+    s_rand ^= s_rand >> 27;
+    return s_rand * 0x2545F4914F6CDD1DULL;
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void ref_init(ref_pin_t *pin, int level) {
+    memset(pin->history, level, sizeof(pin->history));
+    pin->head = 0;
+    pin->state = (uint8_t)level;
+}
+
+static int ref_update(ref_pin_t *pin, int m, int level) {
+    pin->history[pin->head] = (uint8_t)level;
+    pin->head = (uint8_t)((pin->head + 1) % m);
+
+    int ones = 0;
+    for (int i = 0; i < m; i++) {
+        ones += pin->history[i];
+    }
+    int n = m / 2 + 1;
+    if (ones >= n) {
+        pin->state = 1;
+    } else if (m - ones >= n) {
+        pin->state = 0;
+    }
+    return pin->state;
+}
+
+/**
+ * @brief: Random noisy input: every pin holds a level and flips it now and then, with glitches on top
+ */
+static uint64_t noisy_sample(uint64_t *level) {
+    *level ^= rand64() & rand64() & rand64() & rand64() & rand64();    // ~1/32 of pins flip
+    uint64_t glitch = rand64() & rand64() & rand64();                   // ~1/8 of pins glitch
+    return *level ^ glitch;
+}
+
+static void test_reference(void) {
+    for (int m = SCAN_FILTER_M_MIN; m <= SCAN_FILTER_M_MAX; m++) {
+        uint64_t level = rand64();
+        scan_filter_t f;
+        ref_pin_t ref[PINS];
+
+        CHECK(scan_filter_init(&f, (uint8_t)m, level));
+        CHECK_EQ_INT(f.n, m / 2 + 1);
+        for (int bit = 0; bit < PINS; bit++) {
+            scan_filter_set_pin(&f, bit, true, (int)((level >> bit) & 1));
+            ref_init(&ref[bit], (int)((level >> bit) & 1));
+        }
+
+        int mismatches = 0;
+        for (int tick = 0; tick < 20000; tick++) {
+            uint64_t sample = noisy_sample(&level);
+            uint64_t changed = scan_filter_update(&f, sample);
+
+            uint64_t expected_state = 0, expected_changed = 0;
+            for (int bit = 0; bit < PINS; bit++) {
+                int before = ref[bit].state;
+                int after = ref_update(&ref[bit], m, (int)((sample >> bit) & 1));
+                expected_state |= (uint64_t)after << bit;
+                expected_changed |= (uint64_t)(before != after) << bit;
+            }
+            if (f.state != expected_state || changed != expected_changed) {
+                mismatches++;
+            }
+        }
+        if (mismatches) {
+            fprintf(stderr, "m=%d: %d ticks differ from the reference\n", m, mismatches);
+        }
+        CHECK_EQ_INT(mismatches, 0);
+    }
+}
+
+static void test_burst(void) {
+    scan_filter_t f;
+    CHECK(scan_filter_init(&f, 5, 0));
+    scan_filter_set_pin(&f, 3, true, 0);
+    uint64_t b = 1ULL << 3;
+
+    // 2 of 5 samples high: a glitch, the pin stays low
+    CHECK_EQ_INT(scan_filter_update(&f, b), 0);
+    CHECK_EQ_INT(scan_filter_update(&f, b), 0);
+    CHECK_EQ_INT(scan_filter_update(&f, 0), 0);
+    CHECK_EQ_INT(scan_filter_update(&f, 0), 0);
+    CHECK_EQ_INT(f.state & b, 0);
+
+    // the third high sample within the window flips it (N = 3)
+    CHECK_EQ_INT(scan_filter_update(&f, b), b);
+    CHECK_EQ_INT(f.state & b, b);
+
+    // the low level needs 3 of the last 5 samples as well
+    for (int i = 0; i < 2; i++) {
+        CHECK_EQ_INT(scan_filter_update(&f, b), 0);
+    }
+    CHECK_EQ_INT(scan_filter_update(&f, 0), 0);
+    CHECK_EQ_INT(scan_filter_update(&f, 0), 0);
+    CHECK_EQ_INT(scan_filter_update(&f, 0), b);
+    CHECK_EQ_INT(f.state & b, 0);
+}
+
+static void test_mask(void) {
+    scan_filter_t f;
+    CHECK(!scan_filter_init(&f, 0, 0));
+    CHECK(!scan_filter_init(&f, SCAN_FILTER_M_MAX + 1, 0));
+    CHECK(scan_filter_init(&f, 1, 0));
+
+    // only scanned pins are reported, the others are filtered all the same
+    scan_filter_set_pin(&f, 0, true, 0);
+    scan_filter_set_pin(&f, 63, true, 0);
+    scan_filter_set_pin(&f, 64, true, 0);
+    scan_filter_set_pin(&f, -1, true, 0);
+    CHECK_EQ_INT(f.mask, (1ULL << 0) | (1ULL << 63));
+    CHECK(scan_filter_update(&f, UINT64_MAX) == ((1ULL << 0) | (1ULL << 63)));
+    CHECK(f.state == UINT64_MAX);
+
+    // removing a pin stops its reports, adding it back resets it to the given level
+    scan_filter_set_pin(&f, 63, false, 1);
+    CHECK_EQ_INT(scan_filter_update(&f, 0), 1);
+    scan_filter_set_pin(&f, 63, true, 1);
+    CHECK(scan_filter_update(&f, 0) == (1ULL << 63));
+}
+
+/**
+ * @brief: Host CPU time per second of input: scan at a 1 ms tick against debounced edges
+ */
+static void test_cost(void) {
+    static const int inputs[] = { 8, 32, 64 };
+    const int seconds = 200;
+    const int ticks_per_s = 1000;
+    const int bounces = 8;              // edges per switch action, each input switches once a second
+
+    printf("inputs  scan ns/s  isr-path ns/s  edges/s\n");
+    for (size_t k = 0; k < sizeof(inputs) / sizeof(inputs[0]); k++) {
+        int n = inputs[k];
+        uint64_t mask = (n == 64) ? UINT64_MAX : ((1ULL << n) - 1);
+
+        scan_filter_t f;
+        scan_filter_init(&f, 5, 0);
+        for (int bit = 0; bit < n; bit++) {
+            scan_filter_set_pin(&f, bit, true, 0);
+        }
+        uint64_t level = 0, flips = 0;
+        int64_t t0 = now_ns();
+        for (int tick = 0; tick < seconds * ticks_per_s; tick++) {
+            if (tick % ticks_per_s == 0) {
+                level ^= mask;
+            }
+            // glitches on every third tick only: never more than 2 of the 5 samples in a window
+            uint64_t glitch = (tick % 3 == 0) ? (rand64() & mask) : 0;
+            flips += (uint64_t)__builtin_popcountll(scan_filter_update(&f, level ^ glitch));
+        }
+        int64_t scan_ns = now_ns() - t0;
+
+        debounce_pin_t pins[PINS];
+        for (int bit = 0; bit < n; bit++) {
+            debounce_pin_init(&pins[bit], 0, 50000);
+        }
+        uint64_t changes = 0;
+        t0 = now_ns();
+        for (int s = 0; s < seconds; s++) {
+            int64_t us = (int64_t)s * 1000000;
+            for (int bit = 0; bit < n; bit++) {
+                int target = !(s & 1);
+                for (int e = 0; e < bounces; e++) {
+                    debounce_pin_edge(&pins[bit], (e & 1) ? !target : target, us + e * 100);
+                }
+                debounce_pin_edge(&pins[bit], target, us + bounces * 100);
+                changes += debounce_pin_poll(&pins[bit], target, debounce_pin_deadline(&pins[bit])) == DEBOUNCE_CHANGED;
+            }
+        }
+        int64_t isr_ns = now_ns() - t0;
+
+        CHECK_EQ_INT(flips, (uint64_t)n * seconds);
+        CHECK_EQ_INT(changes, (uint64_t)n * seconds);
+        printf("%6d  %9lld  %13lld  %7d\n", n, (long long)(scan_ns / seconds), (long long)(isr_ns / seconds), n * (bounces + 1));
+    }
+}
+
+int main(void) {
+    test_reference();
+    test_burst();
+    test_mask();
+    test_cost();
+    TEST_DONE();
+}
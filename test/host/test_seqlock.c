@@ -0,0 +1,309 @@
+/**
+ * @file test_seqlock.c
+ * @brief Sequence lock (main/seqlock.c): concurrent readers against writers, reader throughput
+ *
+ * The model is relay.c: writers serialize on a mutex (the units writer mutex) and rewrite whole records, readers
+ * copy them lock-free with at most RETRIES attempts and then fall back to the writers' mutex. Every record a writer
+ * leaves behind has all of its words equal, so a torn copy is detected by any word that differs. The second part
+ * models relay_units_list_copy(): the number of records changes too (relay_units_reconfigure()), the reader
+ * allocates outside the read section and the count and records it copies have to match.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "seqlock.h"
+#include "test_common.h"
+
+#define WORDS           16          // ~ sizeof(relay_unit_t) / 4
+#define RECORDS         30          // RELAY_INDEX_UNITS_MAX
+#define READERS         3
+#define WRITERS         2
+#define RETRIES         16          // RELAY_SNAPSHOT_RETRIES
+#define DURATION_MS     300
+
+typedef struct {
+    uint32_t word[WORDS];
+} record_t;
+
+static seqlock_t s_lock;
+static pthread_mutex_t s_write_mux = PTHREAD_MUTEX_INITIALIZER;    // s_units_write_lock
+static record_t s_records[RECORDS];
+static size_t s_count = RECORDS;
+static atomic_int s_stop;
+
+typedef struct {
+    uint64_t copies;
+    uint64_t fallbacks;
+    uint64_t torn;
+} reader_stats_t;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void record_fill(record_t *r, uint32_t value) {
+    for (int w = 0; w < WORDS; w++) {
+        r->word[w] = value;
+    }
+}
+
+static bool record_consistent(const record_t *r) {
+    for (int w = 1; w < WORDS; w++) {
+        if (r->word[w] != r->word[0]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_single_thread(void) {
+    seqlock_t sl = {0};
+    record_t src, dst;
+    record_fill(&src, 7);
+
+    uint32_t seq = seqlock_read_begin(&sl);
+    CHECK_EQ_INT(seq & 1, 0);
+    CHECK(!seqlock_read_retry(&sl, seq));
+
+    // a writer in between invalidates the read, also once it's done
+    seqlock_write_begin(&sl);
+    CHECK(seqlock_read_retry(&sl, seq));
+    CHECK_EQ_INT(seqlock_read_begin(&sl) & 1, 1);
+    CHECK(!seqlock_read_copy(&sl, &dst, &src, sizeof(dst), RETRIES));
+    seqlock_write_end(&sl);
+    CHECK(seqlock_read_retry(&sl, seq));
+
+    memset(&dst, 0, sizeof(dst));
+    CHECK(seqlock_read_copy(&sl, &dst, &src, sizeof(dst), RETRIES));
+    CHECK(memcmp(&dst, &src, sizeof(dst)) == 0);
+    CHECK_EQ_INT(sl.seq, 2);
+}
+
+/**
+ * @brief: Writer: relay_units_write_lock(), rewrite a few records, relay_units_write_unlock()
+ */
+static void *writer(void *arg) {
+    uint32_t value = (uint32_t)(uintptr_t)arg << 24;
+    unsigned int seed = (unsigned int)(uintptr_t)arg;
+
+    while (!atomic_load(&s_stop)) {
+        pthread_mutex_lock(&s_write_mux);
+        seqlock_write_begin(&s_lock);
+        for (int k = 0; k < 4; k++) {
+            record_fill(&s_records[rand_r(&seed) % RECORDS], ++value);
+        }
+        seqlock_write_end(&s_lock);
+        pthread_mutex_unlock(&s_write_mux);
+        sched_yield();
+    }
+    return NULL;
+}
+
+/**
+ * @brief: Reader: relay_units_copy() of one record
+ */
+static void *reader(void *arg) {
+    reader_stats_t *stats = arg;
+    unsigned int seed = (unsigned int)(uintptr_t)stats;
+    record_t copy;
+
+    while (!atomic_load(&s_stop)) {
+        const record_t *src = &s_records[rand_r(&seed) % RECORDS];
+        if (!seqlock_read_copy(&s_lock, &copy, src, sizeof(copy), RETRIES)) {
+            pthread_mutex_lock(&s_write_mux);
+            copy = *src;
+            pthread_mutex_unlock(&s_write_mux);
+            stats->fallbacks++;
+        }
+        if (!record_consistent(&copy)) {
+            stats->torn++;
+        }
+        stats->copies++;
+    }
+    return NULL;
+}
+
+/**
+ * @brief: Same reads without the seqlock: shows the race the lock protects against
+ */
+static void *reader_unprotected(void *arg) {
+    reader_stats_t *stats = arg;
+    unsigned int seed = 1;
+    record_t copy;
+
+    while (!atomic_load(&s_stop)) {
+        memcpy(&copy, (const void *)&s_records[rand_r(&seed) % RECORDS], sizeof(copy));
+        if (!record_consistent(&copy)) {
+            stats->torn++;
+        }
+        stats->copies++;
+    }
+    return NULL;
+}
+
+static void run(void *(*read_fn)(void *), int writers, reader_stats_t *total) {
+    pthread_t w[WRITERS], r[READERS];
+    reader_stats_t stats[READERS];
+    memset(stats, 0, sizeof(stats));
+    atomic_store(&s_stop, 0);
+
+    for (int i = 0; i < writers; i++) {
+        pthread_create(&w[i], NULL, writer, (void *)(uintptr_t)(i + 1));
+    }
+    for (int i = 0; i < READERS; i++) {
+        pthread_create(&r[i], NULL, read_fn, &stats[i]);
+    }
+    struct timespec ts = { .tv_sec = 0, .tv_nsec = DURATION_MS * 1000000L };
+    nanosleep(&ts, NULL);
+    atomic_store(&s_stop, 1);
+    for (int i = 0; i < writers; i++) {
+        pthread_join(w[i], NULL);
+    }
+    for (int i = 0; i < READERS; i++) {
+        pthread_join(r[i], NULL);
+    }
+
+    memset(total, 0, sizeof(*total));
+    for (int i = 0; i < READERS; i++) {
+        total->copies += stats[i].copies;
+        total->fallbacks += stats[i].fallbacks;
+        total->torn += stats[i].torn;
+    }
+}
+
+static void test_concurrent(void) {
+    reader_stats_t idle, busy, unprotected;
+    for (int i = 0; i < RECORDS; i++) {
+        record_fill(&s_records[i], 0);
+    }
+
+    run(reader, 0, &idle);
+    run(reader, WRITERS, &busy);
+    run(reader_unprotected, WRITERS, &unprotected);
+
+    CHECK_EQ_INT(idle.torn, 0);
+    CHECK_EQ_INT(idle.fallbacks, 0);
+    CHECK_EQ_INT(busy.torn, 0);
+    CHECK(busy.copies > 0);
+
+    printf("%d readers, record of %zu bytes, copies per second:\n", READERS, sizeof(record_t));
+    printf("  no writers      %10.0f\n", idle.copies * 1000.0 / DURATION_MS);
+    printf("  %d writers       %10.0f  (%llu fallbacks to the writer mutex, 0 torn)\n", WRITERS,
+           busy.copies * 1000.0 / DURATION_MS, (unsigned long long)busy.fallbacks);
+    printf("  without seqlock %10.0f  (%llu torn of %llu)\n", unprotected.copies * 1000.0 / DURATION_MS,
+           (unsigned long long)unprotected.torn, (unsigned long long)unprotected.copies);
+}
+
+/**
+ * @brief: Reconfiguration: change the number of records, every record is tagged with the count it belongs to
+ */
+static void *reconfigurer(void *arg) {
+    unsigned int seed = (unsigned int)(uintptr_t)arg;
+
+    while (!atomic_load(&s_stop)) {
+        size_t count = 1 + (size_t)rand_r(&seed) % RECORDS;
+        pthread_mutex_lock(&s_write_mux);
+        seqlock_write_begin(&s_lock);
+        s_count = count;
+        for (size_t i = 0; i < count; i++) {
+            record_fill(&s_records[i], (uint32_t)count);
+        }
+        seqlock_write_end(&s_lock);
+        pthread_mutex_unlock(&s_write_mux);
+        sched_yield();
+    }
+    return NULL;
+}
+
+/**
+ * @brief: relay_units_list_copy(): count and records in one read section, allocation outside of it
+ */
+static record_t *list_copy(size_t *count, uint64_t *allocations) {
+    record_t *buf = NULL;
+    size_t capacity = 0;
+    size_t n;
+
+    for (int attempt = 0; ; attempt++) {
+        bool copied;
+        if (attempt < RETRIES) {
+            uint32_t seq = seqlock_read_begin(&s_lock);
+            if (seq & 1) {
+                continue;
+            }
+            n = s_count;
+            if (n <= capacity && n > 0) {
+                memcpy(buf, s_records, sizeof(record_t) * n);
+            }
+            if (seqlock_read_retry(&s_lock, seq)) {
+                continue;
+            }
+            copied = (n <= capacity);
+        } else {
+            pthread_mutex_lock(&s_write_mux);
+            n = s_count;
+            copied = (n <= capacity);
+            if (copied && n > 0) {
+                memcpy(buf, s_records, sizeof(record_t) * n);
+            }
+            pthread_mutex_unlock(&s_write_mux);
+        }
+
+        if (copied) {
+            break;
+        }
+
+        free(buf);
+        buf = calloc(n, sizeof(record_t));
+        (*allocations)++;
+        capacity = n;
+    }
+
+    *count = n;
+    return buf;
+}
+
+static void test_list_copy(void) {
+    pthread_t w;
+    uint64_t lists = 0, allocations = 0, mismatches = 0;
+    s_count = RECORDS;
+    for (int i = 0; i < RECORDS; i++) {
+        record_fill(&s_records[i], RECORDS);
+    }
+    atomic_store(&s_stop, 0);
+    pthread_create(&w, NULL, reconfigurer, (void *)(uintptr_t)3);
+
+    int64_t end = now_ns() + DURATION_MS * 1000000LL;
+    while (now_ns() < end) {
+        size_t count;
+        record_t *list = list_copy(&count, &allocations);
+        CHECK(list != NULL);
+        for (size_t i = 0; list != NULL && i < count; i++) {
+            if (!record_consistent(&list[i]) || list[i].word[0] != count) {
+                mismatches++;
+                break;
+            }
+        }
+        free(list);
+        lists++;
+    }
+    atomic_store(&s_stop, 1);
+    pthread_join(w, NULL);
+
+    CHECK_EQ_INT(mismatches, 0);
+    printf("%llu list copies while the count changed, %.2f allocations per copy\n", (unsigned long long)lists,
+           (double)allocations / (double)lists);
+}
+
+int main(void) {
+    test_single_thread();
+    test_concurrent();
+    test_list_copy();
+    TEST_DONE();
+}
@@ -0,0 +1,253 @@
+/**
+ * @file test_timer_wheel.c
+ * @brief Hierarchical timer wheel (main/timer_wheel.c): expiry against a flat model, insert and expiry cost
+ *
+ * The wheel is driven the way schedule.c does it: sleep until timer_wheel_next_tick(), advance to the
+ * current second, re-arm what expired. A flat array of deadlines is the model: after every advance the
+ * expired entries have to be exactly the armed ones that are due, and the next tick must never be later
+ * than the earliest deadline. The cost part times insert, delete and expiry of 500 entries.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "timer_wheel.h"
+#include "test_common.h"
+
+#define ENTRIES         500
+#define START           1760000000u     // wall clock seconds, as schedule.c uses them
+
+/**
+ * @brief: Entry of the model. The wheel entry is the first member, so expired entries map back to it.
+ */
+typedef struct {
+    timer_wheel_entry_t timer;
+    uint32_t expires;
+    bool armed;
+} model_entry_t;
+
+static model_entry_t s_entries[ENTRIES];
+static uint64_t s_rand = 0x2545F4914F6CDD1DULL;
+
+static uint32_t rand32(void) {
+    // xorshift64*
+    s_rand ^= s_rand >> 12;
+    s_rand ^= s_rand << 25;
+    s_rand ^= s_rand >> 27;
+    return (uint32_t)((s_rand * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief: Random deadline: mostly within minutes to days, some beyond the wheel's 2^24 s horizon
+ */
+static uint32_t random_delay(void) {
+    switch (rand32() % 6) {
+        case 0:  return rand32() % 64;
+        case 1:  return rand32() % 4096;
+        case 2:  return rand32() % 86400;
+        case 3:  return rand32() % (7 * 86400);
+        case 4:  return rand32() % (1u << 24);
+        default: return rand32() % (1u << 26);
+    }
+}
+
+static void arm(timer_wheel_t *wheel, model_entry_t *e, uint32_t expires) {
+    timer_wheel_add(wheel, &e->timer, expires);
+    e->expires = expires;
+    e->armed = true;
+}
+
+/**
+ * @brief: Advance the wheel and compare the expired entries with the model
+ *
+ * @return number of entries that expired
+ */
+static int advance_and_check(timer_wheel_t *wheel, uint32_t now) {
+    int expired = 0;
+    for (timer_wheel_entry_t *t = timer_wheel_advance(wheel, now); t != NULL; t = t->next) {
+        model_entry_t *e = (model_entry_t *)t;
+        int i = (int)(e - s_entries);
+        CHECK(i >= 0 && i < ENTRIES);
+        CHECK(!t->linked);
+        CHECK(e->armed && e->expires <= now);
+        e->armed = false;
+        expired++;
+    }
+    for (int i = 0; i < ENTRIES; i++) {
+        // every due entry expired, nothing else did
+        if (s_entries[i].armed && s_entries[i].expires <= now) {
+            fprintf(stderr, "entry %d due at %u not expired at %u\n", i, s_entries[i].expires, now);
+            s_test_failures++;
+        }
+    }
+    CHECK_EQ_INT(wheel->now, now);
+    return expired;
+}
+
+static void check_next_tick(const timer_wheel_t *wheel) {
+    uint32_t earliest = TIMER_WHEEL_NO_DEADLINE;
+    uint32_t armed = 0;
+    for (int i = 0; i < ENTRIES; i++) {
+        if (s_entries[i].armed) {
+            armed++;
+            uint32_t due = (s_entries[i].expires <= wheel->now) ? wheel->now + 1 : s_entries[i].expires;
+            if (due < earliest) {
+                earliest = due;
+            }
+        }
+    }
+    CHECK_EQ_INT(wheel->count, armed);
+    uint32_t next = timer_wheel_next_tick(wheel);
+    CHECK(next > wheel->now);
+    CHECK(next <= earliest);
+    CHECK((armed == 0) == (next == TIMER_WHEEL_NO_DEADLINE));
+}
+
+static void test_edges(void) {
+    timer_wheel_t wheel;
+    timer_wheel_init(&wheel, START);
+    memset(s_entries, 0, sizeof(s_entries));
+    CHECK_EQ_INT(timer_wheel_next_tick(&wheel), TIMER_WHEEL_NO_DEADLINE);
+    CHECK(timer_wheel_advance(&wheel, START + 100) == NULL);
+    CHECK_EQ_INT(wheel.now, START + 100);
+
+    // level boundaries, the horizon and a deadline in the past
+    static const uint32_t delays[] = { 1, 63, 64, 65, 4095, 4096, 262143, 262144, (1u << 24) - 1, 1u << 24, (1u << 24) + 77, 0 };
+    uint32_t base = wheel.now;
+    for (size_t i = 0; i < sizeof(delays) / sizeof(delays[0]); i++) {
+        arm(&wheel, &s_entries[i], base + delays[i]);
+    }
+    arm(&wheel, &s_entries[20], base - 30);
+    arm(&wheel, &s_entries[21], base + 10);
+    arm(&wheel, &s_entries[21], base + 70);             // moved: only the last deadline counts
+    CHECK_EQ_INT(wheel.count, sizeof(delays) / sizeof(delays[0]) + 2);
+
+    // past and "now" deadlines expire on the next advance
+    CHECK_EQ_INT(timer_wheel_next_tick(&wheel), base + 1);
+    CHECK_EQ_INT(advance_and_check(&wheel, base + 1), 3);
+
+    // sleeping until the next tick every time expires every entry at exactly its deadline
+    int expired = 0;
+    while (wheel.count > 0) {
+        check_next_tick(&wheel);
+        uint32_t next = timer_wheel_next_tick(&wheel);
+        for (timer_wheel_entry_t *t = timer_wheel_advance(&wheel, next); t != NULL; t = t->next) {
+            model_entry_t *e = (model_entry_t *)t;
+            CHECK_EQ_INT(e->expires, next);
+            e->armed = false;
+            expired++;
+        }
+    }
+    CHECK_EQ_INT(expired, sizeof(delays) / sizeof(delays[0]) - 2 + 1);
+
+    // deleting the only entry empties the wheel, deleting it again is ignored
+    arm(&wheel, &s_entries[0], wheel.now + 5000);
+    timer_wheel_del(&wheel, &s_entries[0].timer);
+    timer_wheel_del(&wheel, &s_entries[0].timer);
+    s_entries[0].armed = false;
+    CHECK_EQ_INT(wheel.count, 0);
+    CHECK_EQ_INT(timer_wheel_next_tick(&wheel), TIMER_WHEEL_NO_DEADLINE);
+}
+
+static void test_random(void) {
+    timer_wheel_t wheel;
+    timer_wheel_init(&wheel, START);
+    memset(s_entries, 0, sizeof(s_entries));
+    for (int i = 0; i < ENTRIES; i++) {
+        arm(&wheel, &s_entries[i], START + random_delay());
+    }
+
+    int expired = 0;
+    for (int round = 0; round < 20000; round++) {
+        check_next_tick(&wheel);
+        uint32_t next = timer_wheel_next_tick(&wheel);
+
+        // sleep until the next tick, wake up late or get woken early (API update, SNTP sync)
+        uint32_t now;
+        switch (rand32() % 4) {
+            case 0:  now = wheel.now + 1 + rand32() % 100000; break;
+            case 1:  now = wheel.now + 1 + rand32() % (next - wheel.now); break;
+            default: now = next; break;
+        }
+        int n = advance_and_check(&wheel, now);
+        expired += n;
+
+        // re-arm the expired ones, move or delete a few others
+        for (int i = 0; i < ENTRIES; i++) {
+            if (!s_entries[i].armed && rand32() % 4 != 0) {
+                arm(&wheel, &s_entries[i], wheel.now + random_delay());
+            }
+        }
+        for (int k = 0; k < 3; k++) {
+            model_entry_t *e = &s_entries[rand32() % ENTRIES];
+            if (rand32() & 1) {
+                arm(&wheel, e, wheel.now + random_delay());
+            } else {
+                timer_wheel_del(&wheel, &e->timer);
+                e->armed = false;
+            }
+        }
+    }
+    CHECK(expired > ENTRIES);
+    printf("%d expiries in 20000 advances, wheel at +%u s\n", expired, wheel.now - START);
+}
+
+static void test_cost(void) {
+    static timer_wheel_t wheel;
+    const int rounds = 200;
+    int64_t add_ns = 0, del_ns = 0, expire_ns = 0;
+    long expired = 0;
+
+    for (int r = 0; r < rounds; r++) {
+        timer_wheel_init(&wheel, START);
+        memset(s_entries, 0, sizeof(s_entries));
+        uint32_t delays[ENTRIES];
+        for (int i = 0; i < ENTRIES; i++) {
+            delays[i] = 1 + rand32() % (7 * 86400);
+        }
+
+        int64_t t0 = now_ns();
+        for (int i = 0; i < ENTRIES; i++) {
+            timer_wheel_add(&wheel, &s_entries[i].timer, START + delays[i]);
+        }
+        int64_t t1 = now_ns();
+        for (int i = 0; i < ENTRIES; i += 2) {
+            timer_wheel_del(&wheel, &s_entries[i].timer);
+        }
+        int64_t t2 = now_ns();
+        for (int i = 0; i < ENTRIES; i += 2) {
+            timer_wheel_add(&wheel, &s_entries[i].timer, START + delays[i]);
+        }
+        int64_t t3 = now_ns();
+        // the schedule task: sleep until the next tick, collect what expired
+        while (wheel.count > 0) {
+            for (timer_wheel_entry_t *t = timer_wheel_advance(&wheel, timer_wheel_next_tick(&wheel)); t != NULL; t = t->next) {
+                expired++;
+            }
+        }
+        int64_t t4 = now_ns();
+
+        add_ns += (t1 - t0) + (t3 - t2);
+        del_ns += t2 - t1;
+        expire_ns += t4 - t3;
+    }
+
+    CHECK_EQ_INT(expired, (long)rounds * ENTRIES);
+    printf("%d entries over a week: add %lld ns, del %lld ns, expiry %lld ns per entry\n", ENTRIES,
+           (long long)(add_ns / (rounds * (ENTRIES + ENTRIES / 2))), (long long)(del_ns / (rounds * ENTRIES / 2)),
+           (long long)(expire_ns / (rounds * ENTRIES)));
+}
+
+int main(void) {
+    test_edges();
+    test_random();
+    test_cost();
+    TEST_DONE();
+}
@@ -0,0 +1,190 @@
+/**
+ * @file test_topic_table.c
+ * @brief MQTT topic table (main/topic_table.c): topics against snprintf, publish preparation cost per unit
+ *
+ * The table is built the way mqtt_topics_rebuild() builds it: actuators, contact sensors and pulse counters
+ * in fixed slots, with the device prefix and ID from the settings. Every topic has to match the string
+ * mqtt_publish_relay_data() used to format. The benchmark compares formatting the topics of a publish with
+ * snprintf into a stack buffer against looking them up in the table.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "topic_table.h"
+#include "test_common.h"
+
+#define PREFIX          "relay_board"
+#define DEVICE_ID       "a0b1c2d3e4f5"
+#define STATUS_PATH     "status"        // HA_DEVICE_STATUS_PATH
+#define PATH_RELAY      "switch"        // HA_DEVICE_STATE_PATH_RELAY
+#define PATH_SENSOR     "sensor"        // HA_DEVICE_STATE_PATH_SENSOR
+#define PATH_COMMAND    "switch"        // HA_DEVICE_FAMILY
+
+#define ACTUATORS       16
+#define SENSORS         8
+#define PULSE_COUNTERS  3
+#define UNITS           (ACTUATORS + SENSORS + PULSE_COUNTERS)
+#define SLOTS           30              // MQTT_TOPIC_SLOTS
+
+static topic_unit_spec_t s_specs[UNITS];
+static char s_keys[UNITS][16];
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief: Units of a fully populated board, in the slots mqtt_topic_slot() gives them
+ */
+static void make_specs(void) {
+    for (int u = 0; u < UNITS; u++) {
+        topic_unit_spec_t *spec = &s_specs[u];
+        if (u < ACTUATORS) {
+            snprintf(s_keys[u], sizeof(s_keys[u]), "relay_ch_%d", u + 1);
+            spec->slot = (uint16_t)(u + 1);
+            spec->kinds = TOPIC_KINDS_BASIC;
+            spec->state_path = PATH_RELAY;
+        } else if (u < ACTUATORS + SENSORS) {
+            snprintf(s_keys[u], sizeof(s_keys[u]), "relay_sn_%d", u - ACTUATORS + 1);
+            spec->slot = (uint16_t)(u + 1);
+            spec->kinds = TOPIC_KINDS_BASIC;
+            spec->state_path = PATH_SENSOR;
+        } else {
+            snprintf(s_keys[u], sizeof(s_keys[u]), "relay_pc_%d", u - ACTUATORS - SENSORS + 1);
+            spec->slot = (uint16_t)(u + 2);
+            spec->kinds = TOPIC_KINDS_ALL;
+            spec->state_path = PATH_SENSOR;
+        }
+        spec->key = s_keys[u];
+        spec->command_path = PATH_COMMAND;
+    }
+}
+
+static void test_topics(void) {
+    static const char *const suffix[TOPIC_KIND_MAX] = {
+        "", "/state", "/channel", "/inverted", "/gpio_pin", "/enabled", "/type", "/count", "/rate", "/set"
+    };
+    topic_table_t table;
+    memset(&table, 0, sizeof(table));
+    CHECK(topic_table_get(&table, 1, TOPIC_KIND_STATE) == NULL);
+    CHECK(topic_table_availability(&table) == NULL);
+
+    CHECK(topic_table_build(&table, PREFIX, DEVICE_ID, STATUS_PATH, s_specs, UNITS, SLOTS));
+    CHECK_EQ_INT(table.units, UNITS);
+    CHECK_EQ_INT(table.slots, SLOTS);
+    CHECK(strcmp(topic_table_availability(&table), PREFIX "/" DEVICE_ID "/" STATUS_PATH) == 0);
+
+    size_t strings = strlen(topic_table_availability(&table)) + 1;
+    char expected[256];
+    for (int u = 0; u < UNITS; u++) {
+        const topic_unit_spec_t *spec = &s_specs[u];
+        for (int k = 0; k < TOPIC_KIND_MAX; k++) {
+            const char *topic = topic_table_get(&table, spec->slot, (topic_kind_t)k);
+            if (!(spec->kinds & (1u << k))) {
+                CHECK(topic == NULL);
+                continue;
+            }
+            snprintf(expected, sizeof(expected), "%s/%s/%s/%s%s", PREFIX, DEVICE_ID, spec->key,
+                     (k == TOPIC_KIND_SET) ? spec->command_path : spec->state_path, suffix[k]);
+            if (topic == NULL || strcmp(topic, expected) != 0) {
+                fprintf(stderr, "slot %d kind %d: \"%s\", expected \"%s\"\n", spec->slot, k, topic ? topic : "(null)", expected);
+                s_test_failures++;
+                continue;
+            }
+            strings += strlen(topic) + 1;
+        }
+    }
+
+    // unused slots and out of range lookups have no topics
+    for (int k = 0; k < TOPIC_KIND_MAX; k++) {
+        CHECK(topic_table_get(&table, 0, (topic_kind_t)k) == NULL);
+        CHECK(topic_table_get(&table, 25, (topic_kind_t)k) == NULL);
+    }
+    CHECK(topic_table_get(&table, SLOTS, TOPIC_KIND_STATE) == NULL);
+    CHECK(topic_table_get(&table, 1, TOPIC_KIND_MAX) == NULL);
+
+    // one allocation: the offset table followed by exactly the strings
+    CHECK_EQ_INT(table.size, (size_t)SLOTS * TOPIC_KIND_MAX * sizeof(uint32_t) + strings);
+    printf("%d units, %d slots: %zu bytes\n", UNITS, SLOTS, table.size);
+
+    topic_table_free(&table);
+    CHECK(table.arena == NULL);
+    CHECK(topic_table_get(&table, 1, TOPIC_KIND_STATE) == NULL);
+}
+
+static void test_invalid(void) {
+    topic_table_t table;
+    topic_unit_spec_t spec = s_specs[0];
+    spec.slot = SLOTS;
+    CHECK(!topic_table_build(&table, PREFIX, DEVICE_ID, STATUS_PATH, &spec, 1, SLOTS));
+    CHECK(table.arena == NULL);
+    CHECK(topic_table_availability(&table) == NULL);
+
+    // no units: only the availability topic
+    CHECK(topic_table_build(&table, PREFIX, DEVICE_ID, STATUS_PATH, NULL, 0, SLOTS));
+    CHECK(strcmp(topic_table_availability(&table), PREFIX "/" DEVICE_ID "/" STATUS_PATH) == 0);
+    CHECK(topic_table_get(&table, 1, TOPIC_KIND_JSON) == NULL);
+    topic_table_free(&table);
+}
+
+/**
+ * @brief: Keeps the compiler from dropping the prepared topics
+ */
+static volatile size_t s_sink;
+
+static void test_cost(void) {
+    const int rounds = 20000;
+    static const topic_kind_t kinds[] = {
+        TOPIC_KIND_JSON, TOPIC_KIND_STATE, TOPIC_KIND_CHANNEL, TOPIC_KIND_INVERTED,
+        TOPIC_KIND_GPIO_PIN, TOPIC_KIND_ENABLED, TOPIC_KIND_TYPE
+    };
+    static const char *const suffix[] = { "", "/state", "/channel", "/inverted", "/gpio_pin", "/enabled", "/type" };
+    const int n_kinds = (int)(sizeof(kinds) / sizeof(kinds[0]));
+    topic_table_t table;
+
+    int64_t t0 = now_ns();
+    for (int r = 0; r < rounds / 100; r++) {
+        topic_table_build(&table, PREFIX, DEVICE_ID, STATUS_PATH, s_specs, UNITS, SLOTS);
+        s_sink += table.size;
+        topic_table_free(&table);
+    }
+    int64_t build_ns = (now_ns() - t0) / (rounds / 100);
+
+    // mqtt_publish_relay_data() before the table: every topic formatted into a 256-byte stack buffer
+    char buf[256];
+    t0 = now_ns();
+    for (int r = 0; r < rounds; r++) {
+        const topic_unit_spec_t *spec = &s_specs[r % UNITS];
+        for (int k = 0; k < n_kinds; k++) {
+            snprintf(buf, sizeof(buf), "%s/%s/%s/%s%s", PREFIX, DEVICE_ID, spec->key, spec->state_path, suffix[k]);
+            s_sink += (size_t)buf[0];
+        }
+    }
+    int64_t format_ns = (now_ns() - t0) / rounds;
+
+    CHECK(topic_table_build(&table, PREFIX, DEVICE_ID, STATUS_PATH, s_specs, UNITS, SLOTS));
+    t0 = now_ns();
+    for (int r = 0; r < rounds; r++) {
+        const topic_unit_spec_t *spec = &s_specs[r % UNITS];
+        for (int k = 0; k < n_kinds; k++) {
+            s_sink += (size_t)topic_table_get(&table, spec->slot, kinds[k])[0];
+        }
+    }
+    int64_t lookup_ns = (now_ns() - t0) / rounds;
+    topic_table_free(&table);
+
+    printf("build %lld ns; %d topics per publish: snprintf %lld ns, table %lld ns\n",
+           (long long)build_ns, n_kinds, (long long)format_ns, (long long)lookup_ns);
+}
+
+int main(void) {
+    make_specs();
+    test_topics();
+    test_invalid();
+    test_cost();
+    TEST_DONE();
+}
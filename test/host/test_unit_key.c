@@ -0,0 +1,149 @@
+/**
+ * @file test_unit_key.c
+ * @brief Unit key parsing (main/unit_key.c) and the cost of a lookup by key at 15, 64 and 256 units
+ *
+ * relay.c resolves a key by parsing its channel and reading the directly addressed channel table. Before the
+ * index, get_relay_actuator_from_memory_by_key() and its siblings walked s_units and, for every unit, formatted
+ * its key into a heap allocation, compared it and freed it. The benchmark runs both over the same units.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "unit_key.h"
+#include "test_common.h"
+
+#define PREFIX          "relay_ch_"     // S_KEY_CH_PREFIX
+#define UNITS_MAX       256
+
+/**
+ * @brief: In-memory unit, as far as lookups by key are concerned
+ */
+typedef struct {
+    int channel;
+} unit_t;
+
+static unit_t s_units[UNITS_MAX];
+static int16_t s_idx_by_channel[UNITS_MAX];
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void test_parse(void) {
+    CHECK_EQ_INT(unit_key_channel("relay_ch_0", PREFIX, 15), 0);
+    CHECK_EQ_INT(unit_key_channel("relay_ch_7", PREFIX, 15), 7);
+    CHECK_EQ_INT(unit_key_channel("relay_ch_15", PREFIX, 15), 15);
+    CHECK_EQ_INT(unit_key_channel("relay_pc_4", "relay_pc_", 4), 4);
+
+    // out of range, also when the digits would overflow an int
+    CHECK_EQ_INT(unit_key_channel("relay_ch_16", PREFIX, 15), UNIT_KEY_NONE);
+    CHECK_EQ_INT(unit_key_channel("relay_ch_99999999999999999999", PREFIX, 15), UNIT_KEY_NONE);
+
+    // only the form "%s%d" formats
+    CHECK_EQ_INT(unit_key_channel("relay_ch_01", PREFIX, 15), UNIT_KEY_NONE);
+    CHECK_EQ_INT(unit_key_channel("relay_ch_00", PREFIX, 15), UNIT_KEY_NONE);
+    CHECK_EQ_INT(unit_key_channel("relay_ch_", PREFIX, 15), UNIT_KEY_NONE);
+    CHECK_EQ_INT(unit_key_channel("relay_ch_1x", PREFIX, 15), UNIT_KEY_NONE);
+    CHECK_EQ_INT(unit_key_channel("relay_ch_1 ", PREFIX, 15), UNIT_KEY_NONE);
+    CHECK_EQ_INT(unit_key_channel("relay_ch_-1", PREFIX, 15), UNIT_KEY_NONE);
+    CHECK_EQ_INT(unit_key_channel("relay_ch_+1", PREFIX, 15), UNIT_KEY_NONE);
+
+    // other unit types and garbage
+    CHECK_EQ_INT(unit_key_channel("relay_sn_1", PREFIX, 15), UNIT_KEY_NONE);
+    CHECK_EQ_INT(unit_key_channel("relay_c", PREFIX, 15), UNIT_KEY_NONE);
+    CHECK_EQ_INT(unit_key_channel("", PREFIX, 15), UNIT_KEY_NONE);
+    CHECK_EQ_INT(unit_key_channel(NULL, PREFIX, 15), UNIT_KEY_NONE);
+    CHECK_EQ_INT(unit_key_channel("relay_ch_1", NULL, 15), UNIT_KEY_NONE);
+
+    // every key formatted the way relay_units_index_rebuild() does it parses back to its channel
+    char key[16];
+    for (int channel = 0; channel < UNITS_MAX; channel++) {
+        snprintf(key, sizeof(key), "%s%d", PREFIX, channel);
+        CHECK_EQ_INT(unit_key_channel(key, PREFIX, UNITS_MAX - 1), channel);
+    }
+}
+
+/**
+ * @brief: get_relay_nvs_key()
+ */
+static char *unit_key_alloc(const unit_t *unit) {
+    char *key = malloc(16);
+    if (key != NULL) {
+        snprintf(key, 16, "%s%d", PREFIX, unit->channel);
+    }
+    return key;
+}
+
+/**
+ * @brief: Lookup by key before the index: a walk over all units with a key allocated per unit
+ */
+static int lookup_walk(const char *key, int count) {
+    for (int i = 0; i < count; i++) {
+        char *unit_key = unit_key_alloc(&s_units[i]);
+        bool found = (unit_key != NULL && strcmp(unit_key, key) == 0);
+        free(unit_key);
+        if (found) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief: relay_index_from_key()
+ */
+static int lookup_index(const char *key, int count) {
+    int channel = unit_key_channel(key, PREFIX, count - 1);
+    return (channel == UNIT_KEY_NONE) ? -1 : s_idx_by_channel[channel];
+}
+
+static void test_cost(void) {
+    static const int counts[] = { 15, 64, 256 };
+    char keys[UNITS_MAX][16];
+    volatile int sink = 0;
+
+    printf(" units  walk ns  index ns\n");
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        int count = counts[c];
+        for (int i = 0; i < count; i++) {
+            s_units[i].channel = i;
+            s_idx_by_channel[i] = (int16_t)i;
+            snprintf(keys[i], sizeof(keys[i]), "%s%d", PREFIX, i);
+        }
+        // every lookup has to find the same unit both ways
+        for (int i = 0; i < count; i++) {
+            CHECK_EQ_INT(lookup_walk(keys[i], count), i);
+            CHECK_EQ_INT(lookup_index(keys[i], count), i);
+        }
+
+        const int lookups = 50000;
+        int64_t t0 = now_ns();
+        for (int n = 0; n < lookups / count; n++) {
+            for (int i = 0; i < count; i++) {
+                sink += lookup_walk(keys[i], count);
+            }
+        }
+        int64_t walk_ns = (now_ns() - t0) / (lookups / count * count);
+
+        t0 = now_ns();
+        for (int n = 0; n < lookups / count; n++) {
+            for (int i = 0; i < count; i++) {
+                sink += lookup_index(keys[i], count);
+            }
+        }
+        int64_t index_ns = (now_ns() - t0) / (lookups / count * count);
+
+        printf("%6d  %7lld  %8lld\n", count, (long long)walk_ns, (long long)index_ns);
+    }
+    (void)sink;
+}
+
+int main(void) {
+    test_parse();
+    test_cost();
+    TEST_DONE();
+}
@@ -0,0 +1,198 @@
+/**
+ * @file test_writebehind.c
+ * @brief Write-behind dirty set (main/writebehind.c): flush timing and concurrent writers against flushes
+ *
+ * The concurrent test models relay.c: writers change a unit in RAM, then mark it dirty under s_persist_mux;
+ * flushes are serialized by s_persist_lock, take the set under s_persist_mux, read the units and save them,
+ * failing now and then. No change may be lost: once writers stop and the last flush is done, "NVS" holds
+ * the last value of every unit.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <sched.h>
+
+#include "writebehind.h"
+#include "test_common.h"
+
+#define QUIET_US        2000000     // RELAY_PERSIST_QUIET_MS
+#define MAX_DELAY_US    10000000    // RELAY_PERSIST_MAX_DELAY_MS
+
+#define UNITS           30          // RELAY_INDEX_UNITS_MAX
+#define WRITERS         4
+#define FLUSHERS        2
+#define MARKS_PER_WRITER    50000
+#define FAIL_ONE_IN     64
+
+static writebehind_t s_wb;
+static pthread_mutex_t s_mux = PTHREAD_MUTEX_INITIALIZER;          // s_persist_mux
+static pthread_mutex_t s_flush_lock = PTHREAD_MUTEX_INITIALIZER;   // s_persist_lock
+static atomic_uint_fast64_t s_units[UNITS];                         // in-memory units
+static uint64_t s_nvs[UNITS];                                       // saved units
+static atomic_bool s_writers_done;
+static atomic_uint s_bad_delays;
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void test_timing(void) {
+    writebehind_t wb;
+    writebehind_init(&wb, QUIET_US, MAX_DELAY_US);
+    CHECK_EQ_INT(writebehind_take(&wb), 0);
+
+    // every change restarts the quiet period
+    CHECK_EQ_INT(writebehind_mark(&wb, 1u << 0, 1000), QUIET_US);
+    CHECK_EQ_INT(writebehind_mark(&wb, 1u << 1, 1000 + QUIET_US - 1), QUIET_US);
+    CHECK_EQ_INT(wb.first_dirty_us, 1000);
+
+    // ... but the flush is never later than the max delay after the first change
+    CHECK_EQ_INT(writebehind_mark(&wb, 1u << 2, 1000 + MAX_DELAY_US - 500), 500);
+    CHECK_EQ_INT(writebehind_mark(&wb, 1u << 2, 1000 + MAX_DELAY_US), 1);
+    CHECK_EQ_INT(writebehind_mark(&wb, 1u << 2, 1000 + MAX_DELAY_US + 5000), 1);
+    CHECK_EQ_INT(wb.requests, 5);
+
+    // repeated changes of a unit coalesce into one write
+    CHECK_EQ_INT(writebehind_take(&wb), 0x7);
+    CHECK_EQ_INT(writebehind_take(&wb), 0);
+    writebehind_done(&wb, 3, 0);
+    CHECK_EQ_INT(wb.flushes, 1);
+    CHECK_EQ_INT(wb.units_written, 3);
+
+    // the next change starts a new max delay window
+    int64_t t = 1000 + 2 * MAX_DELAY_US;
+    CHECK_EQ_INT(writebehind_mark(&wb, 1u << 5, t), QUIET_US);
+    CHECK_EQ_INT(wb.first_dirty_us, t);
+
+    // failed units stay dirty for the next flush, without restarting the window
+    uint32_t dirty = writebehind_take(&wb);
+    CHECK_EQ_INT(dirty, 1u << 5);
+    writebehind_done(&wb, 0, dirty);
+    CHECK_EQ_INT(wb.dirty_mask, 1u << 5);
+    CHECK_EQ_INT(writebehind_mark(&wb, 1u << 6, t + MAX_DELAY_US), 1);
+    CHECK_EQ_INT(writebehind_take(&wb), (1u << 5) | (1u << 6));
+}
+
+/**
+ * @brief: relay_persist_flush(): returns true if anything was taken
+ */
+static bool flush(unsigned int *seed, bool may_fail) {
+    pthread_mutex_lock(&s_flush_lock);
+
+    pthread_mutex_lock(&s_mux);
+    uint32_t dirty = writebehind_take(&s_wb);
+    pthread_mutex_unlock(&s_mux);
+
+    if (dirty == 0) {
+        pthread_mutex_unlock(&s_flush_lock);
+        return false;
+    }
+
+    uint32_t written = 0, failed = 0;
+    for (uint32_t mask = dirty; mask != 0; mask &= mask - 1) {
+        int unit = __builtin_ctz(mask);
+        uint64_t value = atomic_load(&s_units[unit]);
+        if (may_fail && rand_r(seed) % FAIL_ONE_IN == 0) {
+            failed |= 1u << unit;
+            continue;
+        }
+        s_nvs[unit] = value;
+        written++;
+    }
+
+    pthread_mutex_lock(&s_mux);
+    writebehind_done(&s_wb, written, failed);
+    pthread_mutex_unlock(&s_mux);
+
+    pthread_mutex_unlock(&s_flush_lock);
+    return true;
+}
+
+static void *writer_thread(void *arg) {
+    unsigned int seed = (unsigned int)(uintptr_t)arg;
+    for (int i = 0; i < MARKS_PER_WRITER; i++) {
+        int unit = rand_r(&seed) % UNITS;
+        atomic_fetch_add(&s_units[unit], 1);
+
+        pthread_mutex_lock(&s_mux);
+        int64_t delay_us = writebehind_mark(&s_wb, 1u << unit, now_us());
+        pthread_mutex_unlock(&s_mux);
+
+        if (delay_us < 1 || delay_us > QUIET_US) {
+            atomic_fetch_add(&s_bad_delays, 1);
+        }
+
+        // let the flushers in between the marks, as the persistence task preempts the writers on the device
+        if ((i & 7) == 0) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *flusher_thread(void *arg) {
+    unsigned int seed = (unsigned int)(uintptr_t)arg;
+    while (!atomic_load(&s_writers_done)) {
+        if (!flush(&seed, true)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void test_concurrent_writers(void) {
+    writebehind_init(&s_wb, QUIET_US, MAX_DELAY_US);
+    for (int i = 0; i < UNITS; i++) {
+        atomic_init(&s_units[i], 0);
+        s_nvs[i] = 0;
+    }
+    atomic_init(&s_writers_done, false);
+    atomic_init(&s_bad_delays, 0);
+
+    pthread_t writers[WRITERS], flushers[FLUSHERS];
+    for (int i = 0; i < FLUSHERS; i++) {
+        pthread_create(&flushers[i], NULL, flusher_thread, (void *)(uintptr_t)(1000 + i));
+    }
+    for (int i = 0; i < WRITERS; i++) {
+        pthread_create(&writers[i], NULL, writer_thread, (void *)(uintptr_t)(1 + i));
+    }
+    for (int i = 0; i < WRITERS; i++) {
+        pthread_join(writers[i], NULL);
+    }
+    atomic_store(&s_writers_done, true);
+    for (int i = 0; i < FLUSHERS; i++) {
+        pthread_join(flushers[i], NULL);
+    }
+
+    // the flush before reboot
+    unsigned int seed = 0;
+    while (flush(&seed, false)) {
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < UNITS; i++) {
+        CHECK_EQ_INT(s_nvs[i], atomic_load(&s_units[i]));
+        total += s_nvs[i];
+    }
+    CHECK_EQ_INT(total, (uint64_t)WRITERS * MARKS_PER_WRITER);
+    CHECK_EQ_INT(s_wb.requests, WRITERS * MARKS_PER_WRITER);
+    CHECK_EQ_INT(s_wb.dirty_mask, 0);
+    CHECK(s_wb.units_written <= s_wb.requests);
+    CHECK_EQ_INT(atomic_load(&s_bad_delays), 0);
+    // flushes have to interleave with the writers for the test to mean anything
+    CHECK(s_wb.flushes > 100);
+
+    printf("%u marks, %u flushes, %u units written (%.1f%% coalesced)\n", (unsigned int)s_wb.requests,
+           (unsigned int)s_wb.flushes, (unsigned int)s_wb.units_written,
+           100.0 * (s_wb.requests - s_wb.units_written) / s_wb.requests);
+}
+
+int main(void) {
+    test_timing();
+    test_concurrent_writers();
+    TEST_DONE();
+}
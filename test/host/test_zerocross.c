@@ -0,0 +1,179 @@
+/**
+ * @file test_zerocross.c
+ * @brief Switch delays planned by the zero-crossing tracker (main/zerocross.c) at 50 Hz and 60 Hz mains
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "zerocross.h"
+#include "test_common.h"
+
+#define MARGIN_US   200     // RELAY_ZC_MARGIN_US
+#define START_US    1000000
+
+/**
+ * @brief: Feed crossings spaced by half_us, optionally with the second edge of a detector pulse
+ *
+ * @return time of the last crossing
+ */
+static int64_t feed_mains(zc_tracker_t *tracker, uint32_t half_us, int crossings, uint32_t pulse_us) {
+    int64_t t = START_US;
+    for (int i = 0; i < crossings; i++) {
+        t = START_US + (int64_t)i * half_us;
+        CHECK(zc_tracker_edge(tracker, t));
+        if (pulse_us > 0) {
+            CHECK(!zc_tracker_edge(tracker, t + pulse_us));
+        }
+    }
+    return t;
+}
+
+static void test_lock(uint32_t half_us) {
+    zc_tracker_t tracker;
+    zc_tracker_init(&tracker);
+
+    int64_t last = feed_mains(&tracker, half_us, ZC_LOCK_HALF_CYCLES, 0);
+    CHECK(!zc_tracker_locked(&tracker, last));
+
+    zc_plan_t plan;
+    CHECK(!zc_tracker_plan(&tracker, last, 0, 0, MARGIN_US, &plan));
+
+    CHECK(zc_tracker_edge(&tracker, last + half_us));
+    CHECK(zc_tracker_locked(&tracker, last + half_us));
+    CHECK_EQ_INT(tracker.half_period_us, half_us);
+
+    // no crossings for too long: mains lost
+    CHECK(!zc_tracker_locked(&tracker, last + half_us + ZC_LOCK_TIMEOUT_US + 1));
+}
+
+static void test_pulse_detector(uint32_t half_us) {
+    zc_tracker_t tracker;
+    zc_tracker_init(&tracker);
+
+    // pulse detectors report both edges of a ~600 us pulse around every crossing
+    int64_t last = feed_mains(&tracker, half_us, 20, 600);
+    CHECK(zc_tracker_locked(&tracker, last));
+    CHECK_EQ_INT(tracker.half_period_us, half_us);
+    CHECK_EQ_INT(tracker.crossings, 20);
+    CHECK_EQ_INT(tracker.rejected, 20);
+}
+
+static void test_phase(void) {
+    // 50 Hz
+    CHECK_EQ_INT(zc_phase(10000, 0, 0), 0);
+    CHECK_EQ_INT(zc_phase(10000, 5000, 0), 5000);
+    CHECK_EQ_INT(zc_phase(10000, 2000, 8000), 4000);
+    CHECK_EQ_INT(zc_phase(10000, 0, 25000), 5000);
+    // 60 Hz
+    CHECK_EQ_INT(zc_phase(8333, 0, 0), 0);
+    CHECK_EQ_INT(zc_phase(8333, 4166, 0), 4166);
+    CHECK_EQ_INT(zc_phase(8333, 2000, 8000), 2333);
+    CHECK_EQ_INT(zc_phase(8333, 0, 25000), 8332);
+    // no half-cycle measured yet
+    CHECK_EQ_INT(zc_phase(0, 5000, 1000), 0);
+}
+
+/**
+ * @brief: Plan edges from every point of two half-cycles and check the delays against the mains
+ */
+static void test_delays(uint32_t half_us, int32_t offset_us, int32_t latency_us) {
+    zc_tracker_t tracker;
+    zc_tracker_init(&tracker);
+    int64_t last = feed_mains(&tracker, half_us, 10, 0);
+
+    uint32_t phase_us = zc_phase(half_us, offset_us, latency_us);
+    int64_t delay_max = 0;
+    for (int64_t now = last; now < last + 2 * (int64_t)half_us; now += 37) {
+        zc_plan_t plan;
+        if (!zc_tracker_plan(&tracker, now, offset_us, latency_us, MARGIN_US, &plan)) {
+            // past the lock timeout: a real tracker would have seen the next crossings by then
+            CHECK(now - last > ZC_LOCK_TIMEOUT_US);
+            continue;
+        }
+
+        CHECK_EQ_INT(plan.phase_us, phase_us);
+        CHECK_EQ_INT(plan.delay_us, plan.drive_us - now);
+        // never closer than the margin, never later than one half-cycle past it
+        CHECK(plan.delay_us >= MARGIN_US);
+        CHECK(plan.delay_us < (int64_t)half_us + MARGIN_US);
+        // driven at the phase of a crossing, so the contacts switch offset_us after a crossing
+        CHECK_EQ_INT((plan.drive_us - last) % half_us, phase_us);
+        CHECK_EQ_INT((plan.drive_us - last) / half_us, plan.half_cycles);
+        int64_t switch_us = plan.drive_us + latency_us - last;
+        CHECK_EQ_INT(((switch_us % half_us) + half_us) % half_us, ((offset_us % (int32_t)half_us) + half_us) % half_us);
+
+        if (plan.delay_us > delay_max) {
+            delay_max = plan.delay_us;
+        }
+    }
+    CHECK(delay_max <= zc_worst_case_delay_us(&tracker, MARGIN_US));
+    CHECK_EQ_INT(zc_worst_case_delay_us(&tracker, MARGIN_US), half_us + MARGIN_US);
+}
+
+static void test_delay_examples(void) {
+    zc_tracker_t tracker;
+    zc_plan_t plan;
+
+    // 50 Hz, switch 5 ms after the crossing (voltage peak), resistive load, relay latency 0
+    zc_tracker_init(&tracker);
+    int64_t last = feed_mains(&tracker, 10000, 10, 0);
+    CHECK(zc_tracker_plan(&tracker, last + 3000, 5000, 0, MARGIN_US, &plan));
+    CHECK_EQ_INT(plan.delay_us, 2000);
+    CHECK_EQ_INT(plan.half_cycles, 0);
+    // too close to the drive point: waits for the next half-cycle
+    CHECK(zc_tracker_plan(&tracker, last + 4900, 5000, 0, MARGIN_US, &plan));
+    CHECK_EQ_INT(plan.delay_us, 10100);
+    CHECK_EQ_INT(plan.half_cycles, 1);
+
+    // 60 Hz, switch at the crossing with 8 ms relay latency: driven 333 us after a crossing
+    zc_tracker_init(&tracker);
+    last = feed_mains(&tracker, 8333, 10, 0);
+    CHECK(zc_tracker_plan(&tracker, last + 100, 0, 8000, MARGIN_US, &plan));
+    CHECK_EQ_INT(plan.phase_us, 333);
+    CHECK_EQ_INT(plan.delay_us, 233);
+    CHECK(zc_tracker_plan(&tracker, last + 200, 0, 8000, MARGIN_US, &plan));
+    CHECK_EQ_INT(plan.delay_us, 8333 + 333 - 200);
+}
+
+static void test_frequency_drift(void) {
+    zc_tracker_t tracker;
+    zc_tracker_init(&tracker);
+
+    // 50 Hz drifting to 49.5 Hz: the smoothed half-cycle follows
+    int64_t t = START_US;
+    for (int i = 0; i < 10; i++, t += 10000) {
+        zc_tracker_edge(&tracker, t);
+    }
+    for (int i = 0; i < 100; i++, t += 10101) {
+        zc_tracker_edge(&tracker, t);
+    }
+    CHECK(tracker.half_period_us >= 10090 && tracker.half_period_us <= 10101);
+    CHECK(zc_tracker_locked(&tracker, t - 10101));
+
+    // a missed crossing restarts the run, the estimate stays
+    uint32_t half_us = tracker.half_period_us;
+    t += 10101;
+    zc_tracker_edge(&tracker, t);
+    CHECK_EQ_INT(tracker.run, 0);
+    CHECK_EQ_INT(tracker.half_period_us, half_us);
+    CHECK(!zc_tracker_locked(&tracker, t));
+}
+
+int main(void) {
+    test_lock(10000);
+    test_lock(8333);
+    test_pulse_detector(10000);
+    test_pulse_detector(8333);
+    test_phase();
+    test_delays(10000, 0, 0);
+    test_delays(10000, 5000, 0);
+    test_delays(10000, 2000, 8000);
+    test_delays(10000, 0, 25000);
+    test_delays(8333, 0, 0);
+    test_delays(8333, 4166, 0);
+    test_delays(8333, 2000, 8000);
+    test_delays(8333, 0, 25000);
+    test_delay_examples();
+    test_frequency_drift();
+    TEST_DONE();
+}